@@ -0,0 +1,124 @@
+#include "AABB.h"
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define AABB_X86
+#include <xmmintrin.h>
+#endif
+
+namespace {
+	// Parts smaller than this are not worth a thread. A core reduces a few
+	// million positions per millisecond
+	const size_t MIN_POSITIONS_PER_THREAD = 1 << 18;
+
+	inline const float* positionAt(const float* positions, size_t i,
+		size_t stride) {
+		return (const float*)((const char*)positions + i * stride);
+	}
+
+	// Reduces positions [first, last) into min and max
+	void reduce(const float* positions, size_t first, size_t last,
+		size_t stride, glm::vec3& min, glm::vec3& max) {
+		min = glm::vec3(std::numeric_limits<float>::max());
+		max = glm::vec3(std::numeric_limits<float>::lowest());
+		size_t i = first;
+
+#ifdef AABB_X86
+		// Each position is loaded as four floats, the fourth being whatever
+		// follows it. Its lane is thrown away, but with a packed array the
+		// last load would read past the end, so the last position is left to
+		// the scalar loop
+		size_t vectorLast = (stride >= 4 * sizeof(float) || last == first) ?
+			last : last - 1;
+		if (i < vectorLast) {
+			__m128 min0 = _mm_set1_ps(std::numeric_limits<float>::max());
+			__m128 max0 = _mm_set1_ps(std::numeric_limits<float>::lowest());
+			// Two pairs of accumulators keep two chains in flight
+			__m128 min1 = min0, max1 = max0;
+			for (; i + 1 < vectorLast; i += 2) {
+				__m128 a = _mm_loadu_ps(positionAt(positions, i, stride));
+				__m128 b = _mm_loadu_ps(positionAt(positions, i + 1, stride));
+				min0 = _mm_min_ps(min0, a);
+				max0 = _mm_max_ps(max0, a);
+				min1 = _mm_min_ps(min1, b);
+				max1 = _mm_max_ps(max1, b);
+			}
+			if (i < vectorLast) {
+				__m128 a = _mm_loadu_ps(positionAt(positions, i, stride));
+				min0 = _mm_min_ps(min0, a);
+				max0 = _mm_max_ps(max0, a);
+				++i;
+			}
+			float lanes[4];
+			_mm_storeu_ps(lanes, _mm_min_ps(min0, min1));
+			min = glm::vec3(lanes[0], lanes[1], lanes[2]);
+			_mm_storeu_ps(lanes, _mm_max_ps(max0, max1));
+			max = glm::vec3(lanes[0], lanes[1], lanes[2]);
+		}
+#endif
+
+		for (; i < last; ++i) {
+			const float* p = positionAt(positions, i, stride);
+			glm::vec3 position(p[0], p[1], p[2]);
+			min = glm::min(min, position);
+			max = glm::max(max, position);
+		}
+	}
+}
+
+void aabb::compute(const float* positions, size_t count, size_t stride,
+	glm::vec3& min, glm::vec3& max) {
+	size_t numThreads = std::max(1u, std::thread::hardware_concurrency());
+	size_t numParts = std::min(numThreads, count / MIN_POSITIONS_PER_THREAD);
+	if (numParts <= 1) {
+		reduce(positions, 0, count, stride, min, max);
+		return;
+	}
+
+	// The calling thread takes the first part itself
+	std::vector<glm::vec3> mins(numParts), maxs(numParts);
+	std::vector<std::thread> workers;
+	workers.reserve(numParts - 1);
+	for (size_t i = 1; i < numParts; ++i) {
+		workers.emplace_back([&, i]() {
+			reduce(positions, count * i / numParts, count * (i + 1) / numParts,
+				stride, mins[i], maxs[i]);
+		});
+	}
+	reduce(positions, 0, count / numParts, stride, mins[0], maxs[0]);
+	for (auto& worker : workers)
+		worker.join();
+
+	min = mins[0];
+	max = maxs[0];
+	for (size_t i = 1; i < numParts; ++i)
+		merge(min, max, mins[i], maxs[i]);
+}
+
+void aabb::transform(const glm::vec3& min, const glm::vec3& max,
+	const glm::mat4& transform, glm::vec3& outMin, glm::vec3& outMax) {
+	if (!isValid(min, max)) {
+		outMin = min;
+		outMax = max;
+		return;
+	}
+	glm::vec3 center = 0.5f * (min + max);
+	glm::vec3 extents = 0.5f * (max - min);
+	glm::vec3 newCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+	// Each axis of the box adds its projection onto every world axis
+	glm::vec3 newExtents = glm::abs(glm::vec3(transform[0])) * extents.x +
+		glm::abs(glm::vec3(transform[1])) * extents.y +
+		glm::abs(glm::vec3(transform[2])) * extents.z;
+	outMin = newCenter - newExtents;
+	outMax = newCenter + newExtents;
+}
+
+void aabb::merge(glm::vec3& min, glm::vec3& max, const glm::vec3& otherMin,
+	const glm::vec3& otherMax) {
+	min = glm::min(min, otherMin);
+	max = glm::max(max, otherMax);
+}
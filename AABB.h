@@ -0,0 +1,54 @@
+/*  Axis-aligned bounding boxes of vertex positions. Computed once while a
+    mesh is imported, so nothing has to read the vertices back later
+    - RAB
+ */
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+namespace aabb {
+	/// <summary>
+	/// Computes the bounds of a strided array of positions. Large arrays are
+	/// split over every core and each part is reduced four lanes at a time
+	/// </summary>
+	/// <param name="positions"> first position. Each is three floats </param>
+	/// <param name="count"> number of positions </param>
+	/// <param name="stride"> distance in bytes from one position to the next.
+	/// At least 12 </param>
+	/// <param name="min"> Stores the min corner. FLT_MAX if count is 0 </param>
+	/// <param name="max"> Stores the max corner. -FLT_MAX if count is 0 </param>
+	void compute(const float* positions, size_t count, size_t stride,
+		glm::vec3& min, glm::vec3& max);
+
+	/// <summary>
+	/// Grows a box so it also holds another one
+	/// </summary>
+	/// <param name="min"> min corner to grow </param>
+	/// <param name="max"> max corner to grow </param>
+	/// <param name="otherMin"> min corner of the box to add </param>
+	/// <param name="otherMax"> max corner of the box to add </param>
+	void merge(glm::vec3& min, glm::vec3& max, const glm::vec3& otherMin,
+		const glm::vec3& otherMax);
+
+	/// <summary>
+	/// Computes the box around another box after a transform. Only the
+	/// center and the extents are transformed, not the eight corners
+	/// </summary>
+	/// <param name="min"> min corner of the box </param>
+	/// <param name="max"> max corner of the box </param>
+	/// <param name="transform"> affine transform to apply </param>
+	/// <param name="outMin"> Stores the min corner of the result </param>
+	/// <param name="outMax"> Stores the max corner of the result </param>
+	void transform(const glm::vec3& min, const glm::vec3& max,
+		const glm::mat4& transform, glm::vec3& outMin, glm::vec3& outMax);
+
+	/// <summary>
+	/// Checks whether a box holds anything, as opposed to being the empty box
+	/// compute returns for no positions
+	/// </summary>
+	inline bool isValid(const glm::vec3& min, const glm::vec3& max) {
+		return min.x <= max.x && min.y <= max.y && min.z <= max.z;
+	}
+}
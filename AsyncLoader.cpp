@@ -0,0 +1,186 @@
+#include "AsyncLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "stb_image.h"
+
+namespace {
+	// At least two workers, so one long import cannot hold up everything
+	// queued behind it
+	const unsigned int MIN_WORKERS = 2;
+
+	struct WorkerPool {
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::deque<std::function<void()>> jobs;
+		std::vector<std::thread> threads;
+		bool stopping = false;
+	};
+
+	// Created on first use. Never destroyed by static destruction, so exiting
+	// with jobs in flight does not have to join the workers
+	WorkerPool* pool = nullptr;
+	std::mutex poolMutex;
+
+	std::mutex uploadMutex;
+	std::deque<std::function<void()>> uploads;
+
+	void work(WorkerPool* workers) {
+		for (;;) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(workers->mutex);
+				workers->wake.wait(lock, [workers]() {
+					return workers->stopping || !workers->jobs.empty();
+				});
+				if (workers->stopping)
+					return;
+				job = std::move(workers->jobs.front());
+				workers->jobs.pop_front();
+			}
+			job();
+		}
+	}
+
+	WorkerPool* getPool() {
+		std::lock_guard<std::mutex> lock(poolMutex);
+		if (pool == nullptr) {
+			pool = new WorkerPool;
+			// Leave a core to the render thread
+			unsigned int numThreads = std::thread::hardware_concurrency();
+			numThreads = std::max(MIN_WORKERS, numThreads > 1 ? numThreads - 1 : 1);
+			for (unsigned int i = 0; i < numThreads; ++i)
+				pool->threads.emplace_back(work, pool);
+		}
+		return pool;
+	}
+}
+
+void asyncLoader::submit(std::function<void()> job) {
+	WorkerPool* workers = getPool();
+	{
+		std::lock_guard<std::mutex> lock(workers->mutex);
+		workers->jobs.push_back(std::move(job));
+	}
+	workers->wake.notify_one();
+}
+
+void asyncLoader::parallelFor(size_t count,
+	const std::function<void(size_t)>& body) {
+	if (count == 0)
+		return;
+	if (count == 1) {
+		body(0);
+		return;
+	}
+
+	// Shared with the helpers, which may only get to run once the caller
+	// has finished every index and returned
+	struct Batch {
+		std::atomic<size_t> next{ 0 };
+		std::atomic<size_t> numDone{ 0 };
+		size_t count;
+		const std::function<void(size_t)>* body;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	auto batch = std::make_shared<Batch>();
+	batch->count = count;
+	batch->body = &body;
+	auto run = [batch]() {
+		for (size_t i = batch->next++; i < batch->count; i = batch->next++) {
+			(*batch->body)(i);
+			if (++batch->numDone == batch->count) {
+				std::lock_guard<std::mutex> lock(batch->mutex);
+				batch->finished.notify_all();
+			}
+		}
+	};
+
+	size_t numHelpers = std::min(count - 1, getPool()->threads.size());
+	for (size_t i = 0; i < numHelpers; ++i)
+		submit(run);
+	run();
+	std::unique_lock<std::mutex> lock(batch->mutex);
+	batch->finished.wait(lock, [&]() { return batch->numDone == count; });
+}
+
+void asyncLoader::queueUpload(std::function<void()> upload) {
+	std::lock_guard<std::mutex> lock(uploadMutex);
+	uploads.push_back(std::move(upload));
+}
+
+size_t asyncLoader::drainUploads(double maxSeconds) {
+	auto start = std::chrono::steady_clock::now();
+	size_t numRun = 0;
+	for (;;) {
+		std::function<void()> upload;
+		{
+			std::lock_guard<std::mutex> lock(uploadMutex);
+			if (uploads.empty())
+				break;
+			upload = std::move(uploads.front());
+			uploads.pop_front();
+		}
+		upload();
+		++numRun;
+
+		std::chrono::duration<double> seconds =
+			std::chrono::steady_clock::now() - start;
+		if (seconds.count() >= maxSeconds)
+			break;
+	}
+	return numRun;
+}
+
+void asyncLoader::decodeImage(const std::string& path,
+	std::shared_ptr<LoadToken> token,
+	std::function<void(const DecodedImage&)> upload) {
+	submit([path, token, upload]() {
+		if (token->cancelled)
+			return;
+		DecodedImage image;
+		unsigned char* pixels = stbi_load(path.c_str(), &image.width,
+			&image.height, &image.numChannels, 0);
+		if (pixels == nullptr) {
+			std::cout << "Texture at path: " << path << " failed to load!\n";
+			return;
+		}
+		image.pixels = std::shared_ptr<unsigned char>(pixels, stbi_image_free);
+
+		queueUpload([token, upload, image]() {
+			if (!token->cancelled)
+				upload(image);
+		});
+	});
+}
+
+void asyncLoader::shutdown() {
+	WorkerPool* workers;
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		workers = pool;
+		pool = nullptr;
+	}
+	if (workers != nullptr) {
+		{
+			std::lock_guard<std::mutex> lock(workers->mutex);
+			workers->stopping = true;
+			workers->jobs.clear();
+		}
+		workers->wake.notify_all();
+		for (auto& thread : workers->threads)
+			thread.join();
+		delete workers;
+	}
+
+	std::lock_guard<std::mutex> lock(uploadMutex);
+	uploads.clear();
+}
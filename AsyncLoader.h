@@ -0,0 +1,76 @@
+/*  Background loading. Jobs that read and decode files run on a pool of
+    worker threads, and whatever they produce for OpenGL is queued for the
+    render thread, which drains the queue a little every frame
+    - RAB
+ */
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+/// <summary>
+/// Shared between an object and the jobs loading it. The object cancels it
+/// before it goes away, and jobs check it before touching the object
+/// </summary>
+struct LoadToken {
+	std::atomic<bool> cancelled{ false };
+};
+
+/// <summary>
+/// Pixels decoded by stb_image
+/// </summary>
+struct DecodedImage {
+	int width, height, numChannels;
+	std::shared_ptr<unsigned char> pixels;
+};
+
+namespace asyncLoader {
+	/// <summary>
+	/// Runs a job on the worker pool. The pool starts on first use
+	/// </summary>
+	/// <param name="job"> work to do. Must not make GL calls </param>
+	void submit(std::function<void()> job);
+
+	/// <summary>
+	/// Runs body once for every index below count, spread over the worker
+	/// pool, and returns when all are done. The calling thread works through
+	/// indices too, so this can be called from a job without waiting on
+	/// workers that are busy
+	/// </summary>
+	/// <param name="count"> number of indices </param>
+	/// <param name="body"> work for one index. Must not make GL calls </param>
+	void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+	/// <summary>
+	/// Queues work for the render thread. Can be called from any thread
+	/// </summary>
+	/// <param name="upload"> work to do with the GL context current </param>
+	void queueUpload(std::function<void()> upload);
+
+	/// <summary>
+	/// Runs queued uploads, oldest first, until the time budget is spent.
+	/// Call once a frame from the render thread
+	/// </summary>
+	/// <param name="maxSeconds"> time budget. At least one upload runs if any
+	/// is queued </param>
+	/// <returns> Number of uploads run </returns>
+	size_t drainUploads(double maxSeconds);
+
+	/// <summary>
+	/// Decodes an image on the worker pool and queues the upload of its
+	/// pixels. Prints an error instead if the image cannot be read
+	/// </summary>
+	/// <param name="path"> file path name of the image </param>
+	/// <param name="token"> the upload is skipped once this is cancelled </param>
+	/// <param name="upload"> called on the render thread with the pixels </param>
+	void decodeImage(const std::string& path, std::shared_ptr<LoadToken> token,
+		std::function<void(const DecodedImage&)> upload);
+
+	/// <summary>
+	/// Stops the workers once their current jobs are done and drops every job
+	/// and upload still queued. Call before the GL context goes away
+	/// </summary>
+	void shutdown();
+}
@@ -0,0 +1,535 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "AsyncLoader.h"
+
+namespace {
+	// Buckets the centroids are sorted into, along the axis they spread
+	// furthest on. Splits are only tried between buckets
+	const int NUM_BINS = 16;
+	// Cost of visiting a node, relative to testing one primitive
+	const float TRAVERSAL_COST = 1.0f;
+	// Ranges at least this long are binned by several tasks, of this many
+	// primitives each
+	const size_t PARALLEL_BIN_RANGE = 1 << 16;
+	const size_t BIN_TASK_SIZE = 1 << 14;
+	// Inputs are split into about this many subtrees for the worker pool,
+	// none smaller than MIN_SUBTREE_SIZE
+	const size_t SUBTREES_PER_BUILD = 128;
+	const size_t MIN_SUBTREE_SIZE = 1 << 12;
+	// Growth of the interior nodes' area past which update builds over
+	// instead of refitting
+	const float MAX_REFIT_GROWTH = 2.0f;
+
+	struct Box {
+		glm::vec3 min, max;
+
+		Box() : min(std::numeric_limits<float>::max()),
+			max(std::numeric_limits<float>::lowest()) {}
+
+		void grow(const glm::vec3& point) {
+			min = glm::min(min, point);
+			max = glm::max(max, point);
+		}
+
+		void grow(const glm::vec3& otherMin, const glm::vec3& otherMax) {
+			min = glm::min(min, otherMin);
+			max = glm::max(max, otherMax);
+		}
+
+		void grow(const Box& other) {
+			grow(other.min, other.max);
+		}
+
+		float area() const {
+			if (min.x > max.x)
+				return 0.0f;
+			glm::vec3 size = max - min;
+			return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+		}
+	};
+
+	/// <summary>
+	/// Box of one primitive, copied so splitting reads and reorders them in
+	/// one contiguous array
+	/// </summary>
+	struct PrimitiveRef {
+		glm::vec3 min;
+		unsigned int index;
+		glm::vec3 max;
+		unsigned int padding;
+
+		// Doubled, as min + max, which saves a multiply and sorts the same
+		glm::vec3 centroid() const {
+			return min + max;
+		}
+	};
+
+	/// <summary>
+	/// Primitives whose centroids fall in one bucket
+	/// </summary>
+	struct Bin {
+		Box bounds;
+		unsigned int count = 0;
+	};
+
+	struct Bins {
+		Bin bins[NUM_BINS];
+
+		void add(const Bins& other) {
+			for (int i = 0; i < NUM_BINS; ++i) {
+				bins[i].bounds.grow(other.bins[i].bounds);
+				bins[i].count += other.bins[i].count;
+			}
+		}
+	};
+
+	/// <summary>
+	/// Part of the primitives still to be split, with the bounds of their
+	/// boxes and of their centroids
+	/// </summary>
+	struct Range {
+		unsigned int node = 0, first = 0, count = 0;
+		Box bounds, centroids;
+	};
+
+	/// <summary>
+	/// Splits ranges of the primitive refs
+	/// </summary>
+	struct Builder {
+		PrimitiveRef* refs;
+		unsigned int maxLeafSize;
+
+		// Bucket of a centroid along the axis a range is binned on
+		static int binOf(float centroid, float start, float scale) {
+			return std::min((int)((centroid - start) * scale), NUM_BINS - 1);
+		}
+
+		void bin(int axis, float start, float scale, size_t first, size_t last,
+			Bins& bins) const {
+			for (size_t i = first; i < last; ++i) {
+				const PrimitiveRef& ref = refs[i];
+				Bin& bin = bins.bins[binOf(ref.min[axis] + ref.max[axis], start, scale)];
+				bin.bounds.grow(ref.min, ref.max);
+				++bin.count;
+			}
+		}
+
+		void fit(unsigned int first, unsigned int count, Range& range) const {
+			range.first = first;
+			range.count = count;
+			range.bounds = Box();
+			range.centroids = Box();
+			for (unsigned int i = first; i < first + count; ++i) {
+				range.bounds.grow(refs[i].min, refs[i].max);
+				range.centroids.grow(refs[i].centroid());
+			}
+		}
+
+		/// <summary>
+		/// Splits a range whose centroids cannot be told apart down the
+		/// middle, so only leaves too large are split
+		/// </summary>
+		bool halve(const Range& range, Range& left, Range& right) const {
+			if (range.count <= maxLeafSize)
+				return false;
+			unsigned int half = range.count / 2;
+			fit(range.first, half, left);
+			fit(range.first + half, range.count - half, right);
+			return true;
+		}
+
+		/// <summary>
+		/// Picks the cheapest split of a range by SAH, along the axis its
+		/// centroids spread furthest on, and partitions the refs by it
+		/// </summary>
+		/// <param name="parallel"> whether large ranges are binned by
+		/// several tasks </param>
+		/// <returns> False if the range is cheaper as a leaf </returns>
+		bool split(const Range& range, bool parallel, Range& left,
+			Range& right) const {
+			if (range.count <= 1)
+				return false;
+
+			glm::vec3 extents = range.centroids.max - range.centroids.min;
+			int axis = extents.x >= extents.y && extents.x >= extents.z ? 0 :
+				(extents.y >= extents.z ? 1 : 2);
+			// Just under NUM_BINS, so the largest centroid stays in the last
+			// bucket
+			float scale = NUM_BINS * 0.9999f / extents[axis];
+			if (!(extents[axis] > 0.0f && scale < std::numeric_limits<float>::max()))
+				return halve(range, left, right);
+			float start = range.centroids.min[axis];
+
+			Bins bins;
+			size_t last = (size_t)range.first + range.count;
+			if (parallel && range.count >= PARALLEL_BIN_RANGE) {
+				size_t numTasks = (range.count + BIN_TASK_SIZE - 1) / BIN_TASK_SIZE;
+				std::vector<Bins> partial(numTasks);
+				asyncLoader::parallelFor(numTasks, [&](size_t task) {
+					size_t first = range.first + task * BIN_TASK_SIZE;
+					bin(axis, start, scale, first, std::min(first + BIN_TASK_SIZE,
+						last), partial[task]);
+				});
+				for (const auto& part : partial)
+					bins.add(part);
+			}
+			else {
+				bin(axis, start, scale, range.first, last, bins);
+			}
+
+			// Sweep from both ends, so each split is priced in one pass
+			float rightCosts[NUM_BINS];
+			Box box;
+			unsigned int count = 0;
+			for (int i = NUM_BINS - 1; i > 0; --i) {
+				box.grow(bins.bins[i].bounds);
+				count += bins.bins[i].count;
+				rightCosts[i] = count * box.area();
+			}
+			float bestCost = std::numeric_limits<float>::max();
+			int bestSplit = -1;
+			box = Box();
+			count = 0;
+			for (int i = 1; i < NUM_BINS; ++i) {
+				box.grow(bins.bins[i - 1].bounds);
+				count += bins.bins[i - 1].count;
+				if (count == 0 || count == range.count)
+					continue;
+				float cost = count * box.area() + rightCosts[i];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestSplit = i;
+				}
+			}
+			// Rounding put every centroid in one bucket
+			if (bestSplit < 0)
+				return halve(range, left, right);
+			float area = range.bounds.area();
+			float splitCost = TRAVERSAL_COST + (area > 0.0f ? bestCost / area : 0.0f);
+			if (range.count <= maxLeafSize && splitCost >= range.count)
+				return false;
+
+			left = Range();
+			right = Range();
+			for (int i = 0; i < NUM_BINS; ++i) {
+				Range& side = i < bestSplit ? left : right;
+				side.bounds.grow(bins.bins[i].bounds);
+				side.count += bins.bins[i].count;
+			}
+			// The centroid bounds of both sides are gathered while the refs
+			// are partitioned
+			size_t i = range.first, j = last;
+			while (i < j) {
+				glm::vec3 centroid = refs[i].centroid();
+				if (binOf(centroid[axis], start, scale) < bestSplit) {
+					left.centroids.grow(centroid);
+					++i;
+				}
+				else {
+					--j;
+					std::swap(refs[i], refs[j]);
+					right.centroids.grow(centroid);
+				}
+			}
+			left.first = range.first;
+			right.first = range.first + left.count;
+			return true;
+		}
+
+		/// <summary>
+		/// Builds the subtree below a range on the calling thread. The root
+		/// goes first and children follow their parent
+		/// </summary>
+		void buildSubtree(Range root, std::vector<BVHNode>& nodes) const {
+			nodes.assign(1, BVHNode());
+			root.node = 0;
+			std::vector<Range> stack(1, root);
+			while (!stack.empty()) {
+				Range range = stack.back();
+				stack.pop_back();
+				Range left, right;
+				BVHNode& node = nodes[range.node];
+				node.min = range.bounds.min;
+				node.max = range.bounds.max;
+				if (!split(range, false, left, right)) {
+					node.first = range.first;
+					node.count = range.count;
+					continue;
+				}
+				unsigned int children = (unsigned int)nodes.size();
+				node.first = children;
+				node.count = 0;
+				nodes.resize(children + 2);
+				left.node = children;
+				right.node = children + 1;
+				stack.push_back(right);
+				stack.push_back(left);
+			}
+		}
+	};
+
+	/// <summary>
+	/// Distance along a ray to where it enters a box
+	/// </summary>
+	/// <returns> Largest float if it misses </returns>
+	inline float entryDistance(const BVHNode& node, const glm::vec3& origin,
+		const glm::vec3& inverseDirection, float maxDistance) {
+		float enter = 0.0f;
+		float leave = maxDistance;
+		for (int axis = 0; axis < 3; ++axis) {
+			// A ray running along the axis stays inside the slab or outside
+			// it for good. Testing its origin keeps rays that start on one of
+			// the planes from working out 0 * inf = NaN
+			if (std::isinf(inverseDirection[axis])) {
+				if (origin[axis] < node.min[axis] || origin[axis] > node.max[axis])
+					return std::numeric_limits<float>::max();
+				continue;
+			}
+			float near = (node.min[axis] - origin[axis]) * inverseDirection[axis];
+			float far = (node.max[axis] - origin[axis]) * inverseDirection[axis];
+			enter = std::max(enter, std::min(near, far));
+			leave = std::min(leave, std::max(near, far));
+		}
+		return enter <= leave ? enter : std::numeric_limits<float>::max();
+	}
+}
+
+BVH::BVH() : builtArea(0.0f) {}
+
+void BVH::build(const glm::vec3* mins, const glm::vec3* maxs, size_t count,
+	unsigned int maxLeafSize) {
+	clear();
+	if (count == 0)
+		return;
+	std::vector<PrimitiveRef> refs(count);
+	Builder builder;
+	builder.refs = refs.data();
+	builder.maxLeafSize = std::max(maxLeafSize, 1u);
+
+	size_t numTasks = (count + BIN_TASK_SIZE - 1) / BIN_TASK_SIZE;
+	std::vector<Range> parts(numTasks);
+	asyncLoader::parallelFor(numTasks, [&](size_t task) {
+		size_t first = task * BIN_TASK_SIZE;
+		size_t last = std::min(first + BIN_TASK_SIZE, count);
+		for (size_t i = first; i < last; ++i) {
+			refs[i].min = mins[i];
+			refs[i].index = (unsigned int)i;
+			refs[i].max = maxs[i];
+		}
+		builder.fit((unsigned int)first, (unsigned int)(last - first), parts[task]);
+	});
+	Range root;
+	root.count = (unsigned int)count;
+	for (const auto& part : parts) {
+		root.bounds.grow(part.bounds);
+		root.centroids.grow(part.centroids);
+	}
+
+	// The top of the tree is split a level at a time, each range of a level
+	// by its own task. Ranges small enough become subtrees, which are built
+	// whole by one task each
+	size_t subtreeSize = std::max(count / SUBTREES_PER_BUILD, MIN_SUBTREE_SIZE);
+	nodes.resize(1);
+	std::vector<Range> level, nextLevel, subtrees;
+	if (root.count <= subtreeSize)
+		subtrees.push_back(root);
+	else
+		level.push_back(root);
+	std::vector<Range> lefts, rights;
+	std::vector<unsigned char> isSplit;
+	while (!level.empty()) {
+		lefts.resize(level.size());
+		rights.resize(level.size());
+		isSplit.resize(level.size());
+		asyncLoader::parallelFor(level.size(), [&](size_t i) {
+			isSplit[i] = builder.split(level[i], true, lefts[i], rights[i]);
+		});
+
+		nextLevel.clear();
+		for (size_t i = 0; i < level.size(); ++i) {
+			BVHNode& node = nodes[level[i].node];
+			node.min = level[i].bounds.min;
+			node.max = level[i].bounds.max;
+			if (!isSplit[i]) {
+				node.first = level[i].first;
+				node.count = level[i].count;
+				continue;
+			}
+			unsigned int children = (unsigned int)nodes.size();
+			node.first = children;
+			node.count = 0;
+			nodes.resize(children + 2);
+			lefts[i].node = children;
+			rights[i].node = children + 1;
+			for (const Range* child : { &lefts[i], &rights[i] })
+				(child->count <= subtreeSize ? subtrees : nextLevel).push_back(*child);
+		}
+		level.swap(nextLevel);
+	}
+
+	std::vector<std::vector<BVHNode>> built(subtrees.size());
+	asyncLoader::parallelFor(subtrees.size(), [&](size_t i) {
+		builder.buildSubtree(subtrees[i], built[i]);
+	});
+	// Each subtree's root takes the place set aside for it and the rest is
+	// appended, with child indices moved along
+	for (size_t i = 0; i < subtrees.size(); ++i) {
+		const std::vector<BVHNode>& local = built[i];
+		unsigned int base = (unsigned int)nodes.size() - 1;
+		for (size_t j = 0; j < local.size(); ++j) {
+			BVHNode node = local[j];
+			if (node.count == 0)
+				node.first += base;
+			if (j == 0)
+				nodes[subtrees[i].node] = node;
+			else
+				nodes.push_back(node);
+		}
+	}
+
+	order.resize(count);
+	for (size_t i = 0; i < count; ++i)
+		order[i] = refs[i].index;
+
+	builtArea = 0.0f;
+	for (const auto& node : nodes) {
+		if (node.count == 0) {
+			Box box;
+			box.grow(node.min, node.max);
+			builtArea += box.area();
+		}
+	}
+}
+
+float BVH::refit(const glm::vec3* mins, const glm::vec3* maxs) {
+	// Children come after their parents, so walking backwards fits every
+	// child before its parent
+	float area = 0.0f;
+	for (size_t i = nodes.size(); i-- > 0;) {
+		BVHNode& node = nodes[i];
+		Box box;
+		if (node.count > 0) {
+			for (unsigned int j = node.first; j < node.first + node.count; ++j)
+				box.grow(mins[order[j]], maxs[order[j]]);
+		}
+		else {
+			box.grow(nodes[node.first].min, nodes[node.first].max);
+			box.grow(nodes[node.first + 1].min, nodes[node.first + 1].max);
+			area += box.area();
+		}
+		node.min = box.min;
+		node.max = box.max;
+	}
+	return builtArea > 0.0f ? area / builtArea : 1.0f;
+}
+
+bool BVH::update(const glm::vec3* mins, const glm::vec3* maxs, size_t count,
+	unsigned int maxLeafSize) {
+	if (count == order.size() && count > 0 &&
+		refit(mins, maxs) <= MAX_REFIT_GROWTH)
+		return false;
+	build(mins, maxs, count, maxLeafSize);
+	return true;
+}
+
+void BVH::clear() {
+	nodes.clear();
+	order.clear();
+	builtArea = 0.0f;
+}
+
+void BVH::queryFrustum(const glm::vec4 planes[6],
+	std::vector<unsigned int>& primitives) const {
+	primitives.clear();
+	if (nodes.empty())
+		return;
+
+	// Each entry carries the planes its node still straddles
+	struct Entry {
+		unsigned int node;
+		unsigned int planeMask;
+	};
+	std::vector<Entry> stack;
+	stack.reserve(64);
+	stack.push_back({ 0, (1u << 6) - 1 });
+	while (!stack.empty()) {
+		Entry entry = stack.back();
+		stack.pop_back();
+		const BVHNode& node = nodes[entry.node];
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; ++p) {
+			if (!(entry.planeMask & (1u << p)))
+				continue;
+			const glm::vec4& plane = planes[p];
+			// The corners furthest along and against the normal
+			glm::vec3 positive(plane.x >= 0.0f ? node.max.x : node.min.x,
+				plane.y >= 0.0f ? node.max.y : node.min.y,
+				plane.z >= 0.0f ? node.max.z : node.min.z);
+			glm::vec3 negative(plane.x >= 0.0f ? node.min.x : node.max.x,
+				plane.y >= 0.0f ? node.min.y : node.max.y,
+				plane.z >= 0.0f ? node.min.z : node.max.z);
+			glm::vec3 normal(plane);
+			if (glm::dot(normal, positive) + plane.w < 0.0f)
+				outside = true;
+			else if (glm::dot(normal, negative) + plane.w >= 0.0f)
+				entry.planeMask &= ~(1u << p);
+		}
+		if (outside)
+			continue;
+		if (node.count > 0) {
+			primitives.insert(primitives.end(), order.begin() + node.first,
+				order.begin() + node.first + node.count);
+			continue;
+		}
+		stack.push_back({ node.first + 1, entry.planeMask });
+		stack.push_back({ node.first, entry.planeMask });
+	}
+}
+
+bool BVH::raycast(const glm::vec3& origin, const glm::vec3& direction,
+	float& maxDistance, const std::function<bool(unsigned int first,
+		unsigned int count, float& maxDistance)>& hitLeaf) const {
+	if (nodes.empty())
+		return false;
+	glm::vec3 inverseDirection = 1.0f / direction;
+	if (entryDistance(nodes[0], origin, inverseDirection, maxDistance) ==
+		std::numeric_limits<float>::max())
+		return false;
+
+	struct Entry {
+		unsigned int node;
+		float distance;
+	};
+	std::vector<Entry> stack;
+	stack.reserve(64);
+	stack.push_back({ 0, 0.0f });
+	bool hit = false;
+	while (!stack.empty()) {
+		Entry entry = stack.back();
+		stack.pop_back();
+		// A closer hit may have been found since the node was pushed
+		if (entry.distance > maxDistance)
+			continue;
+		const BVHNode& node = nodes[entry.node];
+		if (node.count > 0) {
+			hit |= hitLeaf(node.first, node.count, maxDistance);
+			continue;
+		}
+		Entry near = { node.first, entryDistance(nodes[node.first], origin,
+			inverseDirection, maxDistance) };
+		Entry far = { node.first + 1, entryDistance(nodes[node.first + 1],
+			origin, inverseDirection, maxDistance) };
+		if (far.distance < near.distance)
+			std::swap(near, far);
+		// The nearer child is popped first
+		if (far.distance != std::numeric_limits<float>::max())
+			stack.push_back(far);
+		if (near.distance != std::numeric_limits<float>::max())
+			stack.push_back(near);
+	}
+	return hit;
+}
@@ -0,0 +1,122 @@
+/*  Bounding volume hierarchy over boxes, built top down with binned SAH.
+    The drawables of a scene, the meshes of a model and the triangles of a
+    mesh each get one. Boxes that move are refit in place instead of being
+    built over
+    - RAB
+ */
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/// <summary>
+/// Node of a BVH. 32 bytes, so two children share a cache line
+/// </summary>
+struct BVHNode {
+	glm::vec3 min;
+	// Leaves: where their primitives start in the BVH's order. Interior
+	// nodes: index of the first of their two children, which sit side by
+	// side
+	unsigned int first;
+	glm::vec3 max;
+	// Number of primitives of a leaf. 0 for interior nodes
+	unsigned int count;
+};
+
+class BVH {
+	// Root first. Children always come after their parent
+	std::vector<BVHNode> nodes;
+	// Primitive indices, grouped by leaf
+	std::vector<unsigned int> order;
+	// Sum of the surface areas of the interior nodes right after the build
+	float builtArea;
+
+public:
+	/// <summary>
+	/// Creates an empty hierarchy
+	/// </summary>
+	/// <returns> N/A </returns>
+	BVH();
+
+	/// <summary>
+	/// Builds the hierarchy over boxes, replacing what it held. Large inputs
+	/// are binned by several tasks and their subtrees are built on the
+	/// worker pool
+	/// </summary>
+	/// <param name="mins"> min corner of every primitive </param>
+	/// <param name="maxs"> max corner of every primitive </param>
+	/// <param name="count"> number of primitives </param>
+	/// <param name="maxLeafSize"> most primitives a leaf holds </param>
+	void build(const glm::vec3* mins, const glm::vec3* maxs, size_t count,
+		unsigned int maxLeafSize = 4);
+
+	/// <summary>
+	/// Fits the nodes to the primitives again after they moved, keeping the
+	/// tree as it is
+	/// </summary>
+	/// <param name="mins"> min corner of every primitive build was given
+	/// </param>
+	/// <param name="maxs"> max corner of every primitive build was given
+	/// </param>
+	/// <returns> Surface area of the interior nodes over what it was after
+	/// the build. Queries slow down as it grows, so build again once it is
+	/// well above 1 </returns>
+	float refit(const glm::vec3* mins, const glm::vec3* maxs);
+
+	/// <summary>
+	/// Refits the hierarchy to primitives that moved, or builds it over if
+	/// their number changed or refitting left it too loose
+	/// </summary>
+	/// <param name="mins"> min corner of every primitive </param>
+	/// <param name="maxs"> max corner of every primitive </param>
+	/// <param name="count"> number of primitives </param>
+	/// <param name="maxLeafSize"> most primitives a leaf holds </param>
+	/// <returns> True if it was built over </returns>
+	bool update(const glm::vec3* mins, const glm::vec3* maxs, size_t count,
+		unsigned int maxLeafSize = 4);
+
+	/// <summary>
+	/// Removes every node and primitive
+	/// </summary>
+	void clear();
+
+	inline bool isEmpty() const { return nodes.empty(); }
+	inline size_t getNumPrimitives() const { return order.size(); }
+	/// <summary>
+	/// Gets the primitive indices in leaf order. Leaves passed to raycast's
+	/// callback are ranges of it
+	/// </summary>
+	inline const std::vector<unsigned int>& getOrder() const { return order; }
+
+	/// <summary>
+	/// Finds the primitives of every leaf that touches a frustum. Subtrees
+	/// inside a plane are not tested against it again. Like
+	/// frustum::intersectsSphere, leaves near a corner may be found while
+	/// being outside
+	/// </summary>
+	/// <param name="planes"> planes from frustum::extractPlanes, in the
+	/// space of the boxes </param>
+	/// <param name="primitives"> Stores the primitive indices found </param>
+	void queryFrustum(const glm::vec4 planes[6],
+		std::vector<unsigned int>& primitives) const;
+
+	/// <summary>
+	/// Walks the leaves a ray passes through, nearest box first. Boxes
+	/// further away than the closest hit so far are skipped
+	/// </summary>
+	/// <param name="origin"> start of the ray </param>
+	/// <param name="direction"> direction of the ray. Need not be of unit
+	/// length </param>
+	/// <param name="maxDistance"> furthest distance along the ray, in units
+	/// of direction. Lowered by every hit </param>
+	/// <param name="hitLeaf"> tests the primitives of one leaf, given where
+	/// they start in getOrder and how many there are. Lowers the distance it
+	/// is passed to the closest hit and returns true if there is any </param>
+	/// <returns> True if any leaf reported a hit </returns>
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction,
+		float& maxDistance, const std::function<bool(unsigned int first,
+			unsigned int count, float& maxDistance)>& hitLeaf) const;
+};
@@ -0,0 +1,666 @@
+/*  Times the model loaders on generated OBJ files of any size and shape and
+    prints the results as JSON. Runs the CPU side of OBJObject::load and
+    Model::load, so it needs no window or GL context
+    - RAB
+ */
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "../ModelImporter.h"
+#include "../NumberParser.h"
+#include "../OBJParser.h"
+
+namespace {
+	const int DEFAULT_REPEATS = 3;
+	const size_t DEFAULT_FACE_COUNTS[] = { 1000, 100000, 1000000 };
+	const double BYTES_PER_MB = 1024.0 * 1024.0;
+	const double PI = 3.14159265358979323846;
+	// Generated files are written in blocks of this size
+	const size_t WRITE_BLOCK_BYTES = 1 << 20;
+
+	// Every operator new in the process goes through these
+	std::atomic<size_t> allocationCount(0);
+	std::atomic<size_t> allocatedBytes(0);
+	// Bytes allocated and not yet freed, and the most there were since
+	// the last reset. A copy of the whole mesh shows up here even when it
+	// is freed again right away
+	std::atomic<size_t> liveBytes(0);
+	std::atomic<size_t> peakLiveBytes(0);
+	// Every block starts with its size so delete knows what it frees. Keeps
+	// the block aligned for anything operator new has to support
+	const size_t ALLOCATION_HEADER_BYTES = alignof(std::max_align_t);
+
+	enum class Shape { GRID, SPHERE, SOUP };
+	const char* SHAPE_NAMES[] = { "grid", "sphere", "soup" };
+
+	/// <summary>
+	/// What a generated file looks like
+	/// </summary>
+	struct MeshSpec {
+		Shape shape;
+		size_t faces;
+		bool normals;
+		bool uvs;
+	};
+
+	/// <summary>
+	/// Ways of loading a file that can be timed
+	/// </summary>
+	enum class Loader { OBJ_STDIO, OBJ_MAPPED, OBJ_PARALLEL, MODEL_ASSIMP, MODEL_CACHE };
+	const char* LOADER_NAMES[] = {
+		"obj_stdio", "obj_mapped", "obj_parallel", "model_assimp", "model_cache"
+	};
+
+	/// <summary>
+	/// One timed load
+	/// </summary>
+	struct RunStats {
+		double seconds;
+		size_t triangles;
+		size_t allocations;
+		size_t bytes;
+		// Most memory in use at once during the load, over what was in use
+		// before it
+		size_t peakLiveBytes;
+	};
+
+	/// <summary>
+	/// Gets the most memory the process has had resident so far
+	/// </summary>
+	size_t peakResidentBytes() {
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+			return counters.PeakWorkingSetSize;
+		return 0;
+#else
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		// Reported in kilobytes
+		return (size_t)usage.ru_maxrss * 1024;
+#endif
+	}
+
+	/// <summary>
+	/// Buffers text and writes it to a file in large blocks
+	/// </summary>
+	class BlockWriter {
+		FILE* file;
+		std::string buffer;
+
+	public:
+		BlockWriter(FILE* file) : file(file) {
+			buffer.reserve(WRITE_BLOCK_BYTES + 256);
+		}
+		~BlockWriter() {
+			flush();
+		}
+
+		void flush() {
+			fwrite(buffer.data(), 1, buffer.size(), file);
+			buffer.clear();
+		}
+
+		void text(const char* s) {
+			buffer += s;
+		}
+
+		void number(float value) {
+			char digits[32];
+			auto result = std::to_chars(digits, digits + sizeof(digits), value,
+				std::chars_format::fixed, 6);
+			buffer.append(digits, result.ptr);
+		}
+
+		void number(size_t value) {
+			char digits[32];
+			auto result = std::to_chars(digits, digits + sizeof(digits), value);
+			buffer.append(digits, result.ptr);
+		}
+
+		void vec3(const char* keyword, const glm::vec3& v) {
+			text(keyword);
+			for (int i = 0; i < 3; ++i) {
+				buffer += ' ';
+				number(v[i]);
+			}
+			endLine();
+		}
+
+		void vec2(const char* keyword, const glm::vec2& v) {
+			text(keyword);
+			buffer += ' ';
+			number(v.x);
+			buffer += ' ';
+			number(v.y);
+			endLine();
+		}
+
+		/// <summary>
+		/// Writes a triangle whose corners use the same index for the
+		/// position and every attribute the file has
+		/// </summary>
+		void face(size_t a, size_t b, size_t c, bool normals, bool uvs) {
+			buffer += 'f';
+			for (size_t index : { a, b, c }) {
+				buffer += ' ';
+				number(index);
+				if (uvs || normals)
+					buffer += '/';
+				if (uvs)
+					number(index);
+				if (normals) {
+					buffer += '/';
+					number(index);
+				}
+			}
+			endLine();
+		}
+
+		void endLine() {
+			buffer += '\n';
+			if (buffer.size() >= WRITE_BLOCK_BYTES)
+				flush();
+		}
+	};
+
+	/// <summary>
+	/// Writes one vertex with whichever attributes the file has
+	/// </summary>
+	void writeVertex(BlockWriter& out, const MeshSpec& spec,
+		const glm::vec3& position, const glm::vec3& normal, const glm::vec2& uv) {
+		out.vec3("v", position);
+		if (spec.normals)
+			out.vec3("vn", normal);
+		if (spec.uvs)
+			out.vec2("vt", uv);
+	}
+
+	/// <summary>
+	/// A flat n x n grid of quads, two triangles each
+	/// </summary>
+	size_t writeGrid(BlockWriter& out, const MeshSpec& spec) {
+		size_t n = std::max<size_t>(1, (size_t)std::lround(std::sqrt(spec.faces / 2.0)));
+		for (size_t i = 0; i <= n; ++i) {
+			for (size_t j = 0; j <= n; ++j) {
+				glm::vec2 uv((float)j / n, (float)i / n);
+				writeVertex(out, spec, glm::vec3(2.0f * uv - 1.0f, 0.0f),
+					glm::vec3(0, 0, 1), uv);
+			}
+		}
+		for (size_t i = 0; i < n; ++i) {
+			for (size_t j = 0; j < n; ++j) {
+				size_t corner = i * (n + 1) + j + 1;
+				out.face(corner, corner + 1, corner + n + 2, spec.normals, spec.uvs);
+				out.face(corner, corner + n + 2, corner + n + 1, spec.normals, spec.uvs);
+			}
+		}
+		return 2 * n * n;
+	}
+
+	/// <summary>
+	/// A unit UV sphere. The seam column is duplicated so texture
+	/// coordinates wrap
+	/// </summary>
+	size_t writeSphere(BlockWriter& out, const MeshSpec& spec) {
+		size_t rings = std::max<size_t>(2, (size_t)std::lround(std::sqrt(spec.faces / 4.0)));
+		size_t segments = 2 * rings;
+		for (size_t i = 0; i <= rings; ++i) {
+			double theta = PI * i / rings;
+			for (size_t j = 0; j <= segments; ++j) {
+				double phi = 2.0 * PI * j / segments;
+				glm::vec3 position((float)(std::sin(theta) * std::cos(phi)),
+					(float)std::cos(theta), (float)(std::sin(theta) * std::sin(phi)));
+				writeVertex(out, spec, position, position,
+					glm::vec2((float)j / segments, (float)i / rings));
+			}
+		}
+		for (size_t i = 0; i < rings; ++i) {
+			for (size_t j = 0; j < segments; ++j) {
+				size_t corner = i * (segments + 1) + j + 1;
+				size_t below = corner + segments + 1;
+				out.face(corner, below, corner + 1, spec.normals, spec.uvs);
+				out.face(corner + 1, below, below + 1, spec.normals, spec.uvs);
+			}
+		}
+		return 2 * rings * segments;
+	}
+
+	/// <summary>
+	/// Unconnected random triangles. Nothing can be welded
+	/// </summary>
+	size_t writeSoup(BlockWriter& out, const MeshSpec& spec) {
+		unsigned int state = 12345;
+		auto random = [&state]() {
+			state = state * 1664525u + 1013904223u;
+			return (state >> 8) / 16777216.0f;
+		};
+		for (size_t i = 0; i < spec.faces; ++i) {
+			glm::vec3 a(random(), random(), random());
+			glm::vec3 b = a + 0.01f * glm::vec3(random(), random(), random());
+			glm::vec3 c = a + 0.01f * glm::vec3(random(), random(), random());
+			glm::vec3 normal = glm::normalize(glm::cross(b - a, c - a));
+			writeVertex(out, spec, a, normal, glm::vec2(random(), random()));
+			writeVertex(out, spec, b, normal, glm::vec2(random(), random()));
+			writeVertex(out, spec, c, normal, glm::vec2(random(), random()));
+			out.face(3 * i + 1, 3 * i + 2, 3 * i + 3, spec.normals, spec.uvs);
+		}
+		return spec.faces;
+	}
+
+	std::string specFileName(const MeshSpec& spec) {
+		std::ostringstream name;
+		name << SHAPE_NAMES[(int)spec.shape] << '_' << spec.faces << '_';
+		name << (spec.normals ? 'n' : 'x') << (spec.uvs ? 'u' : 'x') << ".obj";
+		return name.str();
+	}
+
+	/// <summary>
+	/// Writes the OBJ file of a spec unless it already exists
+	/// </summary>
+	/// <returns> True if the file is there, False if it cannot be written
+	/// </returns>
+	bool generate(const std::string& path, const MeshSpec& spec, bool regenerate) {
+		std::error_code ec;
+		if (!regenerate && std::filesystem::exists(path, ec))
+			return true;
+
+		std::cerr << "Generating " << path << std::endl;
+		FILE* file = nullptr;
+		if (fopen_s(&file, path.c_str(), "wb") != 0 || !file)
+			return false;
+		{
+			BlockWriter out(file);
+			out.text("# Generated by loader_benchmark\n");
+			switch (spec.shape) {
+			case Shape::GRID:
+				writeGrid(out, spec);
+				break;
+			case Shape::SPHERE:
+				writeSphere(out, spec);
+				break;
+			case Shape::SOUP:
+				writeSoup(out, spec);
+				break;
+			}
+		}
+		fclose(file);
+		return true;
+	}
+
+	/// <summary>
+	/// Does what OBJObject::load does, except that the welded geometry goes
+	/// to system memory instead of mapped GL buffers
+	/// </summary>
+	size_t loadOBJ(const std::string& path, OBJLoadMode mode) {
+		OBJData geometry;
+		if (!objParser::parse(path.c_str(), mode, geometry))
+			return 0;
+
+		std::vector<OBJMaterialGroup> groups;
+		objParser::groupByMaterial(geometry, groups);
+		OBJWeld weld;
+		std::vector<Vertex> vertices;
+		std::vector<unsigned int> indices;
+		for (const auto& group : groups) {
+			indices.resize(group.numCorners);
+			if (!objParser::weldIndices(geometry, group, indices.data(), weld))
+				return 0;
+			glm::vec3 minCorner, maxCorner;
+			vertices.resize(weld.firstCorners.size());
+			objParser::writeVertices(geometry, weld, vertices.data(), minCorner,
+				maxCorner);
+		}
+		return geometry.corners.size() / 3;
+	}
+
+	/// <summary>
+	/// Does what Model::load does short of uploading the meshes
+	/// </summary>
+	size_t loadModel(const std::string& path, bool cached) {
+		ModelImporter importer(path.c_str());
+		std::vector<ImportedMesh> meshes;
+		NodeHierarchy nodes;
+		if (!(cached ? importer.importCached(meshes, nodes) :
+			importer.importSource(meshes, nodes)))
+			return 0;
+		nodes.update();
+		ModelImporter::getCenter(meshes, nodes);
+		size_t triangles = 0;
+		for (const auto& mesh : meshes)
+			triangles += mesh.indices.size() / 3;
+		return triangles;
+	}
+
+	/// <summary>
+	/// Discards everything written to it. Keeps the loaders' progress
+	/// messages out of the timings and the JSON
+	/// </summary>
+	class NullBuffer : public std::streambuf {
+	protected:
+		int overflow(int c) override { return c; }
+	};
+
+	/// <summary>
+	/// Sends std::cout to a NullBuffer for as long as it lives
+	/// </summary>
+	class SilenceOutput {
+		NullBuffer nullBuffer;
+		std::streambuf* coutBuffer;
+
+	public:
+		SilenceOutput() : coutBuffer(std::cout.rdbuf(&nullBuffer)) {}
+		~SilenceOutput() {
+			std::cout.rdbuf(coutBuffer);
+		}
+	};
+
+	RunStats timeLoad(const std::string& path, Loader loader) {
+		SilenceOutput silence;
+		size_t startAllocations = allocationCount;
+		size_t startBytes = allocatedBytes;
+		size_t startLiveBytes = liveBytes;
+		peakLiveBytes = startLiveBytes;
+		auto start = std::chrono::steady_clock::now();
+
+		RunStats stats;
+		switch (loader) {
+		case Loader::OBJ_STDIO:
+			stats.triangles = loadOBJ(path, OBJLoadMode::STDIO);
+			break;
+		case Loader::OBJ_MAPPED:
+			stats.triangles = loadOBJ(path, OBJLoadMode::MAPPED);
+			break;
+		case Loader::OBJ_PARALLEL:
+			stats.triangles = loadOBJ(path, OBJLoadMode::PARALLEL);
+			break;
+		case Loader::MODEL_ASSIMP:
+			stats.triangles = loadModel(path, false);
+			break;
+		case Loader::MODEL_CACHE:
+			stats.triangles = loadModel(path, true);
+			break;
+		}
+
+		std::chrono::duration<double> seconds =
+			std::chrono::steady_clock::now() - start;
+		// Keeps the rates finite on a coarse clock
+		stats.seconds = std::max(seconds.count(), 1e-9);
+		stats.allocations = allocationCount - startAllocations;
+		stats.bytes = allocatedBytes - startBytes;
+		stats.peakLiveBytes = peakLiveBytes - startLiveBytes;
+		return stats;
+	}
+
+	/// <summary>
+	/// Splits a comma separated option value
+	/// </summary>
+	std::vector<std::string> splitList(const std::string& list) {
+		std::vector<std::string> items;
+		std::stringstream stream(list);
+		std::string item;
+		while (std::getline(stream, item, ','))
+			if (!item.empty())
+				items.push_back(item);
+		return items;
+	}
+
+	/// <summary>
+	/// Reads an on/off/both option
+	/// </summary>
+	bool parseToggle(const std::string& value, std::vector<bool>& toggles) {
+		if (value == "on")
+			toggles = { true };
+		else if (value == "off")
+			toggles = { false };
+		else if (value == "both")
+			toggles = { false, true };
+		else
+			return false;
+		return true;
+	}
+
+	void printUsage() {
+		std::cerr << "USAGE: loader_benchmark [options]\n"
+			"  --shapes grid,sphere,soup      shapes to generate (default all)\n"
+			"  --faces 1000,100000,...        face counts (default 1K,100K,1M)\n"
+			"  --normals on|off|both          write vn lines (default both)\n"
+			"  --uvs on|off|both              write vt lines (default both)\n"
+			"  --loaders obj_mapped,...       loaders to time (default all but\n"
+			"                                 obj_stdio, which only reads v//vn)\n"
+			"  --repeats N                    runs per loader, best is kept\n"
+			"  --dir path                     where generated files are kept\n"
+			"  --regenerate                   rewrite files that already exist\n"
+			"JSON goes to stdout, progress to stderr. peak_rss_bytes is the\n"
+			"high-water mark of the whole process so far, so run one case per\n"
+			"process to get it for that case alone. allocations,\n"
+			"allocated_bytes and peak_live_bytes only cover the load itself\n";
+	}
+}
+
+// Count every allocation the process makes. Allocations made inside the
+// Assimp DLL use its own allocator and are not seen
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+	char* block = (char*)malloc(size + ALLOCATION_HEADER_BYTES);
+	if (block == nullptr)
+		return nullptr;
+	*(size_t*)block = size;
+	++allocationCount;
+	allocatedBytes += size;
+	size_t live = liveBytes += size;
+	size_t peak = peakLiveBytes;
+	while (live > peak && !peakLiveBytes.compare_exchange_weak(peak, live)) {}
+	return block + ALLOCATION_HEADER_BYTES;
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+	return operator new(size, tag);
+}
+
+void* operator new(size_t size) {
+	if (void* memory = operator new(size, std::nothrow))
+		return memory;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+	if (memory == nullptr)
+		return;
+	char* block = (char*)memory - ALLOCATION_HEADER_BYTES;
+	liveBytes -= *(size_t*)block;
+	free(block);
+}
+
+void operator delete[](void* memory) noexcept {
+	operator delete(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+	operator delete(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+	operator delete(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+	operator delete(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+	operator delete(memory);
+}
+
+int main(int argc, char* argv[]) {
+	std::vector<Shape> shapes = { Shape::GRID, Shape::SPHERE, Shape::SOUP };
+	std::vector<size_t> faceCounts(std::begin(DEFAULT_FACE_COUNTS),
+		std::end(DEFAULT_FACE_COUNTS));
+	std::vector<bool> normalToggles = { false, true };
+	std::vector<bool> uvToggles = { false, true };
+	std::vector<Loader> loaders = {
+		Loader::OBJ_MAPPED, Loader::OBJ_PARALLEL, Loader::MODEL_ASSIMP,
+		Loader::MODEL_CACHE
+	};
+	int repeats = DEFAULT_REPEATS;
+	std::filesystem::path directory =
+		std::filesystem::temp_directory_path() / "object_loader_benchmark";
+	bool regenerate = false;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string option = argv[i];
+		std::string value = (i + 1 < argc) ? argv[i + 1] : "";
+		bool valid = true;
+		if (option == "--shapes") {
+			shapes.clear();
+			for (const auto& name : splitList(value)) {
+				auto it = std::find_if(std::begin(SHAPE_NAMES), std::end(SHAPE_NAMES),
+					[&](const char* shape) { return name == shape; });
+				valid = valid && it != std::end(SHAPE_NAMES);
+				if (valid)
+					shapes.push_back((Shape)(it - std::begin(SHAPE_NAMES)));
+			}
+			++i;
+		}
+		else if (option == "--faces") {
+			faceCounts.clear();
+			for (const auto& count : splitList(value))
+				faceCounts.push_back((size_t)strtoull(count.c_str(), nullptr, 10));
+			++i;
+		}
+		else if (option == "--normals") {
+			valid = parseToggle(value, normalToggles);
+			++i;
+		}
+		else if (option == "--uvs") {
+			valid = parseToggle(value, uvToggles);
+			++i;
+		}
+		else if (option == "--loaders") {
+			loaders.clear();
+			for (const auto& name : splitList(value)) {
+				auto it = std::find_if(std::begin(LOADER_NAMES), std::end(LOADER_NAMES),
+					[&](const char* loader) { return name == loader; });
+				valid = valid && it != std::end(LOADER_NAMES);
+				if (valid)
+					loaders.push_back((Loader)(it - std::begin(LOADER_NAMES)));
+			}
+			++i;
+		}
+		else if (option == "--repeats") {
+			repeats = std::max(1, atoi(value.c_str()));
+			++i;
+		}
+		else if (option == "--dir") {
+			directory = value;
+			++i;
+		}
+		else if (option == "--regenerate")
+			regenerate = true;
+		else
+			valid = false;
+
+		if (!valid || shapes.empty() || faceCounts.empty() || loaders.empty()) {
+			printUsage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::create_directories(directory, ec);
+
+	printf("{\n  \"benchmark\": \"loader\",\n");
+	printf("  \"number_kernel\": \"%s\",\n",
+		numberParser::kernelName(numberParser::activeKernel()));
+	printf("  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+	printf("  \"repeats\": %d,\n  \"results\": [", repeats);
+	bool firstResult = true;
+
+	for (Shape shape : shapes) {
+		for (size_t faces : faceCounts) {
+			for (bool normals : normalToggles) {
+				for (bool uvs : uvToggles) {
+					MeshSpec spec = { shape, faces, normals, uvs };
+					std::string path = (directory / specFileName(spec)).generic_string();
+					if (!generate(path, spec, regenerate)) {
+						std::cerr << "Cannot write " << path << std::endl;
+						return EXIT_FAILURE;
+					}
+					double fileMB = std::filesystem::file_size(path, ec) / BYTES_PER_MB;
+
+					for (Loader loader : loaders) {
+						// The old reader only understands v//vn triangles
+						if (loader == Loader::OBJ_STDIO && (!normals || uvs))
+							continue;
+
+						RunStats best = {};
+						for (int r = 0; r < repeats; ++r) {
+							// Every Assimp run has to miss the cache, and the
+							// cache run needs one to read
+							if (loader == Loader::MODEL_ASSIMP)
+								std::filesystem::remove(path + ".meshcache", ec);
+							else if (loader == Loader::MODEL_CACHE && r == 0) {
+								SilenceOutput silence;
+								loadModel(path, false);
+							}
+
+							RunStats stats = timeLoad(path, loader);
+							if (r == 0 || stats.seconds < best.seconds)
+								best = stats;
+						}
+						if (best.triangles == 0) {
+							std::cerr << LOADER_NAMES[(int)loader] << " failed on " << path << std::endl;
+							continue;
+						}
+
+						std::cerr << LOADER_NAMES[(int)loader] << " " << path << ": ";
+						std::cerr << best.seconds << " s\n";
+						printf("%s\n    {\"shape\": \"%s\", \"faces\": %zu, \"normals\": %s, "
+							"\"uvs\": %s, \"file_mb\": %.3f, \"loader\": \"%s\", "
+							"\"triangles\": %zu, \"wall_s\": %.6f, \"mb_per_s\": %.2f, "
+							"\"faces_per_s\": %.0f, \"peak_rss_bytes\": %zu, "
+							"\"allocations\": %zu, \"allocated_bytes\": %zu, "
+							"\"peak_live_bytes\": %zu}",
+							firstResult ? "" : ",", SHAPE_NAMES[(int)shape], faces,
+							normals ? "true" : "false", uvs ? "true" : "false", fileMB,
+							LOADER_NAMES[(int)loader], best.triangles, best.seconds,
+							fileMB / best.seconds, best.triangles / best.seconds,
+							peakResidentBytes(), best.allocations, best.bytes,
+							best.peakLiveBytes);
+						fflush(stdout);
+						firstResult = false;
+					}
+					std::filesystem::remove(path + ".meshcache", ec);
+				}
+			}
+		}
+	}
+
+	printf("\n  ]\n}\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,248 @@
+/*  Times numberParser against strtof/strtol and fscanf_s on the numbers of
+    an OBJ file, once per kernel the CPU supports. Every kernel's output is
+    checked bit for bit against strtof
+    - RAB
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../MappedFile.h"
+#include "../NumberParser.h"
+
+namespace {
+	const int DEFAULT_REPEATS = 5;
+	// Vertices made up when no file is given
+	const size_t SYNTHETIC_VERTICES = 1000000;
+	const double BYTES_PER_MB = 1024.0 * 1024.0;
+
+	/// <summary>
+	/// Numbers pulled out of an OBJ file, one source line per line
+	/// </summary>
+	struct NumberText {
+		// Components of v, vn and vt lines
+		std::string floats;
+		// Indices of f lines, with the slashes turned into blanks
+		std::string ints;
+	};
+
+	/// <summary>
+	/// Copies everything after the keyword of the attribute and face lines
+	/// </summary>
+	void extractNumbers(const char* p, const char* end, NumberText& text) {
+		while (p < end) {
+			const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+			if (!lineEnd)
+				lineEnd = end;
+
+			if (lineEnd - p > 2 && p[0] == 'v' && (p[1] == ' ' || p[1] == 'n' || p[1] == 't')) {
+				text.floats.append(p + 2, lineEnd);
+				text.floats += '\n';
+			}
+			else if (lineEnd - p > 2 && p[0] == 'f' && p[1] == ' ') {
+				for (const char* c = p + 2; c < lineEnd; ++c)
+					text.ints += (*c == '/') ? ' ' : *c;
+				text.ints += '\n';
+			}
+			p = lineEnd + 1;
+		}
+	}
+
+	/// <summary>
+	/// Makes up vertex data shaped like a scanned mesh: six decimals, mixed
+	/// signs and magnitudes
+	/// </summary>
+	void synthesizeNumbers(NumberText& text) {
+		unsigned int state = 12345;
+		char line[128];
+		for (size_t i = 0; i < SYNTHETIC_VERTICES; ++i) {
+			float v[3];
+			for (int j = 0; j < 3; ++j) {
+				state = state * 1664525u + 1013904223u;
+				v[j] = ((int)(state >> 8) % 2000000 - 1000000) / 7919.0f;
+			}
+			snprintf(line, sizeof(line), "%f %f %f\n", v[0], v[1], v[2]);
+			text.floats += line;
+			snprintf(line, sizeof(line), "%zu %zu %zu\n", i + 1, (i * 7) % SYNTHETIC_VERTICES + 1,
+				(i * 13) % SYNTHETIC_VERTICES + 1);
+			text.ints += line;
+		}
+	}
+
+	/// <summary>
+	/// Runs a parse function several times and keeps the fastest run
+	/// </summary>
+	template <class Function>
+	double bestSeconds(int repeats, Function function) {
+		double best = 1e30;
+		for (int i = 0; i < repeats; ++i) {
+			auto start = std::chrono::steady_clock::now();
+			function();
+			std::chrono::duration<double> seconds =
+				std::chrono::steady_clock::now() - start;
+			best = (seconds.count() < best) ? seconds.count() : best;
+		}
+		return best;
+	}
+
+	void report(const char* name, double seconds, size_t count, size_t bytes,
+		size_t mismatches) {
+		printf("  %-10s %8.2f ns/number %9.1f MB/s", name, 1e9 * seconds / count,
+			bytes / BYTES_PER_MB / seconds);
+		if (mismatches)
+			printf("  %zu MISMATCHES", mismatches);
+		printf("\n");
+	}
+}
+
+int main(int argc, char* argv[]) {
+	if (argc > 3) {
+		std::cout << "USAGE: number_parser_benchmark [file.obj] [repeats]\n";
+		return EXIT_FAILURE;
+	}
+	int repeats = (argc > 2) ? atoi(argv[2]) : DEFAULT_REPEATS;
+	repeats = (repeats > 0) ? repeats : DEFAULT_REPEATS;
+
+	NumberText text;
+	if (argc > 1) {
+		MappedFile file(argv[1]);
+		if (!file.isOpen()) {
+			std::cout << "Cannot open " << argv[1] << std::endl;
+			return EXIT_FAILURE;
+		}
+		extractNumbers(file.begin(), file.end(), text);
+		std::cout << "Numbers of " << argv[1] << std::endl;
+	}
+	else {
+		synthesizeNumbers(text);
+		std::cout << "Synthetic vertex data" << std::endl;
+	}
+
+	// strtof is the reference every other reader has to match bit for bit
+	std::vector<float> expected;
+	for (const char* p = text.floats.c_str();;) {
+		char* next;
+		float value = strtof(p, &next);
+		if (next == p)
+			break;
+		expected.push_back(value);
+		p = next;
+	}
+	std::vector<int> expectedInts;
+	for (const char* p = text.ints.c_str();;) {
+		char* next;
+		long value = strtol(p, &next, 10);
+		if (next == p)
+			break;
+		expectedInts.push_back((int)value);
+		p = next;
+	}
+	if (expected.empty()) {
+		std::cout << "No vertex data found\n";
+		return EXIT_FAILURE;
+	}
+
+	std::vector<float> floats(expected.size());
+	std::vector<int> ints(expectedInts.size());
+	auto countMismatches = [&]() {
+		size_t mismatches = 0;
+		for (size_t i = 0; i < expected.size(); ++i)
+			mismatches += (memcmp(&floats[i], &expected[i], sizeof(float)) != 0);
+		return mismatches;
+	};
+	auto countIntMismatches = [&]() {
+		size_t mismatches = 0;
+		for (size_t i = 0; i < expectedInts.size(); ++i)
+			mismatches += (ints[i] != expectedInts[i]);
+		return mismatches;
+	};
+
+	printf("%zu floats (%.1f MB), %zu ints (%.1f MB), best of %d\n\n",
+		expected.size(), text.floats.size() / BYTES_PER_MB, expectedInts.size(),
+		text.ints.size() / BYTES_PER_MB, repeats);
+
+	printf("floats\n");
+	double seconds = bestSeconds(repeats, [&]() {
+		const char* p = text.floats.c_str();
+		for (size_t i = 0; i < floats.size(); ++i) {
+			char* next;
+			floats[i] = strtof(p, &next);
+			p = next;
+		}
+	});
+	report("strtof", seconds, floats.size(), text.floats.size(), countMismatches());
+
+	// fscanf_s reads from a file, so give it one with the same text
+	std::string tempPath = (std::filesystem::temp_directory_path() /
+		"number_parser_benchmark.txt").string();
+	FILE* tempFile = nullptr;
+	if (fopen_s(&tempFile, tempPath.c_str(), "wb") == 0 && tempFile) {
+		fwrite(text.floats.data(), 1, text.floats.size(), tempFile);
+		fclose(tempFile);
+		seconds = bestSeconds(repeats, [&]() {
+			FILE* file = nullptr;
+			if (fopen_s(&file, tempPath.c_str(), "rb") != 0 || !file)
+				return;
+			for (size_t i = 0; i < floats.size(); ++i)
+				fscanf_s(file, "%f", &floats[i]);
+			fclose(file);
+		});
+		report("fscanf_s", seconds, floats.size(), text.floats.size(),
+			countMismatches());
+		std::filesystem::remove(tempPath);
+	}
+
+	numberParser::Kernel best = numberParser::bestKernel();
+	for (int k = 0; k <= (int)best; ++k) {
+		numberParser::Kernel kernel = (numberParser::Kernel)k;
+		numberParser::setKernel(kernel);
+		seconds = bestSeconds(repeats, [&]() {
+			const char* p = text.floats.data();
+			const char* end = p + text.floats.size();
+			for (size_t i = 0; i < floats.size(); ++i) {
+				while (*p == '\n')
+					++p;
+				numberParser::parseFloat(p, end, floats[i]);
+			}
+		});
+		report(numberParser::kernelName(kernel), seconds, floats.size(),
+			text.floats.size(), countMismatches());
+	}
+
+	if (!ints.empty()) {
+		printf("\nints\n");
+		seconds = bestSeconds(repeats, [&]() {
+			const char* p = text.ints.c_str();
+			for (size_t i = 0; i < ints.size(); ++i) {
+				char* next;
+				ints[i] = (int)strtol(p, &next, 10);
+				p = next;
+			}
+		});
+		report("strtol", seconds, ints.size(), text.ints.size(),
+			countIntMismatches());
+
+		for (int k = 0; k <= (int)best; ++k) {
+			numberParser::Kernel kernel = (numberParser::Kernel)k;
+			numberParser::setKernel(kernel);
+			seconds = bestSeconds(repeats, [&]() {
+				const char* p = text.ints.data();
+				const char* end = p + text.ints.size();
+				for (size_t i = 0; i < ints.size(); ++i) {
+					while (*p == '\n')
+						++p;
+					numberParser::parseInt(p, end, ints[i]);
+				}
+			});
+			report(numberParser::kernelName(kernel), seconds, ints.size(),
+				text.ints.size(), countIntMismatches());
+		}
+	}
+	numberParser::setKernel(best);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,415 @@
+#include "BlockCompressor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "AsyncLoader.h"
+
+namespace {
+	using blockCompressor::BlockFormat;
+
+	const int BLOCK_DIM = 4;
+	const int BLOCK_PIXELS = BLOCK_DIM * BLOCK_DIM;
+	// Iterations of the power method that finds a block's principal axis
+	const int POWER_ITERATIONS = 8;
+	// Least squares passes that move the BC1 endpoints closer to the pixels
+	const int REFINE_PASSES = 2;
+	// Interpolation weights of BC7's 4 bit indices, out of 64
+	const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47,
+		51, 55, 60, 64 };
+
+	// Pixels of one block as floats in [0, 255], RGBA
+	typedef float Block[BLOCK_PIXELS][4];
+
+	/// <summary>
+	/// Reads a block of the image, repeating the edge pixels for blocks that
+	/// stick out of it
+	/// </summary>
+	void loadBlock(const unsigned char* pixels, int width, int height,
+		int blockX, int blockY, Block& block) {
+		for (int y = 0; y < BLOCK_DIM; ++y) {
+			int row = std::min(blockY * BLOCK_DIM + y, height - 1);
+			for (int x = 0; x < BLOCK_DIM; ++x) {
+				int column = std::min(blockX * BLOCK_DIM + x, width - 1);
+				const unsigned char* pixel = pixels + 4 * ((size_t)row * width + column);
+				for (int c = 0; c < 4; ++c)
+					block[y * BLOCK_DIM + x][c] = pixel[c];
+			}
+		}
+	}
+
+	/// <summary>
+	/// Finds the mean of a block and the direction its colors spread along
+	/// most, with the power method on their covariance
+	/// </summary>
+	/// <param name="numChannels"> 3 for RGB, 4 for RGBA </param>
+	/// <param name="mean"> Stores the mean </param>
+	/// <param name="axis"> Stores the unit axis, zero if the block is flat
+	/// </param>
+	void principalAxis(const Block& block, int numChannels, float mean[4],
+		float axis[4]) {
+		for (int c = 0; c < 4; ++c) {
+			mean[c] = 0.0f;
+			axis[c] = 0.0f;
+		}
+		for (int i = 0; i < BLOCK_PIXELS; ++i) {
+			for (int c = 0; c < numChannels; ++c)
+				mean[c] += block[i][c] / BLOCK_PIXELS;
+		}
+		float covariance[4][4] = {};
+		for (int i = 0; i < BLOCK_PIXELS; ++i) {
+			float d[4];
+			for (int c = 0; c < numChannels; ++c)
+				d[c] = block[i][c] - mean[c];
+			for (int a = 0; a < numChannels; ++a) {
+				for (int b = 0; b < numChannels; ++b)
+					covariance[a][b] += d[a] * d[b];
+			}
+		}
+
+		// Start from the channel that varies most, so the first guess is
+		// never orthogonal to the answer
+		int start = 0;
+		for (int c = 1; c < numChannels; ++c) {
+			if (covariance[c][c] > covariance[start][start])
+				start = c;
+		}
+		if (covariance[start][start] <= 0.0f)
+			return;
+		for (int c = 0; c < numChannels; ++c)
+			axis[c] = covariance[start][c];
+		for (int iteration = 0; iteration < POWER_ITERATIONS; ++iteration) {
+			float next[4] = {};
+			float length = 0.0f;
+			for (int a = 0; a < numChannels; ++a) {
+				for (int b = 0; b < numChannels; ++b)
+					next[a] += covariance[a][b] * axis[b];
+				length += next[a] * next[a];
+			}
+			length = std::sqrt(length);
+			if (length <= 0.0f)
+				return;
+			for (int c = 0; c < numChannels; ++c)
+				axis[c] = next[c] / length;
+		}
+	}
+
+	/// <summary>
+	/// Gets the ends of the segment the block's colors cover along an axis
+	/// </summary>
+	void fitEndpoints(const Block& block, int numChannels, const float mean[4],
+		const float axis[4], float low[4], float high[4]) {
+		float minT = std::numeric_limits<float>::max();
+		float maxT = std::numeric_limits<float>::lowest();
+		for (int i = 0; i < BLOCK_PIXELS; ++i) {
+			float t = 0.0f;
+			for (int c = 0; c < numChannels; ++c)
+				t += (block[i][c] - mean[c]) * axis[c];
+			minT = std::min(minT, t);
+			maxT = std::max(maxT, t);
+		}
+		for (int c = 0; c < 4; ++c) {
+			low[c] = std::min(std::max(mean[c] + axis[c] * minT, 0.0f), 255.0f);
+			high[c] = std::min(std::max(mean[c] + axis[c] * maxT, 0.0f), 255.0f);
+		}
+	}
+
+	inline int quantize(float value, int maxLevel) {
+		int level = (int)std::lround(value * maxLevel / 255.0f);
+		return std::min(std::max(level, 0), maxLevel);
+	}
+
+	uint16_t to565(const float color[4]) {
+		return (uint16_t)((quantize(color[0], 31) << 11) |
+			(quantize(color[1], 63) << 5) | quantize(color[2], 31));
+	}
+
+	/// <summary>
+	/// Expands a 565 color the way the hardware does
+	/// </summary>
+	void from565(uint16_t packed, float color[3]) {
+		int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+		color[0] = (float)((r << 3) | (r >> 2));
+		color[1] = (float)((g << 2) | (g >> 4));
+		color[2] = (float)((b << 3) | (b >> 2));
+	}
+
+	/// <summary>
+	/// Picks the nearest of the four colors of a block with endpoints c0 and
+	/// c1 for every pixel
+	/// </summary>
+	/// <returns> Summed squared error </returns>
+	float pickColorIndices(const Block& block, uint16_t c0, uint16_t c1,
+		unsigned char indices[BLOCK_PIXELS]) {
+		float palette[4][3];
+		from565(c0, palette[0]);
+		from565(c1, palette[1]);
+		for (int c = 0; c < 3; ++c) {
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+		float total = 0.0f;
+		for (int i = 0; i < BLOCK_PIXELS; ++i) {
+			float bestError = std::numeric_limits<float>::max();
+			for (unsigned char j = 0; j < 4; ++j) {
+				float error = 0.0f;
+				for (int c = 0; c < 3; ++c) {
+					float d = block[i][c] - palette[j][c];
+					error += d * d;
+				}
+				if (error < bestError) {
+					bestError = error;
+					indices[i] = j;
+				}
+			}
+			total += bestError;
+		}
+		return total;
+	}
+
+	/// <summary>
+	/// Encodes the colors of a block as BC1, always in four color mode
+	/// </summary>
+	void encodeColorBlock(const Block& block, unsigned char* out) {
+		float mean[4], axis[4], low[4], high[4];
+		principalAxis(block, 3, mean, axis);
+		fitEndpoints(block, 3, mean, axis, low, high);
+
+		// Four color mode needs the first endpoint to be the larger one
+		uint16_t c0 = to565(high), c1 = to565(low);
+		if (c0 < c1)
+			std::swap(c0, c1);
+		unsigned char indices[BLOCK_PIXELS];
+		float error = pickColorIndices(block, c0, c1, indices);
+
+		// Solve for the endpoints that best fit the chosen indices. Index j
+		// weighs the first endpoint by 1, 0, 2/3 or 1/3
+		const float WEIGHTS[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+		for (int pass = 0; pass < REFINE_PASSES && c0 != c1; ++pass) {
+			float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+			float ax[3] = {}, bx[3] = {};
+			for (int i = 0; i < BLOCK_PIXELS; ++i) {
+				float w = WEIGHTS[indices[i]];
+				aa += w * w;
+				ab += w * (1.0f - w);
+				bb += (1.0f - w) * (1.0f - w);
+				for (int c = 0; c < 3; ++c) {
+					ax[c] += w * block[i][c];
+					bx[c] += (1.0f - w) * block[i][c];
+				}
+			}
+			float determinant = aa * bb - ab * ab;
+			if (std::abs(determinant) < 1e-6f)
+				break;
+			float first[4], second[4];
+			for (int c = 0; c < 3; ++c) {
+				first[c] = std::min(std::max(
+					(ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+				second[c] = std::min(std::max(
+					(bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+			}
+			uint16_t r0 = to565(first), r1 = to565(second);
+			if (r0 < r1)
+				std::swap(r0, r1);
+			unsigned char refined[BLOCK_PIXELS];
+			float refinedError = pickColorIndices(block, r0, r1, refined);
+			if (refinedError >= error)
+				break;
+			c0 = r0;
+			c1 = r1;
+			error = refinedError;
+			memcpy(indices, refined, sizeof(indices));
+		}
+		// Equal endpoints would switch to three color mode, where index 3
+		// is black. Index 0 is the color either way
+		if (c0 == c1)
+			memset(indices, 0, sizeof(indices));
+
+		uint32_t bits = 0;
+		for (int i = 0; i < BLOCK_PIXELS; ++i)
+			bits |= (uint32_t)indices[i] << (2 * i);
+		out[0] = (unsigned char)(c0 & 0xff);
+		out[1] = (unsigned char)(c0 >> 8);
+		out[2] = (unsigned char)(c1 & 0xff);
+		out[3] = (unsigned char)(c1 >> 8);
+		for (int i = 0; i < 4; ++i)
+			out[4 + i] = (unsigned char)(bits >> (8 * i));
+	}
+
+	/// <summary>
+	/// Encodes the alpha of a block as the alpha half of BC3, in the mode
+	/// with six interpolated values
+	/// </summary>
+	void encodeAlphaBlock(const Block& block, unsigned char* out) {
+		int high = 0, low = 255;
+		for (int i = 0; i < BLOCK_PIXELS; ++i) {
+			int alpha = (int)std::lround(block[i][3]);
+			high = std::max(high, alpha);
+			low = std::min(low, alpha);
+		}
+		memset(out, 0, 8);
+		out[0] = (unsigned char)high;
+		out[1] = (unsigned char)low;
+		if (high == low)
+			return;
+
+		float values[8];
+		values[0] = (float)high;
+		values[1] = (float)low;
+		for (int i = 1; i < 7; ++i)
+			values[i + 1] = ((7 - i) * high + i * low) / 7.0f;
+		uint64_t bits = 0;
+		for (int i = 0; i < BLOCK_PIXELS; ++i) {
+			int best = 0;
+			float bestError = std::numeric_limits<float>::max();
+			for (int j = 0; j < 8; ++j) {
+				float error = std::abs(block[i][3] - values[j]);
+				if (error < bestError) {
+					bestError = error;
+					best = j;
+				}
+			}
+			bits |= (uint64_t)best << (3 * i);
+		}
+		for (int i = 0; i < 6; ++i)
+			out[2 + i] = (unsigned char)(bits >> (8 * i));
+	}
+
+	/// <summary>
+	/// Quantizes a BC7 mode 6 endpoint to 7 bits a channel plus a parity bit
+	/// shared by the channels, whichever parity fits better
+	/// </summary>
+	void quantizeBC7Endpoint(const float color[4], int quantized[4], int& parity) {
+		float bestError = std::numeric_limits<float>::max();
+		for (int p = 0; p < 2; ++p) {
+			int candidate[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; ++c) {
+				candidate[c] = std::min(std::max(
+					(int)std::lround((color[c] - p) / 2.0f), 0), 127);
+				float d = (float)((candidate[c] << 1) | p) - color[c];
+				error += d * d;
+			}
+			if (error < bestError) {
+				bestError = error;
+				parity = p;
+				memcpy(quantized, candidate, sizeof(candidate));
+			}
+		}
+	}
+
+	/// <summary>
+	/// Appends bits to a block, least significant first
+	/// </summary>
+	struct BitWriter {
+		unsigned char* out;
+		int position;
+
+		void write(unsigned int value, int numBits) {
+			for (int i = 0; i < numBits; ++i, ++position) {
+				if ((value >> i) & 1)
+					out[position >> 3] |= (unsigned char)(1 << (position & 7));
+			}
+		}
+	};
+
+	/// <summary>
+	/// Encodes a block as BC7 mode 6: one subset, RGBA endpoints and 16
+	/// interpolation steps
+	/// </summary>
+	void encodeBC7Block(const Block& block, unsigned char* out) {
+		float mean[4], axis[4], low[4], high[4];
+		principalAxis(block, 4, mean, axis);
+		fitEndpoints(block, 4, mean, axis, low, high);
+
+		int endpoints[2][4], parity[2];
+		quantizeBC7Endpoint(low, endpoints[0], parity[0]);
+		quantizeBC7Endpoint(high, endpoints[1], parity[1]);
+		float palette[16][4];
+		for (int j = 0; j < 16; ++j) {
+			for (int c = 0; c < 4; ++c) {
+				int e0 = (endpoints[0][c] << 1) | parity[0];
+				int e1 = (endpoints[1][c] << 1) | parity[1];
+				palette[j][c] = (float)(((64 - BC7_WEIGHTS[j]) * e0 +
+					BC7_WEIGHTS[j] * e1 + 32) >> 6);
+			}
+		}
+		int indices[BLOCK_PIXELS];
+		for (int i = 0; i < BLOCK_PIXELS; ++i) {
+			float bestError = std::numeric_limits<float>::max();
+			for (int j = 0; j < 16; ++j) {
+				float error = 0.0f;
+				for (int c = 0; c < 4; ++c) {
+					float d = block[i][c] - palette[j][c];
+					error += d * d;
+				}
+				if (error < bestError) {
+					bestError = error;
+					indices[i] = j;
+				}
+			}
+		}
+
+		// The first index is stored without its top bit, so it must be clear
+		if (indices[0] & 8) {
+			for (int c = 0; c < 4; ++c)
+				std::swap(endpoints[0][c], endpoints[1][c]);
+			std::swap(parity[0], parity[1]);
+			for (int i = 0; i < BLOCK_PIXELS; ++i)
+				indices[i] = 15 - indices[i];
+		}
+
+		memset(out, 0, 16);
+		BitWriter writer = { out, 0 };
+		// Mode 6 is six zero bits followed by a one
+		writer.write(1 << 6, 7);
+		for (int c = 0; c < 4; ++c) {
+			writer.write(endpoints[0][c], 7);
+			writer.write(endpoints[1][c], 7);
+		}
+		writer.write(parity[0], 1);
+		writer.write(parity[1], 1);
+		writer.write(indices[0], 3);
+		for (int i = 1; i < BLOCK_PIXELS; ++i)
+			writer.write(indices[i], 4);
+	}
+}
+
+size_t blockCompressor::blockSize(BlockFormat format) {
+	return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+size_t blockCompressor::compressedSize(int width, int height, BlockFormat format) {
+	size_t blocksX = (size_t)(width + BLOCK_DIM - 1) / BLOCK_DIM;
+	size_t blocksY = (size_t)(height + BLOCK_DIM - 1) / BLOCK_DIM;
+	return blocksX * blocksY * blockSize(format);
+}
+
+void blockCompressor::compress(const unsigned char* pixels, int width,
+	int height, BlockFormat format, unsigned char* blocks) {
+	int blocksX = (width + BLOCK_DIM - 1) / BLOCK_DIM;
+	int blocksY = (height + BLOCK_DIM - 1) / BLOCK_DIM;
+	size_t size = blockSize(format);
+	asyncLoader::parallelFor(blocksY, [&](size_t blockY) {
+		Block block;
+		unsigned char* out = blocks + blockY * blocksX * size;
+		for (int blockX = 0; blockX < blocksX; ++blockX, out += size) {
+			loadBlock(pixels, width, height, blockX, (int)blockY, block);
+			switch (format) {
+			case BlockFormat::BC1:
+				encodeColorBlock(block, out);
+				break;
+			case BlockFormat::BC3:
+				encodeAlphaBlock(block, out);
+				encodeColorBlock(block, out + 8);
+				break;
+			case BlockFormat::BC7:
+				encodeBC7Block(block, out);
+				break;
+			}
+		}
+	});
+}
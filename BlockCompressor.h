@@ -0,0 +1,50 @@
+/*  Compresses RGBA8 images into the BC block formats GPUs sample directly:
+    BC1 for opaque images, BC3 for images with alpha, and BC7 as a higher
+    quality option for either. Block rows are spread over the worker pool
+    - RAB
+ */
+#pragma once
+
+#include <cstddef>
+
+namespace blockCompressor {
+	/// <summary>
+	/// Block compressed formats. Every format stores 4x4 pixel blocks
+	/// </summary>
+	enum class BlockFormat {
+		// 8 bytes a block. Two 565 endpoints, 2 bit indices. No alpha
+		BC1,
+		// 16 bytes a block. BC1 color plus interpolated 8 bit alpha
+		BC3,
+		// 16 bytes a block. Encoded in mode 6: 7 bit RGBA endpoints with
+		// parity bits and 4 bit indices
+		BC7
+	};
+
+	/// <summary>
+	/// Gets the bytes one block of a format takes
+	/// </summary>
+	size_t blockSize(BlockFormat format);
+
+	/// <summary>
+	/// Gets the bytes an image of some size takes in a format. Partial
+	/// blocks at the right and bottom count as whole ones
+	/// </summary>
+	/// <param name="width"> width in pixels </param>
+	/// <param name="height"> height in pixels </param>
+	/// <param name="format"> block format </param>
+	size_t compressedSize(int width, int height, BlockFormat format);
+
+	/// <summary>
+	/// Compresses an image. Blocks that stick out of the image repeat its
+	/// edge pixels
+	/// </summary>
+	/// <param name="pixels"> RGBA8 pixels, rows top to bottom </param>
+	/// <param name="width"> width in pixels </param>
+	/// <param name="height"> height in pixels </param>
+	/// <param name="format"> block format to write </param>
+	/// <param name="blocks"> Stores compressedSize(width, height, format)
+	/// bytes of blocks, row by row </param>
+	void compress(const unsigned char* pixels, int width, int height,
+		BlockFormat format, unsigned char* blocks);
+}
@@ -3,6 +3,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
 
+#include "Frustum.h"
 #include "PrintDebug.h"
 
 // Standard camera settings
@@ -58,6 +59,23 @@ glm::mat4 Camera::getProjMat(int width, int height) const {
         near, far);
 }
 
+void Camera::getFrustumPlanes(int width, int height, glm::vec4 planes[6]) const {
+    frustum::extractPlanes(getProjMat(width, height) * getViewMat(), planes);
+}
+
+void Camera::getRay(double x, double y, int width, int height,
+    glm::vec3& origin, glm::vec3& direction) const {
+    // Window coordinates start at the top left, clip space at the center
+    // with y up
+    float ndcX = (float)(2.0 * x / width - 1.0);
+    float ndcY = (float)(1.0 - 2.0 * y / height);
+    glm::mat4 toWorld = glm::inverse(getProjMat(width, height) * getViewMat());
+    glm::vec4 nearPoint = toWorld * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = toWorld * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    origin = glm::vec3(nearPoint) / nearPoint.w;
+    direction = glm::vec3(farPoint) / farPoint.w - origin;
+}
+
 void Camera::setEye(glm::vec3 eye) {
     fixCameraVecs(eye, center, up);
 }
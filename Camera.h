@@ -76,6 +76,27 @@ public:
 	/// <param name="height"> height of window </param>
 	/// <returns></returns>
 	glm::mat4 getProjMat(int width, int height) const;
+	/// <summary>
+	/// Extracts the planes of the camera's view frustum in world space
+	/// </summary>
+	/// <param name="width"> width of window </param>
+	/// <param name="height"> height of window </param>
+	/// <param name="planes"> Stores left, right, bottom, top, near and far,
+	/// as frustum::extractPlanes does </param>
+	void getFrustumPlanes(int width, int height, glm::vec4 planes[6]) const;
+	/// <summary>
+	/// Gets the ray through a point of the window, from the near plane to
+	/// the far plane
+	/// </summary>
+	/// <param name="x"> x position in the window, from the left </param>
+	/// <param name="y"> y position in the window, from the top </param>
+	/// <param name="width"> width of window </param>
+	/// <param name="height"> height of window </param>
+	/// <param name="origin"> Stores the point on the near plane </param>
+	/// <param name="direction"> Stores the way to the point on the far
+	/// plane, so distances along it are fractions of the view depth </param>
+	void getRay(double x, double y, int width, int height, glm::vec3& origin,
+		glm::vec3& direction) const;
 
 	/// <summary>
 	/// Sets location of camera
@@ -0,0 +1,420 @@
+#include "CompressedTexture.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "BlockCompressor.h"
+#include "MappedFile.h"
+#include "MipChain.h"
+#include "stb_image.h"
+
+// S3TC is an extension, so a core profile loader may not define its formats
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+
+using blockCompressor::BlockFormat;
+
+namespace {
+	const unsigned char KTX_IDENTIFIER[12] = {
+		0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+	};
+	// Reads back as this number when the file has the reader's byte order
+	const uint32_t KTX_ENDIANNESS = 0x04030201;
+	// Key of the value holding the stamp of the sources
+	const char* const STAMP_KEY = "OLSource";
+	// Part of every stamp. Bump when the encoders or mip filters change, so
+	// caches written by older ones are built again
+	const char* const ENCODER_VERSION = "2";
+
+	/// <summary>
+	/// Header of a KTX 1.1 file, as laid out on disk
+	/// </summary>
+	struct KTXHeader {
+		unsigned char identifier[12];
+		uint32_t endianness;
+		// Type, type size and format are 0, 1 and 0 for compressed data, and
+		// GL_UNSIGNED_BYTE, 1 and GL_RGBA for RGBA8
+		uint32_t glType;
+		uint32_t glTypeSize;
+		uint32_t glFormat;
+		uint32_t glInternalFormat;
+		uint32_t glBaseInternalFormat;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t numberOfArrayElements;
+		uint32_t numberOfFaces;
+		uint32_t numberOfMipmapLevels;
+		uint32_t bytesOfKeyValueData;
+	};
+	static_assert(sizeof(KTXHeader) == 64, "KTX header must be 64 bytes");
+
+	// Set once at startup, before any texture loads
+	bool bc7Enabled = false;
+
+	GLenum glFormat(BlockFormat format) {
+		switch (format) {
+		case BlockFormat::BC1:
+			return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case BlockFormat::BC3:
+			return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		default:
+			return GL_COMPRESSED_RGBA_BPTC_UNORM;
+		}
+	}
+
+	/// <summary>
+	/// Gets the block format of a GL compressed format
+	/// </summary>
+	/// <returns> False if the format is not one this loader writes </returns>
+	bool blockFormat(uint32_t internalFormat, BlockFormat& format) {
+		switch (internalFormat) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+			format = BlockFormat::BC1;
+			return true;
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+			format = BlockFormat::BC3;
+			return true;
+		case GL_COMPRESSED_RGBA_BPTC_UNORM:
+			format = BlockFormat::BC7;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	/// <summary>
+	/// Gets the bytes one face of a level takes, for plain RGBA8 texels or
+	/// any of the block formats
+	/// </summary>
+	size_t faceSize(uint32_t internalFormat, int width, int height) {
+		BlockFormat format;
+		if (!blockFormat(internalFormat, format))
+			return (size_t)width * height * 4;
+		return blockCompressor::compressedSize(width, height, format);
+	}
+
+	/// <summary>
+	/// Whether the driver lists a compressed format
+	/// </summary>
+	bool formatSupported(GLenum format) {
+		GLint numFormats = 0;
+		glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &numFormats);
+		if (numFormats <= 0)
+			return false;
+		std::vector<GLint> formats(numFormats);
+		glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats.data());
+		return std::find(formats.begin(), formats.end(), (GLint)format) !=
+			formats.end();
+	}
+
+	/// <summary>
+	/// Stamps the sources with their sizes and modification times and the
+	/// format choice, so a cache written for anything else is rejected
+	/// </summary>
+	bool sourceStamp(const std::vector<std::string>& sources, bool useBlocks,
+		bool useBC7, std::string& stamp) {
+		stamp = std::string("v") + ENCODER_VERSION +
+			(!useBlocks ? " rgba8" : useBC7 ? " bc7" : " bc1");
+		for (const std::string& source : sources) {
+			std::error_code ec;
+			uintmax_t size = std::filesystem::file_size(source, ec);
+			if (ec)
+				return false;
+			auto writeTime = std::filesystem::last_write_time(source, ec);
+			if (ec)
+				return false;
+			stamp += " " + std::to_string(size) + ":" +
+				std::to_string((long long)writeTime.time_since_epoch().count());
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Decodes the sources, builds their mip chains and compresses every
+	/// level, unless the driver takes no block formats
+	/// </summary>
+	bool compressSources(const std::vector<std::string>& sources, bool useBlocks,
+		bool useBC7, CompressedImage& image) {
+		// Faces decode in parallel. Each is forced to RGBA
+		std::vector<DecodedImage> faces(sources.size());
+		asyncLoader::parallelFor(sources.size(), [&](size_t i) {
+			unsigned char* pixels = stbi_load(sources[i].c_str(), &faces[i].width,
+				&faces[i].height, &faces[i].numChannels, 4);
+			if (pixels != nullptr)
+				faces[i].pixels = std::shared_ptr<unsigned char>(pixels, stbi_image_free);
+		});
+		for (size_t i = 0; i < faces.size(); ++i) {
+			if (faces[i].pixels == nullptr) {
+				std::cout << "Texture at path: " << sources[i] << " failed to load!\n";
+				return false;
+			}
+			if (faces[i].width != faces[0].width || faces[i].height != faces[0].height) {
+				std::cout << "Texture at path: " << sources[i];
+				std::cout << " does not match the size of the other faces\n";
+				return false;
+			}
+		}
+
+		bool hasAlpha = false;
+		for (const DecodedImage& face : faces) {
+			size_t numPixels = (size_t)face.width * face.height;
+			const unsigned char* pixels = face.pixels.get();
+			for (size_t i = 0; i < numPixels && !hasAlpha; ++i)
+				hasAlpha = pixels[4 * i + 3] != 255;
+		}
+		BlockFormat format = useBC7 ? BlockFormat::BC7 :
+			hasAlpha ? BlockFormat::BC3 : BlockFormat::BC1;
+
+		image.internalFormat = useBlocks ? glFormat(format) : GL_RGBA8;
+		image.width = faces[0].width;
+		image.height = faces[0].height;
+		image.numFaces = (int)faces.size();
+		image.levels.assign(mipChain::numLevels(image.width, image.height),
+			std::vector<unsigned char>());
+
+		// Faces are sRGB encoded colors. Each level is compressed as soon as
+		// its face's chain is built
+		std::vector<mipChain::MipLevel> chain;
+		for (size_t face = 0; face < faces.size(); ++face) {
+			mipChain::build(faces[face].pixels.get(), image.width, image.height,
+				true, mipChain::MipFilter::KAISER, chain);
+			for (size_t level = 0; level < chain.size(); ++level) {
+				const mipChain::MipLevel& mip = chain[level];
+				size_t size = faceSize(image.internalFormat, mip.width, mip.height);
+				std::vector<unsigned char>& data = image.levels[level];
+				data.resize(size * faces.size());
+				if (useBlocks) {
+					blockCompressor::compress(mip.pixels.data(), mip.width,
+						mip.height, format, data.data() + face * size);
+				}
+				else {
+					std::copy(mip.pixels.begin(), mip.pixels.end(),
+						data.begin() + face * size);
+				}
+			}
+		}
+		return true;
+	}
+}
+
+void compressedTexture::setBC7Enabled(bool enabled) {
+	bc7Enabled = enabled;
+}
+
+bool compressedTexture::isSupported() {
+	return formatSupported(GL_COMPRESSED_RGB_S3TC_DXT1_EXT) &&
+		formatSupported(GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+}
+
+bool compressedTexture::loadAsync(const std::vector<std::string>& sources,
+	const std::string& cachePath, std::shared_ptr<LoadToken> token,
+	std::function<void(const CompressedImage&)> upload) {
+	if (sources.empty())
+		return false;
+	bool useBlocks = isSupported();
+	bool useBC7 = useBlocks && bc7Enabled &&
+		formatSupported(GL_COMPRESSED_RGBA_BPTC_UNORM);
+
+	asyncLoader::submit([sources, cachePath, token, upload, useBlocks, useBC7]() {
+		if (token->cancelled)
+			return;
+		std::string stamp;
+		if (!sourceStamp(sources, useBlocks, useBC7, stamp)) {
+			std::cout << "Texture sources for " << cachePath << " are missing\n";
+			return;
+		}
+		auto image = std::make_shared<CompressedImage>();
+		if (!readCache(cachePath, stamp, *image)) {
+			if (!compressSources(sources, useBlocks, useBC7, *image))
+				return;
+			if (!writeCache(cachePath, stamp, *image))
+				std::cout << "Could not write texture cache " << cachePath << std::endl;
+		}
+
+		asyncLoader::queueUpload([token, upload, image]() {
+			if (!token->cancelled)
+				upload(*image);
+		});
+	});
+	return true;
+}
+
+void compressedTexture::upload(const CompressedImage& image, unsigned int texture) {
+	GLenum target = image.numFaces == 6 ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+	glBindTexture(target, texture);
+	int width = image.width, height = image.height;
+	for (size_t level = 0; level < image.levels.size(); ++level) {
+		size_t faceSize = image.levels[level].size() / image.numFaces;
+		for (int face = 0; face < image.numFaces; ++face) {
+			GLenum faceTarget = image.numFaces == 6 ?
+				GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+			const unsigned char* data = image.levels[level].data() + face * faceSize;
+			if (image.internalFormat == GL_RGBA8) {
+				glTexImage2D(faceTarget, (GLint)level, GL_RGBA8, width, height, 0,
+					GL_RGBA, GL_UNSIGNED_BYTE, data);
+			}
+			else {
+				glCompressedTexImage2D(faceTarget, (GLint)level, image.internalFormat,
+					width, height, 0, (GLsizei)faceSize, data);
+			}
+		}
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+	glBindTexture(target, 0);
+}
+
+bool compressedTexture::readCache(const std::string& cachePath,
+	const std::string& stamp, CompressedImage& image) {
+	std::error_code ec;
+	if (!std::filesystem::exists(cachePath, ec))
+		return false;
+
+	MappedFile file;
+	if (!file.open(cachePath.c_str()) || file.size() < sizeof(KTXHeader)) {
+		std::cout << "Texture cache " << cachePath << " is unreadable\n";
+		return false;
+	}
+	KTXHeader header;
+	memcpy(&header, file.begin(), sizeof(header));
+	BlockFormat format;
+	bool plain = header.glInternalFormat == GL_RGBA8 &&
+		header.glType == GL_UNSIGNED_BYTE && header.glFormat == GL_RGBA;
+	bool valid = !memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) &&
+		header.endianness == KTX_ENDIANNESS &&
+		(plain || blockFormat(header.glInternalFormat, format)) &&
+		header.pixelWidth > 0 && header.pixelHeight > 0 && header.pixelDepth == 0 &&
+		header.numberOfArrayElements == 0 &&
+		(header.numberOfFaces == 1 || header.numberOfFaces == 6) &&
+		header.numberOfMipmapLevels > 0 &&
+		header.numberOfMipmapLevels <=
+			(uint32_t)mipChain::numLevels(header.pixelWidth, header.pixelHeight) &&
+		header.bytesOfKeyValueData <= file.size() - sizeof(KTXHeader);
+	auto corrupt = [&]() {
+		std::cout << "Texture cache " << cachePath << " is corrupt\n";
+		image.levels.clear();
+		return false;
+	};
+	if (!valid)
+		return corrupt();
+
+	// Find the stamp among the key and value pairs
+	const char* cursor = file.begin() + sizeof(KTXHeader);
+	const char* keyValueEnd = cursor + header.bytesOfKeyValueData;
+	std::string cachedStamp;
+	while (keyValueEnd - cursor >= 4) {
+		uint32_t pairSize;
+		memcpy(&pairSize, cursor, sizeof(pairSize));
+		cursor += sizeof(pairSize);
+		if (pairSize > (size_t)(keyValueEnd - cursor))
+			return corrupt();
+		std::string pair(cursor, pairSize);
+		size_t keyEnd = pair.find('\0');
+		if (keyEnd != std::string::npos && pair.compare(0, keyEnd, STAMP_KEY) == 0) {
+			cachedStamp = pair.substr(keyEnd + 1);
+			if (!cachedStamp.empty() && cachedStamp.back() == '\0')
+				cachedStamp.pop_back();
+		}
+		cursor += (pairSize + 3) & ~3u;
+	}
+	if (cachedStamp != stamp) {
+		std::cout << "Texture cache " << cachePath << " is out of date\n";
+		return false;
+	}
+
+	cursor = keyValueEnd;
+	image.internalFormat = header.glInternalFormat;
+	image.width = (int)header.pixelWidth;
+	image.height = (int)header.pixelHeight;
+	image.numFaces = (int)header.numberOfFaces;
+	image.levels.assign(header.numberOfMipmapLevels, std::vector<unsigned char>());
+	int width = image.width, height = image.height;
+	for (uint32_t level = 0; level < header.numberOfMipmapLevels; ++level) {
+		// Blocks and RGBA8 rows are multiples of 4 bytes, so faces and levels
+		// need no padding
+		size_t size = faceSize(image.internalFormat, width, height);
+		uint32_t imageSize;
+		if (file.end() - cursor < 4)
+			return corrupt();
+		memcpy(&imageSize, cursor, sizeof(imageSize));
+		cursor += sizeof(imageSize);
+		size_t levelSize = size * image.numFaces;
+		if (imageSize != size || (size_t)(file.end() - cursor) < levelSize)
+			return corrupt();
+		image.levels[level].assign(cursor, cursor + levelSize);
+		cursor += levelSize;
+		width = std::max(width / 2, 1);
+		height = std::max(height / 2, 1);
+	}
+	return true;
+}
+
+bool compressedTexture::writeCache(const std::string& cachePath,
+	const std::string& stamp, const CompressedImage& image) {
+	KTXHeader header = {};
+	memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+	header.endianness = KTX_ENDIANNESS;
+	header.glTypeSize = 1;
+	if (image.internalFormat == GL_RGBA8) {
+		header.glType = GL_UNSIGNED_BYTE;
+		header.glFormat = GL_RGBA;
+	}
+	header.glInternalFormat = image.internalFormat;
+	header.glBaseInternalFormat =
+		image.internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? GL_RGB : GL_RGBA;
+	header.pixelWidth = (uint32_t)image.width;
+	header.pixelHeight = (uint32_t)image.height;
+	header.numberOfFaces = (uint32_t)image.numFaces;
+	header.numberOfMipmapLevels = (uint32_t)image.levels.size();
+
+	// One pair: the key and the value, both with their terminating null
+	std::string pair = std::string(STAMP_KEY) + '\0' + stamp + '\0';
+	uint32_t pairSize = (uint32_t)pair.size();
+	pair.resize((pair.size() + 3) & ~(size_t)3, '\0');
+	header.bytesOfKeyValueData = (uint32_t)(sizeof(pairSize) + pair.size());
+
+	std::string tempPath = cachePath + ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out)
+			return false;
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)&pairSize, sizeof(pairSize));
+		out.write(pair.data(), pair.size());
+		for (const std::vector<unsigned char>& level : image.levels) {
+			// Cubemaps give the size of one face, everything else of the level
+			uint32_t imageSize = (uint32_t)(level.size() / image.numFaces);
+			out.write((const char*)&imageSize, sizeof(imageSize));
+			out.write((const char*)level.data(), level.size());
+		}
+		if (!out) {
+			out.close();
+			std::filesystem::remove(tempPath);
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tempPath, cachePath, ec);
+	if (ec) {
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	std::cout << "Wrote texture cache " << cachePath << std::endl;
+	return true;
+}
@@ -0,0 +1,95 @@
+/*  Block compressed textures with their whole mip chain, kept next to the
+    source images in a KTX 1.1 cache file. The first load decodes, mips and
+    compresses the sources on the worker pool and writes the cache; later
+    loads only read the cache. Either way the render thread just hands the
+    levels to GL. Drivers without block formats get plain RGBA8 levels
+    - RAB
+ */
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AsyncLoader.h"
+
+/// <summary>
+/// A compressed 2D texture or cubemap, level by level
+/// </summary>
+struct CompressedImage {
+	// GL compressed internal format of the blocks, or GL_RGBA8 for plain
+	// texels
+	unsigned int internalFormat;
+	// Size of level 0 in pixels
+	int width, height;
+	// 1 for a 2D texture, 6 for a cubemap
+	int numFaces;
+	// Blocks of every level, largest first. The faces of a level follow each
+	// other in GL_TEXTURE_CUBE_MAP_POSITIVE_X order
+	std::vector<std::vector<unsigned char>> levels;
+};
+
+namespace compressedTexture {
+	// Appended to the source path to get the path of the cache
+	const char* const CACHE_EXTENSION = ".ktx";
+
+	/// <summary>
+	/// Lets textures be compressed to BC7 where the driver takes it. Slower
+	/// to compress, but better looking than BC1 and BC3. Textures cached in
+	/// the other formats are compressed again
+	/// </summary>
+	/// <param name="enabled"> whether to use BC7 </param>
+	void setBC7Enabled(bool enabled);
+
+	/// <summary>
+	/// Whether the driver takes BC1 and BC3 textures. Render thread only
+	/// </summary>
+	bool isSupported();
+
+	/// <summary>
+	/// Loads a texture from its cache on the worker pool, or builds the mip
+	/// chains of the sources, compresses them and writes the cache when it is
+	/// missing or out of date, then queues the upload. Render thread only
+	/// </summary>
+	/// <param name="sources"> file path names of the images. One for a 2D
+	/// texture, six in face order for a cubemap </param>
+	/// <param name="cachePath"> file path name of the cache </param>
+	/// <param name="token"> the upload is skipped once this is cancelled </param>
+	/// <param name="upload"> called on the render thread with the levels </param>
+	/// <returns> False if there are no sources, in which case nothing is
+	/// loaded </returns>
+	bool loadAsync(const std::vector<std::string>& sources,
+		const std::string& cachePath, std::shared_ptr<LoadToken> token,
+		std::function<void(const CompressedImage&)> upload);
+
+	/// <summary>
+	/// Fills a texture with every level of an image and limits sampling to
+	/// them. Binds the texture to GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP by the
+	/// number of faces. Render thread only
+	/// </summary>
+	/// <param name="image"> compressed image </param>
+	/// <param name="texture"> GL texture to fill </param>
+	void upload(const CompressedImage& image, unsigned int texture);
+
+	/// <summary>
+	/// Reads a cache file written for the same sources
+	/// </summary>
+	/// <param name="cachePath"> file path name of the cache </param>
+	/// <param name="stamp"> stamp of the sources the cache must match </param>
+	/// <param name="image"> Stores the image </param>
+	/// <returns> True if the cache exists and is valid, Otherwise false
+	/// </returns>
+	bool readCache(const std::string& cachePath, const std::string& stamp,
+		CompressedImage& image);
+
+	/// <summary>
+	/// Writes an image to a cache file, replacing the old one in one step
+	/// </summary>
+	/// <param name="cachePath"> file path name of the cache </param>
+	/// <param name="stamp"> stamp of the sources, checked by readCache </param>
+	/// <param name="image"> compressed image </param>
+	/// <returns> True if successful, Otherwise false </returns>
+	bool writeCache(const std::string& cachePath, const std::string& stamp,
+		const CompressedImage& image);
+}
@@ -0,0 +1,150 @@
+#include "Frustum.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FRUSTUM_X86
+#include <xmmintrin.h>
+#endif
+
+namespace {
+	/// <summary>
+	/// Constants of one cullBoxes call, and the scalar test of one box
+	/// </summary>
+	struct BoxTest {
+		const glm::vec4* planes;
+		glm::vec3 eye;
+		// Squares of the projection scale and the least coverage, so the
+		// size test needs no square roots
+		float scaleSquared, coverageSquared;
+
+		bool keep(const frustum::Boxes& boxes, size_t i) const {
+			glm::vec3 min(boxes.minX[i], boxes.minY[i], boxes.minZ[i]);
+			glm::vec3 max(boxes.maxX[i], boxes.maxY[i], boxes.maxZ[i]);
+			// The corner furthest along a plane's normal is the last one to
+			// leave through it
+			for (int p = 0; p < 6; ++p) {
+				const glm::vec4& plane = planes[p];
+				glm::vec3 corner(plane.x >= 0.0f ? max.x : min.x,
+					plane.y >= 0.0f ? max.y : min.y,
+					plane.z >= 0.0f ? max.z : min.z);
+				if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+					return false;
+			}
+			glm::vec3 halfSize = 0.5f * (max - min);
+			glm::vec3 offset = 0.5f * (min + max) - eye;
+			return glm::dot(halfSize, halfSize) * scaleSquared >=
+				glm::dot(offset, offset) * coverageSquared;
+		}
+	};
+}
+
+void frustum::Boxes::clear() {
+	minX.clear();
+	minY.clear();
+	minZ.clear();
+	maxX.clear();
+	maxY.clear();
+	maxZ.clear();
+}
+
+void frustum::Boxes::add(const glm::vec3& min, const glm::vec3& max) {
+	minX.push_back(min.x);
+	minY.push_back(min.y);
+	minZ.push_back(min.z);
+	maxX.push_back(max.x);
+	maxY.push_back(max.y);
+	maxZ.push_back(max.z);
+}
+
+void frustum::extractPlanes(const glm::mat4& clip, glm::vec4 planes[6]) {
+	// Each plane is the last row plus or minus one of the others. glm is
+	// column major, so rows are gathered across the columns
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; ++i)
+		rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[3] + rows[2];
+	planes[5] = rows[3] - rows[2];
+	for (int i = 0; i < 6; ++i) {
+		float length = glm::length(glm::vec3(planes[i]));
+		if (length > 0.0f)
+			planes[i] /= length;
+	}
+}
+
+size_t frustum::cullBoxes(const glm::vec4 planes[6], const glm::vec3& eye,
+	float projectionScale, float minCoverage, const Boxes& boxes,
+	unsigned char* visible) {
+	BoxTest test;
+	test.planes = planes;
+	test.eye = eye;
+	test.scaleSquared = projectionScale * projectionScale;
+	test.coverageSquared = minCoverage * minCoverage;
+	size_t count = boxes.size();
+	size_t numCulled = 0;
+	size_t i = 0;
+
+#ifdef FRUSTUM_X86
+	// A plane picks the same corner for every box, so each lane only loads
+	// the components of that corner
+	const float* corners[6][3];
+	for (int p = 0; p < 6; ++p) {
+		corners[p][0] = planes[p].x >= 0.0f ? boxes.maxX.data() : boxes.minX.data();
+		corners[p][1] = planes[p].y >= 0.0f ? boxes.maxY.data() : boxes.minY.data();
+		corners[p][2] = planes[p].z >= 0.0f ? boxes.maxZ.data() : boxes.minZ.data();
+	}
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 scaleSquared = _mm_set1_ps(test.scaleSquared);
+	const __m128 coverageSquared = _mm_set1_ps(test.coverageSquared);
+	const __m128 eyeX = _mm_set1_ps(eye.x);
+	const __m128 eyeY = _mm_set1_ps(eye.y);
+	const __m128 eyeZ = _mm_set1_ps(eye.z);
+	for (; i + 4 <= count; i += 4) {
+		// All bits set, for every lane
+		__m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+		for (int p = 0; p < 6; ++p) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_set1_ps(planes[p].x), _mm_loadu_ps(corners[p][0] + i)),
+				_mm_mul_ps(_mm_set1_ps(planes[p].y), _mm_loadu_ps(corners[p][1] + i))),
+				_mm_add_ps(
+				_mm_mul_ps(_mm_set1_ps(planes[p].z), _mm_loadu_ps(corners[p][2] + i)),
+				_mm_set1_ps(planes[p].w)));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+		}
+
+		__m128 minX = _mm_loadu_ps(boxes.minX.data() + i);
+		__m128 minY = _mm_loadu_ps(boxes.minY.data() + i);
+		__m128 minZ = _mm_loadu_ps(boxes.minZ.data() + i);
+		__m128 maxX = _mm_loadu_ps(boxes.maxX.data() + i);
+		__m128 maxY = _mm_loadu_ps(boxes.maxY.data() + i);
+		__m128 maxZ = _mm_loadu_ps(boxes.maxZ.data() + i);
+		__m128 halfX = _mm_mul_ps(half, _mm_sub_ps(maxX, minX));
+		__m128 halfY = _mm_mul_ps(half, _mm_sub_ps(maxY, minY));
+		__m128 halfZ = _mm_mul_ps(half, _mm_sub_ps(maxZ, minZ));
+		__m128 offsetX = _mm_sub_ps(_mm_mul_ps(half, _mm_add_ps(minX, maxX)), eyeX);
+		__m128 offsetY = _mm_sub_ps(_mm_mul_ps(half, _mm_add_ps(minY, maxY)), eyeY);
+		__m128 offsetZ = _mm_sub_ps(_mm_mul_ps(half, _mm_add_ps(minZ, maxZ)), eyeZ);
+		__m128 radiusSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(halfX, halfX),
+			_mm_mul_ps(halfY, halfY)), _mm_mul_ps(halfZ, halfZ));
+		__m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(offsetX, offsetX),
+			_mm_mul_ps(offsetY, offsetY)), _mm_mul_ps(offsetZ, offsetZ));
+		inside = _mm_and_ps(inside, _mm_cmpge_ps(
+			_mm_mul_ps(radiusSquared, scaleSquared),
+			_mm_mul_ps(distanceSquared, coverageSquared)));
+
+		int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; ++lane) {
+			visible[i + lane] = (unsigned char)((mask >> lane) & 1);
+			numCulled += 1 - visible[i + lane];
+		}
+	}
+#endif
+	for (; i < count; ++i) {
+		visible[i] = test.keep(boxes, i) ? 1 : 0;
+		numCulled += 1 - visible[i];
+	}
+	return numCulled;
+}
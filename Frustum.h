@@ -0,0 +1,80 @@
+/*  View frustum planes pulled out of a clip matrix, and the tests culling
+    runs against them
+    - RAB
+ */
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+namespace frustum {
+	// Least share of the screen's half height the bounding sphere of a mesh
+	// covers to be drawn. About a pixel at 1080 lines
+	const float MIN_SCREEN_COVERAGE = 0.001f;
+
+	/// <summary>
+	/// Boxes kept as one array per corner component, so the culling kernel
+	/// loads the same component of four boxes at once
+	/// </summary>
+	struct Boxes {
+		std::vector<float> minX, minY, minZ;
+		std::vector<float> maxX, maxY, maxZ;
+
+		void clear();
+		void add(const glm::vec3& min, const glm::vec3& max);
+		size_t size() const { return minX.size(); }
+	};
+
+	/// <summary>
+	/// Extracts the six planes of the frustum a matrix clips against. Each
+	/// plane is (n, d) with n of unit length pointing inwards, so points with
+	/// dot(n, p) + d < 0 are outside. The planes are in whatever space the
+	/// matrix takes to clip space, so passing projection * view * model gives
+	/// planes in the model's own space
+	/// </summary>
+	/// <param name="clip"> matrix to clip space </param>
+	/// <param name="planes"> Stores left, right, bottom, top, near and far
+	/// </param>
+	void extractPlanes(const glm::mat4& clip, glm::vec4 planes[6]);
+
+	/// <summary>
+	/// Checks whether a sphere touches the frustum. Spheres near a corner may
+	/// pass while being outside, never the other way round
+	/// </summary>
+	/// <param name="planes"> planes from extractPlanes </param>
+	/// <param name="center"> center of the sphere </param>
+	/// <param name="radius"> radius of the sphere </param>
+	/// <returns> False if the sphere is certainly outside </returns>
+	inline bool intersectsSphere(const glm::vec4 planes[6],
+		const glm::vec3& center, float radius) {
+		for (int i = 0; i < 6; ++i) {
+			if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+				return false;
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Tests boxes against the frustum four at a time, and against a least
+	/// size on screen. A box is kept if it touches the frustum and the sphere
+	/// around it covers at least minCoverage of the screen's half height,
+	/// which is radius * projectionScale / distance. Like intersectsSphere,
+	/// boxes near a corner may be kept while being outside
+	/// </summary>
+	/// <param name="planes"> planes from extractPlanes, in the boxes' space
+	/// </param>
+	/// <param name="eye"> camera position the distances are measured from
+	/// </param>
+	/// <param name="projectionScale"> projection[1][1] of the camera </param>
+	/// <param name="minCoverage"> least size on screen. 0 keeps boxes of any
+	/// size, which suits passes without a perspective camera </param>
+	/// <param name="boxes"> boxes to test </param>
+	/// <param name="visible"> Stores 1 for every box kept and 0 for every box
+	/// culled. Holds boxes.size() entries </param>
+	/// <returns> Number of boxes culled </returns>
+	size_t cullBoxes(const glm::vec4 planes[6], const glm::vec3& eye,
+		float projectionScale, float minCoverage, const Boxes& boxes,
+		unsigned char* visible);
+}
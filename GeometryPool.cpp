@@ -0,0 +1,288 @@
+#include "GeometryPool.h"
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <iostream>
+
+namespace {
+	// Sizes the buffers start at, in elements. They double whenever they run
+	// out of space
+	const size_t INITIAL_VERTICES = 1 << 16;
+	const size_t INITIAL_INDICES = 3 << 16;
+
+	const TLSFAllocator::Allocation NO_RANGE = { 0, 0, TLSFAllocator::INVALID_BLOCK };
+}
+
+GeometryPool::GeometryPool(size_t vertexSize, AttributeSetup setupAttributes,
+	size_t indexSize)
+	: vertexSize(vertexSize), indexSize(indexSize),
+	  setupAttributes(setupAttributes), VAO(0), VBO(0), EBO(0) {}
+
+size_t GeometryPool::elementSize(bool indices) const {
+	return indices ? indexSize : vertexSize;
+}
+
+unsigned int GeometryPool::indexType() const {
+	return indexSize == sizeof(unsigned short) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+void GeometryPool::createBuffers() {
+	if (VAO != 0)
+		return;
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &VBO);
+	glGenBuffers(1, &EBO);
+
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, INITIAL_VERTICES * vertexSize, nullptr,
+		GL_STATIC_DRAW);
+	setupAttributes();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, INITIAL_INDICES * indexSize, nullptr,
+		GL_STATIC_DRAW);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	vertexSpace.reset(INITIAL_VERTICES);
+	indexSpace.reset(INITIAL_INDICES);
+}
+
+GeometryPool::Handle GeometryPool::create() {
+	createBuffers();
+	Handle handle;
+	if (!unusedSlots.empty()) {
+		handle = unusedSlots.back();
+		unusedSlots.pop_back();
+	}
+	else {
+		handle = (Handle)slots.size();
+		slots.push_back(Slot());
+	}
+	slots[handle].vertices = NO_RANGE;
+	slots[handle].indices = NO_RANGE;
+	slots[handle].used = true;
+	return handle;
+}
+
+void GeometryPool::release(Handle handle) {
+	if (handle >= slots.size() || !slots[handle].used)
+		return;
+	Slot& slot = slots[handle];
+	vertexSpace.free(slot.vertices);
+	indexSpace.free(slot.indices);
+	slot.vertices = NO_RANGE;
+	slot.indices = NO_RANGE;
+	slot.used = false;
+	unusedSlots.push_back(handle);
+}
+
+void GeometryPool::allocate(bool indices, size_t size,
+	TLSFAllocator::Allocation& allocation) {
+	TLSFAllocator& space = indices ? indexSpace : vertexSpace;
+	if (space.allocate(size, allocation))
+		return;
+
+	// Pack the buffer if there is enough free space in total, otherwise grow
+	// it. Either way the free space ends up as one range at the end
+	size_t capacity = space.getCapacity();
+	size_t used = capacity - space.getFreeSize();
+	if (capacity - used < size)
+		capacity = std::max(2 * capacity, used + size);
+	relocate(indices, capacity);
+	space.allocate(size, allocation);
+}
+
+void GeometryPool::relocate(bool indices, size_t newCapacity) {
+	TLSFAllocator& space = indices ? indexSpace : vertexSpace;
+	unsigned int& buffer = indices ? EBO : VBO;
+	size_t size = elementSize(indices);
+
+	unsigned int newBuffer;
+	glGenBuffers(1, &newBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * size, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+
+	// Keep the ranges in buffer order. A fresh allocator hands out
+	// consecutive ranges, so they end up packed
+	std::vector<TLSFAllocator::Allocation*> live;
+	for (auto& slot : slots) {
+		TLSFAllocator::Allocation& range = indices ? slot.indices : slot.vertices;
+		if (slot.used && range.block != TLSFAllocator::INVALID_BLOCK)
+			live.push_back(&range);
+	}
+	std::sort(live.begin(), live.end(),
+		[](const TLSFAllocator::Allocation* a, const TLSFAllocator::Allocation* b) {
+		return a->offset < b->offset;
+	});
+	space.reset(newCapacity);
+	for (TLSFAllocator::Allocation* range : live) {
+		TLSFAllocator::Allocation moved;
+		space.allocate(range->size, moved);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+			range->offset * size, moved.offset * size, range->size * size);
+		*range = moved;
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &buffer);
+	buffer = newBuffer;
+
+	// Point the vertex array at the new buffer
+	glBindVertexArray(VAO);
+	if (indices) {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	}
+	else {
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		setupAttributes();
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	glBindVertexArray(0);
+
+	std::cout << "Geometry pool " << (indices ? "index" : "vertex");
+	std::cout << " buffer holds " << newCapacity << " elements\n";
+}
+
+void GeometryPool::resizeVertices(Handle handle, size_t numVertices) {
+	vertexSpace.free(slots[handle].vertices);
+	slots[handle].vertices = NO_RANGE;
+	if (numVertices == 0)
+		return;
+	// Relocating may move other ranges, so only store the range afterwards
+	TLSFAllocator::Allocation range;
+	allocate(false, numVertices, range);
+	slots[handle].vertices = range;
+}
+
+void GeometryPool::resizeIndices(Handle handle, size_t numIndices) {
+	indexSpace.free(slots[handle].indices);
+	slots[handle].indices = NO_RANGE;
+	if (numIndices == 0)
+		return;
+	TLSFAllocator::Allocation range;
+	allocate(true, numIndices, range);
+	slots[handle].indices = range;
+}
+
+void* GeometryPool::mapVertices(Handle handle) {
+	const TLSFAllocator::Allocation& range = slots[handle].vertices;
+	if (range.block == TLSFAllocator::INVALID_BLOCK)
+		return nullptr;
+	// Only this range is invalidated. The rest of the buffer is still drawn
+	glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+	return glMapBufferRange(GL_COPY_WRITE_BUFFER, range.offset * vertexSize,
+		range.size * vertexSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+bool GeometryPool::unmapVertices() {
+	glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+	bool intact = glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_TRUE;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return intact;
+}
+
+void* GeometryPool::mapIndices(Handle handle) {
+	const TLSFAllocator::Allocation& range = slots[handle].indices;
+	if (range.block == TLSFAllocator::INVALID_BLOCK)
+		return nullptr;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+	return glMapBufferRange(GL_COPY_WRITE_BUFFER, range.offset * indexSize,
+		range.size * indexSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+bool GeometryPool::unmapIndices() {
+	glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+	bool intact = glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_TRUE;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return intact;
+}
+
+size_t GeometryPool::getIndexCount(Handle handle) const {
+	return slots[handle].indices.size;
+}
+
+size_t GeometryPool::getUsedBytes() const {
+	if (VAO == 0)
+		return 0;
+	return (vertexSpace.getCapacity() - vertexSpace.getFreeSize()) * vertexSize +
+		(indexSpace.getCapacity() - indexSpace.getFreeSize()) * indexSize;
+}
+
+void GeometryPool::bind() const {
+	glBindVertexArray(VAO);
+}
+
+void GeometryPool::unbind() const {
+	glBindVertexArray(0);
+}
+
+void GeometryPool::draw(Handle handle) const {
+	const Slot& slot = slots[handle];
+	if (slot.indices.size == 0 || slot.vertices.size == 0)
+		return;
+	glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)slot.indices.size,
+		indexType(), (void*)(slot.indices.offset * indexSize),
+		(GLint)slot.vertices.offset);
+}
+
+void GeometryPool::draw(Handle handle, size_t firstIndex,
+	size_t numIndices) const {
+	const Slot& slot = slots[handle];
+	if (slot.vertices.size == 0 || firstIndex >= slot.indices.size)
+		return;
+	numIndices = std::min(numIndices, slot.indices.size - firstIndex);
+	glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)numIndices, indexType(),
+		(void*)((slot.indices.offset + firstIndex) * indexSize),
+		(GLint)slot.vertices.offset);
+}
+
+void GeometryPool::draw(Handle handle, const IndexRange* ranges,
+	size_t numRanges) const {
+	const Slot& slot = slots[handle];
+	if (slot.vertices.size == 0 || numRanges == 0)
+		return;
+	drawCounts.resize(numRanges);
+	drawOffsets.resize(numRanges);
+	drawBaseVertices.assign(numRanges, (int)slot.vertices.offset);
+	for (size_t i = 0; i < numRanges; ++i) {
+		drawCounts[i] = (int)ranges[i].numIndices;
+		drawOffsets[i] = (const void*)((slot.indices.offset + ranges[i].firstIndex) *
+			indexSize);
+	}
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), indexType(),
+		drawOffsets.data(), (GLsizei)numRanges, drawBaseVertices.data());
+}
+void GeometryPool::drawInstanced(Handle handle, size_t firstIndex,
+	size_t numIndices, size_t numInstances) const {
+	const Slot& slot = slots[handle];
+	if (slot.vertices.size == 0 || firstIndex >= slot.indices.size ||
+		numInstances == 0)
+		return;
+	numIndices = std::min(numIndices, slot.indices.size - firstIndex);
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)numIndices,
+		indexType(), (void*)((slot.indices.offset + firstIndex) * indexSize),
+		(GLsizei)numInstances, (GLint)slot.vertices.offset);
+}
+
+void GeometryPool::defragment() {
+	if (VAO == 0)
+		return;
+	relocate(false, vertexSpace.getCapacity());
+	relocate(true, indexSpace.getCapacity());
+}
+
+void GeometryPool::destroy() {
+	if (VAO != 0) {
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		glDeleteVertexArrays(1, &VAO);
+	}
+	VAO = VBO = EBO = 0;
+	slots.clear();
+	unusedSlots.clear();
+	vertexSpace.reset(0);
+	indexSpace.reset(0);
+}
@@ -0,0 +1,225 @@
+/*  Holds the geometry of many meshes in one large vertex buffer and one
+    large index buffer, with one vertex array for all of them. Meshes own
+    ranges of the buffers handed out by a TLSFAllocator and are drawn with
+    glDrawElementsBaseVertex, so drawing them back to back needs no binds
+    - RAB
+ */
+#pragma once
+
+#include <vector>
+
+#include "TLSFAllocator.h"
+
+class GeometryPool {
+public:
+	// Identifies the ranges of one mesh. Stays valid when the buffers grow or
+	// are defragmented, which moves the ranges
+	typedef unsigned int Handle;
+	static const Handle INVALID_HANDLE = ~0u;
+
+	// Sets the vertex attributes of the format with the pool's vertex buffer
+	// bound to GL_ARRAY_BUFFER
+	typedef void (*AttributeSetup)();
+
+	// Part of a mesh's indices, relative to the mesh's first index
+	struct IndexRange {
+		unsigned int firstIndex;
+		unsigned int numIndices;
+	};
+
+private:
+	struct Slot {
+		TLSFAllocator::Allocation vertices;
+		TLSFAllocator::Allocation indices;
+		bool used;
+	};
+
+	size_t vertexSize;
+	// Bytes per index. 2 or 4
+	size_t indexSize;
+	AttributeSetup setupAttributes;
+	unsigned int VAO, VBO, EBO;
+	TLSFAllocator vertexSpace, indexSpace;
+	std::vector<Slot> slots;
+	std::vector<Handle> unusedSlots;
+	// Arrays for glMultiDrawElementsBaseVertex, kept between draws so they
+	// are not allocated every frame
+	mutable std::vector<int> drawCounts;
+	mutable std::vector<const void*> drawOffsets;
+	mutable std::vector<int> drawBaseVertices;
+
+	/// <summary>
+	/// Creates the buffers and vertex array on first use
+	/// </summary>
+	void createBuffers();
+
+	/// <summary>
+	/// Allocates a range of the vertex or index buffer, defragmenting or
+	/// growing the buffer when no free range is big enough
+	/// </summary>
+	/// <param name="indices"> True for the index buffer, false for the
+	/// vertex buffer </param>
+	/// <param name="size"> size of the range in elements </param>
+	/// <param name="allocation"> Set to the range </param>
+	void allocate(bool indices, size_t size, TLSFAllocator::Allocation& allocation);
+
+	/// <summary>
+	/// Moves the live ranges of a buffer to the front of a new buffer, in
+	/// order, and frees the old buffer
+	/// </summary>
+	/// <param name="indices"> True for the index buffer, false for the
+	/// vertex buffer </param>
+	/// <param name="newCapacity"> size of the new buffer in elements </param>
+	void relocate(bool indices, size_t newCapacity);
+
+	// Size in bytes of one element of either buffer
+	size_t elementSize(bool indices) const;
+
+	// GL type of the indices
+	unsigned int indexType() const;
+
+public:
+	/// <summary>
+	/// Creates an empty pool for one vertex format. No GL objects are made
+	/// until the first allocation
+	/// </summary>
+	/// <param name="vertexSize"> size of one vertex in bytes </param>
+	/// <param name="setupAttributes"> sets the attributes of the format
+	/// </param>
+	/// <param name="indexSize"> size of one index in bytes. 2 for unsigned
+	/// shorts, 4 for unsigned ints </param>
+	/// <returns> N/A </returns>
+	GeometryPool(size_t vertexSize, AttributeSetup setupAttributes,
+		size_t indexSize = sizeof(unsigned int));
+
+	GeometryPool(const GeometryPool&) = delete;
+	GeometryPool& operator=(const GeometryPool&) = delete;
+
+	/// <summary>
+	/// Creates a mesh without any geometry
+	/// </summary>
+	/// <returns> Handle of the mesh </returns>
+	Handle create();
+
+	/// <summary>
+	/// Frees the ranges of a mesh. The handle is invalid afterwards
+	/// </summary>
+	/// <param name="handle"> mesh to free </param>
+	void release(Handle handle);
+
+	/// <summary>
+	/// Gives a mesh a new vertex range. The old one is freed, with its data
+	/// </summary>
+	/// <param name="handle"> mesh </param>
+	/// <param name="numVertices"> size of the new range </param>
+	void resizeVertices(Handle handle, size_t numVertices);
+
+	/// <summary>
+	/// Gives a mesh a new index range. The old one is freed, with its data
+	/// </summary>
+	/// <param name="handle"> mesh </param>
+	/// <param name="numIndices"> size of the new range </param>
+	void resizeIndices(Handle handle, size_t numIndices);
+
+	/// <summary>
+	/// Maps a mesh's vertex range for writing. The only way geometry gets
+	/// into the pool, so it can be converted straight into the buffer. Unmap
+	/// before anything else touches the pool
+	/// </summary>
+	/// <param name="handle"> mesh </param>
+	/// <returns> Write-only pointer to the range, nullptr if mapping failed
+	/// or the range is empty </returns>
+	void* mapVertices(Handle handle);
+
+	/// <summary>
+	/// Unmaps the range mapped by mapVertices
+	/// </summary>
+	/// <returns> True if successful, False if the driver lost the data </returns>
+	bool unmapVertices();
+
+	/// <summary>
+	/// Maps a mesh's index range for writing. Indices are relative to the
+	/// mesh's first vertex. Unmap before anything else touches the pool
+	/// </summary>
+	/// <param name="handle"> mesh </param>
+	/// <returns> Write-only pointer to the range, nullptr if mapping failed
+	/// or the range is empty </returns>
+	void* mapIndices(Handle handle);
+
+	/// <summary>
+	/// Unmaps the range mapped by mapIndices
+	/// </summary>
+	/// <returns> True if successful, False if the driver lost the data </returns>
+	bool unmapIndices();
+
+	/// <summary>
+	/// Gets the number of indices of a mesh
+	/// </summary>
+	size_t getIndexCount(Handle handle) const;
+
+	/// <summary>
+	/// Gets the bytes of both buffers taken up by meshes
+	/// </summary>
+	size_t getUsedBytes() const;
+
+	/// <summary>
+	/// Binds the shared vertex array. Every draw until unbind uses it
+	/// </summary>
+	void bind() const;
+
+	/// <summary>
+	/// Unbinds the shared vertex array
+	/// </summary>
+	void unbind() const;
+
+	/// <summary>
+	/// Draws a mesh as triangles. The pool must be bound
+	/// </summary>
+	/// <param name="handle"> mesh to draw </param>
+	void draw(Handle handle) const;
+
+	/// <summary>
+	/// Draws part of a mesh's indices as triangles, such as one level of
+	/// detail. The pool must be bound
+	/// </summary>
+	/// <param name="handle"> mesh to draw </param>
+	/// <param name="firstIndex"> first index of the part, relative to the
+	/// mesh </param>
+	/// <param name="numIndices"> number of indices to draw </param>
+	void draw(Handle handle, size_t firstIndex, size_t numIndices) const;
+
+	/// <summary>
+	/// Draws several parts of a mesh's indices with one multi-draw call,
+	/// such as the clusters that survived culling. The pool must be bound
+	/// </summary>
+	/// <param name="handle"> mesh to draw </param>
+	/// <param name="ranges"> parts to draw. Must lie within the mesh's
+	/// indices </param>
+	/// <param name="numRanges"> number of parts </param>
+	void draw(Handle handle, const IndexRange* ranges, size_t numRanges) const;
+
+	/// <summary>
+	/// Draws part of a mesh's indices several times with one instanced draw
+	/// call. The pool must be bound
+	/// </summary>
+	/// <param name="handle"> mesh to draw </param>
+	/// <param name="firstIndex"> first index of the part, relative to the
+	/// mesh </param>
+	/// <param name="numIndices"> number of indices to draw </param>
+	/// <param name="numInstances"> number of copies to draw </param>
+	void drawInstanced(Handle handle, size_t firstIndex, size_t numIndices,
+		size_t numInstances) const;
+
+	/// <summary>
+	/// Packs every live range to the front of its buffer, so the free space
+	/// is one range at the end. Runs by itself when an allocation fails
+	/// although enough space is free
+	/// </summary>
+	void defragment();
+
+	/// <summary>
+	/// Deletes the GL objects and forgets every mesh. Call once nothing draws
+	/// from the pool any more, while the GL context is still current
+	/// </summary>
+	void destroy();
+};
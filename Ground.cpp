@@ -1,7 +1,8 @@
 #include "Ground.h"
 
 #include <iostream>
-#include "stb_image.h"
+
+#include "CompressedTexture.h"
 
 const Vertex Ground::vertices[4] = {
 	// ll
@@ -18,7 +19,8 @@ const glm::ivec3 Ground::indices[2] = {
 	glm::ivec3(3, 2, 0)
 };
 
-Ground::Ground() : Object(renderType::TEXTURE_WRAP) {
+Ground::Ground()
+	: Object(renderType::TEXTURE_WRAP), loadToken(std::make_shared<LoadToken>()) {
 	load("Models/wood.png");
 
 	numTiles = 50;
@@ -53,6 +55,7 @@ Ground::Ground() : Object(renderType::TEXTURE_WRAP) {
 	glBindVertexArray(0);
 }
 Ground::~Ground() {
+	loadToken->cancelled = true;
 	glDeleteBuffers(1, &VBO);
 	glDeleteBuffers(1, &EBO);
 	glDeleteVertexArrays(1, &VAO);
@@ -60,28 +63,23 @@ Ground::~Ground() {
 }
 
 bool Ground::load(const char* path) {
-	int width, height, nrChannels;
-	unsigned char* data;
-	if (!(data = stbi_load(path, &width, &height, &nrChannels, 0))) {
-		std::cout << "Texture at path: " << path << " failed to load!\n";
-		stbi_image_free(data);
-		return false;
-	}
-	
 	glGenTextures(1, &texID);
 	glBindTexture(GL_TEXTURE_2D, texID);
-	
-	// Use the data to create a texture
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, 
-		         GL_UNSIGNED_BYTE, data);
-	stbi_image_free(data);
-
-	glGenerateMipmap(GL_TEXTURE_2D);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	return true;
+
+	// Loaded on the worker pool. The ground draws untextured until the
+	// render thread uploads the image. Its mip chain is built on the CPU,
+	// block compressed where the driver takes it and cached next to the image
+	GLuint texture = texID;
+	std::vector<std::string> sources = { path };
+	return compressedTexture::loadAsync(sources,
+		std::string(path) + compressedTexture::CACHE_EXTENSION, loadToken,
+		[texture](const CompressedImage& image) {
+		compressedTexture::upload(image, texture);
+	});
 }
 
 void Ground::draw(const Shader& program, glm::mat4 view, glm::mat4 projection) {
@@ -91,6 +89,8 @@ void Ground::draw(const Shader& program, glm::mat4 view, glm::mat4 projection) {
 	program.use();
 	setShaderToRenderType(program);
 	program.setInt("numTiles", numTiles);
+	// Meshes drawn before may have left the shader decoding packed vertices
+	program.setInt("vertexFormat", 0);
 	program.setMat4("model", model);
 	program.setMat4("view", view);
 	program.setMat4("projection", projection);
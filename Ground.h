@@ -7,6 +7,9 @@
 
 #include <glad/glad.h>
 
+#include <memory>
+
+#include "AsyncLoader.h"
 #include "Object.h"
 
 // Struct is defined at Mesh.h (should move later)
@@ -20,6 +23,8 @@ class Ground : public Object
 	
 	// Buffer/Array object IDs
     GLuint VAO, VBO, EBO, texID;
+	// Cancelled on deletion so a texture upload still queued is dropped
+	std::shared_ptr<LoadToken> loadToken;
 
 	// For tiling the ground
 	int numTiles;
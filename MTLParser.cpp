@@ -0,0 +1,166 @@
+#include "MTLParser.h"
+
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include "MappedFile.h"
+#include "NumberParser.h"
+
+namespace {
+	const int VEC_3_NUM_COMPONENTS = 3;
+
+	inline bool isBlank(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline void skipBlanks(const char*& p, const char* end) {
+		while (p < end && isBlank(*p))
+			++p;
+	}
+
+	/// <summary>
+	/// Consumes a keyword if the line starts with it as a whole word
+	/// </summary>
+	/// <param name="p"> Read position. Moved past the keyword on a match
+	/// </param>
+	/// <param name="lineEnd"> end of the line </param>
+	/// <param name="keyword"> keyword to match </param>
+	/// <returns> True if the keyword matched, False if otherwise </returns>
+	bool matchKeyword(const char*& p, const char* lineEnd, const char* keyword) {
+		size_t length = strlen(keyword);
+		if ((size_t)(lineEnd - p) < length || memcmp(p, keyword, length) != 0)
+			return false;
+		if (p + length < lineEnd && !isBlank(p[length]))
+			return false;
+		p += length;
+		return true;
+	}
+
+	/// <summary>
+	/// Gets the rest of the line without surrounding blanks
+	/// </summary>
+	std::string restOfLine(const char* p, const char* lineEnd) {
+		skipBlanks(p, lineEnd);
+		while (lineEnd > p && isBlank(lineEnd[-1]))
+			--lineEnd;
+		return std::string(p, lineEnd);
+	}
+
+	/// <summary>
+	/// Gets the file name of a map_ statement. Options such as -bm or -s come
+	/// first, so the file name is the last word on the line
+	/// </summary>
+	std::string mapFileName(const char* p, const char* lineEnd) {
+		while (lineEnd > p && isBlank(lineEnd[-1]))
+			--lineEnd;
+		const char* nameBegin = lineEnd;
+		while (nameBegin > p && !isBlank(nameBegin[-1]))
+			--nameBegin;
+		return std::string(nameBegin, lineEnd);
+	}
+
+	/// <summary>
+	/// Reads an r [g b] color. A lone r applies to all three channels. The
+	/// spectral and xyz forms are not supported and leave the color as is
+	/// </summary>
+	void scanColor(const char* p, const char* lineEnd, glm::vec3& color) {
+		glm::vec3 value;
+		size_t numRead = numberParser::parseFloats(p, lineEnd, &value[0],
+			VEC_3_NUM_COMPONENTS);
+		if (numRead == VEC_3_NUM_COMPONENTS)
+			color = value;
+		else if (numRead == 1)
+			color = glm::vec3(value[0]);
+	}
+
+	void scanFloat(const char* p, const char* lineEnd, float& value) {
+		float parsed;
+		if (numberParser::parseFloat(p, lineEnd, parsed))
+			value = parsed;
+	}
+}
+
+bool mtlParser::parse(const char* path, const MTLMaterial& defaults,
+	std::vector<MTLMaterial>& materials) {
+	MappedFile file(path);
+	if (!file.isOpen()) {
+		std::cout << "Failed to read material library " << path << std::endl;
+		return false;
+	}
+
+	// Texture maps are named relative to the library
+	std::string directory = std::filesystem::path(path).parent_path().generic_string();
+	if (!directory.empty())
+		directory += '/';
+	return parseBuffer(file.begin(), file.end(), directory, defaults, materials);
+}
+
+bool mtlParser::parseBuffer(const char* begin, const char* end,
+	const std::string& directory, const MTLMaterial& defaults,
+	std::vector<MTLMaterial>& materials) {
+	MTLMaterial* material = nullptr;
+
+	for (const char* p = begin; p < end;) {
+		const char* newline = (const char*)memchr(p, '\n', end - p);
+		const char* lineEnd = newline ? newline : end;
+		const char* next = newline ? newline + 1 : end;
+		skipBlanks(p, lineEnd);
+
+		if (matchKeyword(p, lineEnd, "newmtl")) {
+			materials.push_back(defaults);
+			material = &materials.back();
+			material->name = restOfLine(p, lineEnd);
+			p = next;
+			continue;
+		}
+		// Everything else describes the current material, so statements
+		// before the first newmtl are dropped along with comments
+		if (material == nullptr) {
+			p = next;
+			continue;
+		}
+
+		if (matchKeyword(p, lineEnd, "Ka"))
+			scanColor(p, lineEnd, material->ambient);
+		else if (matchKeyword(p, lineEnd, "Kd"))
+			scanColor(p, lineEnd, material->diffuse);
+		else if (matchKeyword(p, lineEnd, "Ks"))
+			scanColor(p, lineEnd, material->specular);
+		else if (matchKeyword(p, lineEnd, "Tf"))
+			scanColor(p, lineEnd, material->transmissionFilter);
+		else if (matchKeyword(p, lineEnd, "Ns"))
+			scanFloat(p, lineEnd, material->shininess);
+		else if (matchKeyword(p, lineEnd, "Ni"))
+			scanFloat(p, lineEnd, material->opticalDensity);
+		else if (matchKeyword(p, lineEnd, "d"))
+			scanFloat(p, lineEnd, material->dissolve);
+		else if (matchKeyword(p, lineEnd, "Tr")) {
+			float transparency = 1.0f - material->dissolve;
+			scanFloat(p, lineEnd, transparency);
+			material->dissolve = 1.0f - transparency;
+		}
+		else if (matchKeyword(p, lineEnd, "illum")) {
+			int model;
+			if (numberParser::parseInt(p, lineEnd, model))
+				material->illuminationModel = model;
+		}
+		else if (matchKeyword(p, lineEnd, "map_Ka"))
+			material->ambientMap = directory + mapFileName(p, lineEnd);
+		else if (matchKeyword(p, lineEnd, "map_Kd"))
+			material->diffuseMap = directory + mapFileName(p, lineEnd);
+		else if (matchKeyword(p, lineEnd, "map_Ks"))
+			material->specularMap = directory + mapFileName(p, lineEnd);
+		else if (matchKeyword(p, lineEnd, "map_Ns"))
+			material->shininessMap = directory + mapFileName(p, lineEnd);
+		else if (matchKeyword(p, lineEnd, "map_d"))
+			material->dissolveMap = directory + mapFileName(p, lineEnd);
+		else if (matchKeyword(p, lineEnd, "map_bump") ||
+			matchKeyword(p, lineEnd, "bump"))
+			material->bumpMap = directory + mapFileName(p, lineEnd);
+
+		p = next;
+	}
+
+	return true;
+}
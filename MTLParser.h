@@ -0,0 +1,61 @@
+/*  Wavefront MTL material library parsing. Like OBJParser, it holds no
+    OpenGL state
+    - RAB
+ */
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+/// <summary>
+/// One newmtl block of a material library
+/// </summary>
+struct MTLMaterial {
+	std::string name;
+	// Ka, Kd, Ks
+	glm::vec3 ambient, diffuse, specular;
+	// Tf
+	glm::vec3 transmissionFilter;
+	// Ns
+	float shininess;
+	// Ni
+	float opticalDensity;
+	// d, or 1 - Tr
+	float dissolve;
+	// illum
+	int illuminationModel;
+	// map_Ka, map_Kd, map_Ks, map_Ns, map_d and bump/map_bump. Relative to
+	// the working directory, empty if the material has none
+	std::string ambientMap, diffuseMap, specularMap, shininessMap, dissolveMap,
+		bumpMap;
+};
+
+namespace mtlParser {
+	/// <summary>
+	/// Parses a material library file
+	/// </summary>
+	/// <param name="path"> file path name of the MTL file </param>
+	/// <param name="defaults"> Values of every property a material leaves out
+	/// </param>
+	/// <param name="materials"> Stores the materials in file order </param>
+	/// <returns> True if successful, False if otherwise </returns>
+	bool parse(const char* path, const MTLMaterial& defaults,
+		std::vector<MTLMaterial>& materials);
+
+	/// <summary>
+	/// Parses a material library that is already in memory
+	/// </summary>
+	/// <param name="begin"> first byte of the file </param>
+	/// <param name="end"> one past the last byte of the file </param>
+	/// <param name="directory"> Prefixed to texture map paths. Empty or ending
+	/// in a separator </param>
+	/// <param name="defaults"> Values of every property a material leaves out
+	/// </param>
+	/// <param name="materials"> Stores the materials in file order </param>
+	/// <returns> True if successful, False if otherwise </returns>
+	bool parseBuffer(const char* begin, const char* end,
+		const std::string& directory, const MTLMaterial& defaults,
+		std::vector<MTLMaterial>& materials);
+}
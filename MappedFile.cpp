@@ -0,0 +1,121 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const char* path) {
+	open(path);
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const char* path) {
+	close();
+
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		return false;
+	}
+	fileHandle = file;
+	fileSize = (size_t)size.QuadPart;
+
+	// Windows refuses to map empty files, so there is nothing more to do
+	if (fileSize == 0) {
+		opened = true;
+		return true;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0,
+		nullptr);
+	if (mapping == nullptr) {
+		close();
+		return false;
+	}
+	mappingHandle = mapping;
+
+	mapped = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (mapped == nullptr) {
+		close();
+		return false;
+	}
+	opened = true;
+	return true;
+}
+
+void MappedFile::close() {
+	if (mapped != nullptr)
+		UnmapViewOfFile(mapped);
+	if (mappingHandle != nullptr)
+		CloseHandle((HANDLE)mappingHandle);
+	if (fileHandle != nullptr)
+		CloseHandle((HANDLE)fileHandle);
+
+	mapped = nullptr;
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+	fileSize = 0;
+	opened = false;
+}
+#else
+bool MappedFile::open(const char* path) {
+	close();
+
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		::close(fd);
+		return false;
+	}
+	fileDesc = fd;
+	fileSize = (size_t)info.st_size;
+
+	if (fileSize == 0) {
+		opened = true;
+		return true;
+	}
+
+	void* view = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED) {
+		close();
+		return false;
+	}
+	// The loaders walk the file front to back exactly once
+	madvise(view, fileSize, MADV_SEQUENTIAL);
+
+	mapped = (const char*)view;
+	opened = true;
+	return true;
+}
+
+void MappedFile::close() {
+	if (mapped != nullptr)
+		munmap((void*)mapped, fileSize);
+	if (fileDesc >= 0)
+		::close(fileDesc);
+
+	mapped = nullptr;
+	fileDesc = -1;
+	fileSize = 0;
+	opened = false;
+}
+#endif
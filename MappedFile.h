@@ -0,0 +1,69 @@
+/*  Read-only memory mapping of a whole file. Lets the loaders tokenize a file
+    in place instead of pulling it through stdio one call at a time
+    - RAB
+ */
+#pragma once
+
+#include <cstddef>
+
+class MappedFile
+{
+	// Start of the mapped view (nullptr when closed or the file is empty)
+	const char* mapped = nullptr;
+	// Size of the mapped view in bytes
+	size_t fileSize = 0;
+	bool opened = false;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#else
+	int fileDesc = -1;
+#endif
+
+public:
+	MappedFile() = default;
+
+	/// <summary>
+	/// ctor that maps the given file for reading
+	/// </summary>
+	/// <param name="path"> path of the file to map </param>
+	/// <returns> N/A </returns>
+	MappedFile(const char* path);
+
+	// Unmaps the file
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/// <summary>
+	/// Maps the given file for reading. Closes any file mapped before
+	/// </summary>
+	/// <param name="path"> path of the file to map </param>
+	/// <returns> True if successful, False if otherwise </returns>
+	bool open(const char* path);
+
+	/// <summary>
+	/// Unmaps the file and releases every handle
+	/// </summary>
+	void close();
+
+	/// <summary>
+	/// Whether a file is currently mapped. Empty files count as mapped
+	/// </summary>
+	inline bool isOpen() const { return opened; }
+
+	/// <summary>
+	/// Gets the first byte of the mapped file
+	/// </summary>
+	inline const char* begin() const { return mapped; }
+	/// <summary>
+	/// Gets one past the last byte of the mapped file
+	/// </summary>
+	inline const char* end() const { return mapped + fileSize; }
+	/// <summary>
+	/// Gets size of the mapped file in bytes
+	/// </summary>
+	inline size_t size() const { return fileSize; }
+};
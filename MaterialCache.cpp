@@ -0,0 +1,199 @@
+#include "MaterialCache.h"
+
+#include <glad/glad.h>
+
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace {
+	using namespace glm;
+	const vec3 STANDARD_MAT_AMBIENT(0.05f, 0.15f, 0.03f);
+	const vec3 STANDARD_MAT_DIFFUSE(0.2f, 0.55f, 0.4f);
+	const vec3 STANDARD_MAT_SPECULAR(0.1f, 0.7f, 0.2f);
+	const float STANDARD_MAT_SHININESS = 100.0f;
+	// Values of the MTL properties the Phong shader does not use
+	const vec3 STANDARD_MAT_TRANSMISSION(1.0f);
+	const float STANDARD_MAT_OPTICAL_DENSITY = 1.0f;
+	const float STANDARD_MAT_DISSOLVE = 1.0f;
+	const int STANDARD_MAT_ILLUMINATION_MODEL = 2;
+	const char* STANDARD_MAT_NAME = "default";
+
+	/// <summary>
+	/// std140 layout of the material uniform block. Every vec3 starts on a
+	/// 16 byte boundary and the shininess fills the last one's padding
+	/// </summary>
+	struct MaterialBlock {
+		glm::vec3 ambient;
+		float padding0;
+		glm::vec3 diffuse;
+		float padding1;
+		glm::vec3 specular;
+		float shininess;
+	};
+	static_assert(sizeof(MaterialBlock) == 48, "MaterialBlock must match std140");
+
+	/// <summary>
+	/// State behind the materialCache functions
+	/// </summary>
+	struct Cache {
+		// Loaders may run on several threads
+		std::mutex mutex;
+		// std::map never moves its elements, so records can be handed out
+		std::map<std::pair<std::string, std::string>, MaterialRecord> records;
+		std::set<std::string> libraries;
+		const MaterialRecord* standard = nullptr;
+		// Buffer currently bound to the material binding point
+		unsigned int boundUBO = 0;
+	};
+
+	Cache& cache() {
+		static Cache instance;
+		return instance;
+	}
+
+	/// <summary>
+	/// Gets the library part of a key, so different spellings of the same
+	/// path find the same records
+	/// </summary>
+	std::string libraryKey(const std::string& library) {
+		return std::filesystem::path(library).lexically_normal().generic_string();
+	}
+
+	/// <summary>
+	/// Gets the properties of the standard material. Also the starting
+	/// point of every material read from a library
+	/// </summary>
+	MTLMaterial standardProperties() {
+		MTLMaterial properties;
+		properties.name = STANDARD_MAT_NAME;
+		properties.ambient = STANDARD_MAT_AMBIENT;
+		properties.diffuse = STANDARD_MAT_DIFFUSE;
+		properties.specular = STANDARD_MAT_SPECULAR;
+		properties.transmissionFilter = STANDARD_MAT_TRANSMISSION;
+		properties.shininess = STANDARD_MAT_SHININESS;
+		properties.opticalDensity = STANDARD_MAT_OPTICAL_DENSITY;
+		properties.dissolve = STANDARD_MAT_DISSOLVE;
+		properties.illuminationModel = STANDARD_MAT_ILLUMINATION_MODEL;
+		return properties;
+	}
+
+	/// <summary>
+	/// Adds a record unless its key exists. The cache must be locked
+	/// </summary>
+	const MaterialRecord* internLocked(Cache& state, const std::string& key,
+		const MTLMaterial& properties) {
+		auto result = state.records.try_emplace(std::make_pair(key, properties.name));
+		MaterialRecord& record = result.first->second;
+		if (result.second) {
+			record.library = key;
+			record.properties = properties;
+			record.shading.ambient = properties.ambient;
+			record.shading.diffuse = properties.diffuse;
+			record.shading.specular = properties.specular;
+			record.shading.shininess = properties.shininess;
+			record.ubo = 0;
+		}
+		return &record;
+	}
+}
+
+const MaterialRecord* materialCache::defaultMaterial() {
+	Cache& state = cache();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	if (state.standard == nullptr)
+		state.standard = internLocked(state, "", standardProperties());
+	return state.standard;
+}
+
+bool materialCache::loadLibrary(const std::string& path) {
+	Cache& state = cache();
+	std::string key = libraryKey(path);
+	{
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (state.libraries.count(key))
+			return true;
+	}
+
+	// Parse without holding the lock. If two threads race on the same
+	// library, the first one to intern a material wins
+	std::vector<MTLMaterial> materials;
+	if (!mtlParser::parse(key.c_str(), standardProperties(), materials))
+		return false;
+
+	std::lock_guard<std::mutex> lock(state.mutex);
+	state.libraries.insert(key);
+	for (const auto& material : materials)
+		internLocked(state, key, material);
+	std::cout << "Loaded " << materials.size() << " materials from " << key;
+	std::cout << std::endl;
+	return true;
+}
+
+const MaterialRecord* materialCache::find(const std::string& library,
+	const std::string& name) {
+	Cache& state = cache();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	auto it = state.records.find(std::make_pair(libraryKey(library), name));
+	return (it != state.records.end()) ? &it->second : nullptr;
+}
+
+const MaterialRecord* materialCache::findInLibraries(
+	const std::vector<std::string>& libraries, const std::string& name) {
+	for (const auto& library : libraries) {
+		const MaterialRecord* material = find(library, name);
+		if (material != nullptr)
+			return material;
+	}
+	if (!name.empty())
+		std::cout << "Material " << name << " not found" << std::endl;
+	return defaultMaterial();
+}
+
+const MaterialRecord* materialCache::intern(const std::string& library,
+	const MTLMaterial& properties) {
+	Cache& state = cache();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	return internLocked(state, libraryKey(library), properties);
+}
+
+void materialCache::bind(const MaterialRecord* record) {
+	Cache& state = cache();
+	if (record->ubo == 0) {
+		MaterialBlock block;
+		block.ambient = record->shading.ambient;
+		block.padding0 = 0.0f;
+		block.diffuse = record->shading.diffuse;
+		block.padding1 = 0.0f;
+		block.specular = record->shading.specular;
+		block.shininess = record->shading.shininess;
+
+		glGenBuffers(1, &record->ubo);
+		glBindBuffer(GL_UNIFORM_BUFFER, record->ubo);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(block), &block, GL_STATIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	// Meshes sharing a material are often drawn back to back
+	if (state.boundUBO != record->ubo) {
+		glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, record->ubo);
+		state.boundUBO = record->ubo;
+	}
+}
+
+void materialCache::clear() {
+	Cache& state = cache();
+	std::lock_guard<std::mutex> lock(state.mutex);
+	for (auto& entry : state.records) {
+		if (entry.second.ubo != 0)
+			glDeleteBuffers(1, &entry.second.ubo);
+	}
+	state.records.clear();
+	state.libraries.clear();
+	state.standard = nullptr;
+	state.boundUBO = 0;
+}
@@ -0,0 +1,99 @@
+/*  Process-wide store of materials, keyed by the library they come from and
+    their name in it. Every mesh that uses a material points at the same
+    record, and every record owns one uniform buffer for the shaders
+    - RAB
+ */
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+#include "MTLParser.h"
+
+/// <summary>
+/// Holds basic material that is constant throughout entire mesh
+/// </summary>
+struct Material {
+	glm::vec3 ambient, diffuse, specular;
+	float shininess;
+};
+
+/// <summary>
+/// A material shared by every mesh that uses it
+/// </summary>
+struct MaterialRecord {
+	// Library the material was read from. Together with the name, the key
+	// of the record
+	std::string library;
+	// Everything the library says about the material
+	MTLMaterial properties;
+	// Phong parameters the shaders use
+	Material shading;
+	// Uniform buffer holding the shading parameters. Created the first time
+	// the record is bound, so records can be made without a GL context
+	mutable unsigned int ubo;
+};
+
+namespace materialCache {
+	// Uniform block the shaders declare the material in, and its binding
+	const char* const MATERIAL_BLOCK_NAME = "MaterialBlock";
+	const unsigned int MATERIAL_BLOCK_BINDING = 0;
+
+	/// <summary>
+	/// Gets the material meshes use when nothing else is known
+	/// </summary>
+	const MaterialRecord* defaultMaterial();
+
+	/// <summary>
+	/// Parses a material library and adds every material in it. A library is
+	/// only ever parsed once
+	/// </summary>
+	/// <param name="path"> file path name of the MTL file </param>
+	/// <returns> True if the library is loaded, False if it cannot be read
+	/// </returns>
+	bool loadLibrary(const std::string& path);
+
+	/// <summary>
+	/// Looks up a material
+	/// </summary>
+	/// <param name="library"> library the material came from </param>
+	/// <param name="name"> name of the material </param>
+	/// <returns> The shared record, nullptr if there is none </returns>
+	const MaterialRecord* find(const std::string& library,
+		const std::string& name);
+
+	/// <summary>
+	/// Looks up a material in several libraries, in order, the way an OBJ
+	/// file resolves usemtl against its mtllib statements
+	/// </summary>
+	/// <param name="libraries"> libraries to search </param>
+	/// <param name="name"> name of the material </param>
+	/// <returns> The first match, the default material if there is none
+	/// </returns>
+	const MaterialRecord* findInLibraries(
+		const std::vector<std::string>& libraries, const std::string& name);
+
+	/// <summary>
+	/// Adds a material unless one with the same library and name exists
+	/// </summary>
+	/// <param name="library"> library the material came from </param>
+	/// <param name="properties"> the material </param>
+	/// <returns> The shared record for the library and name </returns>
+	const MaterialRecord* intern(const std::string& library,
+		const MTLMaterial& properties);
+
+	/// <summary>
+	/// Binds a material's uniform buffer to MATERIAL_BLOCK_BINDING, creating
+	/// it on first use. Must be called with a current GL context
+	/// </summary>
+	/// <param name="record"> material to bind </param>
+	void bind(const MaterialRecord* record);
+
+	/// <summary>
+	/// Deletes every uniform buffer and record. Records handed out before are
+	/// invalid afterwards, so only call this once nothing draws any more
+	/// </summary>
+	void clear();
+}
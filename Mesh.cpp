@@ -1,108 +1,491 @@
 #include "Mesh.h"
 
 #include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
+#include "AABB.h"
+#include "AsyncLoader.h"
+#include "Frustum.h"
+#include "TextureCache.h"
+#include "VertexPacking.h"
+
 namespace {
-    using namespace glm;
-    const vec3 STANDARD_MAT_AMBIENT(0.05f, 0.15f, 0.03f);
-    const vec3 STANDARD_MAT_DIFFUSE(0.2f, 0.55f, 0.4f);
-    const vec3 STANDARD_MAT_SPECULAR(0.1f, 0.7f, 0.2f);
-    const float STANDARD_MAT_SHININESS = 100.0f;
+    // Coverage below which the second level is drawn. Coverage is the
+    // radius of the bounding sphere on screen over half the screen height.
+    // Every further level halves it, as each one halves the triangles
+    const float LOD_COVERAGE = 0.25f;
+    // How far past a threshold coverage has to move before switching
+    const float LOD_HYSTERESIS = 0.15f;
+    // Meshes with more vertices cannot use 16 bit indices
+    const size_t MAX_SHORT_INDEX_VERTICES = 65535;
+    // Vertices packed at a time. The block they are built in stays in cache
+    const size_t VERTICES_PER_BLOCK = 1024;
+    // Values of the vertexFormat uniform
+    const int SHADER_FORMAT_FLOAT = 0;
+    const int SHADER_FORMAT_PACKED = 1;
+
+    // Attribute layout of Vertex, for the vertex array of the geometry pool
+    void setVertexAttributes() {
+        // Vertex positions
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        // Vertex normals
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                              (void*)offsetof(Vertex, normal));
+        // Texture coordinates
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                              (void*)offsetof(Vertex, texCoords));
+    }
+
+    // Attribute layout of PackedVertex. The shaders read the same vec3,
+    // vec3 and vec2 as for Vertex, with the normal's z left at 0
+    void setPackedVertexAttributes() {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+                              sizeof(PackedVertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex),
+                              (void*)offsetof(PackedVertex, normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex),
+                              (void*)offsetof(PackedVertex, texCoords));
+    }
 }
 
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices,
+    std::vector<Texture> textures) : geometry(GeometryPool::INVALID_HANDLE),
+    pool(nullptr), format(defaultFormat()), worldBoundsValid(false),
+    currentLOD(0) {
+    this->textures = std::move(textures);
+
+    material = materialCache::defaultMaterial();
+
+    aabb::compute((const float*)vertices.data(), vertices.size(),
+                  sizeof(Vertex), aabbMin, aabbMax);
+
+    init(std::move(vertices), std::move(indices));
+}
 
 Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices,
-    std::vector<Texture> textures) {
-    this->vertices = vertices;
-    this->indices = indices;
-    this->textures = textures;
-
-    mat.ambient = STANDARD_MAT_AMBIENT;
-    mat.diffuse = STANDARD_MAT_DIFFUSE;
-    mat.specular = STANDARD_MAT_SPECULAR;
-    mat.shininess = STANDARD_MAT_SHININESS;
-
-    init();
-}
-
-void Mesh::init() {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-    // Bind the vertex buffer for reading
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex),
-                 vertices.data(), GL_STATIC_DRAW);
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-                 indices.data(), GL_STATIC_DRAW);
-
-    // Tell OpenGL how to read the data
-    // Vertex positions
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    // Vertex normals
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void*)offsetof(Vertex, normal));
-    // Texture coordinates
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          (void*)offsetof(Vertex, texCoords));
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    
-    std::cout << "Vertices: " << vertices.size() << std::endl;
-    std::cout << "Indices: " << indices.size() << std::endl;
+    std::vector<Texture> textures, const MaterialRecord* material,
+    const glm::vec3& aabbMin, const glm::vec3& aabbMax,
+    std::vector<LODLevel> lods, std::vector<Meshlet> meshlets)
+    : geometry(GeometryPool::INVALID_HANDLE), pool(nullptr),
+      format(defaultFormat()), material(material), aabbMin(aabbMin),
+      aabbMax(aabbMax), worldBoundsValid(false),
+      lods(std::move(lods)), currentLOD(0), meshlets(std::move(meshlets)),
+      textures(std::move(textures)) {
+    init(std::move(vertices), std::move(indices));
+}
+
+Mesh::Mesh() : geometry(GeometryPool::INVALID_HANDLE), pool(nullptr),
+    format(defaultFormat()), material(materialCache::defaultMaterial()),
+    aabbMin(0.0f), aabbMax(0.0f), worldBoundsValid(false), currentLOD(0) {
+}
+
+VertexFormat& Mesh::defaultFormat() {
+    static VertexFormat format = VertexFormat::FLOAT;
+    return format;
+}
+
+GeometryPool& Mesh::getPool(VertexFormat format, bool shortIndices) {
+    static GeometryPool floatPool(sizeof(Vertex), setVertexAttributes);
+    static GeometryPool packedPool(sizeof(PackedVertex),
+        setPackedVertexAttributes);
+    static GeometryPool packedShortPool(sizeof(PackedVertex),
+        setPackedVertexAttributes, sizeof(unsigned short));
+    if (format == VertexFormat::FLOAT)
+        return floatPool;
+    return shortIndices ? packedShortPool : packedPool;
+}
+
+void Mesh::destroyPools() {
+    std::cout << "Geometry pools held " << getPool().getUsedBytes() +
+        getPool(VertexFormat::PACKED).getUsedBytes() +
+        getPool(VertexFormat::PACKED, true).getUsedBytes() << " bytes\n";
+    getPool().destroy();
+    getPool(VertexFormat::PACKED).destroy();
+    getPool(VertexFormat::PACKED, true).destroy();
+}
+
+void Mesh::setVertexFormat(VertexFormat format) {
+    defaultFormat() = format;
+}
+
+GeometryPool* Mesh::getGeometryPool() const {
+    return pool;
+}
+
+void Mesh::init(std::vector<Vertex> vertices, std::vector<unsigned int> indices) {
+    acquireTextures();
+    upload(vertices.data(), vertices.size(), indices.data(), indices.size());
+
+    // Only the positions are kept of the vertices, and only by the job
+    auto source = std::make_shared<std::vector<Vertex>>(std::move(vertices));
+    submitTriangles([source]() {
+        std::vector<glm::vec3> positions(source->size());
+        for (size_t i = 0; i < positions.size(); ++i)
+            positions[i] = (*source)[i].position;
+        *source = std::vector<Vertex>();
+        return positions;
+    }, std::move(indices));
+}
 
+void Mesh::buildTriangles(std::vector<glm::vec3> positions,
+    std::vector<unsigned int> indices) {
+    auto source = std::make_shared<std::vector<glm::vec3>>(std::move(positions));
+    submitTriangles([source]() {
+        return std::move(*source);
+    }, std::move(indices));
+}
+
+void Mesh::submitTriangles(std::function<std::vector<glm::vec3>()> positions,
+    std::vector<unsigned int> indices) {
+    // Coarser levels cover the same surface, so rays only test the finest
+    size_t firstIndex = lods.empty() ? 0 : lods[0].firstIndex;
+    size_t numIndices = lods.empty() ? indices.size() : lods[0].numIndices;
+    if (firstIndex + numIndices > indices.size())
+        return;
+    // Held by pointer, so handing the job to the pool never copies them
+    auto kept = std::make_shared<std::vector<unsigned int>>(std::move(indices));
+    auto triangles = std::make_shared<TriangleBVH>();
+    this->triangles = triangles;
+    asyncLoader::submit([positions, kept, triangles, firstIndex, numIndices]() {
+        kept->erase(kept->begin() + firstIndex + numIndices, kept->end());
+        kept->erase(kept->begin(), kept->begin() + firstIndex);
+        triangles->build(positions(), std::move(*kept));
+    });
+}
+
+void Mesh::createRanges(size_t numVertices, size_t numIndices) {
+    if (pool)
+        pool->release(geometry);
+    bool shortIndices = format == VertexFormat::PACKED &&
+        numVertices <= MAX_SHORT_INDEX_VERTICES;
+    pool = &getPool(format, shortIndices);
+    geometry = pool->create();
+    pool->resizeVertices(geometry, numVertices);
+    pool->resizeIndices(geometry, numIndices);
+
+    size_t numBytes;
+    if (format == VertexFormat::FLOAT) {
+        numBytes = numVertices * sizeof(Vertex) + numIndices * sizeof(unsigned int);
+    }
+    else {
+        positionOffset = aabbMin;
+        positionScale = aabbMax - aabbMin;
+        numBytes = numVertices * sizeof(PackedVertex) + numIndices *
+            (shortIndices ? sizeof(unsigned short) : sizeof(unsigned int));
+    }
+
+    std::cout << "Vertices: " << numVertices << std::endl;
+    std::cout << "Indices: " << numIndices << std::endl;
+    std::cout << "Geometry: " << numBytes << " bytes (" <<
+        numVertices * sizeof(Vertex) + numIndices * sizeof(unsigned int) <<
+        " unpacked)" << std::endl;
+}
+
+void Mesh::upload(const Vertex* vertices, size_t numVertices,
+    const unsigned int* indices, size_t numIndices) {
+    upload(numVertices, [vertices](size_t first, size_t count, Vertex* out) {
+        std::copy(vertices + first, vertices + first + count, out);
+    }, indices, numIndices);
+}
+
+void Mesh::upload(size_t numVertices, const VertexSource& source,
+    const unsigned int* indices, size_t numIndices) {
+    createRanges(numVertices, numIndices);
+    writeVertices(source, numVertices);
+    writeIndices(indices, numIndices);
+    triangles.reset();
+}
+
+const MaterialRecord* Mesh::getMaterial() const {
+    return material;
+}
+
+void Mesh::setMaterial(const MaterialRecord* material) {
+    this->material = material;
 }
 
 void Mesh::getCornerVecs(glm::vec3& minCorner, glm::vec3& maxCorner) const {
-    glm::vec3 min(std::numeric_limits<float>::max());
-    glm::vec3 max(std::numeric_limits<float>::lowest());
-    for (const auto& vertex : vertices) {
-        glm::vec3 pos(vertex.position);
-        for (int i = 0; i < 3; ++i) {
-            min[i] = (min[i] > pos[i]) ? pos[i] : min[i];
-            max[i] = (max[i] < pos[i]) ? pos[i] : max[i];
+    minCorner = aabbMin;
+    maxCorner = aabbMax;
+}
+
+void Mesh::setCornerVecs(const glm::vec3& minCorner,
+    const glm::vec3& maxCorner) {
+    aabbMin = minCorner;
+    aabbMax = maxCorner;
+    worldBoundsValid = false;
+}
+
+void Mesh::getBounds(const glm::mat4& transform, glm::vec3& minCorner,
+    glm::vec3& maxCorner) {
+    if (!worldBoundsValid || transform != boundsTransform) {
+        aabb::transform(aabbMin, aabbMax, transform, worldMin, worldMax);
+        boundsTransform = transform;
+        worldBoundsValid = true;
+    }
+    minCorner = worldMin;
+    maxCorner = worldMax;
+}
+
+bool Mesh::raycast(const glm::vec3& origin, const glm::vec3& direction,
+    float maxDistance, TriangleHit& hit) const {
+    return triangles && triangles->raycast(origin, direction, maxDistance, hit);
+}
+
+void Mesh::acquireTextures() {
+    for (auto& texture : textures) {
+        texture.record = textureCache::acquire(texture.path);
+        texture.id = texture.record->id;
+    }
+}
+
+void Mesh::releaseTextures() {
+    for (auto& texture : textures) {
+        textureCache::release(texture.record);
+        texture.record = nullptr;
+        texture.id = 0;
+    }
+}
+
+void Mesh::setTextures(std::vector<Texture> textures) {
+    releaseTextures();
+    this->textures = std::move(textures);
+    acquireTextures();
+}
+
+void Mesh::setLODs(std::vector<LODLevel> lods) {
+    this->lods = std::move(lods);
+    currentLOD = 0;
+}
+
+size_t Mesh::getNumLODs() const {
+    return lods.empty() ? 1 : lods.size();
+}
+
+void Mesh::setMeshlets(std::vector<Meshlet> meshlets) {
+    this->meshlets = std::move(meshlets);
+    visibleRanges.clear();
+}
+
+size_t Mesh::cull(const glm::mat4& model, const glm::mat4& view,
+    const glm::mat4& projection) {
+    selectLOD(model, view, projection);
+    visibleRanges.clear();
+
+    // Coarser levels are for meshes far enough away to be seen whole
+    if (currentLOD > 0 || meshlets.empty()) {
+        GeometryPool::IndexRange range;
+        range.firstIndex = lods.empty() ? 0 : lods[currentLOD].firstIndex;
+        range.numIndices = lods.empty() ?
+            (unsigned int)(pool ? pool->getIndexCount(geometry) : 0) :
+            lods[currentLOD].numIndices;
+        visibleRanges.push_back(range);
+        return range.numIndices / 3;
+    }
+
+    // Planes and eye in the mesh's own space, so the bounds are used as is
+    glm::mat4 modelview = view * model;
+    glm::vec4 planes[6];
+    frustum::extractPlanes(projection * modelview, planes);
+    glm::vec3 eye = glm::vec3(glm::inverse(modelview)[3]);
+
+    size_t numIndices = 0;
+    for (const auto& meshlet : meshlets) {
+        if (!frustum::intersectsSphere(planes, meshlet.center, meshlet.radius))
+            continue;
+        if (meshlet.coneCutoff <= 1.0f && glm::dot(glm::normalize(
+            meshlet.coneApex - eye), meshlet.coneAxis) >= meshlet.coneCutoff)
+            continue;
+        numIndices += meshlet.numIndices;
+        // Runs of visible meshlets are one range, so one draw
+        if (!visibleRanges.empty() && visibleRanges.back().firstIndex +
+            visibleRanges.back().numIndices == meshlet.firstIndex) {
+            visibleRanges.back().numIndices += meshlet.numIndices;
+            continue;
         }
+        visibleRanges.push_back({ meshlet.firstIndex, meshlet.numIndices });
     }
+    return numIndices / 3;
+}
 
-    minCorner = min;
-    maxCorner = max;
+void Mesh::cullWhole() {
+    visibleRanges.clear();
 }
 
-void Mesh::updateBuffers() const {
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferSubData(
-        GL_ARRAY_BUFFER, // Target
-        0, // Offset
-        vertices.size() * sizeof(Vertex), // Size in bytes of data
-        vertices.data() // Actual data
-    );
+void Mesh::selectLOD(const glm::mat4& model, const glm::mat4& view,
+    const glm::mat4& projection) {
+    if (lods.size() < 2 || !aabb::isValid(aabbMin, aabbMax)) {
+        currentLOD = 0;
+        return;
+    }
+
+    // The sphere around the box, scaled by the largest axis of the model
+    glm::vec3 center = 0.5f * (aabbMin + aabbMax);
+    float scale = std::max(glm::length(glm::vec3(model[0])),
+        std::max(glm::length(glm::vec3(model[1])),
+                 glm::length(glm::vec3(model[2]))));
+    float radius = 0.5f * glm::length(aabbMax - aabbMin) * scale;
+    float distance = glm::length(glm::vec3(view * model * glm::vec4(center, 1.0f)));
+    if (distance <= radius) {
+        currentLOD = 0;
+        return;
+    }
+    float coverage = radius * projection[1][1] / distance;
+
+    // Threshold of level i is LOD_COVERAGE / 2^(i - 1)
+    unsigned int level = std::min(currentLOD, (unsigned int)lods.size() - 1);
+    while (level + 1 < lods.size() && coverage <
+        LOD_COVERAGE / (float)(1u << level) * (1.0f - LOD_HYSTERESIS))
+        ++level;
+    while (level > 0 && coverage >
+        LOD_COVERAGE / (float)(1u << (level - 1)) * (1.0f + LOD_HYSTERESIS))
+        --level;
+    currentLOD = level;
+}
+
+void Mesh::deleteBuffers() {
+    if (pool)
+        pool->release(geometry);
+    geometry = GeometryPool::INVALID_HANDLE;
+    pool = nullptr;
+    triangles.reset();
+    releaseTextures();
+}
+
+bool Mesh::writeVertices(const VertexSource& source, size_t numVertices) const {
+    if (numVertices == 0)
+        return true;
+    void* range = pool->mapVertices(geometry);
+    if (!range) {
+        std::cout << "Failed to map vertex range\n";
+        return false;
+    }
+    if (format == VertexFormat::FLOAT) {
+        source(0, numVertices, (Vertex*)range);
+    }
+    else {
+        std::vector<Vertex> block(std::min(numVertices, VERTICES_PER_BLOCK));
+        PackedVertex* packed = (PackedVertex*)range;
+        for (size_t first = 0; first < numVertices; first += block.size()) {
+            size_t count = std::min(block.size(), numVertices - first);
+            source(first, count, block.data());
+            vertexPacking::pack(block.data(), count, positionOffset,
+                                positionOffset + positionScale, packed + first);
+        }
+    }
+    if (!pool->unmapVertices()) {
+        std::cout << "Vertex range was lost while mapped\n";
+        return false;
+    }
+    return true;
+}
+
+bool Mesh::writeIndices(const unsigned int* indices, size_t numIndices) const {
+    if (numIndices == 0)
+        return true;
+    void* range = pool->mapIndices(geometry);
+    if (!range) {
+        std::cout << "Failed to map index range\n";
+        return false;
+    }
+    if (pool == &getPool(VertexFormat::PACKED, true))
+        vertexPacking::narrowIndices(indices, numIndices, (unsigned short*)range);
+    else
+        std::memcpy(range, indices, numIndices * sizeof(unsigned int));
+    if (!pool->unmapIndices()) {
+        std::cout << "Index range was lost while mapped\n";
+        return false;
+    }
+    return true;
 }
 
 void Mesh::sendMatToShader(const Shader& program) const {
-    program.setVec3("material.ambient", mat.ambient);
-    program.setVec3("material.diffuse", mat.diffuse);
-    program.setVec3("material.specular", mat.specular);
-    program.setFloat("material.shininess", mat.shininess);
+    // The program reads the material from the uniform block its binding was
+    // set to when it was linked
+    materialCache::bind(material);
+
+    // The first loaded map of each type is used. Until one is loaded the
+    // material's colors are drawn as they are
+    const TextureRecord* diffuseMap = nullptr;
+    const TextureRecord* specularMap = nullptr;
+    for (const auto& texture : textures) {
+        if (texture.record == nullptr || !texture.record->ready)
+            continue;
+        if (!diffuseMap && texture.type == textureCache::DIFFUSE_TYPE)
+            diffuseMap = texture.record;
+        else if (!specularMap && texture.type == textureCache::SPECULAR_TYPE)
+            specularMap = texture.record;
+    }
+    program.setBool("hasDiffuseMap", diffuseMap != nullptr);
+    if (diffuseMap) {
+        glActiveTexture(GL_TEXTURE0 + textureCache::DIFFUSE_MAP_UNIT);
+        glBindTexture(GL_TEXTURE_2D, diffuseMap->id);
+        program.setInt("diffuseMap", textureCache::DIFFUSE_MAP_UNIT);
+    }
+    program.setBool("hasSpecularMap", specularMap != nullptr);
+    if (specularMap) {
+        glActiveTexture(GL_TEXTURE0 + textureCache::SPECULAR_MAP_UNIT);
+        glBindTexture(GL_TEXTURE_2D, specularMap->id);
+        program.setInt("specularMap", textureCache::SPECULAR_MAP_UNIT);
+    }
+}
+
+void Mesh::sendFormatToShader(const Shader& program) const {
+    if (format == VertexFormat::PACKED) {
+        program.setInt("vertexFormat", SHADER_FORMAT_PACKED);
+        program.setVec3("positionOffset", positionOffset);
+        program.setVec3("positionScale", positionScale);
+    }
+    else {
+        program.setInt("vertexFormat", SHADER_FORMAT_FLOAT);
+    }
 }
 
 void Mesh::draw(const Shader& program, glm::mat4& model, glm::mat4& view, 
-    glm::mat4& projection) {
+    glm::mat4& projection, bool visibleOnly) {
     // Improve on this later
     program.setMat4("model", model);
     program.setMat4("view", view);
     program.setMat4("projection", projection);
+    if (!pool)
+        return;
+    sendFormatToShader(program);
+
+    if (visibleOnly) {
+        pool->draw(geometry, visibleRanges.data(), visibleRanges.size());
+        return;
+    }
+    // Picked by the camera's cull, so passes that look from elsewhere, such
+    // as the shadow map, draw the same level and do not move its hysteresis
+    if (lods.empty())
+        pool->draw(geometry);
+    else
+        pool->draw(geometry, lods[currentLOD].firstIndex,
+                   lods[currentLOD].numIndices);
+}
+
+void Mesh::drawInstanced(const Shader& program, glm::mat4& model,
+    glm::mat4& view, glm::mat4& projection, size_t numInstances) {
+    program.setMat4("model", model);
+    program.setMat4("view", view);
+    program.setMat4("projection", projection);
+    if (!pool)
+        return;
+    sendFormatToShader(program);
 
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, (int)indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    // Copies may be anywhere, so none of them get a coarser level
+    if (lods.empty())
+        pool->drawInstanced(geometry, 0, pool->getIndexCount(geometry),
+                            numInstances);
+    else
+        pool->drawInstanced(geometry, lods[0].firstIndex, lods[0].numIndices,
+                            numInstances);
 }
@@ -6,9 +6,16 @@
  */
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <vector>
 
+#include "GeometryPool.h"
+#include "MaterialCache.h"
 #include "Shader.h"
+#include "TriangleBVH.h"
+
+struct TextureRecord;
 
 /// <summary>
 /// Stores per vertex info
@@ -19,6 +26,48 @@ struct Vertex {
     glm::vec2 texCoords;
 };
 
+/// <summary>
+/// Strided view of vertex positions, so code that only reads positions
+/// takes Vertex arrays and plain position arrays alike
+/// </summary>
+struct PositionArray {
+    const char* first;
+    size_t stride;
+
+    PositionArray(const Vertex* vertices)
+        : first((const char*)vertices), stride(sizeof(Vertex)) {}
+    PositionArray(const glm::vec3* positions)
+        : first((const char*)positions), stride(sizeof(glm::vec3)) {}
+
+    const glm::vec3& operator[](size_t i) const {
+        return *(const glm::vec3*)(first + i * stride);
+    }
+};
+
+/// <summary>
+/// Compact vertex of half the size of Vertex. The shaders decode it
+/// </summary>
+struct PackedVertex {
+    // Position within the mesh's bounds as unsigned normalized shorts. The
+    // fourth only pads the normal to 4 byte alignment
+    unsigned short position[4];
+    // Octahedral normal as signed normalized shorts
+    short normal[2];
+    // Half floats
+    unsigned short texCoords[2];
+};
+
+/// <summary>
+/// Layout of a mesh's geometry on the GPU
+/// </summary>
+enum class VertexFormat {
+    // Vertex and 32 bit indices
+    FLOAT,
+    // PackedVertex, and 16 bit indices for meshes with fewer than 65536
+    // vertices
+    PACKED
+};
+
 /// <summary>
 /// Stores texture info
 /// </summary>
@@ -26,39 +75,167 @@ struct Texture {
     unsigned int id;
     std::string type;
     std::string path;
+    // Shared record in the texture cache. Null until the mesh acquires it
+    const TextureRecord* record;
 };
 
 /// <summary>
-/// Holds basic material that is constant throughout entire mesh
+/// Index range of one level of detail within a mesh's indices
 /// </summary>
-struct Material {
-    glm::vec3 ambient, diffuse, specular;
-    float shininess;
+struct LODLevel {
+    unsigned int firstIndex;
+    unsigned int numIndices;
 };
 
+/// <summary>
+/// Cluster of neighbouring triangles of a mesh's full detail level, with
+/// the bounds culling tests it by
+/// </summary>
+struct Meshlet {
+    // Range of the triangles in the mesh's indices
+    unsigned int firstIndex;
+    unsigned int numIndices;
+    // Sphere around the cluster's vertices
+    glm::vec3 center;
+    float radius;
+    // Cone holding every triangle normal. The cluster faces away from any
+    // viewer for which dot(normalize(coneApex - eye), coneAxis) is at least
+    // coneCutoff. A cutoff above 1 means it never does
+    glm::vec3 coneApex;
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
+/// <summary>
+/// Writes count vertices of a mesh, starting at vertex first, to a caller
+/// provided array. Lets meshes upload vertices that are only built while
+/// they are written
+/// </summary>
+typedef std::function<void(size_t first, size_t count, Vertex* vertices)>
+    VertexSource;
+
 /// <summary>
 /// Stores mesh information for a model
 /// </summary>
 class Mesh
 {
     friend class Model;
-    // Data rendering
-    unsigned int VAO, VBO, EBO;
-    // Material
-    Material mat;
+    // Vertex and index ranges of the mesh in its geometry pool
+    GeometryPool::Handle geometry;
+    // Pool holding the geometry. Null until it is uploaded
+    GeometryPool* pool;
+    // Layout the geometry is uploaded in
+    VertexFormat format;
+    // Box packed positions are fractions of. Taken from the bounds when the
+    // vertices are uploaded
+    glm::vec3 positionOffset, positionScale;
+    // Material. Shared with every other mesh that uses it
+    const MaterialRecord* material;
+    // Bounds of the vertex positions. Kept up to date by whoever moves them
+    glm::vec3 aabbMin, aabbMax;
+    // Bounds under the last transform asked for, and that transform. Only
+    // worked out again when the transform changes
+    glm::vec3 worldMin, worldMax;
+    glm::mat4 boundsTransform;
+    bool worldBoundsValid;
+    // Levels of detail, finest first. Empty if the mesh only has one
+    std::vector<LODLevel> lods;
+    // Level drawn last. Kept so selection can lag behind small changes
+    unsigned int currentLOD;
+    // Clusters of the full detail level. Empty if the mesh is not split
+    std::vector<Meshlet> meshlets;
+    // Index ranges the last cull kept, with neighbouring ranges merged
+    std::vector<GeometryPool::IndexRange> visibleRanges;
+    // Hierarchy over the triangles of the full detail level, for ray casts.
+    // Built on the worker pool once the geometry is uploaded, and dropped
+    // whenever it is replaced. Shared with the job building it
+    std::shared_ptr<TriangleBVH> triangles;
+
+    /// <summary>
+    /// Uploads the vertices and indices into ranges of the geometry pool,
+    /// then hands them to the worker pool for the triangle hierarchy
+    /// </summary>
+    /// <param name="vertices"> vertices to upload. Taken over </param>
+    /// <param name="indices"> indices to upload. Taken over </param>
+    void init(std::vector<Vertex> vertices, std::vector<unsigned int> indices);
 
     /// <summary>
-    /// Initializes buffer objects for rendering
+    /// Builds the triangle hierarchy on the worker pool. The geometry moves
+    /// into the job, which keeps only the full detail level's indices
     /// </summary>
-    void init();
+    /// <param name="positions"> run by the job for the vertex positions
+    /// </param>
+    /// <param name="indices"> uploaded indices. Taken over </param>
+    void submitTriangles(std::function<std::vector<glm::vec3>()> positions,
+        std::vector<unsigned int> indices);
+
+    /// <summary>
+    /// Acquires the textures from the texture cache, which starts decoding
+    /// the ones not loaded yet
+    /// </summary>
+    void acquireTextures();
+
+    /// <summary>
+    /// Releases the textures acquired from the texture cache
+    /// </summary>
+    void releaseTextures();
+
+    /// <summary>
+    /// Format newly made meshes upload their geometry in
+    /// </summary>
+    static VertexFormat& defaultFormat();
+
+    /// <summary>
+    /// Picks the level of detail from how large the mesh's bounding sphere
+    /// appears on screen. Only switches once the size moved a margin past
+    /// the threshold, so meshes near one do not flicker between levels
+    /// </summary>
+    /// <param name="model"> model matrix </param>
+    /// <param name="view"> view matrix </param>
+    /// <param name="projection"> projection matrix </param>
+    void selectLOD(const glm::mat4& model, const glm::mat4& view,
+        const glm::mat4& projection);
+
+    /// <summary>
+    /// Tells the shader how the mesh's vertices are laid out
+    /// </summary>
+    /// <param name="program"> Shader program </param>
+    void sendFormatToShader(const Shader& program) const;
+
+    /// <summary>
+    /// Replaces the mesh's ranges in the pool of its format with new ones
+    /// </summary>
+    /// <param name="numVertices"> size of the vertex range </param>
+    /// <param name="numIndices"> size of the index range </param>
+    void createRanges(size_t numVertices, size_t numIndices);
+
+    /// <summary>
+    /// Writes vertices straight into the mesh's mapped vertex range. Packed
+    /// meshes get them through a small block they are packed from
+    /// </summary>
+    /// <param name="source"> writes the vertices </param>
+    /// <param name="numVertices"> number of vertices. Must fit the range
+    /// </param>
+    /// <returns> True if successful, False if the range could not be mapped
+    /// or its data was lost </returns>
+    bool writeVertices(const VertexSource& source, size_t numVertices) const;
+
+    /// <summary>
+    /// Writes indices straight into the mesh's mapped index range, narrowed
+    /// on the way if the pool has 16 bit indices
+    /// </summary>
+    /// <param name="indices"> indices to write </param>
+    /// <param name="numIndices"> number of indices. Must fit the range </param>
+    /// <returns> True if successful, False if the range could not be mapped
+    /// or its data was lost </returns>
+    bool writeIndices(const unsigned int* indices, size_t numIndices) const;
 
 public:
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
     std::vector<Texture> textures;
 
     /// <summary>
-    /// Mesh constructor. Copies all info from passed vector objects
+    /// Mesh constructor. Uploads the vertices and indices, keeping only the
+    /// positions and indices ray casts need, and takes over the textures
     /// </summary>
     /// <param name="vertices"> contains position info </param>
     /// <param name="indices"> contains index info </param>
@@ -67,6 +244,48 @@ public:
     Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices,
         std::vector<Texture> textures);
 
+    /// <summary>
+    /// Mesh constructor for data whose material and bounds are already known.
+    /// Uploads the vertices and indices without scanning them, keeping only
+    /// the positions and indices ray casts need
+    /// </summary>
+    /// <param name="vertices"> contains position info </param>
+    /// <param name="indices"> contains index info </param>
+    /// <param name="textures"> contains texture info </param>
+    /// <param name="material"> material of the mesh </param>
+    /// <param name="aabbMin"> min corner of the vertex positions </param>
+    /// <param name="aabbMax"> max corner of the vertex positions </param>
+    /// <param name="lods"> index ranges of the levels of detail in indices
+    /// </param>
+    /// <param name="meshlets"> clusters of the full detail level </param>
+    /// <returns> N/A </returns>
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices,
+        std::vector<Texture> textures, const MaterialRecord* material,
+        const glm::vec3& aabbMin, const glm::vec3& aabbMax,
+        std::vector<LODLevel> lods = std::vector<LODLevel>(),
+        std::vector<Meshlet> meshlets = std::vector<Meshlet>());
+
+    /// <summary>
+    /// Mesh constructor for geometry handed over once with upload. Starts
+    /// without any geometry and keeps no CPU side copy of the vertices or
+    /// indices
+    /// </summary>
+    /// <returns> N/A </returns>
+    Mesh();
+
+    /// <summary>
+    /// Gets the material of the mesh
+    /// </summary>
+    /// <returns> The shared material record </returns>
+    const MaterialRecord* getMaterial() const;
+
+    /// <summary>
+    /// Sets the material of the mesh
+    /// </summary>
+    /// <param name="material"> Shared material record. Must outlive the mesh
+    /// </param>
+    void setMaterial(const MaterialRecord* material);
+
     /// <summary>
     /// Gets AABB corner positions of mesh
     /// </summary>
@@ -75,27 +294,196 @@ public:
     void getCornerVecs(glm::vec3& minCorner, glm::vec3& maxCorner) const;
 
     /// <summary>
-    /// Updates VBO with vertex data currently stored by model
+    /// Sets the AABB of a mesh whose vertices are uploaded. Packed positions
+    /// are quantized within it, so set it before calling upload
+    /// </summary>
+    /// <param name="minCorner"> min corner </param>
+    /// <param name="maxCorner"> max corner </param>
+    void setCornerVecs(const glm::vec3& minCorner, const glm::vec3& maxCorner);
+
+    /// <summary>
+    /// Gets the AABB of the mesh under a transform. Kept from the last call
+    /// unless the transform changed
+    /// </summary>
+    /// <param name="transform"> matrix taking the mesh to the space the
+    /// bounds are wanted in </param>
+    /// <param name="minCorner"> Stores min corner </param>
+    /// <param name="maxCorner"> Stores max corner </param>
+    void getBounds(const glm::mat4& transform, glm::vec3& minCorner,
+        glm::vec3& maxCorner);
+
+    /// <summary>
+    /// Finds the closest triangle of the full detail level a ray hits.
+    /// Meshes uploaded from a VertexSource can only be hit once
+    /// buildTriangles was called
+    /// </summary>
+    /// <param name="origin"> start of the ray, in the mesh's own space </param>
+    /// <param name="direction"> direction of the ray </param>
+    /// <param name="maxDistance"> furthest distance along the ray, in units
+    /// of direction </param>
+    /// <param name="hit"> Stores the closest hit. Triangles are counted from
+    /// the first of the full detail level </param>
+    /// <returns> True if the ray hits the mesh. False too while the mesh's
+    /// hierarchy is still being built </returns>
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction,
+        float maxDistance, TriangleHit& hit) const;
+
+    /// <summary>
+    /// Replaces the textures of the mesh. Releases the old ones and acquires
+    /// the new ones from the texture cache
     /// </summary>
-    void updateBuffers() const;
+    /// <param name="textures"> textures with their type and path set </param>
+    void setTextures(std::vector<Texture> textures);
 
     /// <summary>
-    /// Sends mesh's material info to given shader program
+    /// Sets the levels of detail of the mesh
+    /// </summary>
+    /// <param name="lods"> Index ranges of the levels, finest first. Empty
+    /// to always draw every index </param>
+    void setLODs(std::vector<LODLevel> lods);
+
+    /// <summary>
+    /// Gets the number of levels of detail, the full mesh included
+    /// </summary>
+    size_t getNumLODs() const;
+
+    /// <summary>
+    /// Sets the clusters the full detail level is culled by
+    /// </summary>
+    /// <param name="meshlets"> Clusters covering the full detail level's
+    /// indices. Empty to cull the mesh as a whole </param>
+    void setMeshlets(std::vector<Meshlet> meshlets);
+
+    /// <summary>
+    /// Picks the level of detail and works out which clusters of it can be
+    /// seen: those inside the view frustum that do not face away from the
+    /// camera. draw with visibleOnly set submits only those. Call once a
+    /// frame with the camera's matrices, as the level only changes here
+    /// </summary>
+    /// <param name="model"> model matrix </param>
+    /// <param name="view"> view matrix </param>
+    /// <param name="projection"> projection matrix </param>
+    /// <returns> Number of triangles that will be submitted </returns>
+    size_t cull(const glm::mat4& model, const glm::mat4& view,
+        const glm::mat4& projection);
+
+    /// <summary>
+    /// Marks the whole mesh as unseen, so draw with visibleOnly submits
+    /// nothing until the next cull
+    /// </summary>
+    void cullWhole();
+
+    /// <summary>
+    /// Gets the pool that holds the geometry of every mesh of one layout.
+    /// Draws of those meshes have to happen while it is bound
+    /// </summary>
+    /// <param name="format"> vertex layout </param>
+    /// <param name="shortIndices"> True for the pool with 16 bit indices.
+    /// Only packed meshes use it </param>
+    static GeometryPool& getPool(VertexFormat format = VertexFormat::FLOAT,
+        bool shortIndices = false);
+
+    /// <summary>
+    /// Destroys every geometry pool. Call once no mesh draws any more
+    /// </summary>
+    static void destroyPools();
+
+    /// <summary>
+    /// Sets the layout meshes made from now on upload their geometry in.
+    /// Meshes that already exist keep theirs
+    /// </summary>
+    /// <param name="format"> vertex layout </param>
+    static void setVertexFormat(VertexFormat format);
+
+    /// <summary>
+    /// Gets the pool holding the mesh's geometry. It has to be bound while
+    /// the mesh is drawn
+    /// </summary>
+    /// <returns> The pool, nullptr if nothing was uploaded yet </returns>
+    GeometryPool* getGeometryPool() const;
+
+    /// <summary>
+    /// Uploads geometry into the pool of the mesh's format, replacing any it
+    /// had. Nothing is kept on the CPU side, so the mesh can no longer be hit
+    /// by ray casts. Set the levels of detail first
+    /// </summary>
+    /// <param name="vertices"> vertices to upload </param>
+    /// <param name="numVertices"> number of vertices </param>
+    /// <param name="indices"> indices to upload, relative to the first vertex
+    /// </param>
+    /// <param name="numIndices"> number of indices </param>
+    void upload(const Vertex* vertices, size_t numVertices,
+        const unsigned int* indices, size_t numIndices);
+
+    /// <summary>
+    /// Uploads geometry whose vertices are written straight into the pool
+    /// by a callback, so they never need to be held anywhere else. Set the
+    /// bounds and levels of detail first
+    /// </summary>
+    /// <param name="numVertices"> number of vertices </param>
+    /// <param name="source"> writes the vertices </param>
+    /// <param name="indices"> indices to upload, relative to the first vertex
+    /// </param>
+    /// <param name="numIndices"> number of indices </param>
+    void upload(size_t numVertices, const VertexSource& source,
+        const unsigned int* indices, size_t numIndices);
+
+    /// <summary>
+    /// Builds the hierarchy ray casts test on the worker pool, for meshes
+    /// uploaded from a VertexSource, which keep no vertices. Call after
+    /// upload
+    /// </summary>
+    /// <param name="positions"> positions of the uploaded vertices. Taken
+    /// over </param>
+    /// <param name="indices"> uploaded indices. Taken over </param>
+    void buildTriangles(std::vector<glm::vec3> positions,
+        std::vector<unsigned int> indices);
+
+    /// <summary>
+    /// Frees the ranges of the mesh in the geometry pool and releases its
+    /// textures
+    /// </summary>
+    void deleteBuffers();
+
+    /// <summary>
+    /// Binds mesh's material to the material block of the shader programs,
+    /// and its diffuse and specular maps once they are loaded
     /// </summary>
     /// <param name="program"> Program to send material info to </param>
     void sendMatToShader(const Shader& program) const;
 
     /// <summary>
-    /// Draws mesh to screen
+    /// Draws mesh to screen at the level of detail the last cull picked,
+    /// full detail if it was never culled. The mesh's geometry pool must be
+    /// bound
     /// </summary>
     /// <param name="program"> Shader program </param>
     /// <param name="model"> model matrix </param>
     /// <param name="view"> view matrix </param>
     /// <param name="projection"> projection matrix </param>
+    /// <param name="visibleOnly"> If set, only the ranges the last cull kept
+    /// are drawn, at the level it picked </param>
     void draw(const Shader& program,
               glm::mat4& model,
               glm::mat4& view,
-              glm::mat4& projection);
+              glm::mat4& projection,
+              bool visibleOnly = false);
+
+    /// <summary>
+    /// Draws copies of the mesh with one instanced draw call, always at full
+    /// detail. The shader places each copy by its own transform in front of
+    /// model. The mesh's geometry pool must be bound
+    /// </summary>
+    /// <param name="program"> Shader program </param>
+    /// <param name="model"> model matrix shared by the copies </param>
+    /// <param name="view"> view matrix </param>
+    /// <param name="projection"> projection matrix </param>
+    /// <param name="numInstances"> number of copies </param>
+    void drawInstanced(const Shader& program,
+                       glm::mat4& model,
+                       glm::mat4& view,
+                       glm::mat4& projection,
+                       size_t numInstances);
 
 };
 
@@ -0,0 +1,415 @@
+#include "MeshCache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+namespace {
+	// Bump whenever the layout of the cache or of Vertex/Material changes
+	const uint32_t MESH_CACHE_VERSION = 6;
+	const char MESH_CACHE_MAGIC[8] = { 'O', 'L', 'M', 'E', 'S', 'H', 'C', '\0' };
+	const char* MESH_CACHE_EXTENSION = ".meshcache";
+	// Blobs start on this boundary so they can be used in place
+	const size_t BLOB_ALIGNMENT = 16;
+	// Longer material names are cut short
+	const size_t MATERIAL_NAME_SIZE = 64;
+	// Longer texture map paths are dropped rather than cut short
+	const size_t MAP_PATH_SIZE = 260;
+	// Further levels of detail are dropped
+	const size_t CACHE_MAX_LODS = 8;
+
+	/// <summary>
+	/// Start of every cache file
+	/// </summary>
+	struct CacheHeader {
+		char magic[8];
+		uint32_t version;
+		// Guard against layout changes that forgot to bump the version
+		uint32_t vertexSize;
+		uint32_t entrySize;
+		uint32_t nodeSize;
+		uint32_t meshletSize;
+		uint32_t numMeshes;
+		uint32_t numNodes;
+		// Identifies the source file the cache was built from
+		uint64_t sourceSize;
+		int64_t sourceModifiedTime;
+		uint64_t sourceHash;
+	};
+
+	/// <summary>
+	/// Material of a cached mesh. The fixed size part of MTLMaterial
+	/// </summary>
+	struct CacheMaterial {
+		char name[MATERIAL_NAME_SIZE];
+		// The maps meshes draw with
+		char diffuseMap[MAP_PATH_SIZE];
+		char specularMap[MAP_PATH_SIZE];
+		glm::vec3 ambient, diffuse, specular, transmissionFilter;
+		float shininess, opticalDensity, dissolve;
+		int32_t illuminationModel;
+	};
+
+	/// <summary>
+	/// Per mesh table entry following the header. Offsets are from the start
+	/// of the file
+	/// </summary>
+	struct CacheEntry {
+		uint64_t vertexOffset, numVertices;
+		uint64_t indexOffset, numIndices;
+		uint64_t meshletOffset, numMeshlets;
+		glm::vec3 aabbMin, aabbMax;
+		CacheMaterial material;
+		uint32_t node;
+		uint32_t numLODs;
+		LODLevel lods[CACHE_MAX_LODS];
+	};
+	// Entries are cleared with memset, padding included, and written as is
+	static_assert(std::is_trivially_copyable<CacheEntry>::value,
+		"CacheEntry must be trivially copyable");
+
+	/// <summary>
+	/// Node table entry following the mesh table
+	/// </summary>
+	struct CacheNode {
+		int32_t parent;
+		glm::mat4 localMat;
+	};
+
+	void packMapPath(const std::string& path, char (&packed)[MAP_PATH_SIZE]) {
+		memset(packed, 0, sizeof(packed));
+		if (path.size() < sizeof(packed))
+			path.copy(packed, sizeof(packed) - 1);
+	}
+
+	void packMaterial(const MTLMaterial& material, CacheMaterial& packed) {
+		memset(packed.name, 0, sizeof(packed.name));
+		material.name.copy(packed.name, sizeof(packed.name) - 1);
+		packMapPath(material.diffuseMap, packed.diffuseMap);
+		packMapPath(material.specularMap, packed.specularMap);
+		packed.ambient = material.ambient;
+		packed.diffuse = material.diffuse;
+		packed.specular = material.specular;
+		packed.transmissionFilter = material.transmissionFilter;
+		packed.shininess = material.shininess;
+		packed.opticalDensity = material.opticalDensity;
+		packed.dissolve = material.dissolve;
+		packed.illuminationModel = material.illuminationModel;
+	}
+
+	void unpackMaterial(const CacheMaterial& packed, MTLMaterial& material) {
+		material = MTLMaterial();
+		material.name.assign(packed.name,
+			strnlen(packed.name, sizeof(packed.name)));
+		material.diffuseMap.assign(packed.diffuseMap,
+			strnlen(packed.diffuseMap, sizeof(packed.diffuseMap)));
+		material.specularMap.assign(packed.specularMap,
+			strnlen(packed.specularMap, sizeof(packed.specularMap)));
+		material.ambient = packed.ambient;
+		material.diffuse = packed.diffuse;
+		material.specular = packed.specular;
+		material.transmissionFilter = packed.transmissionFilter;
+		material.shininess = packed.shininess;
+		material.opticalDensity = packed.opticalDensity;
+		material.dissolve = packed.dissolve;
+		material.illuminationModel = packed.illuminationModel;
+	}
+
+	/// <summary>
+	/// Checks that count elements starting at offset lie within a file. Each
+	/// value comes from the file, so nothing is added or multiplied that
+	/// could overflow
+	/// </summary>
+	inline bool fitsInFile(uint64_t offset, uint64_t count, uint64_t elementSize,
+		uint64_t fileSize) {
+		return offset <= fileSize && count <= (fileSize - offset) / elementSize;
+	}
+
+	inline size_t alignUp(size_t value, size_t alignment) {
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	inline uint64_t rotateLeft(uint64_t value, int bits) {
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	/// <summary>
+	/// 64 bit content hash in the style of xxHash64. Four independent lanes
+	/// keep the multiplier busy, so hashing runs close to memory bandwidth
+	/// </summary>
+	uint64_t hashBytes(const char* data, size_t size) {
+		const uint64_t PRIME_1 = 0x9E3779B185EBCA87ull;
+		const uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+		const uint64_t PRIME_3 = 0x165667B19E3779F9ull;
+		uint64_t lanes[4] = { PRIME_1 + PRIME_2, PRIME_2, 0, 0 - PRIME_1 };
+
+		size_t i = 0;
+		for (; i + 32 <= size; i += 32) {
+			for (int lane = 0; lane < 4; ++lane) {
+				uint64_t word;
+				memcpy(&word, data + i + 8 * lane, sizeof(word));
+				lanes[lane] = rotateLeft(lanes[lane] + word * PRIME_2, 31) * PRIME_1;
+			}
+		}
+		uint64_t hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) +
+			rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18) + size;
+		for (; i < size; ++i)
+			hash = rotateLeft(hash ^ ((unsigned char)data[i] * PRIME_3), 11) * PRIME_1;
+
+		hash ^= hash >> 33;
+		hash *= PRIME_2;
+		hash ^= hash >> 29;
+		hash *= PRIME_3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+
+	/// <summary>
+	/// Gets the size and modification time of a source file
+	/// </summary>
+	bool statSource(const char* sourcePath, uint64_t& size, int64_t& modifiedTime) {
+		std::error_code ec;
+		size = std::filesystem::file_size(sourcePath, ec);
+		if (ec)
+			return false;
+		auto writeTime = std::filesystem::last_write_time(sourcePath, ec);
+		if (ec)
+			return false;
+		modifiedTime = (int64_t)writeTime.time_since_epoch().count();
+		return true;
+	}
+
+	/// <summary>
+	/// Hashes the full contents of a source file
+	/// </summary>
+	bool hashSource(const char* sourcePath, uint64_t& hash) {
+		MappedFile source(sourcePath);
+		if (!source.isOpen())
+			return false;
+		hash = hashBytes(source.begin(), source.size());
+		return true;
+	}
+}
+
+std::string meshCache::cachePath(const char* sourcePath) {
+	return std::string(sourcePath) + MESH_CACHE_EXTENSION;
+}
+
+bool meshCache::read(const char* sourcePath, MappedFile& file,
+	std::vector<MeshRecord>& records, std::vector<NodeRecord>& nodes) {
+	std::string path = cachePath(sourcePath);
+	std::error_code ec;
+	if (!std::filesystem::exists(path, ec))
+		return false;
+
+	if (!file.open(path.c_str()) || file.size() < sizeof(CacheHeader)) {
+		std::cout << "Mesh cache " << path << " is unreadable\n";
+		file.close();
+		return false;
+	}
+
+	CacheHeader header;
+	memcpy(&header, file.begin(), sizeof(header));
+	bool valid = !memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) &&
+		header.version == MESH_CACHE_VERSION &&
+		header.vertexSize == sizeof(Vertex) &&
+		header.entrySize == sizeof(CacheEntry) &&
+		header.nodeSize == sizeof(CacheNode) &&
+		header.meshletSize == sizeof(Meshlet);
+
+	// Check the cheap stamps first and only hash the source if they match
+	uint64_t sourceSize, sourceHash;
+	int64_t sourceModifiedTime;
+	valid = valid && statSource(sourcePath, sourceSize, sourceModifiedTime) &&
+		sourceSize == header.sourceSize &&
+		sourceModifiedTime == header.sourceModifiedTime &&
+		hashSource(sourcePath, sourceHash) && sourceHash == header.sourceHash;
+
+	uint64_t tableEnd = sizeof(CacheHeader) +
+		(uint64_t)header.numMeshes * sizeof(CacheEntry) +
+		(uint64_t)header.numNodes * sizeof(CacheNode);
+	valid = valid && tableEnd <= file.size();
+	if (!valid) {
+		std::cout << "Mesh cache " << path << " is out of date\n";
+		file.close();
+		return false;
+	}
+
+	const char* entryData = file.begin() + sizeof(CacheHeader);
+	const char* nodeData = entryData + header.numMeshes * sizeof(CacheEntry);
+	records.clear();
+	nodes.clear();
+	auto corrupt = [&]() {
+		std::cout << "Mesh cache " << path << " is corrupt\n";
+		records.clear();
+		nodes.clear();
+		file.close();
+		return false;
+	};
+
+	// The hierarchy is only usable if every parent comes first
+	nodes.reserve(header.numNodes);
+	for (uint32_t i = 0; i < header.numNodes; ++i) {
+		CacheNode node;
+		memcpy(&node, nodeData + i * sizeof(CacheNode), sizeof(node));
+		if (node.parent >= (int32_t)i)
+			return corrupt();
+		NodeRecord record;
+		record.parent = node.parent < 0 ? -1 : node.parent;
+		record.localMat = node.localMat;
+		nodes.push_back(record);
+	}
+
+	records.reserve(header.numMeshes);
+	for (uint32_t i = 0; i < header.numMeshes; ++i) {
+		CacheEntry entry;
+		memcpy(&entry, entryData + i * sizeof(CacheEntry), sizeof(entry));
+
+		if (entry.vertexOffset % BLOB_ALIGNMENT || entry.indexOffset % BLOB_ALIGNMENT ||
+			entry.meshletOffset % BLOB_ALIGNMENT ||
+			!fitsInFile(entry.vertexOffset, entry.numVertices, sizeof(Vertex),
+				file.size()) ||
+			!fitsInFile(entry.indexOffset, entry.numIndices, sizeof(unsigned int),
+				file.size()) ||
+			!fitsInFile(entry.meshletOffset, entry.numMeshlets, sizeof(Meshlet),
+				file.size()) ||
+			entry.node >= header.numNodes || entry.numLODs > CACHE_MAX_LODS)
+			return corrupt();
+		for (uint32_t j = 0; j < entry.numLODs; ++j) {
+			if ((uint64_t)entry.lods[j].firstIndex + entry.lods[j].numIndices >
+				entry.numIndices)
+				return corrupt();
+		}
+
+		MeshRecord record;
+		record.vertices = (const Vertex*)(file.begin() + entry.vertexOffset);
+		record.numVertices = (size_t)entry.numVertices;
+		record.indices = (const unsigned int*)(file.begin() + entry.indexOffset);
+		record.numIndices = (size_t)entry.numIndices;
+		// Everything downstream indexes the vertices with these, on the CPU
+		// and on the GPU
+		for (size_t j = 0; j < record.numIndices; ++j) {
+			if (record.indices[j] >= entry.numVertices)
+				return corrupt();
+		}
+		record.aabbMin = entry.aabbMin;
+		record.aabbMax = entry.aabbMax;
+		unpackMaterial(entry.material, record.material);
+		record.node = entry.node;
+		record.lods.assign(entry.lods, entry.lods + entry.numLODs);
+		record.meshlets = (const Meshlet*)(file.begin() + entry.meshletOffset);
+		record.numMeshlets = (size_t)entry.numMeshlets;
+		for (size_t j = 0; j < record.numMeshlets; ++j) {
+			const Meshlet& meshlet = record.meshlets[j];
+			if ((uint64_t)meshlet.firstIndex + meshlet.numIndices > entry.numIndices)
+				return corrupt();
+		}
+		records.push_back(record);
+	}
+	return true;
+}
+
+bool meshCache::write(const char* sourcePath,
+	const std::vector<MeshRecord>& records, const std::vector<NodeRecord>& nodes) {
+	CacheHeader header;
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+	header.version = MESH_CACHE_VERSION;
+	header.vertexSize = sizeof(Vertex);
+	header.entrySize = sizeof(CacheEntry);
+	header.nodeSize = sizeof(CacheNode);
+	header.meshletSize = sizeof(Meshlet);
+	header.numMeshes = (uint32_t)records.size();
+	header.numNodes = (uint32_t)nodes.size();
+	if (!statSource(sourcePath, header.sourceSize, header.sourceModifiedTime) ||
+		!hashSource(sourcePath, header.sourceHash))
+		return false;
+
+	std::vector<CacheNode> packedNodes(nodes.size());
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		packedNodes[i].parent = nodes[i].parent;
+		packedNodes[i].localMat = nodes[i].localMat;
+	}
+
+	// Lay out the blobs after the mesh and node tables
+	std::vector<CacheEntry> entries(records.size());
+	size_t offset = sizeof(CacheHeader) + records.size() * sizeof(CacheEntry) +
+		nodes.size() * sizeof(CacheNode);
+	for (size_t i = 0; i < records.size(); ++i) {
+		CacheEntry& entry = entries[i];
+		// Zeroed padding keeps the file the same for the same meshes
+		memset(static_cast<void*>(&entry), 0, sizeof(entry));
+		entry.node = records[i].node;
+		entry.numLODs = (uint32_t)std::min(records[i].lods.size(), CACHE_MAX_LODS);
+		std::copy(records[i].lods.begin(),
+			records[i].lods.begin() + entry.numLODs, entry.lods);
+		entry.numVertices = records[i].numVertices;
+		entry.numIndices = records[i].numIndices;
+		entry.numMeshlets = records[i].numMeshlets;
+		entry.aabbMin = records[i].aabbMin;
+		entry.aabbMax = records[i].aabbMax;
+		packMaterial(records[i].material, entry.material);
+
+		offset = alignUp(offset, BLOB_ALIGNMENT);
+		entry.vertexOffset = offset;
+		offset += records[i].numVertices * sizeof(Vertex);
+		offset = alignUp(offset, BLOB_ALIGNMENT);
+		entry.indexOffset = offset;
+		offset += records[i].numIndices * sizeof(unsigned int);
+		offset = alignUp(offset, BLOB_ALIGNMENT);
+		entry.meshletOffset = offset;
+		offset += records[i].numMeshlets * sizeof(Meshlet);
+	}
+
+	std::string path = cachePath(sourcePath);
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out)
+			return false;
+
+		const char padding[BLOB_ALIGNMENT] = {};
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)entries.data(), entries.size() * sizeof(CacheEntry));
+		out.write((const char*)packedNodes.data(),
+			packedNodes.size() * sizeof(CacheNode));
+		size_t written = sizeof(header) + entries.size() * sizeof(CacheEntry) +
+			packedNodes.size() * sizeof(CacheNode);
+		for (size_t i = 0; i < records.size(); ++i) {
+			out.write(padding, entries[i].vertexOffset - written);
+			out.write((const char*)records[i].vertices,
+				records[i].numVertices * sizeof(Vertex));
+			written = entries[i].vertexOffset + records[i].numVertices * sizeof(Vertex);
+
+			out.write(padding, entries[i].indexOffset - written);
+			out.write((const char*)records[i].indices,
+				records[i].numIndices * sizeof(unsigned int));
+			written = entries[i].indexOffset +
+				records[i].numIndices * sizeof(unsigned int);
+
+			out.write(padding, entries[i].meshletOffset - written);
+			out.write((const char*)records[i].meshlets,
+				records[i].numMeshlets * sizeof(Meshlet));
+			written = entries[i].meshletOffset +
+				records[i].numMeshlets * sizeof(Meshlet);
+		}
+		if (!out) {
+			out.close();
+			std::error_code ec;
+			std::filesystem::remove(tempPath, ec);
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tempPath, path, ec);
+	if (ec) {
+		std::filesystem::remove(tempPath, ec);
+		return false;
+	}
+	std::cout << "Wrote mesh cache " << path << std::endl;
+	return true;
+}
@@ -0,0 +1,76 @@
+/*  Versioned binary cache of imported meshes, stored next to the source file.
+    Lets Model skip Assimp entirely when the source has not changed
+    - RAB
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Mesh.h"
+
+namespace meshCache {
+	/// <summary>
+	/// One mesh as laid out in the cache. Pointers refer to the mapped cache
+	/// file when read, or to the mesh's own arrays when written
+	/// </summary>
+	struct MeshRecord {
+		const Vertex* vertices;
+		size_t numVertices;
+		const unsigned int* indices;
+		size_t numIndices;
+		glm::vec3 aabbMin, aabbMax;
+		// Of the texture maps only the diffuse and specular paths are cached.
+		// The others are always empty
+		MTLMaterial material;
+		// Node the mesh hangs off, as an index into the node records
+		unsigned int node;
+		// Index ranges of the levels of detail. Every level is part of indices
+		std::vector<LODLevel> lods;
+		// Clusters of the full detail level
+		const Meshlet* meshlets;
+		size_t numMeshlets;
+	};
+
+	/// <summary>
+	/// One node of the model's hierarchy. Parents come before their children
+	/// </summary>
+	struct NodeRecord {
+		// Index of the parent node, -1 for roots
+		int parent;
+		glm::mat4 localMat;
+	};
+
+	/// <summary>
+	/// Gets the path of the cache belonging to a source file
+	/// </summary>
+	/// <param name="sourcePath"> path of the model file </param>
+	/// <returns> path of its cache file </returns>
+	std::string cachePath(const char* sourcePath);
+
+	/// <summary>
+	/// Maps the cache of a source file if it exists and is still valid. The
+	/// cache is valid if its version and layout match this build and the
+	/// source file's size, modification time and content hash are unchanged
+	/// </summary>
+	/// <param name="sourcePath"> path of the model file </param>
+	/// <param name="file"> Holds the mapping. Records point into it </param>
+	/// <param name="records"> Stores one record per cached mesh </param>
+	/// <param name="nodes"> Stores one record per cached node </param>
+	/// <returns> True if a valid cache was mapped, False if otherwise </returns>
+	bool read(const char* sourcePath, MappedFile& file,
+		std::vector<MeshRecord>& records, std::vector<NodeRecord>& nodes);
+
+	/// <summary>
+	/// Writes the cache of a source file. The file is written under a
+	/// temporary name and renamed into place so a crash never leaves a
+	/// half-written cache behind
+	/// </summary>
+	/// <param name="sourcePath"> path of the model file </param>
+	/// <param name="records"> meshes to store </param>
+	/// <param name="nodes"> nodes to store </param>
+	/// <returns> True if successful, False if otherwise </returns>
+	bool write(const char* sourcePath, const std::vector<MeshRecord>& records,
+		const std::vector<NodeRecord>& nodes);
+}
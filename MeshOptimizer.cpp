@@ -0,0 +1,274 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+
+namespace {
+	// Entries of the simulated post-transform cache. Small enough that the
+	// orderings also suit older hardware
+	const unsigned int CACHE_SIZE = 16;
+	// Clusters may have an ACMR up to 5% worse than the unsplit order
+	const float OVERDRAW_THRESHOLD = 1.05f;
+
+	/// <summary>
+	/// FIFO cache simulated with timestamps. A vertex is cached if fewer
+	/// than CACHE_SIZE misses happened since it was last loaded
+	/// </summary>
+	struct FIFOCache {
+		std::vector<uint32_t> loadTimes;
+		uint32_t time;
+
+		FIFOCache(size_t numVertices)
+			: loadTimes(numVertices, 0), time(CACHE_SIZE + 1) {}
+
+		// Starts over with an empty cache, without clearing every entry
+		void flush() {
+			time += CACHE_SIZE + 1;
+		}
+
+		// Returns 1 if the vertex was not cached
+		unsigned int access(unsigned int vertex) {
+			if (time - loadTimes[vertex] <= CACHE_SIZE)
+				return 0;
+			loadTimes[vertex] = time++;
+			return 1;
+		}
+	};
+
+	/// <summary>
+	/// Triangles around each vertex, as offsets into one array
+	/// </summary>
+	struct Adjacency {
+		std::vector<unsigned int> offsets;
+		std::vector<unsigned int> triangles;
+
+		Adjacency(const unsigned int* indices, size_t numIndices,
+			size_t numVertices) : offsets(numVertices + 1, 0),
+			triangles(numIndices) {
+			for (size_t i = 0; i < numIndices; ++i)
+				++offsets[indices[i] + 1];
+			std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+			std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < numIndices; ++i)
+				triangles[fill[indices[i]]++] = (unsigned int)(i / 3);
+		}
+	};
+
+	// Next fanning vertex after a dead end. Vertices that just left the
+	// fan come first, then the rest in input order
+	int skipDeadEnd(const std::vector<unsigned int>& liveTriangles,
+		std::vector<unsigned int>& deadEnds, size_t& cursor) {
+		while (!deadEnds.empty()) {
+			unsigned int vertex = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[vertex] > 0)
+				return (int)vertex;
+		}
+		for (; cursor < liveTriangles.size(); ++cursor) {
+			if (liveTriangles[cursor] > 0)
+				return (int)cursor;
+		}
+		return -1;
+	}
+}
+
+void meshOptimizer::analyzeVertexCache(const unsigned int* indices,
+	size_t numIndices, size_t numVertices, VertexCacheStats& stats) {
+	FIFOCache cache(numVertices);
+	std::vector<unsigned char> used(numVertices, 0);
+	size_t numUsed = 0;
+	for (size_t i = 0; i < numIndices; ++i) {
+		stats.numMisses += cache.access(indices[i]);
+		numUsed += !used[indices[i]];
+		used[indices[i]] = 1;
+	}
+	stats.numTriangles += numIndices / 3;
+	stats.numVertices += numUsed;
+}
+
+void meshOptimizer::optimizeVertexCache(unsigned int* indices,
+	size_t numIndices, size_t numVertices) {
+	size_t numTriangles = numIndices / 3;
+	if (numTriangles == 0)
+		return;
+	Adjacency adjacency(indices, numIndices, numVertices);
+	std::vector<unsigned int> liveTriangles(numVertices);
+	for (size_t v = 0; v < numVertices; ++v)
+		liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+	FIFOCache cache(numVertices);
+	std::vector<unsigned char> emitted(numTriangles, 0);
+	std::vector<unsigned int> deadEnds;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> output;
+	output.reserve(numIndices);
+	size_t cursor = 0;
+
+	int fanVertex = skipDeadEnd(liveTriangles, deadEnds, cursor);
+	while (fanVertex >= 0) {
+		// Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (unsigned int j = adjacency.offsets[fanVertex];
+			j < adjacency.offsets[fanVertex + 1]; ++j) {
+			unsigned int triangle = adjacency.triangles[j];
+			if (emitted[triangle])
+				continue;
+			emitted[triangle] = 1;
+			for (int k = 0; k < 3; ++k) {
+				unsigned int vertex = indices[3 * triangle + k];
+				output.push_back(vertex);
+				deadEnds.push_back(vertex);
+				candidates.push_back(vertex);
+				--liveTriangles[vertex];
+				cache.access(vertex);
+			}
+		}
+
+		// Fan around the candidate that will still be cached after its own
+		// fan is emitted, preferring the one that entered the cache first
+		int next = -1;
+		int bestPriority = -1;
+		for (unsigned int vertex : candidates) {
+			if (liveTriangles[vertex] == 0)
+				continue;
+			int priority = 0;
+			int age = (int)(cache.time - cache.loadTimes[vertex]);
+			if (age + 2 * (int)liveTriangles[vertex] <= (int)CACHE_SIZE)
+				priority = age;
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = (int)vertex;
+			}
+		}
+		fanVertex = (next >= 0) ? next : skipDeadEnd(liveTriangles, deadEnds, cursor);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void meshOptimizer::optimizeOverdraw(unsigned int* indices, size_t numIndices,
+	const Vertex* vertices, size_t numVertices, float threshold) {
+	size_t numTriangles = numIndices / 3;
+	if (numTriangles == 0)
+		return;
+
+	// Hard boundaries are where the cache starts over anyway: a triangle
+	// that misses on all three vertices
+	FIFOCache cache(numVertices);
+	std::vector<size_t> hardStarts;
+	for (size_t t = 0; t < numTriangles; ++t) {
+		unsigned int misses = cache.access(indices[3 * t]) +
+			cache.access(indices[3 * t + 1]) + cache.access(indices[3 * t + 2]);
+		if (misses == 3)
+			hardStarts.push_back(t);
+	}
+	if (hardStarts.empty() || hardStarts[0] != 0)
+		hardStarts.insert(hardStarts.begin(), 0);
+	hardStarts.push_back(numTriangles);
+
+	// Soft boundaries split a hard cluster wherever the part so far already
+	// does about as well as the whole
+	std::vector<size_t> clusterStarts;
+	for (size_t c = 0; c + 1 < hardStarts.size(); ++c) {
+		size_t first = hardStarts[c], last = hardStarts[c + 1];
+		cache.flush();
+		size_t clusterMisses = 0;
+		for (size_t i = 3 * first; i < 3 * last; ++i)
+			clusterMisses += cache.access(indices[i]);
+		float limit = threshold * clusterMisses / (last - first);
+
+		cache.flush();
+		clusterStarts.push_back(first);
+		size_t misses = 0, count = 0;
+		for (size_t t = first; t < last; ++t) {
+			misses += cache.access(indices[3 * t]) +
+				cache.access(indices[3 * t + 1]) + cache.access(indices[3 * t + 2]);
+			++count;
+			if (t + 1 < last && misses <= limit * count) {
+				clusterStarts.push_back(t + 1);
+				cache.flush();
+				misses = count = 0;
+			}
+		}
+	}
+	size_t numClusters = clusterStarts.size();
+	clusterStarts.push_back(numTriangles);
+
+	// Clusters facing away from the middle of the mesh tend to occlude the
+	// rest, so they go first. The key is how far the cluster lies along its
+	// own average normal
+	glm::vec3 meshCentroid(0.0f);
+	for (size_t v = 0; v < numVertices; ++v)
+		meshCentroid += vertices[v].position;
+	meshCentroid /= (float)std::max<size_t>(numVertices, 1);
+
+	std::vector<float> sortKeys(numClusters);
+	for (size_t c = 0; c < numClusters; ++c) {
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t) {
+			const glm::vec3& a = vertices[indices[3 * t]].position;
+			const glm::vec3& b = vertices[indices[3 * t + 1]].position;
+			const glm::vec3& c2 = vertices[indices[3 * t + 2]].position;
+			// Length is twice the area, so this weights by area
+			glm::vec3 n = glm::cross(b - a, c2 - a);
+			float triangleArea = glm::length(n);
+			centroid += (a + b + c2) * (triangleArea / 3.0f);
+			normal += n;
+			area += triangleArea;
+		}
+		float normalLength = glm::length(normal);
+		if (area <= 0.0f || normalLength <= 0.0f) {
+			sortKeys[c] = 0.0f;
+			continue;
+		}
+		centroid /= area;
+		sortKeys[c] = glm::dot(centroid - meshCentroid, normal / normalLength);
+	}
+
+	std::vector<unsigned int> order(numClusters);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	std::vector<unsigned int> output;
+	output.reserve(numIndices);
+	for (unsigned int c : order) {
+		output.insert(output.end(), indices + 3 * clusterStarts[c],
+			indices + 3 * clusterStarts[c + 1]);
+	}
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void meshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices,
+	std::vector<unsigned int>& indices) {
+	const unsigned int UNUSED = UINT32_MAX;
+	std::vector<unsigned int> remap(vertices.size(), UNUSED);
+	std::vector<Vertex> reordered;
+	reordered.reserve(vertices.size());
+	for (auto& index : indices) {
+		if (remap[index] == UNUSED) {
+			remap[index] = (unsigned int)reordered.size();
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(reordered);
+}
+
+bool meshOptimizer::optimize(std::vector<Vertex>& vertices,
+	std::vector<unsigned int>& indices) {
+	if (indices.empty() || indices.size() % 3 != 0)
+		return false;
+	for (unsigned int index : indices) {
+		if (index >= vertices.size())
+			return false;
+	}
+	optimizeVertexCache(indices.data(), indices.size(), vertices.size());
+	optimizeOverdraw(indices.data(), indices.size(), vertices.data(),
+		vertices.size(), OVERDRAW_THRESHOLD);
+	optimizeVertexFetch(vertices, indices);
+	return true;
+}
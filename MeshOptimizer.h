@@ -0,0 +1,87 @@
+/*  Reorders the triangles and vertices of imported meshes for the GPU:
+    triangles for the post-transform vertex cache and against overdraw,
+    vertices in the order the triangles fetch them
+    - RAB
+ */
+#pragma once
+
+#include <vector>
+
+#include "Mesh.h"
+
+namespace meshOptimizer {
+	/// <summary>
+	/// Post-transform cache behaviour of one or more meshes, as simulated by
+	/// analyzeVertexCache
+	/// </summary>
+	struct VertexCacheStats {
+		size_t numTriangles = 0;
+		size_t numVertices = 0;
+		size_t numMisses = 0;
+
+		// Average cache miss ratio. Vertices shaded per triangle, from 0.5
+		// for ideal grids to 3 for no reuse at all
+		inline float getACMR() const {
+			return numTriangles ? (float)numMisses / numTriangles : 0.0f;
+		}
+		// Average transformed vertex ratio. Times each vertex is shaded, 1
+		// at best
+		inline float getATVR() const {
+			return numVertices ? (float)numMisses / numVertices : 0.0f;
+		}
+	};
+
+	/// <summary>
+	/// Simulates a FIFO post-transform cache over a triangle list and adds
+	/// the result to stats
+	/// </summary>
+	/// <param name="indices"> triangle list </param>
+	/// <param name="numIndices"> number of indices. A multiple of 3 </param>
+	/// <param name="numVertices"> number of vertices the indices refer to </param>
+	/// <param name="stats"> Counts are added to it </param>
+	void analyzeVertexCache(const unsigned int* indices, size_t numIndices,
+		size_t numVertices, VertexCacheStats& stats);
+
+	/// <summary>
+	/// Reorders triangles for vertex cache locality with Tipsify. Fans
+	/// triangles around one vertex at a time and picks the next vertex among
+	/// those still in the cache. Runs in linear time
+	/// </summary>
+	/// <param name="indices"> triangle list to reorder in place </param>
+	/// <param name="numIndices"> number of indices. A multiple of 3 </param>
+	/// <param name="numVertices"> number of vertices the indices refer to </param>
+	void optimizeVertexCache(unsigned int* indices, size_t numIndices,
+		size_t numVertices);
+
+	/// <summary>
+	/// Splits a cache optimized triangle list into clusters where the cache
+	/// behaviour allows it and sorts them so outward facing clusters are
+	/// drawn first. Keeps triangles within a cluster in order
+	/// </summary>
+	/// <param name="indices"> triangle list to reorder in place </param>
+	/// <param name="numIndices"> number of indices. A multiple of 3 </param>
+	/// <param name="vertices"> vertices the indices refer to </param>
+	/// <param name="numVertices"> number of vertices </param>
+	/// <param name="threshold"> how much worse than the cluster's own ACMR a
+	/// split may make it. 1.05 allows 5% </param>
+	void optimizeOverdraw(unsigned int* indices, size_t numIndices,
+		const Vertex* vertices, size_t numVertices, float threshold);
+
+	/// <summary>
+	/// Renumbers vertices in the order the triangles first use them, so the
+	/// vertex fetch walks memory forwards. Unused vertices are dropped
+	/// </summary>
+	/// <param name="vertices"> vertices to reorder </param>
+	/// <param name="indices"> triangle list to renumber in place </param>
+	void optimizeVertexFetch(std::vector<Vertex>& vertices,
+		std::vector<unsigned int>& indices);
+
+	/// <summary>
+	/// Runs every stage on a mesh: vertex cache, overdraw, then vertex fetch.
+	/// Meshes that are not plain triangle lists are left alone
+	/// </summary>
+	/// <param name="vertices"> vertices of the mesh </param>
+	/// <param name="indices"> indices of the mesh </param>
+	/// <returns> True if the mesh was optimized </returns>
+	bool optimize(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+}
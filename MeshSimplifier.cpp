@@ -0,0 +1,285 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+
+#include "MeshOptimizer.h"
+
+namespace {
+	// Levels in a chain, the full mesh included
+	const size_t MAX_LOD_LEVELS = 6;
+	// Levels below this are not worth their draw call
+	const size_t MIN_LOD_TRIANGLES = 64;
+	// A level has to drop at least this share of the previous one's
+	// triangles, otherwise the chain ends
+	const float MIN_LOD_REDUCTION = 0.2f;
+
+	/// <summary>
+	/// Symmetric 4x4 matrix summing squared distances to planes
+	/// </summary>
+	struct Quadric {
+		double a00, a01, a02, a03;
+		double a11, a12, a13;
+		double a22, a23;
+		double a33;
+
+		Quadric() : a00(0), a01(0), a02(0), a03(0), a11(0), a12(0), a13(0),
+			a22(0), a23(0), a33(0) {}
+
+		// Plane n.p + d = 0, with n of unit length
+		Quadric(const glm::dvec3& n, double d, double weight)
+			: a00(weight * n.x * n.x), a01(weight * n.x * n.y),
+			  a02(weight * n.x * n.z), a03(weight * n.x * d),
+			  a11(weight * n.y * n.y), a12(weight * n.y * n.z),
+			  a13(weight * n.y * d), a22(weight * n.z * n.z),
+			  a23(weight * n.z * d), a33(weight * d * d) {}
+
+		Quadric& operator+=(const Quadric& q) {
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+			a11 += q.a11; a12 += q.a12; a13 += q.a13;
+			a22 += q.a22; a23 += q.a23;
+			a33 += q.a33;
+			return *this;
+		}
+
+		// Weighted sum of squared distances from p to the planes
+		double error(const glm::vec3& p) const {
+			double x = p.x, y = p.y, z = p.z;
+			double e = a00 * x * x + a11 * y * y + a22 * z * z + a33 +
+				2.0 * (a01 * x * y + a02 * x * z + a12 * y * z +
+					a03 * x + a13 * y + a23 * z);
+			return std::max(e, 0.0);
+		}
+	};
+
+	/// <summary>
+	/// Moving one vertex onto another
+	/// </summary>
+	struct Collapse {
+		double cost;
+		unsigned int from, to;
+	};
+
+	/// <summary>
+	/// Finds the vertices that must not move. A vertex is on a seam if
+	/// another vertex shares its position with different attributes, and on
+	/// a border if an edge at its position has only one triangle
+	/// </summary>
+	std::vector<unsigned char> findLockedVertices(PositionArray positions,
+		size_t numVertices, const unsigned int* indices, size_t numIndices) {
+		// Number every distinct position, by sorting instead of hashing
+		std::vector<unsigned int> order(numVertices);
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+			const glm::vec3& p = positions[a];
+			const glm::vec3& q = positions[b];
+			if (p.x != q.x)
+				return p.x < q.x;
+			if (p.y != q.y)
+				return p.y < q.y;
+			return p.z < q.z;
+		});
+		std::vector<unsigned int> positionIds(numVertices);
+		std::vector<unsigned char> lockedPositions;
+		for (size_t i = 0; i < numVertices; ++i) {
+			bool repeated = (i > 0 &&
+				positions[order[i]] == positions[order[i - 1]]);
+			if (!repeated)
+				lockedPositions.push_back(0);
+			else
+				lockedPositions.back() = 1;
+			positionIds[order[i]] = (unsigned int)lockedPositions.size() - 1;
+		}
+
+		// An edge is on the border if its reverse does not exist
+		std::vector<uint64_t> edges;
+		edges.reserve(numIndices);
+		for (size_t t = 0; t + 2 < numIndices; t += 3) {
+			for (int k = 0; k < 3; ++k) {
+				uint64_t a = positionIds[indices[t + k]];
+				uint64_t b = positionIds[indices[t + (k + 1) % 3]];
+				edges.push_back((a << 32) | b);
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (uint64_t edge : edges) {
+			uint64_t reverse = (edge << 32) | (edge >> 32);
+			if (!std::binary_search(edges.begin(), edges.end(), reverse)) {
+				lockedPositions[(size_t)(edge >> 32)] = 1;
+				lockedPositions[(size_t)(edge & 0xFFFFFFFFu)] = 1;
+			}
+		}
+
+		std::vector<unsigned char> locked(numVertices);
+		for (size_t v = 0; v < numVertices; ++v)
+			locked[v] = lockedPositions[positionIds[v]];
+		return locked;
+	}
+
+	// Whether moving from onto to turns any triangle around from over
+	bool flipsTriangle(PositionArray positions, const unsigned int* indices,
+		const std::vector<unsigned int>& offsets,
+		const std::vector<unsigned int>& triangles, unsigned int from,
+		unsigned int to) {
+		for (unsigned int j = offsets[from]; j < offsets[from + 1]; ++j) {
+			const unsigned int* corners = indices + 3 * triangles[j];
+			if (corners[0] == to || corners[1] == to || corners[2] == to)
+				continue;
+			glm::vec3 p[3], q[3];
+			for (int k = 0; k < 3; ++k) {
+				p[k] = positions[corners[k]];
+				q[k] = (corners[k] == from) ? positions[to] : p[k];
+			}
+			glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+			glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+			if (glm::dot(before, after) <= 0.0f)
+				return true;
+		}
+		return false;
+	}
+}
+
+size_t meshSimplifier::simplify(PositionArray positions, size_t numVertices,
+	const unsigned int* indices, size_t numIndices, size_t targetIndices,
+	unsigned int* destination) {
+	std::vector<unsigned int> result(indices, indices + numIndices);
+	std::vector<unsigned char> locked =
+		findLockedVertices(positions, numVertices, indices, numIndices);
+
+	// Each vertex starts with the planes of the triangles around it,
+	// weighted by area
+	std::vector<Quadric> quadrics(numVertices);
+	for (size_t t = 0; t + 2 < numIndices; t += 3) {
+		glm::dvec3 p0(positions[indices[t]]);
+		glm::dvec3 p1(positions[indices[t + 1]]);
+		glm::dvec3 p2(positions[indices[t + 2]]);
+		glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+		double length = glm::length(normal);
+		if (length <= 0.0)
+			continue;
+		normal = normal * (1.0 / length);
+		Quadric plane(normal, -glm::dot(normal, p0), 0.5 * length);
+		for (int k = 0; k < 3; ++k)
+			quadrics[indices[t + k]] += plane;
+	}
+
+	std::vector<unsigned int> collapseTo(numVertices);
+	std::iota(collapseTo.begin(), collapseTo.end(), 0);
+	std::vector<unsigned int> offsets, triangles;
+	std::vector<Collapse> candidates;
+	std::vector<unsigned char> touched(numVertices);
+
+	// Every pass collapses an independent set of the cheapest edges, then
+	// drops the triangles that became degenerate
+	while (result.size() > targetIndices) {
+		size_t numTriangles = result.size() / 3;
+
+		// Triangles around each vertex
+		offsets.assign(numVertices + 1, 0);
+		for (unsigned int index : result)
+			++offsets[index + 1];
+		std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+		triangles.resize(result.size());
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < result.size(); ++i)
+			triangles[fill[result[i]]++] = (unsigned int)(i / 3);
+
+		// Each directed edge only offers moving its start onto its end. The
+		// opposite move comes from the neighbouring triangle, which has the
+		// edge the other way round unless the edge is on a border or seam,
+		// where the start is locked anyway
+		candidates.clear();
+		for (size_t t = 0; t < numTriangles; ++t) {
+			for (int k = 0; k < 3; ++k) {
+				unsigned int a = result[3 * t + k];
+				unsigned int b = result[3 * t + (k + 1) % 3];
+				if (locked[a] || a == b)
+					continue;
+				Quadric sum = quadrics[a];
+				sum += quadrics[b];
+				candidates.push_back({ sum.error(positions[b]), a, b });
+			}
+		}
+		if (candidates.empty())
+			break;
+		std::sort(candidates.begin(), candidates.end(),
+			[](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		// Each collapse removes about two triangles
+		size_t maxCollapses = (numTriangles - targetIndices / 3 + 1) / 2;
+		size_t numCollapses = 0;
+		std::fill(touched.begin(), touched.end(), (unsigned char)0);
+		for (const Collapse& collapse : candidates) {
+			if (numCollapses >= maxCollapses)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+			if (flipsTriangle(positions, result.data(), offsets, triangles,
+				collapse.from, collapse.to))
+				continue;
+
+			collapseTo[collapse.from] = collapse.to;
+			quadrics[collapse.to] += quadrics[collapse.from];
+			// Nothing around the collapse moves again this pass, so the flip
+			// test above stays valid
+			for (unsigned int j = offsets[collapse.from];
+				j < offsets[collapse.from + 1]; ++j) {
+				const unsigned int* corners = result.data() + 3 * triangles[j];
+				touched[corners[0]] = touched[corners[1]] = touched[corners[2]] = 1;
+			}
+			touched[collapse.to] = 1;
+			++numCollapses;
+		}
+		if (numCollapses == 0)
+			break;
+
+		size_t written = 0;
+		for (size_t t = 0; t < numTriangles; ++t) {
+			unsigned int a = collapseTo[result[3 * t]];
+			unsigned int b = collapseTo[result[3 * t + 1]];
+			unsigned int c = collapseTo[result[3 * t + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			result[written++] = a;
+			result[written++] = b;
+			result[written++] = c;
+		}
+		result.resize(written);
+	}
+
+	std::copy(result.begin(), result.end(), destination);
+	return result.size();
+}
+
+void meshSimplifier::buildLODChain(PositionArray positions, size_t numVertices,
+	std::vector<unsigned int>& indices, std::vector<LODLevel>& lods) {
+	lods.clear();
+	if (indices.empty() || indices.size() % 3 != 0)
+		return;
+
+	std::vector<LODLevel> levels;
+	levels.push_back({ 0, (unsigned int)indices.size() });
+	std::vector<unsigned int> level;
+	while (levels.size() < MAX_LOD_LEVELS) {
+		// Each level is simplified from the one before, which is faster than
+		// starting over from the full mesh every time
+		LODLevel previous = levels.back();
+		size_t target = previous.numIndices / 6 * 3;
+		if (target / 3 < MIN_LOD_TRIANGLES)
+			break;
+		level.resize(previous.numIndices);
+		size_t numIndices = simplify(positions, numVertices,
+			indices.data() + previous.firstIndex, previous.numIndices, target,
+			level.data());
+		if (numIndices == 0 ||
+			numIndices > (1.0f - MIN_LOD_REDUCTION) * previous.numIndices)
+			break;
+
+		meshOptimizer::optimizeVertexCache(level.data(), numIndices, numVertices);
+		levels.push_back({ (unsigned int)indices.size(), (unsigned int)numIndices });
+		indices.insert(indices.end(), level.begin(), level.begin() + numIndices);
+	}
+	if (levels.size() > 1)
+		lods.swap(levels);
+}
@@ -0,0 +1,45 @@
+/*  Quadric error metric simplification for level of detail chains. Every
+    level collapses vertices onto other vertices, so all levels index the
+    mesh's original vertex buffer
+    - RAB
+ */
+#pragma once
+
+#include <vector>
+
+#include "Mesh.h"
+
+namespace meshSimplifier {
+	/// <summary>
+	/// Simplifies a triangle list by collapsing edges in order of quadric
+	/// error. Vertices on borders and on attribute seams stay put, so
+	/// neighbouring meshes and UV islands do not crack apart
+	/// </summary>
+	/// <param name="positions"> positions of the vertices the indices refer
+	/// to </param>
+	/// <param name="numVertices"> number of vertices </param>
+	/// <param name="indices"> triangle list to simplify </param>
+	/// <param name="numIndices"> number of indices. A multiple of 3 </param>
+	/// <param name="targetIndices"> number of indices to aim for </param>
+	/// <param name="destination"> Room for numIndices indices. Stores the
+	/// simplified triangle list </param>
+	/// <returns> Number of indices written. More than targetIndices if the
+	/// mesh cannot be simplified that far </returns>
+	size_t simplify(PositionArray positions, size_t numVertices,
+		const unsigned int* indices, size_t numIndices, size_t targetIndices,
+		unsigned int* destination);
+
+	/// <summary>
+	/// Builds up to six levels of detail, each about half the triangles of
+	/// the one before. Stops early once a level would be tiny or barely
+	/// smaller than the last
+	/// </summary>
+	/// <param name="positions"> positions of the mesh's vertices </param>
+	/// <param name="numVertices"> number of vertices </param>
+	/// <param name="indices"> triangle list of the mesh. The coarser levels
+	/// are appended to it </param>
+	/// <param name="lods"> Stores the index range of each level, finest
+	/// first. Left empty if no coarser level could be built </param>
+	void buildLODChain(PositionArray positions, size_t numVertices,
+		std::vector<unsigned int>& indices, std::vector<LODLevel>& lods);
+}
@@ -0,0 +1,232 @@
+#include "MeshletBuilder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace {
+	// Sizes that suit both task/mesh shader hardware and CPU culling
+	const size_t MAX_MESHLET_VERTICES = 64;
+	const size_t MAX_MESHLET_TRIANGLES = 124;
+	// Cones wider than this cannot be culled from enough directions to be
+	// worth testing. Cosine of the widest normal from the axis
+	const float MIN_CONE_SPREAD = 0.1f;
+
+	/// <summary>
+	/// Numbers every distinct position. Vertices split only by their normal
+	/// or UVs then still count as neighbours
+	/// </summary>
+	std::vector<unsigned int> numberPositions(PositionArray positions,
+		size_t numVertices, size_t& numPositions) {
+		std::vector<unsigned int> order(numVertices);
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+			const glm::vec3& p = positions[a];
+			const glm::vec3& q = positions[b];
+			if (p.x != q.x)
+				return p.x < q.x;
+			if (p.y != q.y)
+				return p.y < q.y;
+			return p.z < q.z;
+		});
+		std::vector<unsigned int> positionIds(numVertices);
+		numPositions = 0;
+		for (size_t i = 0; i < numVertices; ++i) {
+			if (i == 0 ||
+				positions[order[i]] != positions[order[i - 1]])
+				++numPositions;
+			positionIds[order[i]] = (unsigned int)numPositions - 1;
+		}
+		return positionIds;
+	}
+
+	/// <summary>
+	/// Fits the bounding sphere and normal cone of a finished meshlet
+	/// </summary>
+	void computeBounds(PositionArray positions, const unsigned int* indices,
+		Meshlet& meshlet) {
+		const unsigned int* first = indices + meshlet.firstIndex;
+		const unsigned int* last = first + meshlet.numIndices;
+
+		glm::vec3 min(std::numeric_limits<float>::max());
+		glm::vec3 max(std::numeric_limits<float>::lowest());
+		for (const unsigned int* i = first; i != last; ++i) {
+			min = glm::min(min, positions[*i]);
+			max = glm::max(max, positions[*i]);
+		}
+		meshlet.center = 0.5f * (min + max);
+		meshlet.radius = 0.0f;
+		for (const unsigned int* i = first; i != last; ++i) {
+			meshlet.radius = std::max(meshlet.radius,
+				glm::length(positions[*i] - meshlet.center));
+		}
+
+		// The axis averages the unit normals. The cone is as wide as the
+		// normal furthest from it
+		glm::vec3 normalSum(0.0f);
+		for (const unsigned int* t = first; t != last; t += 3) {
+			glm::vec3 n = glm::cross(positions[t[1]] - positions[t[0]],
+				positions[t[2]] - positions[t[0]]);
+			float length = glm::length(n);
+			if (length > 0.0f)
+				normalSum += n / length;
+		}
+		meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneApex = meshlet.center;
+		meshlet.coneCutoff = 2.0f;
+		float sumLength = glm::length(normalSum);
+		if (sumLength <= 0.0f)
+			return;
+		glm::vec3 axis = normalSum / sumLength;
+
+		float minDot = 1.0f;
+		for (const unsigned int* t = first; t != last; t += 3) {
+			glm::vec3 n = glm::cross(positions[t[1]] - positions[t[0]],
+				positions[t[2]] - positions[t[0]]);
+			float length = glm::length(n);
+			if (length > 0.0f)
+				minDot = std::min(minDot, glm::dot(axis, n / length));
+		}
+		meshlet.coneAxis = axis;
+		if (minDot <= MIN_CONE_SPREAD)
+			return;
+
+		// The apex is pushed back along the axis until it is behind every
+		// triangle. A viewer can then only see a triangle if it sees the
+		// apex from the front, within the cone widened by 90 degrees
+		float apexDistance = 0.0f;
+		for (const unsigned int* t = first; t != last; t += 3) {
+			const glm::vec3& p = positions[t[0]];
+			glm::vec3 n = glm::cross(positions[t[1]] - p,
+				positions[t[2]] - p);
+			float length = glm::length(n);
+			if (length <= 0.0f)
+				continue;
+			n /= length;
+			apexDistance = std::max(apexDistance,
+				glm::dot(meshlet.center - p, n) / glm::dot(axis, n));
+		}
+		meshlet.coneApex = meshlet.center - axis * apexDistance;
+		meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+	}
+}
+
+void meshletBuilder::build(PositionArray positions, size_t numVertices,
+	unsigned int* indices, size_t numIndices, std::vector<Meshlet>& meshlets) {
+	meshlets.clear();
+	size_t numTriangles = numIndices / 3;
+	if (numTriangles == 0)
+		return;
+
+	// Triangles around each position
+	size_t numPositions;
+	std::vector<unsigned int> positionIds =
+		numberPositions(positions, numVertices, numPositions);
+	std::vector<unsigned int> offsets(numPositions + 1, 0);
+	for (size_t i = 0; i < numTriangles * 3; ++i)
+		++offsets[positionIds[indices[i]] + 1];
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+	std::vector<unsigned int> adjacent(numTriangles * 3);
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < numTriangles * 3; ++i)
+		adjacent[fill[positionIds[indices[i]]]++] = (unsigned int)(i / 3);
+
+	std::vector<unsigned char> emitted(numTriangles, 0);
+	// Meshlet that last took each vertex, and that last queued each
+	// triangle, plus one
+	std::vector<unsigned int> owners(numVertices, 0);
+	std::vector<unsigned int> queued(numTriangles, 0);
+	std::vector<unsigned int> output;
+	output.reserve(numTriangles * 3);
+	std::vector<unsigned int> candidates;
+	size_t cursor = 0;
+
+	while (output.size() < numTriangles * 3) {
+		unsigned int owner = (unsigned int)meshlets.size() + 1;
+		Meshlet meshlet;
+		meshlet.firstIndex = (unsigned int)output.size();
+		size_t meshletVertices = 0, meshletTriangles = 0;
+		glm::vec3 cornerSum(0.0f);
+
+		// The newest leftover neighbour of the last meshlet seeds this one,
+		// so consecutive meshlets stay next to each other too. The rest are
+		// dropped, or the list would grow with every meshlet
+		while (!candidates.empty() && emitted[candidates.back()])
+			candidates.pop_back();
+		if (!candidates.empty())
+			candidates.erase(candidates.begin(), candidates.end() - 1);
+
+		for (;;) {
+			int best = -1;
+			size_t bestNew = 4;
+			float bestDistance = std::numeric_limits<float>::max();
+			glm::vec3 centroid = meshletTriangles ?
+				cornerSum / (3.0f * meshletTriangles) : glm::vec3(0.0f);
+			size_t live = 0;
+			for (unsigned int triangle : candidates) {
+				if (emitted[triangle])
+					continue;
+				candidates[live++] = triangle;
+				const unsigned int* corners = indices + 3 * triangle;
+				size_t numNew = (owners[corners[0]] != owner) +
+					(owners[corners[1]] != owner && corners[1] != corners[0]) +
+					(owners[corners[2]] != owner && corners[2] != corners[0] &&
+						corners[2] != corners[1]);
+				float distance = 0.0f;
+				if (meshletTriangles) {
+					glm::vec3 d = (positions[corners[0]] +
+						positions[corners[1]] +
+						positions[corners[2]]) / 3.0f - centroid;
+					distance = glm::dot(d, d);
+				}
+				if (numNew < bestNew || (numNew == bestNew && distance < bestDistance)) {
+					best = (int)triangle;
+					bestNew = numNew;
+					bestDistance = distance;
+				}
+			}
+			candidates.resize(live);
+
+			// Nothing connected is left, so continue in input order
+			if (best < 0) {
+				while (cursor < numTriangles && emitted[cursor])
+					++cursor;
+				if (cursor == numTriangles)
+					break;
+				candidates.push_back((unsigned int)cursor);
+				continue;
+			}
+			if (meshletVertices + bestNew > MAX_MESHLET_VERTICES ||
+				meshletTriangles + 1 > MAX_MESHLET_TRIANGLES)
+				break;
+
+			emitted[best] = 1;
+			++meshletTriangles;
+			meshletVertices += bestNew;
+			for (int k = 0; k < 3; ++k) {
+				unsigned int vertex = indices[3 * best + k];
+				output.push_back(vertex);
+				cornerSum += positions[vertex];
+				if (owners[vertex] == owner)
+					continue;
+				owners[vertex] = owner;
+				unsigned int position = positionIds[vertex];
+				for (unsigned int j = offsets[position]; j < offsets[position + 1]; ++j) {
+					unsigned int triangle = adjacent[j];
+					if (emitted[triangle] || queued[triangle] == owner)
+						continue;
+					queued[triangle] = owner;
+					candidates.push_back(triangle);
+				}
+			}
+		}
+
+		meshlet.numIndices = (unsigned int)output.size() - meshlet.firstIndex;
+		meshlets.push_back(meshlet);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+	for (auto& meshlet : meshlets)
+		computeBounds(positions, indices, meshlet);
+}
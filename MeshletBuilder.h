@@ -0,0 +1,27 @@
+/*  Splits meshes into meshlets: clusters of up to 64 vertices and 124
+    triangles that are culled one by one instead of with the whole mesh
+    - RAB
+ */
+#pragma once
+
+#include <vector>
+
+#include "Mesh.h"
+
+namespace meshletBuilder {
+	/// <summary>
+	/// Groups the triangles of a mesh into meshlets. Each meshlet grows from
+	/// a seed by the neighbouring triangle that adds the fewest new vertices,
+	/// so clusters stay compact and their bounds tight. Triangles are
+	/// reordered so every meshlet is one range of the indices
+	/// </summary>
+	/// <param name="positions"> positions of the vertices the indices refer
+	/// to </param>
+	/// <param name="numVertices"> number of vertices </param>
+	/// <param name="indices"> triangle list to split. Reordered in place </param>
+	/// <param name="numIndices"> number of indices. A multiple of 3 </param>
+	/// <param name="meshlets"> Stores the meshlets in the order of indices
+	/// </param>
+	void build(PositionArray positions, size_t numVertices, unsigned int* indices,
+		size_t numIndices, std::vector<Meshlet>& meshlets);
+}
@@ -0,0 +1,293 @@
+#include "MipChain.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "AsyncLoader.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MIP_X86
+#include <xmmintrin.h>
+#endif
+
+using mipChain::MipFilter;
+
+namespace {
+	// Rows one task of the worker pool filters
+	const int ROWS_PER_TASK = 16;
+	// Half width of the Kaiser filter in destination texels. Takes in the
+	// first negative lobe of the sinc
+	const float KAISER_RADIUS = 2.0f;
+	// Shape of the Kaiser window. Larger rings less but blurs more
+	const float KAISER_ALPHA = 4.0f;
+	const float PI = 3.14159265358979f;
+	// Buckets of linear values that sRGB encoding starts its search from
+	const int ENCODE_BUCKETS = 4096;
+
+	float srgbToLinear(float value) {
+		return value <= 0.04045f ? value / 12.92f :
+			std::pow((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	/// <summary>
+	/// Lookup tables between sRGB and linear light
+	/// </summary>
+	struct SRGBTables {
+		// Linear value of every sRGB value
+		float toLinear[256];
+		// Every byte value over 255, for alpha and colors that are not sRGB
+		float toUnorm[256];
+		// Linear value halfway between sRGB values i and i + 1. Encoding
+		// counts the thresholds below a value, which rounds to the nearest
+		// sRGB value exactly
+		float thresholds[255];
+		// Smallest sRGB value of every bucket, so encoding only steps over
+		// the thresholds inside one bucket
+		unsigned char bucketStart[ENCODE_BUCKETS + 1];
+
+		SRGBTables() {
+			for (int i = 0; i < 256; ++i) {
+				toLinear[i] = srgbToLinear(i / 255.0f);
+				toUnorm[i] = i / 255.0f;
+			}
+			for (int i = 0; i < 255; ++i)
+				thresholds[i] = srgbToLinear((i + 0.5f) / 255.0f);
+			for (int i = 0; i <= ENCODE_BUCKETS; ++i) {
+				bucketStart[i] = (unsigned char)(std::upper_bound(thresholds,
+					thresholds + 255, (float)i / ENCODE_BUCKETS) - thresholds);
+			}
+		}
+
+		// Encodes a linear value in [0, 1]
+		unsigned char encode(float value) const {
+			int code = bucketStart[(int)(value * ENCODE_BUCKETS)];
+			while (code < 255 && value >= thresholds[code])
+				++code;
+			return (unsigned char)code;
+		}
+	};
+
+	const SRGBTables& srgbTables() {
+		static SRGBTables instance;
+		return instance;
+	}
+
+	/// <summary>
+	/// Weights of the source texels behind every destination texel along
+	/// one axis
+	/// </summary>
+	struct Kernel {
+		struct Taps {
+			// First source texel and number of texels, all inside the image
+			int first, count;
+			// Where the weights of the texels start in weights
+			size_t offset;
+		};
+		std::vector<Taps> taps;
+		std::vector<float> weights;
+	};
+
+	// Modified Bessel function of the first kind, order 0
+	float bessel0(float x) {
+		float sum = 1.0f, term = 1.0f;
+		float halfSquared = x * x / 4.0f;
+		for (int k = 1; k < 32 && term > sum * 1e-8f; ++k) {
+			term *= halfSquared / (float)(k * k);
+			sum += term;
+		}
+		return sum;
+	}
+
+	float kaiser(float t) {
+		if (std::abs(t) >= KAISER_RADIUS)
+			return 0.0f;
+		float sinc = t == 0.0f ? 1.0f : std::sin(PI * t) / (PI * t);
+		float ratio = t / KAISER_RADIUS;
+		return sinc * bessel0(KAISER_ALPHA * std::sqrt(1.0f - ratio * ratio)) /
+			bessel0(KAISER_ALPHA);
+	}
+
+	/// <summary>
+	/// Works out the weights for shrinking one axis. Texels past the edges
+	/// repeat the edge texel, so their weight goes to it
+	/// </summary>
+	void buildKernel(int srcSize, int dstSize, MipFilter filter, Kernel& kernel) {
+		float scale = (float)srcSize / dstSize;
+		float support = filter == MipFilter::BOX ? 0.5f * scale : KAISER_RADIUS * scale;
+		kernel.taps.resize(dstSize);
+		kernel.weights.clear();
+		std::vector<float> row;
+		for (int x = 0; x < dstSize; ++x) {
+			float center = (x + 0.5f) * scale;
+			int first = (int)std::floor(center - support);
+			int last = (int)std::ceil(center + support);
+			int clampedFirst = std::max(first, 0);
+			int clampedLast = std::min(last, srcSize);
+			row.assign(clampedLast - clampedFirst, 0.0f);
+			float sum = 0.0f;
+			for (int i = first; i < last; ++i) {
+				float weight;
+				if (filter == MipFilter::BOX) {
+					float low = std::max((float)i, center - support);
+					float high = std::min((float)(i + 1), center + support);
+					weight = std::max(high - low, 0.0f);
+				}
+				else {
+					weight = kaiser((i + 0.5f - center) / scale);
+				}
+				int j = std::min(std::max(i, 0), srcSize - 1);
+				row[j - clampedFirst] += weight;
+				sum += weight;
+			}
+			Kernel::Taps& taps = kernel.taps[x];
+			taps.first = clampedFirst;
+			taps.count = (int)row.size();
+			taps.offset = kernel.weights.size();
+			for (float weight : row)
+				kernel.weights.push_back(weight / sum);
+		}
+	}
+
+	/// <summary>
+	/// Shrinks one row of RGBA floats along x
+	/// </summary>
+	void filterRow(const float* src, const Kernel& kernel, float* dst) {
+		for (size_t x = 0; x < kernel.taps.size(); ++x) {
+			const Kernel::Taps& taps = kernel.taps[x];
+			const float* weights = kernel.weights.data() + taps.offset;
+			const float* texel = src + 4 * (size_t)taps.first;
+#ifdef MIP_X86
+			__m128 sum = _mm_setzero_ps();
+			for (int k = 0; k < taps.count; ++k) {
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]),
+					_mm_loadu_ps(texel + 4 * k)));
+			}
+			_mm_storeu_ps(dst + 4 * x, sum);
+#else
+			float sum[4] = {};
+			for (int k = 0; k < taps.count; ++k) {
+				for (int c = 0; c < 4; ++c)
+					sum[c] += weights[k] * texel[4 * k + c];
+			}
+			for (int c = 0; c < 4; ++c)
+				dst[4 * x + c] = sum[c];
+#endif
+		}
+	}
+
+	/// <summary>
+	/// Adds a weighted row of RGBA floats to another
+	/// </summary>
+	void addRow(const float* src, float weight, size_t numFloats, float* dst) {
+		size_t i = 0;
+#ifdef MIP_X86
+		__m128 factor = _mm_set1_ps(weight);
+		for (; i < numFloats; i += 4) {
+			_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i),
+				_mm_mul_ps(factor, _mm_loadu_ps(src + i))));
+		}
+#endif
+		for (; i < numFloats; ++i)
+			dst[i] += weight * src[i];
+	}
+
+	/// <summary>
+	/// Clamps a row of RGBA floats to [0, 1], as negative lobes can overshoot,
+	/// and encodes it to RGBA8
+	/// </summary>
+	void encodeRow(float* row, size_t numTexels, bool srgb, unsigned char* out) {
+		const SRGBTables& tables = srgbTables();
+		for (size_t i = 0; i < 4 * numTexels; i += 4) {
+#ifdef MIP_X86
+			_mm_storeu_ps(row + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(row + i),
+				_mm_setzero_ps()), _mm_set1_ps(1.0f)));
+#else
+			for (int c = 0; c < 4; ++c)
+				row[i + c] = std::min(std::max(row[i + c], 0.0f), 1.0f);
+#endif
+			// Values are clamped, so adding a half rounds to nearest
+			for (int c = 0; c < 3; ++c) {
+				out[i + c] = srgb ? tables.encode(row[i + c]) :
+					(unsigned char)(row[i + c] * 255.0f + 0.5f);
+			}
+			out[i + 3] = (unsigned char)(row[i + 3] * 255.0f + 0.5f);
+		}
+	}
+
+	size_t numTasks(int numRows) {
+		return (size_t)(numRows + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+	}
+}
+
+int mipChain::numLevels(int width, int height) {
+	int count = 1;
+	for (int size = std::max(width, height); size > 1; size >>= 1)
+		++count;
+	return count;
+}
+
+void mipChain::build(const unsigned char* pixels, int width, int height,
+	bool srgb, MipFilter filter, std::vector<MipLevel>& levels) {
+	levels.assign(numLevels(width, height), MipLevel());
+	levels[0].width = width;
+	levels[0].height = height;
+	levels[0].pixels.assign(pixels, pixels + (size_t)width * height * 4);
+
+	// Levels are filtered from the linear floats of the level before, not
+	// from its rounded bytes
+	const SRGBTables& tables = srgbTables();
+	const float* colorTable = srgb ? tables.toLinear : tables.toUnorm;
+	std::vector<float> current((size_t)width * height * 4);
+	asyncLoader::parallelFor(numTasks(height), [&](size_t task) {
+		size_t first = task * ROWS_PER_TASK * (size_t)width * 4;
+		size_t last = std::min((size_t)height, (task + 1) * ROWS_PER_TASK) *
+			(size_t)width * 4;
+		for (size_t i = first; i < last; i += 4) {
+			for (int c = 0; c < 3; ++c)
+				current[i + c] = colorTable[pixels[i + c]];
+			current[i + 3] = tables.toUnorm[pixels[i + 3]];
+		}
+	});
+
+	std::vector<float> shrunkRows, next;
+	Kernel horizontal, vertical;
+	int srcWidth = width, srcHeight = height;
+	for (size_t level = 1; level < levels.size(); ++level) {
+		int dstWidth = std::max(srcWidth / 2, 1);
+		int dstHeight = std::max(srcHeight / 2, 1);
+		buildKernel(srcWidth, dstWidth, filter, horizontal);
+		buildKernel(srcHeight, dstHeight, filter, vertical);
+		MipLevel& out = levels[level];
+		out.width = dstWidth;
+		out.height = dstHeight;
+		out.pixels.resize((size_t)dstWidth * dstHeight * 4);
+
+		// Shrink every row along x, then shrink the columns of the result
+		size_t dstRowFloats = (size_t)dstWidth * 4;
+		shrunkRows.resize((size_t)srcHeight * dstRowFloats);
+		asyncLoader::parallelFor(numTasks(srcHeight), [&](size_t task) {
+			int last = std::min(srcHeight, (int)(task + 1) * ROWS_PER_TASK);
+			for (int y = (int)task * ROWS_PER_TASK; y < last; ++y) {
+				filterRow(current.data() + (size_t)y * srcWidth * 4, horizontal,
+					shrunkRows.data() + y * dstRowFloats);
+			}
+		});
+		next.assign((size_t)dstHeight * dstRowFloats, 0.0f);
+		asyncLoader::parallelFor(numTasks(dstHeight), [&](size_t task) {
+			int last = std::min(dstHeight, (int)(task + 1) * ROWS_PER_TASK);
+			for (int y = (int)task * ROWS_PER_TASK; y < last; ++y) {
+				const Kernel::Taps& taps = vertical.taps[y];
+				float* row = next.data() + y * dstRowFloats;
+				for (int k = 0; k < taps.count; ++k) {
+					addRow(shrunkRows.data() + (taps.first + k) * dstRowFloats,
+						vertical.weights[taps.offset + k], dstRowFloats, row);
+				}
+				encodeRow(row, dstWidth, srgb, out.pixels.data() + y * dstRowFloats);
+			}
+		});
+
+		current.swap(next);
+		srcWidth = dstWidth;
+		srcHeight = dstHeight;
+	}
+}
@@ -0,0 +1,50 @@
+/*  Builds the mip chain of an RGBA8 image on the CPU, so textures do not
+    wait on glGenerateMipmap and their levels can be cached with the rest of
+    the texture. Colors are filtered in linear light and every level is split
+    into bands of rows for the worker pool
+    - RAB
+ */
+#pragma once
+
+#include <vector>
+
+namespace mipChain {
+	/// <summary>
+	/// Filters that make each level from the one above it
+	/// </summary>
+	enum class MipFilter {
+		// Averages the texels a destination texel covers. Cheap but blurry
+		BOX,
+		// Kaiser windowed sinc. Keeps more detail and aliases less
+		KAISER
+	};
+
+	/// <summary>
+	/// One level of a chain
+	/// </summary>
+	struct MipLevel {
+		int width, height;
+		// RGBA8 texels, rows top to bottom
+		std::vector<unsigned char> pixels;
+	};
+
+	/// <summary>
+	/// Gets the number of levels of a full chain, down to 1x1
+	/// </summary>
+	int numLevels(int width, int height);
+
+	/// <summary>
+	/// Builds the full chain of an image. Each level halves the size of the
+	/// one before it, rounding down and stopping at 1
+	/// </summary>
+	/// <param name="pixels"> RGBA8 pixels of level 0 </param>
+	/// <param name="width"> width in pixels </param>
+	/// <param name="height"> height in pixels </param>
+	/// <param name="srgb"> whether the colors are sRGB encoded, in which case
+	/// they are filtered in linear light and encoded again. Alpha is always
+	/// filtered as it is </param>
+	/// <param name="filter"> filter to downsample with </param>
+	/// <param name="levels"> Stores every level, level 0 first </param>
+	void build(const unsigned char* pixels, int width, int height, bool srgb,
+		MipFilter filter, std::vector<MipLevel>& levels);
+}
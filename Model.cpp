@@ -2,174 +2,522 @@
 
 #include <glad/glad.h>
 
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <filesystem>
+
+#include "AABB.h"
 #include "PrintDebug.h"
+#include "TextureCache.h"
+
+namespace {
+	// Vertex and index data a progressive load uploads per frame at most
+	const size_t UPLOAD_BYTES_PER_FRAME = 32 << 20;
+	// Most meshes, and instanced copies, a leaf of their hierarchies holds
+	const unsigned int MESHES_PER_LEAF = 4;
+	const unsigned int COPIES_PER_LEAF = 4;
+}
 
-Model::Model(const char* path) : Object(renderType::PHONG) {
+Model::Model(const char* path, bool async)
+	: Object(renderType::PHONG), async(async), loaded(false),
+	  loadToken(std::make_shared<LoadToken>()), loader(nullptr),
+	  instanceBuffer(0), instanceTexture(0), builtMeshes(0), boundsDirty(true),
+	  worldBoundsValid(false) {
 	model = glm::mat4(1.0f);
 	if (!load(path)) {
 		std::cout << "Exiting program...\n";
 		exit(EXIT_FAILURE);
 	}
-	centerToOrigin();
 }
 
 Model::~Model() {
-	for (auto& mesh : meshes) {
-		glDeleteBuffers(1, &mesh.VBO);
-		glDeleteBuffers(1, &mesh.EBO);
-		glDeleteVertexArrays(1, &mesh.VAO);
+	// Jobs still in flight must not touch the model any more
+	loadToken->cancelled = true;
+	delete loader;
+	for (auto& mesh : meshes)
+		mesh.deleteBuffers();
+	setInstances(std::vector<glm::mat4>());
+}
+
+void Model::update() {
+	if (nodes.update())
+		boundsDirty = true;
+	if (loader == nullptr)
+		return;
+
+	// Spread the uploads over several frames so the window stays responsive
+	std::vector<ProgressiveBatch> batches;
+	loader->takeBatches(batches, UPLOAD_BYTES_PER_FRAME);
+	bool first = meshes.empty() && !batches.empty();
+	for (auto& batch : batches) {
+		meshes.push_back(Mesh(std::move(batch.vertices), std::move(batch.indices),
+			textureCache::materialTextures(batch.material->properties),
+			batch.material, batch.aabbMin, batch.aabbMax,
+			std::move(batch.lods), std::move(batch.meshlets)));
+		meshNodes.push_back(0);
+		boundsDirty = true;
+	}
+	// Center on the first geometry so the model shows up near the origin.
+	// Recentered once the whole file is in
+	if (first) {
+		centerToOrigin();
+		std::chrono::duration<double> seconds =
+			std::chrono::steady_clock::now() - loadStart;
+		std::cout << "First geometry visible after " << seconds.count();
+		std::cout << " s\n";
+	}
+
+	bool success;
+	if (!loader->isDone(success))
+		return;
+	delete loader;
+	loader = nullptr;
+	if (!success) {
+		std::cout << "Exiting program...\n";
+		exit(EXIT_FAILURE);
+	}
+
+	centerToOrigin();
+	finishLoad();
+
+	// The progressive loader writes no cache. Assimp builds it in the
+	// background, optimized, so the next run reads the model from it
+	std::string path = sourcePath;
+	asyncLoader::submit([path]() {
+		ModelImporter importer(path.c_str());
+		std::vector<ImportedMesh> imported;
+		NodeHierarchy hierarchy;
+		importer.importSource(imported, hierarchy);
+	});
+}
+
+bool Model::isLoaded() const {
+	return loaded;
+}
+
+void Model::setInstances(const std::vector<glm::mat4>& transforms) {
+	instances = transforms;
+	worldBoundsValid = false;
+	if (instances.empty()) {
+		if (instanceTexture) {
+			glDeleteTextures(1, &instanceTexture);
+			glDeleteBuffers(1, &instanceBuffer);
+		}
+		instanceTexture = instanceBuffer = 0;
+		return;
+	}
+
+	if (!instanceBuffer) {
+		glGenBuffers(1, &instanceBuffer);
+		glGenTextures(1, &instanceTexture);
 	}
+	glBindBuffer(GL_TEXTURE_BUFFER, instanceBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, instances.size() * sizeof(glm::mat4),
+		instances.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	// Each matrix is four texels, one column each
+	glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instanceBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+size_t Model::getNumInstances() const {
+	return instances.size();
+}
+
+NodeHierarchy& Model::getNodes() {
+	return nodes;
 }
 
 void Model::draw(const Shader& program, glm::mat4 view, glm::mat4 projection) {
+	drawMeshes(program, view, projection, false);
+}
+
+void Model::updateBounds() {
+	if (!boundsDirty)
+		return;
+	boundsDirty = false;
+	worldBoundsValid = false;
+	size_t numMeshes = meshes.size();
+	meshMins.resize(numMeshes);
+	meshMaxs.resize(numMeshes);
+	modelMin = glm::vec3(std::numeric_limits<float>::max());
+	modelMax = glm::vec3(std::numeric_limits<float>::lowest());
+	for (size_t i = 0; i < numMeshes; ++i) {
+		meshes[i].getBounds(nodes.getWorldMat(meshNodes[i]), meshMins[i],
+			meshMaxs[i]);
+		aabb::merge(modelMin, modelMax, meshMins[i], meshMaxs[i]);
+	}
+
+	if (numMeshes > builtMeshes &&
+		(loaded || numMeshes > builtMeshes + builtMeshes / 4)) {
+		meshBVH.build(meshMins.data(), meshMaxs.data(), numMeshes,
+			MESHES_PER_LEAF);
+		builtMeshes = numMeshes;
+	}
+	else if (builtMeshes > 0) {
+		meshBVH.update(meshMins.data(), meshMaxs.data(), builtMeshes,
+			MESHES_PER_LEAF);
+	}
+}
+
+void Model::updateWorldBounds() {
+	updateBounds();
+	glm::mat4 world = getWorldMat();
+	if (worldBoundsValid && world == boundsWorld)
+		return;
+	boundsWorld = world;
+	worldBoundsValid = true;
+	worldMin = glm::vec3(std::numeric_limits<float>::max());
+	worldMax = glm::vec3(std::numeric_limits<float>::lowest());
+	if (!aabb::isValid(modelMin, modelMax))
+		return;
+	if (instances.empty()) {
+		aabb::transform(modelMin, modelMax, world, worldMin, worldMax);
+		return;
+	}
+
+	instanceMins.resize(instances.size());
+	instanceMaxs.resize(instances.size());
+	for (size_t i = 0; i < instances.size(); ++i) {
+		aabb::transform(modelMin, modelMax, instances[i] * world,
+			instanceMins[i], instanceMaxs[i]);
+		aabb::merge(worldMin, worldMax, instanceMins[i], instanceMaxs[i]);
+	}
+	instanceBVH.update(instanceMins.data(), instanceMaxs.data(),
+		instances.size(), COPIES_PER_LEAF);
+}
+
+bool Model::getBounds(glm::vec3& minCorner, glm::vec3& maxCorner) {
+	if (meshes.empty())
+		return false;
+	updateWorldBounds();
+	minCorner = worldMin;
+	maxCorner = worldMax;
+	return aabb::isValid(worldMin, worldMax);
+}
+
+size_t Model::getNumMeshes() const {
+	return meshes.size();
+}
+
+void Model::findVisible(const glm::vec4 planes[6], const glm::vec3& eye,
+	float projectionScale, float minCoverage,
+	std::vector<unsigned int>& visible) {
+	meshBVH.queryFrustum(planes, candidates);
+	for (size_t i = builtMeshes; i < meshes.size(); ++i)
+		candidates.push_back((unsigned int)i);
+	// Leaves near a corner of the frustum come along, so the kernel tests
+	// every candidate exactly
+	candidateBounds.clear();
+	for (unsigned int i : candidates)
+		candidateBounds.add(meshMins[i], meshMaxs[i]);
+	candidateVisible.resize(candidates.size());
+	frustum::cullBoxes(planes, eye, projectionScale, minCoverage,
+		candidateBounds, candidateVisible.data());
+
+	visible.clear();
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		if (candidateVisible[i])
+			visible.push_back(candidates[i]);
+	}
+	// Drawn in order, so meshes of one node and one pool stay together
+	std::sort(visible.begin(), visible.end());
+}
+
+size_t Model::cull(const glm::mat4& view, const glm::mat4& projection) {
+	// Meshlets are culled for one transform, not for every copy
+	if (!instances.empty())
+		return 0;
+	updateBounds();
+	// The mesh bounds are in the model's own space, so the frustum and the
+	// eye are taken there. The size test compares ratios, which no uniform
+	// scale changes
+	glm::mat4 world = getWorldMat();
+	glm::vec4 planes[6];
+	frustum::extractPlanes(projection * view * world, planes);
+	glm::vec3 eye = glm::vec3(glm::inverse(view * world)[3]);
+	findVisible(planes, eye, projection[1][1], frustum::MIN_SCREEN_COVERAGE,
+		visibleMeshes);
+
+	for (unsigned int i : visibleMeshes)
+		meshes[i].cull(world * nodes.getWorldMat(meshNodes[i]), view, projection);
+	return meshes.size() - visibleMeshes.size();
+}
+
+void Model::drawVisible(const Shader& program, glm::mat4 view,
+	glm::mat4 projection) {
+	if (instances.empty())
+		drawMeshes(program, view, projection, true, &visibleMeshes);
+	else
+		drawMeshes(program, view, projection, false);
+}
+
+size_t Model::cullShadowCasters(const glm::mat4& lightTransform) {
+	if (!instances.empty())
+		return 0;
+	updateBounds();
+	glm::vec4 planes[6];
+	frustum::extractPlanes(lightTransform * getWorldMat(), planes);
+	// The light's projection is not a perspective one, so size is no test
+	findVisible(planes, glm::vec3(0.0f), 0.0f, 0.0f, casterMeshes);
+	return meshes.size() - casterMeshes.size();
+}
+
+void Model::drawShadowCasters(const Shader& program, glm::mat4 view,
+	glm::mat4 projection) {
+	drawMeshes(program, view, projection, false,
+		instances.empty() ? &casterMeshes : nullptr);
+}
+
+bool Model::raycastMeshes(const glm::vec3& origin, const glm::vec3& direction,
+	float& maxDistance, RayHit& hit) const {
+	// Each mesh is tested in its own space, where its triangles are
+	auto hitMesh = [&](unsigned int mesh, float& closest) {
+		glm::mat4 toMesh = glm::inverse(nodes.getWorldMat(meshNodes[mesh]));
+		TriangleHit triangle;
+		if (!meshes[mesh].raycast(glm::vec3(toMesh * glm::vec4(origin, 1.0f)),
+			glm::vec3(toMesh * glm::vec4(direction, 0.0f)), closest, triangle))
+			return false;
+		closest = triangle.distance;
+		hit.distance = triangle.distance;
+		hit.mesh = mesh;
+		hit.triangle = triangle.triangle;
+		hit.barycentrics = triangle.barycentrics;
+		return true;
+	};
+
+	const std::vector<unsigned int>& order = meshBVH.getOrder();
+	bool found = meshBVH.raycast(origin, direction, maxDistance,
+		[&](unsigned int first, unsigned int count, float& closest) {
+		bool any = false;
+		for (unsigned int i = first; i < first + count; ++i) {
+			if (hitMesh(order[i], closest))
+				any = true;
+		}
+		return any;
+	});
+	// Meshes added since the build are not in the hierarchy yet
+	for (size_t i = builtMeshes; i < meshes.size(); ++i) {
+		if (hitMesh((unsigned int)i, maxDistance))
+			found = true;
+	}
+	return found;
+}
+
+bool Model::raycastCopy(const glm::mat4& transform, size_t copy,
+	const glm::vec3& origin, const glm::vec3& direction, float& maxDistance,
+	RayHit& hit) const {
+	// Distances along the ray stay the same in the model's own space, as
+	// the direction is transformed along with the origin
+	glm::mat4 toModel = glm::inverse(transform);
+	if (!raycastMeshes(glm::vec3(toModel * glm::vec4(origin, 1.0f)),
+		glm::vec3(toModel * glm::vec4(direction, 0.0f)), maxDistance, hit))
+		return false;
+	hit.instance = copy;
+	return true;
+}
+
+bool Model::raycast(const glm::vec3& origin, const glm::vec3& direction,
+	float maxDistance, RayHit& hit) {
+	if (meshes.empty())
+		return false;
+	updateWorldBounds();
+	glm::mat4 world = getWorldMat();
+	bool found;
+	if (instances.empty()) {
+		found = raycastCopy(world, 0, origin, direction, maxDistance, hit);
+	}
+	else {
+		const std::vector<unsigned int>& order = instanceBVH.getOrder();
+		found = instanceBVH.raycast(origin, direction, maxDistance,
+			[&](unsigned int first, unsigned int count, float& closest) {
+			bool any = false;
+			for (unsigned int i = first; i < first + count; ++i) {
+				if (raycastCopy(instances[order[i]] * world, order[i], origin,
+					direction, closest, hit))
+					any = true;
+			}
+			return any;
+		});
+	}
+	if (found)
+		hit.object = this;
+	return found;
+}
+
+void Model::drawMeshes(const Shader& program, glm::mat4& view,
+	glm::mat4& projection, bool visibleOnly,
+	const std::vector<unsigned int>* drawn) {
 	program.use();
 	setShaderToRenderType(program);
-	glm::mat4 invTransposeModelview = glm::inverse(glm::transpose(view * model));
-	program.setMat4("invTransModelview", invTransposeModelview);
-	for (auto& mesh : meshes) {
-		mesh.sendMatToShader(program);
-		mesh.draw(program, model, view, projection);
+	bool instanced = !instances.empty();
+	program.setInt("instanced", instanced ? 1 : 0);
+	program.setInt("instanceTransforms", INSTANCE_TRANSFORM_UNIT);
+	if (instanced) {
+		glActiveTexture(GL_TEXTURE0 + INSTANCE_TRANSFORM_UNIT);
+		glBindTexture(GL_TEXTURE_BUFFER, instanceTexture);
 	}
+	glm::mat4 world = getWorldMat();
+	glm::mat4 meshWorld;
+	unsigned int currentNode = UINT_MAX;
+	// Meshes of one layout share buffers, so only a change of layout rebinds
+	const GeometryPool* boundPool = nullptr;
+	size_t numDrawn = drawn ? drawn->size() : meshes.size();
+	for (size_t j = 0; j < numDrawn; ++j) {
+		size_t i = drawn ? (*drawn)[j] : j;
+		const GeometryPool* pool = meshes[i].getGeometryPool();
+		if (pool && pool != boundPool) {
+			pool->bind();
+			boundPool = pool;
+		}
+		// Meshes of one node are next to each other, so the matrices are
+		// only rebuilt when the node changes
+		if (meshNodes[i] != currentNode) {
+			currentNode = meshNodes[i];
+			meshWorld = world * nodes.getWorldMat(currentNode);
+			glm::mat4 invTransposeModelview =
+				glm::inverse(glm::transpose(view * meshWorld));
+			program.setMat4("invTransModelview", invTransposeModelview);
+		}
+		meshes[i].sendMatToShader(program);
+		if (instanced)
+			meshes[i].drawInstanced(program, meshWorld, view, projection,
+				instances.size());
+		else
+			meshes[i].draw(program, meshWorld, view, projection, visibleOnly);
+	}
+	if (boundPool)
+		boundPool->unbind();
+	// Whatever the program draws next is drawn once
+	if (instanced)
+		program.setInt("instanced", 0);
 }
 
 bool Model::load(const char* path) {
-	Assimp::Importer import;
-	const aiScene* scene = import.ReadFile(path, aiProcess_FlipUVs | 
-		                                         aiProcess_Triangulate);
-
-	// Check if loading has failed (incomplete, no root node to load)
-	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
-		!scene->mRootNode) {
-		std::cout << "Error in assimp loading model!\n" << import.GetErrorString();
-		std::cout << std::endl;
-		return false;
+	loadStart = std::chrono::steady_clock::now();
+	sourcePath = path;
+	if (async) {
+		loadAsync();
+		return true;
 	}
-	std::string sPath = std::string(path);
-	directory = sPath.substr(0, sPath.find_last_of('/'));
 
-	// Recursively move through scene graph
-	processNode(scene->mRootNode, scene);
+	ModelImporter importer(path);
+	std::vector<ImportedMesh> imported;
+	if (!importer.import(imported, nodes))
+		return false;
+	nodes.update();
+	pivot = ModelImporter::getCenter(imported, nodes);
 
+	meshes.reserve(imported.size());
+	for (auto& mesh : imported)
+		addMesh(mesh);
+	finishLoad();
 	return true;
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene) {
-	//TODO: ADD SCENE GRAPH TRANSFORMATION IMPLEMENTATIONS
-	//At the moment, this can only work for 1 node objects.
-	
-	// Process each mesh within the node (node actual contains mesh INDICES)
-	for (unsigned int i = 0; i < node->mNumMeshes; ++i) {
-		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		meshes.push_back(processMesh(mesh, scene));
-	}
-	// Traverse scene graph
-	for (unsigned int i = 0; i < node->mNumChildren; ++i) {
-		processNode(node->mChildren[i], scene);
-	}
-}
-
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene) {
-	std::vector<Vertex> vertices;
-	std::vector<unsigned int> indices;
-	std::vector<Texture> textures;
-
-	// Load vertex info
-	Vertex vertex;
-	for (unsigned int i = 0; i < mesh->mNumVertices; ++i) {
-		vertex.position = glm::vec3(
-			mesh->mVertices[i].x, 
-			mesh->mVertices[i].y,
-			mesh->mVertices[i].z
-		);
-
-		vertex.normal = glm::normalize(
-			glm::vec3(
-				mesh->mNormals[i].x,
-				mesh->mNormals[i].y, 
-				mesh->mNormals[i].z
-			)
-		);
-
-		if (mesh->HasTextureCoords(0)) {
-			vertex.texCoords = glm::vec2(mesh->mTextureCoords[0][i].x,
-				mesh->mTextureCoords[0][i].y);
+void Model::loadAsync() {
+	std::shared_ptr<LoadToken> token = loadToken;
+	Model* target = this;
+	std::string path = sourcePath;
+
+	// Only the token and the path are touched off the render thread. The
+	// model itself is only reached through uploads, after checking the token
+	asyncLoader::submit([token, target, path]() {
+		if (token->cancelled)
+			return;
+
+		ModelImporter importer(path.c_str());
+		auto imported = std::make_shared<std::vector<ImportedMesh>>();
+		auto hierarchy = std::make_shared<NodeHierarchy>();
+		if (!importer.importCached(*imported, *hierarchy)) {
+			// OBJ files can be read in-house and drawn while they load.
+			// Assimp still writes the cache, once the load is done
+			std::string extension = std::filesystem::path(path).extension().string();
+			std::transform(extension.begin(), extension.end(), extension.begin(),
+				[](unsigned char c) { return (char)std::tolower(c); });
+			if (extension == ".obj") {
+				asyncLoader::queueUpload([token, target]() {
+					if (token->cancelled)
+						return;
+					// OBJ files have no hierarchy. Everything hangs off one node
+					target->nodes.addNode(-1, glm::mat4(1.0f));
+					target->loader = new ProgressiveOBJLoader(target->sourcePath.c_str());
+				});
+				return;
+			}
+
+			if (!importer.importSource(*imported, *hierarchy)) {
+				asyncLoader::queueUpload([token]() {
+					if (token->cancelled)
+						return;
+					std::cout << "Exiting program...\n";
+					exit(EXIT_FAILURE);
+				});
+				return;
+			}
+		}
+		// Placed and centered before the first mesh shows up, so it never
+		// moves
+		hierarchy->update();
+		glm::vec3 center = ModelImporter::getCenter(*imported, *hierarchy);
+		asyncLoader::queueUpload([token, target, hierarchy, center]() {
+			if (token->cancelled)
+				return;
+			target->nodes = std::move(*hierarchy);
+			target->pivot = center;
+			target->boundsDirty = true;
+		});
+
+		// One upload per mesh, so a model made of many meshes is spread over
+		// several frames
+		for (size_t i = 0; i < imported->size(); ++i) {
+			asyncLoader::queueUpload([token, target, imported, i]() {
+				if (!token->cancelled)
+					target->addMesh((*imported)[i]);
+			});
 		}
-		else 
-			vertex.texCoords = glm::vec2(0);
-		
-		vertices.push_back(vertex);
-	}
-
-	// Load indices
-	for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
-		aiFace face = mesh->mFaces[i];
-		for (unsigned int j = 0; j < face.mNumIndices; ++j)
-			indices.push_back(face.mIndices[j]);
-	}
-	/*
-	if (mesh->mMaterialIndex >= 0) {
-		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-		std::vector<Texture> diffuseMaps = loadMaterialTextures(material,
-			aiTextureType_DIFFUSE, "texture_diffuse");
-		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-		std::vector<Texture> specularMaps = loadMaterialTextures(material,
-			aiTextureType_SPECULAR, "texture_specular");
-		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-	}
-	*/
-	return Mesh(vertices, indices, textures);
-}
-
-std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, 
-	aiTextureType type, std::string typeName) {
-
-	std::vector<Texture> textures;
-	/*
-	for (unsigned int i = 0; i < mat->GetTextureCount(type); ++i) {
-		aiString str;
-		mat->GetTexture(type, i, &str);
-		Texture texture;
-		texture.id = TextureFromFile(str.C_Str(), directory);
-		texture.type = typeName;
-		texture.path = str;
-		textures.push_back(texture);
-	}
-	*/
-	return textures;
+		asyncLoader::queueUpload([token, target]() {
+			if (!token->cancelled)
+				target->finishLoad();
+		});
+	});
+}
+
+void Model::addMesh(ImportedMesh& mesh) {
+	meshNodes.push_back(mesh.node);
+	boundsDirty = true;
+	// The mesh cache keeps the maps only as part of the material
+	if (mesh.textures.empty() && mesh.material != nullptr)
+		mesh.textures = textureCache::materialTextures(mesh.material->properties);
+	meshes.push_back(Mesh(std::move(mesh.vertices), std::move(mesh.indices),
+		std::move(mesh.textures), mesh.material, mesh.aabbMin, mesh.aabbMax,
+		std::move(mesh.lods), std::move(mesh.meshlets)));
+}
+
+void Model::finishLoad() {
+	loaded = true;
+	// Builds of the mesh hierarchy were held back while meshes came in
+	boundsDirty = true;
+	std::chrono::duration<double> seconds =
+		std::chrono::steady_clock::now() - loadStart;
+	std::cout << "Loaded " << sourcePath << " in " << seconds.count() << " s\n";
 }
 
 void Model::centerToOrigin() {
-	std::vector<glm::vec3> minDimVec;
-	std::vector<glm::vec3> maxDimVec;
+	// The bounds of each mesh are known from the import, so this only
+	// merges one box per mesh
 	glm::vec3 min(std::numeric_limits<float>::max());
 	glm::vec3 max(std::numeric_limits<float>::lowest());
-	
-	// Find minimum and maximum position values of the model
-	for (auto const& mesh : meshes) {
-		glm::vec3 minHolder, maxHolder;
-		mesh.getCornerVecs(minHolder, maxHolder);
-		minDimVec.push_back(minHolder);
-		maxDimVec.push_back(maxHolder);
-	}
-	for (int i = 0; i < minDimVec.size(); ++i) {
-		for (int j = 0; j < 3; ++j) {
-			min[j] = (min[j] > minDimVec[i][j]) ? minDimVec[i][j] : min[j];
-			max[j] = (max[j] < maxDimVec[i][j]) ? maxDimVec[i][j] : max[j];
-		}
-	}
-
-	// Translate each point in the mesh to the center
-	glm::vec3 translate(
-		0.5f * (max.x + min.x),
-		0.5f * (max.y + min.y),
-		0.5f * (max.z + min.z)
-	);
-	for (auto& mesh : meshes) {
-		for (auto& vertex : mesh.vertices) {
-			vertex.position -= translate;
-		}
-		mesh.updateBuffers();
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		glm::vec3 meshMin, meshMax;
+		aabb::transform(meshes[i].aabbMin, meshes[i].aabbMax,
+			nodes.getWorldMat(meshNodes[i]), meshMin, meshMax);
+		aabb::merge(min, max, meshMin, meshMax);
 	}
+	if (aabb::isValid(min, max))
+		pivot = 0.5f * (min + max);
 }
 
 void Model::sendMatToShader(const Shader& program) const {
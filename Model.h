@@ -4,16 +4,69 @@
  */
 #pragma once
 
-#include <assimp/Importer.hpp>
-#include <assimp/scene.h>
-#include <assimp/postprocess.h>
+#include <chrono>
+#include <memory>
 
+#include "AsyncLoader.h"
+#include "BVH.h"
+#include "Frustum.h"
 #include "Mesh.h"
+#include "ModelImporter.h"
+#include "NodeHierarchy.h"
 #include "Object.h"
+#include "ProgressiveOBJLoader.h"
 
 class Model : public Object {
 	std::vector<Mesh> meshes;
-	std::string directory;
+	// Transform hierarchy of the file, and the node each mesh hangs off
+	NodeHierarchy nodes;
+	std::vector<unsigned int> meshNodes;
+	// File the model was loaded from
+	std::string sourcePath;
+	// Whether the model loads in the background
+	bool async;
+	// Set once every mesh of the model is uploaded
+	bool loaded;
+	// Shared with the background jobs loading the model, so they drop their
+	// results if it is deleted first
+	std::shared_ptr<LoadToken> loadToken;
+	// Reads an OBJ file without a cache in the background. Only set while
+	// such a load is running
+	ProgressiveOBJLoader* loader;
+	std::chrono::steady_clock::time_point loadStart;
+	// Transforms of the copies drawn by instanced draws, placed in front of
+	// the model's own. Empty when the model is drawn once
+	std::vector<glm::mat4> instances;
+	// Buffer holding the transforms and the texture buffer shaders read
+	// them through. 0 until there are instances
+	unsigned int instanceBuffer, instanceTexture;
+	// Bounds of every mesh in the model's own space, with the transform of
+	// its node applied, and the hierarchy over them
+	std::vector<glm::vec3> meshMins, meshMaxs;
+	BVH meshBVH;
+	// Meshes meshBVH was built over. Meshes added since are tested one by
+	// one until it is built again
+	size_t builtMeshes;
+	// Set when meshes were added or nodes moved since the bounds were
+	// gathered
+	bool boundsDirty;
+	// Bounds of every mesh together, in the model's own space
+	glm::vec3 modelMin, modelMax;
+	// Bounds in world space, every copy included, and the world matrix they
+	// were taken with
+	glm::vec3 worldMin, worldMax;
+	glm::mat4 boundsWorld;
+	bool worldBoundsValid;
+	// World bounds of every instanced copy and the hierarchy over them, so
+	// rays only test the copies they pass
+	std::vector<glm::vec3> instanceMins, instanceMaxs;
+	BVH instanceBVH;
+	// Meshes a frustum query found and their bounds, for the culling kernel
+	std::vector<unsigned int> candidates;
+	frustum::Boxes candidateBounds;
+	std::vector<unsigned char> candidateVisible;
+	// Meshes the last cull and cullShadowCasters kept, in ascending order
+	std::vector<unsigned int> visibleMeshes, casterMeshes;
 
 	/// <summary>
 	/// Loads object from given file
@@ -23,41 +76,116 @@ class Model : public Object {
 	bool load(const char* path);
 
 	/// <summary>
-	/// Processes each aiNode scene. Can be called recursively
+	/// Imports the model on the worker pool and queues the upload of each
+	/// mesh for the render thread
 	/// </summary>
-	/// <param name="node"> ptr to aiNode </param>
-	/// <param name="scene"> ptr to aiScene </param>
-	void processNode(aiNode* node, const aiScene* scene);
+	void loadAsync();
+
+	/// <summary>
+	/// Uploads an imported mesh and adds it to the model
+	/// </summary>
+	/// <param name="mesh"> mesh to upload. Its data is moved out </param>
+	void addMesh(ImportedMesh& mesh);
+
+	/// <summary>
+	/// Marks the model loaded and reports how long it took
+	/// </summary>
+	void finishLoad();
+
+	/// <summary>
+	/// Gathers the bounds of the meshes again if they changed, and refits
+	/// the mesh hierarchy or builds it over. Builds are held back while a
+	/// load keeps adding meshes, until their number grew by a quarter
+	/// </summary>
+	void updateBounds();
+
+	/// <summary>
+	/// Works out the world bounds and those of every instanced copy again if
+	/// the model moved
+	/// </summary>
+	void updateWorldBounds();
+
+	/// <summary>
+	/// Finds the meshes inside a frustum, by the mesh hierarchy and then the
+	/// culling kernel
+	/// </summary>
+	/// <param name="planes"> frustum planes in the model's own space </param>
+	/// <param name="eye"> camera position in the model's own space </param>
+	/// <param name="projectionScale"> projection[1][1] of the camera. 0 to
+	/// skip the size test </param>
+	/// <param name="minCoverage"> smallest share of the screen height kept
+	/// </param>
+	/// <param name="visible"> Stores the meshes found, in ascending order
+	/// </param>
+	void findVisible(const glm::vec4 planes[6], const glm::vec3& eye,
+		float projectionScale, float minCoverage,
+		std::vector<unsigned int>& visible);
+
+	/// <summary>
+	/// Finds the closest triangle of the meshes a ray hits
+	/// </summary>
+	/// <param name="origin"> start of the ray, in the model's own space </param>
+	/// <param name="direction"> direction of the ray </param>
+	/// <param name="maxDistance"> furthest distance along the ray. Lowered
+	/// to the closest hit </param>
+	/// <param name="hit"> Stores the closest hit, without object or instance
+	/// </param>
+	/// <returns> True if any mesh was hit before maxDistance </returns>
+	bool raycastMeshes(const glm::vec3& origin, const glm::vec3& direction,
+		float& maxDistance, RayHit& hit) const;
+
 	/// <summary>
-	/// Processes a passed in aiMesh
+	/// Casts a ray at one copy of the model
 	/// </summary>
-	/// <param name="mesh"> ptr to an aiMesh </param>
-	/// <param name="scene"> ptr to an aiScene object </param>
-	/// <returns> Mesh object </returns>
-	Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+	/// <param name="transform"> world matrix of the copy </param>
+	/// <param name="copy"> index of the copy, stored with the hit </param>
+	/// <param name="origin"> start of the ray, in world space </param>
+	/// <param name="direction"> direction of the ray </param>
+	/// <param name="maxDistance"> furthest distance along the ray. Lowered
+	/// to the closest hit </param>
+	/// <param name="hit"> Stores the closest hit </param>
+	/// <returns> True if the copy was hit before maxDistance </returns>
+	bool raycastCopy(const glm::mat4& transform, size_t copy,
+		const glm::vec3& origin, const glm::vec3& direction, float& maxDistance,
+		RayHit& hit) const;
+
 	/// <summary>
-	/// Loads material textures
+	/// Draws every mesh, either whole or only what the last cull kept
 	/// </summary>
-	/// <param name="mat"> ptr to aiMaterial </param>
-	/// <param name="type"> enum that denotes texture type </param>
-	/// <param name="typeName"> string name of texture type </param>
-	/// <returns></returns>
-	std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type,
-		std::string typeName);
+	/// <param name="program"> Shader program </param>
+	/// <param name="view"> view matrix </param>
+	/// <param name="projection"> projection matrix </param>
+	/// <param name="visibleOnly"> whether to draw only what cull kept </param>
+	/// <param name="drawn"> meshes to draw, in ascending order. Null to draw
+	/// them all </param>
+	void drawMeshes(const Shader& program, glm::mat4& view,
+		glm::mat4& projection, bool visibleOnly,
+		const std::vector<unsigned int>* drawn = nullptr);
 
 public:
+	// Texture unit of the instance transforms. 0 to 3 hold the shadow map,
+	// the ground's texture and the material maps. Programs must point
+	// instanceTransforms here even when nothing is instanced, or it clashes
+	// with the shadow map on unit 0
+	static const unsigned int INSTANCE_TRANSFORM_UNIT = 4;
+
 	/// <summary>
 	/// Constructor that loads an object from a given file
 	/// </summary>
 	/// <param name="path"> file path of object to load </param>
+	/// <param name="async"> If set, the constructor returns right away and
+	/// the model is read on the worker pool. Its meshes show up as the render
+	/// thread drains the upload queue. OBJ files without a cache are read
+	/// progressively and show up in update, then their cache is written in
+	/// the background </param>
 	/// <returns> N/A </returns>
-	Model(const char* path);
+	Model(const char* path, bool async = false);
 
 	// Destructor. Deletes every mesh and buffer associated with said mesh
 	~Model();
 
 	/// <summary>
-	/// Draw object to screen. 
+	/// Draw object to screen.
 	/// </summary>
 	/// <param name="program"> Shader program </param>
 	/// <param name="view"> view matrix </param>
@@ -65,7 +193,108 @@ public:
 	void draw(const Shader& program, glm::mat4 view, glm::mat4 projection);
 
 	/// <summary>
-	/// Centers object to origin
+	/// Skips the meshes outside the camera's frustum or too small to see,
+	/// and culls the meshlets of the rest. The mesh hierarchy rules out
+	/// most meshes before the culling kernel sees them. Instanced models are
+	/// not culled
+	/// </summary>
+	/// <param name="view"> view matrix </param>
+	/// <param name="projection"> projection matrix </param>
+	/// <returns> Number of meshes skipped </returns>
+	size_t cull(const glm::mat4& view, const glm::mat4& projection);
+
+	/// <summary>
+	/// Draws the meshlets the last cull kept
+	/// </summary>
+	/// <param name="program"> Shader program </param>
+	/// <param name="view"> view matrix </param>
+	/// <param name="projection"> projection matrix </param>
+	void drawVisible(const Shader& program, glm::mat4 view, glm::mat4 projection);
+
+	/// <summary>
+	/// Skips the meshes outside the light's volume. Instanced models are not
+	/// culled
+	/// </summary>
+	/// <param name="lightTransform"> light's projection * view matrix
+	/// </param>
+	/// <returns> Number of meshes skipped </returns>
+	size_t cullShadowCasters(const glm::mat4& lightTransform);
+
+	/// <summary>
+	/// Draws the meshes the last cullShadowCasters kept
+	/// </summary>
+	/// <param name="program"> Shader program </param>
+	/// <param name="view"> view matrix </param>
+	/// <param name="projection"> projection matrix </param>
+	void drawShadowCasters(const Shader& program, glm::mat4 view,
+		glm::mat4 projection);
+
+	/// <summary>
+	/// Gets the world bounds of the model, every instanced copy included
+	/// </summary>
+	/// <param name="minCorner"> Stores min corner </param>
+	/// <param name="maxCorner"> Stores max corner </param>
+	/// <returns> False until the first mesh is in </returns>
+	bool getBounds(glm::vec3& minCorner, glm::vec3& maxCorner);
+
+	/// <summary>
+	/// Gets the number of meshes loaded so far
+	/// </summary>
+	size_t getNumMeshes() const;
+
+	/// <summary>
+	/// Finds the closest triangle a ray hits, through the instance, mesh
+	/// and triangle hierarchies. Meshes whose triangle hierarchy is still
+	/// being built are missed
+	/// </summary>
+	/// <param name="origin"> start of the ray, in world space </param>
+	/// <param name="direction"> direction of the ray </param>
+	/// <param name="maxDistance"> furthest distance along the ray, in units
+	/// of direction </param>
+	/// <param name="hit"> Stores the closest hit </param>
+	/// <returns> True if the ray hits the model before maxDistance </returns>
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction,
+		float maxDistance, RayHit& hit);
+
+	/// <summary>
+	/// Updates the world matrices of nodes that moved. Uploads the meshes a
+	/// progressive load has finished since the last frame, and centers the
+	/// model once the whole file is in
+	/// </summary>
+	void update();
+
+	/// <summary>
+	/// Draws the model once for every transform, with one instanced draw
+	/// call a mesh. The transforms go in front of the model's own, so the
+	/// model still moves every copy. Copies are drawn at full detail and
+	/// not culled in parts. Render thread only
+	/// </summary>
+	/// <param name="transforms"> transform of each copy. Empty to draw the
+	/// model once again </param>
+	void setInstances(const std::vector<glm::mat4>& transforms);
+
+	/// <summary>
+	/// Gets the number of copies instanced draws make
+	/// </summary>
+	/// <returns> 0 if the model is drawn once </returns>
+	size_t getNumInstances() const;
+
+	/// <summary>
+	/// Gets the node hierarchy of the model. Changes to local matrices show
+	/// up after the next update
+	/// </summary>
+	/// <returns> the model's nodes </returns>
+	NodeHierarchy& getNodes();
+
+	/// <summary>
+	/// Checks whether every mesh of the model is uploaded
+	/// </summary>
+	/// <returns> True once loading is complete </returns>
+	bool isLoaded() const;
+
+	/// <summary>
+	/// Centers object to origin by moving its pivot to the center of its
+	/// bounds. Leaves the vertices and GL buffers alone
 	/// </summary>
 	void centerToOrigin();
 
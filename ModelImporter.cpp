@@ -0,0 +1,345 @@
+#include "ModelImporter.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+
+#include <iostream>
+#include <utility>
+
+#include "AABB.h"
+#include "MeshCache.h"
+#include "MeshletBuilder.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "TextureCache.h"
+
+namespace {
+	// Assimp stores matrices by row, glm by column
+	glm::mat4 toMat4(const aiMatrix4x4& m) {
+		return glm::mat4(
+			glm::vec4(m.a1, m.b1, m.c1, m.d1),
+			glm::vec4(m.a2, m.b2, m.c2, m.d2),
+			glm::vec4(m.a3, m.b3, m.c3, m.d3),
+			glm::vec4(m.a4, m.b4, m.c4, m.d4));
+	}
+}
+
+ModelImporter::ModelImporter(const char* path) : sourcePath(path) {
+	directory = sourcePath.substr(0, sourcePath.find_last_of('/'));
+}
+
+bool ModelImporter::import(std::vector<ImportedMesh>& meshes,
+	NodeHierarchy& nodes) {
+	// Skip Assimp entirely while the cache matches the source file
+	return importCached(meshes, nodes) || importSource(meshes, nodes);
+}
+
+bool ModelImporter::importCached(std::vector<ImportedMesh>& meshes,
+	NodeHierarchy& nodes) {
+	MappedFile cacheFile;
+	std::vector<meshCache::MeshRecord> records;
+	std::vector<meshCache::NodeRecord> nodeRecords;
+	if (!meshCache::read(sourcePath.c_str(), cacheFile, records, nodeRecords))
+		return false;
+
+	// Indices in the cache are relative to the file's first node
+	unsigned int firstNode = (unsigned int)nodes.size();
+	for (const auto& node : nodeRecords) {
+		nodes.addNode(node.parent < 0 ? -1 : (int)firstNode + node.parent,
+			node.localMat);
+	}
+
+	meshes.reserve(meshes.size() + records.size());
+	for (const auto& record : records) {
+		ImportedMesh mesh;
+		mesh.vertices.assign(record.vertices, record.vertices + record.numVertices);
+		mesh.indices.assign(record.indices, record.indices + record.numIndices);
+		mesh.aabbMin = record.aabbMin;
+		mesh.aabbMax = record.aabbMax;
+		mesh.material = materialCache::intern(sourcePath, record.material);
+		mesh.node = firstNode + record.node;
+		mesh.lods = record.lods;
+		mesh.meshlets.assign(record.meshlets, record.meshlets + record.numMeshlets);
+		meshes.push_back(std::move(mesh));
+	}
+	return true;
+}
+
+bool ModelImporter::importSource(std::vector<ImportedMesh>& meshes,
+	NodeHierarchy& nodes) {
+	size_t firstMesh = meshes.size();
+	size_t firstNode = nodes.size();
+	if (!importAssimp(meshes, nodes))
+		return false;
+	optimizeMeshes(meshes, firstMesh);
+	writeCache(meshes, firstMesh, nodes, firstNode);
+	return true;
+}
+
+glm::vec3 ModelImporter::getCenter(const std::vector<ImportedMesh>& meshes,
+	const NodeHierarchy& nodes) {
+	glm::vec3 min(std::numeric_limits<float>::max());
+	glm::vec3 max(std::numeric_limits<float>::lowest());
+	for (const auto& mesh : meshes) {
+		glm::vec3 meshMin, meshMax;
+		aabb::transform(mesh.aabbMin, mesh.aabbMax, nodes.getWorldMat(mesh.node),
+			meshMin, meshMax);
+		aabb::merge(min, max, meshMin, meshMax);
+	}
+	return aabb::isValid(min, max) ? 0.5f * (min + max) : glm::vec3(0.0f);
+}
+
+void ModelImporter::optimizeMeshes(std::vector<ImportedMesh>& meshes,
+	size_t firstMesh) const {
+	meshOptimizer::VertexCacheStats before, after;
+	size_t numLODs = 0, numWithLODs = 0, numMeshlets = 0;
+	for (size_t i = firstMesh; i < meshes.size(); ++i) {
+		ImportedMesh& mesh = meshes[i];
+		if (mesh.indices.size() % 3 != 0)
+			continue;
+		meshOptimizer::analyzeVertexCache(mesh.indices.data(), mesh.indices.size(),
+			mesh.vertices.size(), before);
+		meshOptimizer::optimize(mesh.vertices, mesh.indices);
+		// Clustering reorders the triangles, so the vertices are put back in
+		// the order they are first used
+		meshletBuilder::build(mesh.vertices.data(), mesh.vertices.size(),
+			mesh.indices.data(), mesh.indices.size(), mesh.meshlets);
+		meshOptimizer::optimizeVertexFetch(mesh.vertices, mesh.indices);
+		meshOptimizer::analyzeVertexCache(mesh.indices.data(), mesh.indices.size(),
+			mesh.vertices.size(), after);
+		numMeshlets += mesh.meshlets.size();
+
+		// The coarser levels go after the full mesh in the same indices
+		meshSimplifier::buildLODChain(mesh.vertices.data(), mesh.vertices.size(),
+			mesh.indices, mesh.lods);
+		if (!mesh.lods.empty()) {
+			numLODs += mesh.lods.size();
+			++numWithLODs;
+		}
+	}
+	std::cout << "Vertex cache ACMR " << before.getACMR() << " -> ";
+	std::cout << after.getACMR() << ", ATVR " << before.getATVR() << " -> ";
+	std::cout << after.getATVR() << std::endl;
+	std::cout << "Levels of detail: " << numLODs << " over " << numWithLODs;
+	std::cout << " meshes" << std::endl;
+	std::cout << "Meshlets: " << numMeshlets << std::endl;
+}
+
+void ModelImporter::writeCache(const std::vector<ImportedMesh>& meshes,
+	size_t firstMesh, const NodeHierarchy& nodes, size_t firstNode) const {
+	std::vector<meshCache::MeshRecord> records;
+	records.reserve(meshes.size() - firstMesh);
+	for (size_t i = firstMesh; i < meshes.size(); ++i) {
+		const ImportedMesh& mesh = meshes[i];
+		meshCache::MeshRecord record;
+		record.vertices = mesh.vertices.data();
+		record.numVertices = mesh.vertices.size();
+		record.indices = mesh.indices.data();
+		record.numIndices = mesh.indices.size();
+		record.aabbMin = mesh.aabbMin;
+		record.aabbMax = mesh.aabbMax;
+		record.material = mesh.material->properties;
+		record.node = (unsigned int)(mesh.node - firstNode);
+		record.lods = mesh.lods;
+		record.meshlets = mesh.meshlets.data();
+		record.numMeshlets = mesh.meshlets.size();
+		records.push_back(record);
+	}
+
+	std::vector<meshCache::NodeRecord> nodeRecords(nodes.size() - firstNode);
+	for (size_t i = firstNode; i < nodes.size(); ++i) {
+		int parent = nodes.getParent((unsigned int)i);
+		nodeRecords[i - firstNode].parent =
+			(parent < (int)firstNode) ? -1 : parent - (int)firstNode;
+		nodeRecords[i - firstNode].localMat = nodes.getLocalMat((unsigned int)i);
+	}
+
+	// Not fatal. The next run simply imports the source again
+	if (!meshCache::write(sourcePath.c_str(), records, nodeRecords))
+		std::cout << "Failed to write mesh cache for " << sourcePath << std::endl;
+}
+
+bool ModelImporter::importAssimp(std::vector<ImportedMesh>& meshes,
+	NodeHierarchy& nodes) {
+	Assimp::Importer import;
+	const aiScene* scene = import.ReadFile(sourcePath, aiProcess_FlipUVs | 
+		                                         aiProcess_Triangulate);
+
+	// Check if loading has failed (incomplete, no root node to load)
+	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
+		!scene->mRootNode) {
+		std::cout << "Error in assimp loading model!\n" << import.GetErrorString();
+		std::cout << std::endl;
+		return false;
+	}
+
+	// Nodes usually use each mesh once, so this is the final size
+	meshes.reserve(meshes.size() + scene->mNumMeshes);
+	processNodes(scene->mRootNode, scene, meshes, nodes);
+
+	return true;
+}
+
+void ModelImporter::processNodes(aiNode* root, const aiScene* scene,
+	std::vector<ImportedMesh>& meshes, NodeHierarchy& nodes) {
+	// Walk the scene graph with an explicit stack, so deep hierarchies
+	// cannot overflow the call stack. Each entry holds the parent's index
+	std::vector<std::pair<aiNode*, int>> stack;
+	stack.push_back(std::make_pair(root, -1));
+	while (!stack.empty()) {
+		aiNode* node = stack.back().first;
+		unsigned int index = nodes.addNode(stack.back().second,
+			toMat4(node->mTransformation));
+		stack.pop_back();
+
+		// Process each mesh within the node (node actual contains mesh INDICES)
+		for (unsigned int i = 0; i < node->mNumMeshes; ++i) {
+			aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+			meshes.push_back(processMesh(mesh, scene));
+			meshes.back().node = index;
+		}
+		// Pushed in reverse so the children come out in file order
+		for (unsigned int i = node->mNumChildren; i > 0; --i)
+			stack.push_back(std::make_pair(node->mChildren[i - 1], (int)index));
+	}
+}
+
+ImportedMesh ModelImporter::processMesh(aiMesh* mesh, const aiScene* scene) {
+	ImportedMesh result;
+	std::vector<Texture>& textures = result.textures;
+
+	// Size everything once, then convert one attribute at a time. Each loop
+	// reads one contiguous Assimp array, so the compiler can vectorize it
+	size_t numVertices = mesh->mNumVertices;
+	result.vertices.resize(numVertices);
+	Vertex* vertices = result.vertices.data();
+
+	const aiVector3D* positions = mesh->mVertices;
+	for (size_t i = 0; i < numVertices; ++i)
+		vertices[i].position = glm::vec3(positions[i].x, positions[i].y, positions[i].z);
+	aabb::compute((const float*)vertices, numVertices, sizeof(Vertex),
+		result.aabbMin, result.aabbMax);
+
+	// Assimp leaves the normals out unless the file has them. Degenerate
+	// faces give zero normals, which are kept as they are rather than
+	// turned into NaNs
+	const aiVector3D* normals = mesh->mNormals;
+	if (normals != nullptr) {
+		for (size_t i = 0; i < numVertices; ++i) {
+			glm::vec3 normal(normals[i].x, normals[i].y, normals[i].z);
+			float lengthSquared = glm::dot(normal, normal);
+			vertices[i].normal = lengthSquared > 0.0f ?
+				normal * glm::inversesqrt(lengthSquared) : normal;
+		}
+	}
+	else {
+		for (size_t i = 0; i < numVertices; ++i)
+			vertices[i].normal = glm::vec3(0.0f);
+	}
+
+	const aiVector3D* uvs = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0] : nullptr;
+	if (uvs != nullptr) {
+		for (size_t i = 0; i < numVertices; ++i)
+			vertices[i].texCoords = glm::vec2(uvs[i].x, uvs[i].y);
+	}
+	else {
+		for (size_t i = 0; i < numVertices; ++i)
+			vertices[i].texCoords = glm::vec2(0);
+	}
+
+	// Load indices. Faces are triangles after aiProcess_Triangulate, except
+	// for any points and lines, so count before copying
+	size_t numIndices = 0;
+	for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
+		numIndices += mesh->mFaces[i].mNumIndices;
+	result.indices.resize(numIndices);
+	unsigned int* indices = result.indices.data();
+	for (unsigned int i = 0; i < mesh->mNumFaces; ++i) {
+		const aiFace& face = mesh->mFaces[i];
+		if (face.mNumIndices == 3) {
+			indices[0] = face.mIndices[0];
+			indices[1] = face.mIndices[1];
+			indices[2] = face.mIndices[2];
+			indices += 3;
+		}
+		else {
+			for (unsigned int j = 0; j < face.mNumIndices; ++j)
+				*indices++ = face.mIndices[j];
+		}
+	}
+	result.material = (mesh->mMaterialIndex < scene->mNumMaterials) ?
+		processMaterial(scene->mMaterials[mesh->mMaterialIndex]) :
+		materialCache::defaultMaterial();
+	// Only the paths are read here. The texture cache decodes the files once
+	// the mesh is uploaded
+	if (mesh->mMaterialIndex < scene->mNumMaterials) {
+		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+		std::vector<Texture> diffuseMaps = loadMaterialTextures(material,
+			aiTextureType_DIFFUSE, textureCache::DIFFUSE_TYPE);
+		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+		std::vector<Texture> specularMaps = loadMaterialTextures(material,
+			aiTextureType_SPECULAR, textureCache::SPECULAR_TYPE);
+		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+	}
+	return result;
+}
+
+const MaterialRecord* ModelImporter::processMaterial(const aiMaterial* mat) {
+	// Whatever the file leaves out keeps its default value
+	MTLMaterial properties = materialCache::defaultMaterial()->properties;
+	aiString name;
+	if (mat->Get(AI_MATKEY_NAME, name) == aiReturn_SUCCESS)
+		properties.name = name.C_Str();
+
+	aiColor3D color;
+	if (mat->Get(AI_MATKEY_COLOR_AMBIENT, color) == aiReturn_SUCCESS)
+		properties.ambient = glm::vec3(color.r, color.g, color.b);
+	if (mat->Get(AI_MATKEY_COLOR_DIFFUSE, color) == aiReturn_SUCCESS)
+		properties.diffuse = glm::vec3(color.r, color.g, color.b);
+	if (mat->Get(AI_MATKEY_COLOR_SPECULAR, color) == aiReturn_SUCCESS)
+		properties.specular = glm::vec3(color.r, color.g, color.b);
+	if (mat->Get(AI_MATKEY_COLOR_TRANSPARENT, color) == aiReturn_SUCCESS)
+		properties.transmissionFilter = glm::vec3(color.r, color.g, color.b);
+	mat->Get(AI_MATKEY_SHININESS, properties.shininess);
+	mat->Get(AI_MATKEY_REFRACTI, properties.opticalDensity);
+	mat->Get(AI_MATKEY_OPACITY, properties.dissolve);
+
+	// Texture paths are relative to the model file
+	const std::pair<aiTextureType, std::string*> maps[] = {
+		{ aiTextureType_AMBIENT, &properties.ambientMap },
+		{ aiTextureType_DIFFUSE, &properties.diffuseMap },
+		{ aiTextureType_SPECULAR, &properties.specularMap },
+		{ aiTextureType_SHININESS, &properties.shininessMap },
+		{ aiTextureType_OPACITY, &properties.dissolveMap },
+		{ aiTextureType_HEIGHT, &properties.bumpMap }
+	};
+	for (const auto& map : maps) {
+		aiString texturePath;
+		if (mat->GetTexture(map.first, 0, &texturePath) == aiReturn_SUCCESS)
+			*map.second = directory + '/' + texturePath.C_Str();
+	}
+
+	return materialCache::intern(sourcePath, properties);
+}
+
+std::vector<Texture> ModelImporter::loadMaterialTextures(aiMaterial* mat, 
+	aiTextureType type, std::string typeName) {
+
+	std::vector<Texture> textures;
+	for (unsigned int i = 0; i < mat->GetTextureCount(type); ++i) {
+		aiString str;
+		if (mat->GetTexture(type, i, &str) != aiReturn_SUCCESS)
+			continue;
+		// Embedded textures are named by their index, like "*0", and have no
+		// file to read
+		if (str.length == 0 || str.C_Str()[0] == '*')
+			continue;
+		Texture texture;
+		texture.id = 0;
+		texture.type = typeName;
+		texture.path = directory + '/' + str.C_Str();
+		texture.record = nullptr;
+		textures.push_back(texture);
+	}
+	return textures;
+}
@@ -0,0 +1,156 @@
+/*  Reads a model file into meshes in system memory, from the mesh cache or
+    through Assimp. Makes no OpenGL calls, so it runs headless or off the
+    render thread. Model uploads what it returns
+    - RAB
+ */
+#pragma once
+
+#include <assimp/scene.h>
+
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "NodeHierarchy.h"
+
+/// <summary>
+/// A mesh that has been read but not uploaded
+/// </summary>
+struct ImportedMesh {
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	std::vector<Texture> textures;
+	glm::vec3 aabbMin = glm::vec3(std::numeric_limits<float>::max());
+	glm::vec3 aabbMax = glm::vec3(std::numeric_limits<float>::lowest());
+	const MaterialRecord* material = nullptr;
+	// Node of the model the mesh hangs off. Its bounds are relative to it
+	unsigned int node = 0;
+	// Index ranges of the levels of detail within indices. Empty if there
+	// is only the full mesh
+	std::vector<LODLevel> lods;
+	// Clusters of the full detail level
+	std::vector<Meshlet> meshlets;
+};
+
+class ModelImporter {
+	// File being imported
+	std::string sourcePath;
+	// Directory of the file. Texture paths are relative to it
+	std::string directory;
+
+	/// <summary>
+	/// Imports the meshes of the source file with Assimp
+	/// </summary>
+	/// <param name="meshes"> Imported meshes are appended here </param>
+	/// <param name="nodes"> Nodes of the model are appended here. Imported
+	/// meshes refer to them </param>
+	/// <returns> True if successful, Otherwise false </returns>
+	bool importAssimp(std::vector<ImportedMesh>& meshes, NodeHierarchy& nodes);
+
+	/// <summary>
+	/// Stores freshly imported meshes in the binary cache of the source file
+	/// </summary>
+	/// <param name="meshes"> imported meshes </param>
+	/// <param name="firstMesh"> first of the meshes that belong to the file
+	/// </param>
+	/// <param name="nodes"> imported nodes </param>
+	/// <param name="firstNode"> first of the nodes that belong to the file
+	/// </param>
+	void writeCache(const std::vector<ImportedMesh>& meshes, size_t firstMesh,
+		const NodeHierarchy& nodes, size_t firstNode) const;
+
+	/// <summary>
+	/// Reorders freshly imported meshes for the vertex cache, overdraw and
+	/// vertex fetch, splits them into meshlets, builds their levels of
+	/// detail, and reports the cache behaviour before and after
+	/// </summary>
+	/// <param name="meshes"> imported meshes </param>
+	/// <param name="firstMesh"> first of the meshes that belong to the file
+	/// </param>
+	void optimizeMeshes(std::vector<ImportedMesh>& meshes, size_t firstMesh) const;
+
+	/// <summary>
+	/// Flattens the aiNode tree depth first, so parents come before their
+	/// children, and processes the meshes of every node
+	/// </summary>
+	/// <param name="root"> ptr to the root aiNode </param>
+	/// <param name="scene"> ptr to aiScene </param>
+	/// <param name="meshes"> Meshes of the nodes are appended here </param>
+	/// <param name="nodes"> The nodes are appended here </param>
+	void processNodes(aiNode* root, const aiScene* scene,
+		std::vector<ImportedMesh>& meshes, NodeHierarchy& nodes);
+	/// <summary>
+	/// Processes a passed in aiMesh
+	/// </summary>
+	/// <param name="mesh"> ptr to an aiMesh </param>
+	/// <param name="scene"> ptr to an aiScene object </param>
+	/// <returns> Imported mesh </returns>
+	ImportedMesh processMesh(aiMesh* mesh, const aiScene* scene);
+	/// <summary>
+	/// Adds an Assimp material to the material cache
+	/// </summary>
+	/// <param name="mat"> ptr to aiMaterial </param>
+	/// <returns> The shared material record </returns>
+	const MaterialRecord* processMaterial(const aiMaterial* mat);
+	/// <summary>
+	/// Lists the texture files of one type a material uses. Nothing is
+	/// decoded yet, the texture cache does that on upload
+	/// </summary>
+	/// <param name="mat"> ptr to aiMaterial </param>
+	/// <param name="type"> enum that denotes texture type </param>
+	/// <param name="typeName"> string name of texture type </param>
+	/// <returns> Textures with their type and path relative to the working
+	/// directory. Embedded textures are left out </returns>
+	std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type,
+		std::string typeName);
+
+public:
+	/// <summary>
+	/// Prepares to import a model file
+	/// </summary>
+	/// <param name="path"> file path of the model </param>
+	/// <returns> N/A </returns>
+	ModelImporter(const char* path);
+
+	/// <summary>
+	/// Reads the model from its cache if the cache is valid, otherwise
+	/// imports it with Assimp and writes the cache
+	/// </summary>
+	/// <param name="meshes"> Imported meshes are appended here </param>
+	/// <param name="nodes"> Nodes of the model are appended here. Imported
+	/// meshes refer to them </param>
+	/// <returns> True if successful, Otherwise false </returns>
+	bool import(std::vector<ImportedMesh>& meshes, NodeHierarchy& nodes);
+
+	/// <summary>
+	/// Reads the model from its cache
+	/// </summary>
+	/// <param name="meshes"> Imported meshes are appended here </param>
+	/// <param name="nodes"> Nodes of the model are appended here. Imported
+	/// meshes refer to them </param>
+	/// <returns> True if a valid cache was found, Otherwise false </returns>
+	bool importCached(std::vector<ImportedMesh>& meshes, NodeHierarchy& nodes);
+
+	/// <summary>
+	/// Imports the model with Assimp, optimizes its meshes for rendering and
+	/// gives them meshlets and levels of detail, then writes its cache
+	/// </summary>
+	/// <param name="meshes"> Imported meshes are appended here </param>
+	/// <param name="nodes"> Nodes of the model are appended here. Imported
+	/// meshes refer to them </param>
+	/// <returns> True if successful, Otherwise false </returns>
+	bool importSource(std::vector<ImportedMesh>& meshes, NodeHierarchy& nodes);
+
+	/// <summary>
+	/// Gets the center of the combined bounds of meshes, placed by their
+	/// nodes. Uses the bounds from the import, so no vertex is read
+	/// </summary>
+	/// <param name="meshes"> meshes of one model </param>
+	/// <param name="nodes"> nodes of the model, with their world matrices
+	/// up to date </param>
+	/// <returns> center of the bounds, the origin if there is no geometry
+	/// </returns>
+	static glm::vec3 getCenter(const std::vector<ImportedMesh>& meshes,
+		const NodeHierarchy& nodes);
+};
@@ -0,0 +1,52 @@
+#include "NodeHierarchy.h"
+
+#include <algorithm>
+
+NodeHierarchy::NodeHierarchy() : firstDirty(0) {}
+
+unsigned int NodeHierarchy::addNode(int parent, const glm::mat4& localMat) {
+	unsigned int node = (unsigned int)parents.size();
+	// A parent that is not there yet would break the single pass update
+	if (parent >= (int)node)
+		parent = -1;
+	parents.push_back(parent);
+	localMats.push_back(localMat);
+	worldMats.push_back(localMat);
+	dirty.push_back(1);
+	firstDirty = std::min(firstDirty, (size_t)node);
+	return node;
+}
+
+void NodeHierarchy::setLocalMat(unsigned int node, const glm::mat4& localMat) {
+	localMats[node] = localMat;
+	dirty[node] = 1;
+	firstDirty = std::min(firstDirty, (size_t)node);
+}
+
+bool NodeHierarchy::update() {
+	size_t numNodes = parents.size();
+	if (firstDirty >= numNodes)
+		return false;
+
+	// A node moves if it changed or its parent moved. Parents come first,
+	// so their flag is final by the time their children are reached
+	for (size_t i = firstDirty; i < numNodes; ++i) {
+		int parent = parents[i];
+		if (parent >= 0)
+			dirty[i] |= dirty[parent];
+		if (!dirty[i])
+			continue;
+		worldMats[i] = (parent >= 0) ? worldMats[parent] * localMats[i] : localMats[i];
+	}
+	std::fill(dirty.begin() + firstDirty, dirty.end(), (unsigned char)0);
+	firstDirty = numNodes;
+	return true;
+}
+
+void NodeHierarchy::clear() {
+	parents.clear();
+	localMats.clear();
+	worldMats.clear();
+	dirty.clear();
+	firstDirty = 0;
+}
@@ -0,0 +1,70 @@
+/*  Transform hierarchy of a model's nodes, flattened into arrays. Parents
+    always come before their children, so every world matrix is updated in
+    one linear pass and only below nodes that changed
+    - RAB
+ */
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+class NodeHierarchy {
+	// Parent of each node, -1 for roots. Always smaller than the node's own
+	// index
+	std::vector<int> parents;
+	// Transform of each node relative to its parent
+	std::vector<glm::mat4> localMats;
+	// Transform of each node relative to the model. Valid after update
+	std::vector<glm::mat4> worldMats;
+	// Set for nodes whose local matrix changed since the last update
+	std::vector<unsigned char> dirty;
+	// No node before this one is dirty
+	size_t firstDirty;
+
+public:
+	/// <summary>
+	/// Creates an empty hierarchy
+	/// </summary>
+	/// <returns> N/A </returns>
+	NodeHierarchy();
+
+	/// <summary>
+	/// Appends a node. Adding nodes in depth first order keeps the parents of
+	/// every node ahead of it
+	/// </summary>
+	/// <param name="parent"> index of a node already in the hierarchy, or -1
+	/// for a root </param>
+	/// <param name="localMat"> transform relative to the parent </param>
+	/// <returns> index of the new node </returns>
+	unsigned int addNode(int parent, const glm::mat4& localMat);
+
+	/// <summary>
+	/// Changes the local matrix of a node. It and its subtree are updated by
+	/// the next call to update
+	/// </summary>
+	/// <param name="node"> node to change </param>
+	/// <param name="localMat"> transform relative to the parent </param>
+	void setLocalMat(unsigned int node, const glm::mat4& localMat);
+
+	/// <summary>
+	/// Recomputes the world matrices of the dirty nodes and their subtrees.
+	/// Does nothing if no node changed
+	/// </summary>
+	/// <returns> True if any world matrix changed </returns>
+	bool update();
+
+	/// <summary>
+	/// Removes every node
+	/// </summary>
+	void clear();
+
+	inline size_t size() const { return parents.size(); }
+	inline int getParent(unsigned int node) const { return parents[node]; }
+	inline const glm::mat4& getLocalMat(unsigned int node) const {
+		return localMats[node];
+	}
+	inline const glm::mat4& getWorldMat(unsigned int node) const {
+		return worldMats[node];
+	}
+};
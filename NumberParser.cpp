@@ -0,0 +1,496 @@
+#include "NumberParser.h"
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define NUMBER_PARSER_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#endif
+
+// MSVC accepts any intrinsic in any function. GCC and Clang only accept
+// them in functions compiled for the matching instruction set
+#if defined(NUMBER_PARSER_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE42
+#define TARGET_AVX2
+#endif
+
+// The shared parse templates must be inlined into each kernel's entry point,
+// otherwise GCC refuses to inline the vector helpers into them
+#ifdef _MSC_VER
+#define FORCE_INLINE __forceinline
+#else
+#define FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace {
+	using numberParser::Kernel;
+
+	// Every power of ten up to 10^22 is exact in double precision
+	const double EXACT_POWERS_OF_TEN[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+		1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	const int MAX_EXACT_POWER = 22;
+	// Largest mantissa a double holds exactly (2^53)
+	const uint64_t MAX_EXACT_MANTISSA = 1ull << 53;
+	// Bits of a double's mantissa that a float drops, and their pattern when
+	// the double sits exactly halfway between two floats
+	const uint64_t FLOAT_DROPPED_BITS = (1ull << 29) - 1;
+	const uint64_t FLOAT_HALFWAY_BITS = 1ull << 28;
+	// Most decimal digits that always fit in a 64 bit mantissa
+	const size_t MAX_MANTISSA_DIGITS = 19;
+	const uint64_t POWERS_OF_TEN[] = {
+		1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull,
+		10000000ull, 100000000ull, 1000000000ull, 10000000000ull,
+		100000000000ull, 1000000000000ull, 10000000000000ull,
+		100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+		100000000000000000ull, 1000000000000000000ull,
+		10000000000000000000ull
+	};
+	const int MAX_EXPONENT_VALUE = 100000;
+
+	inline bool isDigit(char c) {
+		return (unsigned char)(c - '0') < 10;
+	}
+
+	inline void skipBlanks(const char*& p, const char* end) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			++p;
+	}
+
+	/// <summary>
+	/// Plain C++ digit handling. Used on any CPU and near the end of a buffer,
+	/// where the vector kernels cannot load a full register
+	/// </summary>
+	struct ScalarDigits {
+		/// <summary>
+		/// Finds the end of the run of digits starting at p
+		/// </summary>
+		FORCE_INLINE static const char* runEnd(const char* p, const char* end) {
+			while (p < end && isDigit(*p))
+				++p;
+			return p;
+		}
+
+		/// <summary>
+		/// Converts a run of at most 19 digits
+		/// </summary>
+		static uint64_t value(const char* p, const char* /*end*/, size_t numDigits) {
+			uint64_t value = 0;
+			for (size_t i = 0; i < numDigits; ++i)
+				value = 10 * value + (uint64_t)(p[i] - '0');
+			return value;
+		}
+	};
+
+#ifdef NUMBER_PARSER_X86
+	inline unsigned int countTrailingZeros(unsigned int mask) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return (unsigned int)index;
+#else
+		return (unsigned int)__builtin_ctz(mask);
+#endif
+	}
+
+	/// <summary>
+	/// Converts up to 16 digits held in one register with three
+	/// multiply-adds instead of a dependent multiply per digit
+	/// </summary>
+	/// <param name="chunk"> register loaded from the first digit </param>
+	/// <param name="numDigits"> digits in the run, at most 16 </param>
+	TARGET_SSE42 inline uint64_t convertDigits(__m128i chunk, size_t numDigits) {
+		// Right align the digits. Shuffle indices that come out negative have
+		// their top bit set and produce leading zeros
+		const __m128i identity = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7,
+			8, 9, 10, 11, 12, 13, 14, 15);
+		__m128i shuffle = _mm_add_epi8(identity, _mm_set1_epi8((char)(numDigits - 16)));
+		__m128i digits = _mm_shuffle_epi8(_mm_sub_epi8(chunk, _mm_set1_epi8('0')), shuffle);
+
+		// Pairs of digits, then groups of four, then groups of eight
+		__m128i pairs = _mm_maddubs_epi16(digits, _mm_setr_epi8(10, 1, 10, 1,
+			10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+		__m128i quads = _mm_madd_epi16(pairs, _mm_setr_epi16(100, 1, 100, 1,
+			100, 1, 100, 1));
+		quads = _mm_packus_epi32(quads, quads);
+		__m128i octets = _mm_madd_epi16(quads, _mm_setr_epi16(10000, 1, 10000, 1,
+			10000, 1, 10000, 1));
+
+		uint64_t high = (uint32_t)_mm_cvtsi128_si32(octets);
+		uint64_t low = (uint32_t)_mm_extract_epi32(octets, 1);
+		return high * 100000000ull + low;
+	}
+
+	/// <summary>
+	/// 16 bytes at a time. Digit runs are found with the SSE4.2 string
+	/// compare instruction
+	/// </summary>
+	struct SSE42Digits {
+		TARGET_SSE42 static const char* runEnd(const char* p, const char* end) {
+			const __m128i digitRange = _mm_setr_epi8('0', '9', 0, 0, 0, 0, 0, 0,
+				0, 0, 0, 0, 0, 0, 0, 0);
+			while (end - p >= 16) {
+				__m128i chunk = _mm_loadu_si128((const __m128i*)p);
+				// Index of the first byte outside '0'-'9', 16 if there is none
+				int index = _mm_cmpistri(digitRange, chunk, _SIDD_UBYTE_OPS |
+					_SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY);
+				if (index < 16)
+					return p + index;
+				p += 16;
+			}
+			return ScalarDigits::runEnd(p, end);
+		}
+
+		TARGET_SSE42 static uint64_t value(const char* p, const char* end,
+			size_t numDigits) {
+			if (numDigits > 16 || end - p < 16)
+				return ScalarDigits::value(p, end, numDigits);
+			return convertDigits(_mm_loadu_si128((const __m128i*)p), numDigits);
+		}
+	};
+
+	/// <summary>
+	/// 32 bytes at a time. Digit runs are found with one range compare and a
+	/// bit scan over the whole register
+	/// </summary>
+	struct AVX2Digits {
+		TARGET_AVX2 static const char* runEnd(const char* p, const char* end) {
+			while (end - p >= 32) {
+				__m256i chunk = _mm256_loadu_si256((const __m256i*)p);
+				// Bytes below '0' wrap around, so one unsigned min tells
+				// digits (c - '0' <= 9) from everything else
+				__m256i shifted = _mm256_sub_epi8(chunk, _mm256_set1_epi8('0'));
+				__m256i digits = _mm256_cmpeq_epi8(
+					_mm256_min_epu8(shifted, _mm256_set1_epi8(9)), shifted);
+				unsigned int others = ~(unsigned int)_mm256_movemask_epi8(digits);
+				if (others != 0)
+					return p + countTrailingZeros(others);
+				p += 32;
+			}
+			return SSE42Digits::runEnd(p, end);
+		}
+
+		TARGET_AVX2 static uint64_t value(const char* p, const char* end,
+			size_t numDigits) {
+			return SSE42Digits::value(p, end, numDigits);
+		}
+	};
+#endif
+
+	/// <summary>
+	/// Reads the exponent of a float if one follows. Only consumed if digits
+	/// follow the 'e', like strtof
+	/// </summary>
+	inline int scanExponent(const char*& p, const char* end) {
+		if (p >= end || (*p != 'e' && *p != 'E'))
+			return 0;
+
+		const char* expStart = p++;
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = (*p == '-');
+			++p;
+		}
+		if (p >= end || !isDigit(*p)) {
+			p = expStart;
+			return 0;
+		}
+		int value = 0;
+		for (; p < end && isDigit(*p); ++p) {
+			if (value < MAX_EXPONENT_VALUE)
+				value = 10 * value + (*p - '0');
+		}
+		return negative ? -value : value;
+	}
+
+	/// <summary>
+	/// Float parsing shared by every kernel. Mantissas of up to 53 bits with
+	/// small exponents are converted with a single correctly rounded double
+	/// operation (Clinger's fast path); anything else goes through
+	/// std::from_chars
+	/// </summary>
+	template <class Digits>
+	FORCE_INLINE bool parseFloatWith(const char*& p, const char* end, float& out) {
+		skipBlanks(p, end);
+		const char* start = p;
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = (*p == '-');
+			++p;
+		}
+		const char* numStart = p;
+
+		const char* intBegin = p;
+		const char* intEnd = Digits::runEnd(intBegin, end);
+		const char* fracBegin = intEnd;
+		const char* fracEnd = intEnd;
+		if (intEnd < end && *intEnd == '.') {
+			fracBegin = intEnd + 1;
+			fracEnd = Digits::runEnd(fracBegin, end);
+		}
+		size_t numFrac = fracEnd - fracBegin;
+
+		// No digits at all. Could still be inf or nan
+		if (intEnd == intBegin && numFrac == 0) {
+			float special;
+			std::from_chars_result result = std::from_chars(numStart, end, special);
+			if (result.ec != std::errc()) {
+				p = start;
+				return false;
+			}
+			p = result.ptr;
+			out = negative ? -special : special;
+			return true;
+		}
+
+		p = fracEnd;
+		int exponent = scanExponent(p, end);
+
+		// Leading zeros of the integer part are not significant
+		while (intBegin < intEnd && *intBegin == '0')
+			++intBegin;
+		size_t numInt = intEnd - intBegin;
+
+		if (numInt + numFrac <= MAX_MANTISSA_DIGITS) {
+			uint64_t mantissa = Digits::value(intBegin, end, numInt);
+			if (numFrac > 0) {
+				mantissa = mantissa * POWERS_OF_TEN[numFrac] +
+					Digits::value(fracBegin, end, numFrac);
+				exponent -= (int)numFrac;
+			}
+
+			// Both operands are exact doubles, so one multiply or divide gives
+			// the correctly rounded double. Rounding that to float can only go
+			// wrong if it landed exactly on the midpoint of two floats
+			if (mantissa <= MAX_EXACT_MANTISSA &&
+				exponent >= -MAX_EXACT_POWER && exponent <= MAX_EXACT_POWER) {
+				double value = (double)mantissa;
+				if (exponent < 0)
+					value /= EXACT_POWERS_OF_TEN[-exponent];
+				else
+					value *= EXACT_POWERS_OF_TEN[exponent];
+				uint64_t bits;
+				memcpy(&bits, &value, sizeof(bits));
+				if ((bits & FLOAT_DROPPED_BITS) != FLOAT_HALFWAY_BITS) {
+					out = (float)(negative ? -value : value);
+					return true;
+				}
+			}
+		}
+
+		float value;
+		std::from_chars_result result = std::from_chars(numStart, p, value);
+		if (result.ec == std::errc::result_out_of_range)
+			value = (exponent > 0) ? std::numeric_limits<float>::infinity() : 0.0f;
+		else if (result.ec != std::errc()) {
+			p = start;
+			return false;
+		}
+		out = negative ? -value : value;
+		return true;
+	}
+
+	template <class Digits>
+	FORCE_INLINE bool parseIntWith(const char*& p, const char* end, int& out) {
+		skipBlanks(p, end);
+		const char* start = p;
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = (*p == '-');
+			++p;
+		}
+		const char* digitsEnd = Digits::runEnd(p, end);
+		size_t numDigits = digitsEnd - p;
+		if (numDigits == 0) {
+			p = start;
+			return false;
+		}
+
+		// Wraps around on overflow like the original %d reader
+		uint64_t value = (numDigits <= MAX_MANTISSA_DIGITS) ?
+			Digits::value(p, end, numDigits) :
+			ScalarDigits::value(p, end, numDigits);
+		p = digitsEnd;
+		out = (int)(negative ? 0u - (uint32_t)value : (uint32_t)value);
+		return true;
+	}
+
+	template <class Digits>
+	FORCE_INLINE size_t parseFloatsWith(const char*& p, const char* end, float* out,
+		size_t count) {
+		size_t numRead = 0;
+		while (numRead < count && parseFloatWith<Digits>(p, end, out[numRead]))
+			++numRead;
+		return numRead;
+	}
+
+	/// <summary>
+	/// Entry points of one kernel
+	/// </summary>
+	struct Kernels {
+		bool (*parseFloat)(const char*&, const char*, float&);
+		size_t (*parseFloats)(const char*&, const char*, float*, size_t);
+		bool (*parseInt)(const char*&, const char*, int&);
+	};
+
+	bool parseFloatScalar(const char*& p, const char* end, float& out) {
+		return parseFloatWith<ScalarDigits>(p, end, out);
+	}
+	size_t parseFloatsScalar(const char*& p, const char* end, float* out,
+		size_t count) {
+		return parseFloatsWith<ScalarDigits>(p, end, out, count);
+	}
+	bool parseIntScalar(const char*& p, const char* end, int& out) {
+		return parseIntWith<ScalarDigits>(p, end, out);
+	}
+
+#ifdef NUMBER_PARSER_X86
+	// The templates are instantiated inside functions built for each
+	// instruction set so the digit helpers inline into them
+	TARGET_SSE42 bool parseFloatSSE42(const char*& p, const char* end, float& out) {
+		return parseFloatWith<SSE42Digits>(p, end, out);
+	}
+	TARGET_SSE42 size_t parseFloatsSSE42(const char*& p, const char* end,
+		float* out, size_t count) {
+		return parseFloatsWith<SSE42Digits>(p, end, out, count);
+	}
+	TARGET_SSE42 bool parseIntSSE42(const char*& p, const char* end, int& out) {
+		return parseIntWith<SSE42Digits>(p, end, out);
+	}
+
+	TARGET_AVX2 bool parseFloatAVX2(const char*& p, const char* end, float& out) {
+		return parseFloatWith<AVX2Digits>(p, end, out);
+	}
+	TARGET_AVX2 size_t parseFloatsAVX2(const char*& p, const char* end,
+		float* out, size_t count) {
+		return parseFloatsWith<AVX2Digits>(p, end, out, count);
+	}
+	TARGET_AVX2 bool parseIntAVX2(const char*& p, const char* end, int& out) {
+		return parseIntWith<AVX2Digits>(p, end, out);
+	}
+
+	const Kernels KERNELS[] = {
+		{ parseFloatScalar, parseFloatsScalar, parseIntScalar },
+		{ parseFloatSSE42, parseFloatsSSE42, parseIntSSE42 },
+		{ parseFloatAVX2, parseFloatsAVX2, parseIntAVX2 }
+	};
+
+	void cpuid(int leaf, int subleaf, int regs[4]) {
+#ifdef _MSC_VER
+		__cpuidex(regs, leaf, subleaf);
+#else
+		unsigned int a, b, c, d;
+		__cpuid_count(leaf, subleaf, a, b, c, d);
+		regs[0] = (int)a;
+		regs[1] = (int)b;
+		regs[2] = (int)c;
+		regs[3] = (int)d;
+#endif
+	}
+
+	uint64_t readXCR0() {
+#ifdef _MSC_VER
+		return _xgetbv(0);
+#else
+		uint32_t low, high;
+		__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+		return ((uint64_t)high << 32) | low;
+#endif
+	}
+
+	Kernel detectKernel() {
+		int regs[4];
+		cpuid(0, 0, regs);
+		int maxLeaf = regs[0];
+		if (maxLeaf < 1)
+			return Kernel::SCALAR;
+
+		cpuid(1, 0, regs);
+		// The SSE4.2 kernel also relies on SSSE3 and SSE4.1 instructions
+		bool sse42 = (regs[2] & (1 << 9)) && (regs[2] & (1 << 19)) &&
+			(regs[2] & (1 << 20));
+		// AVX2 also needs the OS to save the upper halves of the registers
+		bool osSavesAVX = (regs[2] & (1 << 27)) && (regs[2] & (1 << 28)) &&
+			(readXCR0() & 0x6) == 0x6;
+		bool avx2 = false;
+		if (maxLeaf >= 7 && osSavesAVX) {
+			cpuid(7, 0, regs);
+			avx2 = (regs[1] & (1 << 5)) != 0;
+		}
+
+		if (sse42 && avx2)
+			return Kernel::AVX2;
+		if (sse42)
+			return Kernel::SSE42;
+		return Kernel::SCALAR;
+	}
+#else
+	const Kernels KERNELS[] = {
+		{ parseFloatScalar, parseFloatsScalar, parseIntScalar }
+	};
+
+	Kernel detectKernel() {
+		return Kernel::SCALAR;
+	}
+#endif
+
+	const Kernels*& activeKernels() {
+		static const Kernels* active = &KERNELS[(int)numberParser::bestKernel()];
+		return active;
+	}
+}
+
+numberParser::Kernel numberParser::bestKernel() {
+	static const Kernel best = detectKernel();
+	return best;
+}
+
+numberParser::Kernel numberParser::activeKernel() {
+	return (Kernel)(activeKernels() - KERNELS);
+}
+
+bool numberParser::setKernel(Kernel kernel) {
+	if ((int)kernel > (int)bestKernel())
+		return false;
+	activeKernels() = &KERNELS[(int)kernel];
+	return true;
+}
+
+const char* numberParser::kernelName(Kernel kernel) {
+	switch (kernel) {
+	case Kernel::SCALAR:
+		return "scalar";
+	case Kernel::SSE42:
+		return "SSE4.2";
+	case Kernel::AVX2:
+		return "AVX2";
+	}
+	return "unknown";
+}
+
+bool numberParser::parseFloat(const char*& p, const char* end, float& out) {
+	return activeKernels()->parseFloat(p, end, out);
+}
+
+size_t numberParser::parseFloats(const char*& p, const char* end, float* out,
+	size_t count) {
+	return activeKernels()->parseFloats(p, end, out, count);
+}
+
+bool numberParser::parseInt(const char*& p, const char* end, int& out) {
+	return activeKernels()->parseInt(p, end, out);
+}
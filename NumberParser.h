@@ -0,0 +1,75 @@
+/*  Locale-free conversion of ASCII decimal numbers for the text mesh formats.
+    Digit runs are found and converted with SSE4.2 or AVX2 when the CPU has
+    them and with plain scalar code otherwise
+    - RAB
+ */
+#pragma once
+
+#include <cstddef>
+
+namespace numberParser {
+	/// <summary>
+	/// Instruction sets the parser can run on, from slowest to fastest
+	/// </summary>
+	enum class Kernel
+	{
+		SCALAR,
+		SSE42,
+		AVX2
+	};
+
+	/// <summary>
+	/// Gets the fastest kernel this CPU supports. Detected once with CPUID
+	/// </summary>
+	Kernel bestKernel();
+
+	/// <summary>
+	/// Gets the kernel the parse functions currently run on. Starts out as
+	/// bestKernel()
+	/// </summary>
+	Kernel activeKernel();
+
+	/// <summary>
+	/// Switches the kernel the parse functions run on. Meant for benchmarks
+	/// and must not be called while another thread is parsing
+	/// </summary>
+	/// <param name="kernel"> kernel to switch to </param>
+	/// <returns> True if successful, False if the CPU lacks the kernel </returns>
+	bool setKernel(Kernel kernel);
+
+	/// <summary>
+	/// Gets a printable name of a kernel
+	/// </summary>
+	const char* kernelName(Kernel kernel);
+
+	/// <summary>
+	/// Reads a decimal float the way %f does, correctly rounded and without
+	/// consulting the locale. Leading spaces, tabs and carriage returns are
+	/// skipped
+	/// </summary>
+	/// <param name="p"> Read position. Moved past the number </param>
+	/// <param name="end"> end of the buffer </param>
+	/// <param name="out"> Stores the parsed value </param>
+	/// <returns> True if a number was read, False if otherwise </returns>
+	bool parseFloat(const char*& p, const char* end, float& out);
+
+	/// <summary>
+	/// Reads a run of blank separated decimal floats
+	/// </summary>
+	/// <param name="p"> Read position. Moved past the last number read </param>
+	/// <param name="end"> end of the buffer </param>
+	/// <param name="out"> Stores the parsed values </param>
+	/// <param name="count"> most numbers to read </param>
+	/// <returns> Number of values read </returns>
+	size_t parseFloats(const char*& p, const char* end, float* out, size_t count);
+
+	/// <summary>
+	/// Reads a decimal integer the way %d does. Leading spaces, tabs and
+	/// carriage returns are skipped
+	/// </summary>
+	/// <param name="p"> Read position. Moved past the number </param>
+	/// <param name="end"> end of the buffer </param>
+	/// <param name="out"> Stores the parsed value </param>
+	/// <returns> True if a number was read, False if otherwise </returns>
+	bool parseInt(const char*& p, const char* end, int& out);
+}
@@ -1,215 +1,173 @@
 #include "OBJObject.h"
 
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
 
-namespace {
-	const int VEC_3_NUM_COMPONENTS = 3;
-	const int FACE_MAX_NUM_COMPONENTS = 6;
-}
-
+#include "AABB.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
+#include "TextureCache.h"
 
 OBJObject::~OBJObject() {
-	glDeleteBuffers(2, VBOs);
-	glDeleteBuffers(1, &EBO);
-	glDeleteVertexArrays(1, &VAO);
-
+	for (auto& mesh : meshes)
+		mesh.deleteBuffers();
 }
 
-OBJObject::OBJObject(const char* path) : Object() {
+OBJObject::OBJObject(const char* path, OBJLoadMode mode)
+	: Object(), loadMode(mode) {
 	model = glm::mat4(1.0f);
-	// Load OBJ file info
-	load(path);
-
-	// Prepare object information to send to GPU
-	glGenVertexArrays(1, &VAO);
-	glGenBuffers(2, VBOs);
-	glGenBuffers(1, &EBO);
-
-	// Bind VAO to modify it
-	glBindVertexArray(VAO);
-
-	// Bind VBO to attach to VAO as an array buffer. This will modify it
-	glBindBuffer(GL_ARRAY_BUFFER, VBOs[0]);
-	// Add data to VBO
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), 
-		vertices.data(), GL_STATIC_DRAW);
-	// Specify location of VBO data by enabling layout location 0
-	glEnableVertexAttribArray(0);
-	// Set metadata that specifies how OpenGL will walk through each vertex
-	glVertexAttribPointer(0,  // Starts at layout location 0
-		3,  // 3 components per vertex
-		GL_FLOAT,  // of type GL_FLOAT
-		GL_FALSE,  // Do not normalize data
-		3 * sizeof(GL_FLOAT),  // Offset between consecutive vertices
-		(GLvoid*)0  // Offset of the 1st vertex component
-	);
-
-	// Move to dealing with normal data
-	// Bind VBO to attach to VAO as an array buffer. This will modify it
-	glBindBuffer(GL_ARRAY_BUFFER, VBOs[1]);
-	// Add data to VBO
-	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3),
-		normals.data(), GL_STATIC_DRAW);
-	// Specify location of VBO data by enabling layout location 1
-	glEnableVertexAttribArray(1);
-	// Set metadata that specifies how OpenGL will walk through each vertex
-	glVertexAttribPointer(1,  // Starts at layout location 1
-		3,  // 3 components per vertex
-		GL_FLOAT,  // of type GL_FLOAT
-		GL_TRUE,  // Do not normalize data
-		3 * sizeof(GL_FLOAT),  // Offset between consecutive vertices
-		(GLvoid*)0  // Offset of the 1st vertex component
-	);
-	
-	// Add element array buffer for dealing with indices
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(glm::ivec3),
-		indices.data(), GL_STATIC_DRAW);
-
-	// Unbind GL_ARRAY_BUFFER (DO NOT UNBIND ELEMENT ARRAY BUFFER)
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	// Load OBJ file info and send it to the GPU
+	if (!load(path)) {
+		std::cout << "Exiting program...\n";
+		exit(EXIT_FAILURE);
+	}
 }
 
 bool OBJObject::load(const char* path) {
-	FILE* fp;
-	glm::vec3 vertex, normal;
-	glm::ivec3 index;
-	int c1, c2, result;
-
-	std::vector<glm::vec3> vertexHolder, normalHolder;
-	std::vector<glm::ivec3> indexHolder;
-
-	// Read file
-	std::cout << "Reading file from " << path << std::endl;
-	fopen_s(&fp, path, "rb");
-	if (fp == nullptr) {
-		std::cout << "Failed to read file!\n Exiting program...\n";
-		exit(EXIT_FAILURE);
+	OBJData geometry;
+	if (!objParser::parse(path, loadMode, geometry))
+		return false;
+
+	// Libraries are named relative to the OBJ file. One that cannot be read
+	// leaves its materials at the default
+	std::filesystem::path directory = std::filesystem::path(path).parent_path();
+	std::vector<std::string> libraries;
+	for (const auto& name : geometry.materialLibraries) {
+		std::string library = (directory / name).generic_string();
+		if (materialCache::loadLibrary(library))
+			libraries.push_back(library);
 	}
 
-	// Read from file
-	result = 0;
-	while ((c1 = fgetc(fp)) != EOF) {
-		// Comment lines
-		if (c1 == '#') {
-			// Move to next line, ignoring current read line
-			// REPLACE IF DOES NOT WORK
-			// Read all lines except newline, then read newline, don't put it to 
-			// any variable
-			fscanf_s(fp, "%*[^\n]%*c");
-			continue;
-		}
-
-		c2 = fgetc(fp);
-		// Vertex position
-		if (c1 == 'v' && c2 == ' ') {
-			// Read vertex information (ignores color info)
-			result = fscanf_s(fp, "%f %f %f %*f %*f %*f\r\n",
-				&vertex.x, &vertex.y, &vertex.z);
-
-			if (result != VEC_3_NUM_COMPONENTS) {
-				std::cout << "Parsing OBJ failure on v\n";
-				exit(EXIT_FAILURE);
-			}
-
-			//vertexHolder.push_back(glm::vec3(vertex));
-			vertices.push_back(glm::vec3(vertex));
-		}
-		// Vertex normal
-		else if (c1 == 'v' && c2 == 'n') {
-			result = fscanf_s(fp, "%f %f %f\r\n",
-				&normal.x, &normal.y, &normal.z);
-			//normalHolder.push_back(vertex);
-			normals.push_back(normalize(normal));
-
-			if (result != VEC_3_NUM_COMPONENTS) {
-				std::cout << "Parsing OBJ failure on vn\n";
-				exit(EXIT_FAILURE);
-			}
-		}
-		// Vertex textures
-		else if (c1 == 'v' && c2 == 't') {
-			// TODO
-		}
-
-		// Parameter space vertices
-
-
-		// Face indices
-		else if (c1 == 'f' && c2 == ' ') {
-			result = fscanf_s(fp, "%d//%*d %d//%*d %d//%*d\r\n",
-				&index.x, &index.y, &index.z);
-			
-			/*
-			// face also includes texture data but no normal data
-			if (result == 1) {
-				result = fscanf_s(fp, "%*d %d/%*d %d/%*d\r\n",
-					&index.y, &index.z);
-
-				// face also includes normal data
-				if (!result) {
-					result = fscanf_s(fp, "/%*d %d/%*d/%*d %d/%*d/%*d\r\n",
-						&index.y, &index.z);
-
-					if (result != 2) {
-						std::cout << "Parsing OBJ failure on f\r\n";
-						exit(EXIT_FAILURE);
-					}
-				}
-
-				// Replace magic number later?
-				else if (result != 2) {
-					std::cout << "Parsing OBJ failure on f\r\n";
-					exit(EXIT_FAILURE);
-				}
-			}
-			*/
-
-			// Failed to parse face index data
-			//else if (result != 3) {
-			if (result != 3) {
-				std::cout << "Failed to parse face index data\r\n";
-				exit(EXIT_FAILURE);
-			}
-			indices.push_back(index - glm::ivec3(1));
-		}
+	std::vector<OBJMaterialGroup> groups;
+	objParser::groupByMaterial(geometry, groups);
+	meshes.reserve(groups.size());
+	OBJWeld weld;
+	for (const auto& group : groups) {
+		if (!loadGroup(geometry, group, weld,
+			materialCache::findInLibraries(libraries, group.name)))
+			return false;
 	}
+	return true;
+}
 
-	std::cout << "Number of vertices: " << vertices.size() << std::endl;
-	std::cout << "Number of vertex normals: " << normals.size();
-	std::cout << std::endl;
-	//std::cout << "Number of faces: " << indexHolder.size() << std::endl;
-	std::cout << "Number of faces: " << indices.size() << std::endl;
-
-	// Sort vertices by order of indices
-	/*
-	glm::ivec3 currIndexVec = glm::ivec3(0, 1, 2);
-	for (auto triIndex : indexHolder) {
-		for (int i = 0; i < VEC_3_NUM_COMPONENTS; ++i) {
-			vertices.push_back(vertexHolder[triIndex[i]]);
-			normals.push_back(normalHolder[triIndex[i]]);
-		}
-		indices.push_back(currIndexVec);
-		currIndexVec += glm::ivec3(3);
-	}
-	*/
+bool OBJObject::loadGroup(const OBJData& geometry,
+	const OBJMaterialGroup& group, OBJWeld& weld,
+	const MaterialRecord* material) {
+	// Only the welded indices and positions pass through system memory,
+	// because the meshlets, levels of detail and ray cast hierarchy are built
+	// from them. The vertices are written straight into the mesh's range of
+	// the pool
+	std::vector<unsigned int> indices(group.numCorners);
+	if (!objParser::weldIndices(geometry, group, indices.data(), weld))
+		return false;
+	size_t numVertices = weld.firstCorners.size();
+	glm::vec3 minCorner, maxCorner;
+	std::vector<Meshlet> meshlets;
+	std::vector<LODLevel> lods;
+	std::vector<glm::vec3> positions(numVertices);
+	objParser::writePositions(geometry, weld, positions.data());
+	aabb::compute((const float*)positions.data(), numVertices,
+		sizeof(glm::vec3), minCorner, maxCorner);
+	meshletBuilder::build(positions.data(), numVertices, indices.data(),
+		indices.size(), meshlets);
+	meshSimplifier::buildLODChain(positions.data(), numVertices, indices,
+		lods);
+
+	meshes.push_back(Mesh());
+	Mesh& mesh = meshes.back();
+	mesh.setMaterial(material);
+	mesh.setTextures(textureCache::materialTextures(material->properties));
+	// Packed positions are quantized within the bounds
+	mesh.setCornerVecs(minCorner, maxCorner);
+	mesh.setLODs(std::move(lods));
+	mesh.upload(numVertices, [&](size_t first, size_t count, Vertex* vertices) {
+		objParser::writeVertices(geometry, weld, first, count, vertices);
+	}, indices.data(), indices.size());
+	mesh.setMeshlets(std::move(meshlets));
+	// The positions and indices go on to the ray cast hierarchy
+	mesh.buildTriangles(std::move(positions), std::move(indices));
+	return true;
+}
 
-	fclose(fp);
+bool OBJObject::raycast(const glm::vec3& origin, const glm::vec3& direction,
+	float maxDistance, RayHit& hit) {
+	// Meshes are in the object's own space. Distances along the ray stay the
+	// same there, as the direction is transformed along with the origin
+	glm::mat4 toObject = glm::inverse(model);
+	glm::vec3 localOrigin = glm::vec3(toObject * glm::vec4(origin, 1.0f));
+	glm::vec3 localDirection = glm::vec3(toObject * glm::vec4(direction, 0.0f));
+	bool found = false;
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		TriangleHit triangle;
+		if (!meshes[i].raycast(localOrigin, localDirection, maxDistance,
+			triangle))
+			continue;
+		maxDistance = triangle.distance;
+		hit.distance = triangle.distance;
+		hit.object = this;
+		hit.mesh = i;
+		hit.instance = 0;
+		hit.triangle = triangle.triangle;
+		hit.barycentrics = triangle.barycentrics;
+		found = true;
+	}
+	return found;
+}
 
-	return true;
+void OBJObject::sendMatToShader(const Shader& program) const {
+	for (const auto& mesh : meshes)
+		mesh.sendMatToShader(program);
+}
 
+void OBJObject::draw(const Shader& program, glm::mat4 view,
+	glm::mat4 projection) {
+	drawMeshes(program, view, projection, false);
 }
 
+size_t OBJObject::cull(const glm::mat4& view, const glm::mat4& projection) {
+	meshBounds.clear();
+	for (auto& mesh : meshes) {
+		glm::vec3 min, max;
+		mesh.getBounds(model, min, max);
+		meshBounds.add(min, max);
+	}
+	glm::vec4 planes[6];
+	frustum::extractPlanes(projection * view, planes);
+	meshVisible.resize(meshes.size());
+	size_t numCulled = frustum::cullBoxes(planes,
+		glm::vec3(glm::inverse(view)[3]), projection[1][1],
+		frustum::MIN_SCREEN_COVERAGE, meshBounds, meshVisible.data());
+
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		if (meshVisible[i])
+			meshes[i].cull(model, view, projection);
+		else
+			meshes[i].cullWhole();
+	}
+	return numCulled;
+}
 
-void OBJObject::draw(Shader shaderProg, glm::mat4 view, glm::mat4 projection) {
-	shaderProg.use();
-	setShaderToRenderType(shaderProg);
-	shaderProg.setMat4("model", model);
-	shaderProg.setMat4("view", view);
-	shaderProg.setMat4("projection", projection);
+void OBJObject::drawVisible(const Shader& program, glm::mat4 view,
+	glm::mat4 projection) {
+	drawMeshes(program, view, projection, true);
+}
 
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, (int)indices.size() * 3, GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+void OBJObject::drawMeshes(const Shader& program, glm::mat4& view,
+	glm::mat4& projection, bool visibleOnly) {
+	program.use();
+	setShaderToRenderType(program);
+	// Meshes of one layout share buffers, so only a change of layout rebinds
+	const GeometryPool* boundPool = nullptr;
+	for (auto& mesh : meshes) {
+		const GeometryPool* pool = mesh.getGeometryPool();
+		if (pool && pool != boundPool) {
+			pool->bind();
+			boundPool = pool;
+		}
+		mesh.sendMatToShader(program);
+		mesh.draw(program, model, view, projection, visibleOnly);
+	}
+	if (boundPool)
+		boundPool->unbind();
 }
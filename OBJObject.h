@@ -6,20 +6,24 @@
  */
 #pragma once
 
-#include <glad/glad.h>
 #include <vector>
 
+#include "Frustum.h"
+#include "Mesh.h"
 #include "Object.h"
+#include "OBJParser.h"
 
 class OBJObject : public Object
 {
-    // Basic 3D object mesh information
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec3> normals;
-    std::vector<glm::ivec3> indices;
+    // Welded geometry of the OBJ file, one mesh per material
+    std::vector<Mesh> meshes;
 
-    // TO BE ADDED LATER IF APPROPRIATE
-    //std::vector<glm::vec2> texCoords;
+    // How the OBJ file is read from disk
+    OBJLoadMode loadMode;
+
+    // World bounds of every mesh, and whether each passed the last cull
+    frustum::Boxes meshBounds;
+    std::vector<unsigned char> meshVisible;
 
     /// <summary>
     /// Helper function that parses the OBJ file
@@ -28,34 +32,82 @@ class OBJObject : public Object
     /// <returns> True if successful, False if otherwise </returns>
     bool load(const char* path);
 
-public:
-    // Add vertex array objects
-    GLuint VAO, EBO;
-    GLuint VBOs[2];
+    /// <summary>
+    /// Welds the corners of one material group into a new mesh with its
+    /// meshlets and levels of detail
+    /// </summary>
+    /// <param name="geometry"> Parsed geometry </param>
+    /// <param name="group"> corners of the mesh </param>
+    /// <param name="weld"> Shared by every group of the file </param>
+    /// <param name="material"> material of the mesh </param>
+    /// <returns> True if successful, False if otherwise </returns>
+    bool loadGroup(const OBJData& geometry, const OBJMaterialGroup& group,
+        OBJWeld& weld, const MaterialRecord* material);
 
+    /// <summary>
+    /// Draws every mesh, either whole or only what the last cull kept
+    /// </summary>
+    /// <param name="program"> ID of shader program to use </param>
+    /// <param name="view"> inverse camera transformation matrix </param>
+    /// <param name="projection"> projection transformation matrix </param>
+    /// <param name="visibleOnly"> whether to draw only what cull kept </param>
+    void drawMeshes(const Shader& program, glm::mat4& view,
+        glm::mat4& projection, bool visibleOnly);
+
+public:
     ~OBJObject();
 
     /// <summary>
     /// ctor that creates a 3D object from a wavefront OBJ file
     /// </summary>
     /// <param name="path"> path to the OBJ file </param>
+    /// <param name="mode"> how the file is read from disk </param>
     /// <returns> N/A </returns>
-    OBJObject(const char* path);
+    OBJObject(const char* path, OBJLoadMode mode = OBJLoadMode::PARALLEL);
 
 	/// <summary>
-	/// Should send material info to shader...but since OBJObject is deprecated
-	/// I won't bother. 
+	/// Sends material info to the passed-in shader
 	/// </summary>
 	/// <param name="program"></param>
-	void sendMatToShader(const Shader& program) const {}
+	void sendMatToShader(const Shader& program) const;
 
     /// <summary>
 	/// Draws object to screen.
 	/// </summary>
-	/// <param name="shaderProg"> ID of shader program to use </param>
+	/// <param name="program"> ID of shader program to use </param>
 	/// <param name="view"> inverse camera transformation matrix </param>
 	/// <param name="projection"> projection transformation matrix </param>
-    void draw(Shader shaderProg, glm::mat4 view, glm::mat4 projection);
+    void draw(const Shader& program, glm::mat4 view, glm::mat4 projection);
+
+    /// <summary>
+    /// Skips the meshes outside the camera's frustum or too small to see,
+    /// and culls the meshlets of the rest
+    /// </summary>
+    /// <param name="view"> inverse camera transformation matrix </param>
+    /// <param name="projection"> projection transformation matrix </param>
+    /// <returns> Number of meshes skipped </returns>
+    size_t cull(const glm::mat4& view, const glm::mat4& projection);
+
+    /// <summary>
+    /// Draws the meshlets the last cull kept
+    /// </summary>
+    /// <param name="program"> ID of shader program to use </param>
+    /// <param name="view"> inverse camera transformation matrix </param>
+    /// <param name="projection"> projection transformation matrix </param>
+    void drawVisible(const Shader& program, glm::mat4 view, glm::mat4 projection);
+
+    /// <summary>
+    /// Finds the closest triangle a ray hits. Meshes whose triangle
+    /// hierarchy is still being built are missed
+    /// </summary>
+    /// <param name="origin"> start of the ray, in world space </param>
+    /// <param name="direction"> direction of the ray </param>
+    /// <param name="maxDistance"> furthest distance along the ray, in units
+    /// of direction </param>
+    /// <param name="hit"> Stores the closest hit </param>
+    /// <returns> True if the ray hits the object before maxDistance </returns>
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction,
+        float maxDistance, RayHit& hit);
 
 };
 
@@ -0,0 +1,816 @@
+#include "OBJParser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+
+#include "MappedFile.h"
+#include "Mesh.h"
+#include "NumberParser.h"
+
+namespace {
+	const int VEC_3_NUM_COMPONENTS = 3;
+	// Components of a face corner
+	const int POSITION = 0;
+	const int TEX_COORD = 1;
+	const int NORMAL = 2;
+
+	const double BYTES_PER_MB = 1024.0 * 1024.0;
+	// Smallest piece of a file the parallel reader hands to a worker
+	const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+	inline bool isBlank(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline void skipBlanks(const char*& p, const char* end) {
+		while (p < end && isBlank(*p))
+			++p;
+	}
+
+	inline void skipLine(const char*& p, const char* end) {
+		const void* newline = memchr(p, '\n', end - p);
+		p = newline ? (const char*)newline + 1 : end;
+	}
+
+	/// <summary>
+	/// Consumes a keyword if it is followed by a blank
+	/// </summary>
+	inline bool matchKeyword(const char*& p, const char* end, const char* keyword,
+		size_t length) {
+		if ((size_t)(end - p) <= length || memcmp(p, keyword, length) != 0 ||
+			!isBlank(p[length]))
+			return false;
+		p += length;
+		return true;
+	}
+
+	/// <summary>
+	/// Gets the rest of the line without surrounding blanks
+	/// </summary>
+	std::string restOfLine(const char* p, const char* end) {
+		skipBlanks(p, end);
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		lineEnd = lineEnd ? lineEnd : end;
+		while (lineEnd > p && isBlank(lineEnd[-1]))
+			--lineEnd;
+		return std::string(p, lineEnd);
+	}
+
+	/// <summary>
+	/// Counts the line a position in the buffer sits on. Only used for error
+	/// messages so the hot loop never has to track it
+	/// </summary>
+	size_t lineNumber(const char* begin, const char* pos) {
+		size_t line = 1;
+		for (const char* c = begin; c < pos; ++c)
+			line += (*c == '\n');
+		return line;
+	}
+
+	/// <summary>
+	/// Reads the components of a vector
+	/// </summary>
+	/// <returns> Number of components read </returns>
+	inline int scanVec3(const char*& p, const char* end, glm::vec3& v) {
+		return (int)numberParser::parseFloats(p, end, &v[0], VEC_3_NUM_COMPONENTS);
+	}
+
+	/// <summary>
+	/// Reads one corner of a face: v, v/vt, v//vn or v/vt/vn
+	/// </summary>
+	/// <param name="p"> Read position. Moved past the corner </param>
+	/// <param name="end"> end of the buffer </param>
+	/// <param name="corner"> Stores the raw position/uv/normal indices </param>
+	/// <param name="presentMask"> Stores a bit for each component the corner
+	/// has, 1 << POSITION and so on </param>
+	/// <returns> 1 if a corner was read, 0 at the end of the line, -1 if the
+	/// corner is malformed or has an index of 0, which OBJ never uses
+	/// </returns>
+	int scanCorner(const char*& p, const char* end, glm::ivec3& corner,
+		int& presentMask) {
+		skipBlanks(p, end);
+		if (p >= end || *p == '\n' || *p == '#')
+			return 0;
+
+		corner = glm::ivec3(0);
+		presentMask = 1 << POSITION;
+		if (!numberParser::parseInt(p, end, corner[POSITION]))
+			return -1;
+		if (p < end && *p == '/') {
+			++p;
+			if (p < end && *p != '/') {
+				if (!numberParser::parseInt(p, end, corner[TEX_COORD]))
+					return -1;
+				presentMask |= 1 << TEX_COORD;
+			}
+			if (p < end && *p == '/') {
+				++p;
+				if (!numberParser::parseInt(p, end, corner[NORMAL]))
+					return -1;
+				presentMask |= 1 << NORMAL;
+			}
+		}
+		for (int i = 0; i < VEC_3_NUM_COMPONENTS; ++i) {
+			if ((presentMask & (1 << i)) && corner[i] == 0)
+				return -1;
+		}
+		return 1;
+	}
+
+	/// <summary>
+	/// Per-chunk parse results of the parallel reader
+	/// </summary>
+	struct ParsedChunk {
+		OBJData data;
+		// Flattened corner slots that held relative (negative) indices
+		std::vector<size_t> relativeSlots;
+		glm::ivec3 attribOffset = glm::ivec3(0);
+		size_t cornerOffset = 0;
+		bool success = false;
+	};
+
+	/// <summary>
+	/// Tokenizes a range of whole lines of an OBJ file
+	/// </summary>
+	/// <param name="fileBegin"> first byte of the file. For error messages
+	/// </param>
+	/// <param name="begin"> first byte of the range </param>
+	/// <param name="end"> one past the last byte of the range </param>
+	/// <param name="data"> Stores the parsed geometry </param>
+	/// <param name="relativeSlots"> If given, relative indices are resolved
+	/// against the attributes of this range only and their slots are recorded
+	/// here so they can be offset later </param>
+	/// <returns> True if successful, False if otherwise </returns>
+	bool parseRange(const char* fileBegin, const char* begin, const char* end,
+		OBJData& data, std::vector<size_t>* relativeSlots) {
+		const char* p = begin;
+		glm::vec3 vertex, normal;
+		glm::vec2 texCoord;
+		glm::ivec3 corner;
+
+		// Corners of the current polygon and which of their components were
+		// relative indices
+		std::vector<glm::ivec3> polygon;
+		std::vector<int> relativeMasks;
+
+		while (p < end) {
+			skipBlanks(p, end);
+			if (p >= end)
+				break;
+
+			const char c1 = *p;
+			const char c2 = (p + 1 < end) ? p[1] : '\0';
+
+			// Vertex position (ignores color info)
+			if (c1 == 'v' && isBlank(c2)) {
+				p += 2;
+				if (scanVec3(p, end, vertex) != VEC_3_NUM_COMPONENTS) {
+					std::cout << "Parsing OBJ failure on v at line ";
+					std::cout << lineNumber(fileBegin, p) << std::endl;
+					return false;
+				}
+				data.vertices.push_back(vertex);
+			}
+			// Vertex normal
+			else if (c1 == 'v' && c2 == 'n') {
+				p += 2;
+				if (scanVec3(p, end, normal) != VEC_3_NUM_COMPONENTS) {
+					std::cout << "Parsing OBJ failure on vn at line ";
+					std::cout << lineNumber(fileBegin, p) << std::endl;
+					return false;
+				}
+				data.normals.push_back(normalize(normal));
+			}
+			// Vertex texture coordinate (ignores the optional w)
+			else if (c1 == 'v' && c2 == 't') {
+				p += 2;
+				if (!numberParser::parseFloat(p, end, texCoord.x)) {
+					std::cout << "Parsing OBJ failure on vt at line ";
+					std::cout << lineNumber(fileBegin, p) << std::endl;
+					return false;
+				}
+				// 1D texture coordinates are allowed
+				if (!numberParser::parseFloat(p, end, texCoord.y))
+					texCoord.y = 0.0f;
+				data.texCoords.push_back(texCoord);
+			}
+			// Face. Polygons are fanned out into triangles
+			else if (c1 == 'f' && isBlank(c2)) {
+				p += 2;
+				const int attribCounts[VEC_3_NUM_COMPONENTS] = {
+					(int)data.vertices.size(),
+					(int)data.texCoords.size(),
+					(int)data.normals.size()
+				};
+
+				polygon.clear();
+				relativeMasks.clear();
+				int result, presentMask;
+				bool inRange = true;
+				while ((result = scanCorner(p, end, corner, presentMask)) > 0) {
+					int relativeMask = 0;
+					for (int i = 0; i < VEC_3_NUM_COMPONENTS; ++i) {
+						// Left out uvs and normals are -1, which no index
+						// resolves to past the checks below
+						if (!(presentMask & (1 << i))) {
+							corner[i] = -1;
+						}
+						// Negative indices count back from the latest attribute.
+						// A range parsed on its own only knows its own
+						// attributes, so its indices are checked once offset
+						else if (corner[i] < 0) {
+							corner[i] += attribCounts[i];
+							relativeMask |= 1 << i;
+							if (relativeSlots == nullptr && corner[i] < 0)
+								inRange = false;
+						}
+						else
+							corner[i] -= 1;
+					}
+					polygon.push_back(corner);
+					relativeMasks.push_back(relativeMask);
+				}
+				if (result < 0 || !inRange || polygon.size() < 3) {
+					std::cout << "Failed to parse face index data at line ";
+					std::cout << lineNumber(fileBegin, p) << std::endl;
+					return false;
+				}
+
+				for (size_t i = 1; i + 1 < polygon.size(); ++i) {
+					const size_t fan[VEC_3_NUM_COMPONENTS] = { 0, i, i + 1 };
+					for (size_t k : fan) {
+						if (relativeSlots != nullptr) {
+							for (int j = 0; j < VEC_3_NUM_COMPONENTS; ++j) {
+								if (relativeMasks[k] & (1 << j)) {
+									relativeSlots->push_back(
+										VEC_3_NUM_COMPONENTS * data.corners.size() + j);
+								}
+							}
+						}
+						data.corners.push_back(polygon[k]);
+					}
+				}
+			}
+			// Material switch. Applies to the faces that follow
+			else if (c1 == 'u' && matchKeyword(p, end, "usemtl", 6)) {
+				data.materialUses.push_back(
+					OBJMaterialUse{ data.corners.size(), restOfLine(p, end) });
+			}
+			// Material libraries. One statement may name several files
+			else if (c1 == 'm' && matchKeyword(p, end, "mtllib", 6)) {
+				std::string names = restOfLine(p, end);
+				for (size_t first = 0; first < names.size();) {
+					size_t last = names.find_first_of(" \t", first);
+					last = (last == std::string::npos) ? names.size() : last;
+					if (last > first)
+						data.materialLibraries.push_back(names.substr(first, last - first));
+					first = last + 1;
+				}
+			}
+			// Comments, groups and everything else
+			skipLine(p, end);
+		}
+
+		return true;
+	}
+
+	/// <summary>
+	/// Open-addressing (linear probing) hash map from a corner's
+	/// position/uv/normal triplet to its welded vertex index
+	/// </summary>
+	class VertexWeldMap {
+		struct Slot {
+			glm::ivec3 key;
+			unsigned int value;
+		};
+		// Positions are never negative once validated, so they mark free slots
+		static const int EMPTY = -1;
+		// Grow once the table is half full
+		static const size_t MAX_LOAD_DENOMINATOR = 2;
+
+		std::vector<Slot> slots;
+		size_t mask = 0;
+		size_t count = 0;
+
+		static size_t hash(const glm::ivec3& key) {
+			uint64_t h = (uint32_t)key.x * 0x9E3779B97F4A7C15ull;
+			h ^= (uint32_t)key.y * 0xC2B2AE3D27D4EB4Full;
+			h ^= (uint32_t)key.z * 0x165667B19E3779F9ull;
+			h ^= h >> 29;
+			return (size_t)h;
+		}
+
+		void allocate(size_t capacity) {
+			slots.assign(capacity, Slot{ glm::ivec3(EMPTY), 0 });
+			mask = capacity - 1;
+			count = 0;
+		}
+
+		void grow() {
+			std::vector<Slot> old;
+			old.swap(slots);
+			allocate(2 * old.size());
+			for (const auto& slot : old) {
+				if (slot.key.x != EMPTY) {
+					bool inserted;
+					findOrInsert(slot.key, slot.value, inserted);
+				}
+			}
+		}
+
+	public:
+		VertexWeldMap(size_t expectedCount) {
+			size_t capacity = 16;
+			while (capacity < MAX_LOAD_DENOMINATOR * expectedCount)
+				capacity <<= 1;
+			allocate(capacity);
+		}
+
+		/// <summary>
+		/// Looks up a triplet, adding it with the given value if it is new
+		/// </summary>
+		/// <param name="key"> position/uv/normal indices </param>
+		/// <param name="value"> vertex index to use if the key is new </param>
+		/// <param name="inserted"> Set to whether the key was new </param>
+		/// <returns> Vertex index stored for the key </returns>
+		unsigned int findOrInsert(const glm::ivec3& key, unsigned int value,
+			bool& inserted) {
+			if (MAX_LOAD_DENOMINATOR * (count + 1) > slots.size())
+				grow();
+
+			for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+				Slot& slot = slots[i];
+				if (slot.key.x == EMPTY) {
+					slot.key = key;
+					slot.value = value;
+					++count;
+					inserted = true;
+					return value;
+				}
+				if (slot.key == key) {
+					inserted = false;
+					return slot.value;
+				}
+			}
+		}
+	};
+
+	/// <summary>
+	/// Builds the welded vertex that a corner introduced
+	/// </summary>
+	inline Vertex buildVertex(const OBJData& data, const OBJWeld& weld,
+		const glm::ivec3& corner) {
+		Vertex vertex;
+		vertex.position = data.vertices[corner[POSITION]];
+		if (corner[NORMAL] >= 0)
+			vertex.normal = data.normals[corner[NORMAL]];
+		else {
+			// Average of the faces around the position
+			const glm::vec3& sum = weld.smoothNormals[corner[POSITION]];
+			float length = glm::length(sum);
+			vertex.normal = (length > 0.0f) ? sum / length : glm::vec3(0.0f);
+		}
+		// Flipped to match the aiProcess_FlipUVs convention used by Model
+		if (corner[TEX_COORD] >= 0) {
+			const glm::vec2& texCoord = data.texCoords[corner[TEX_COORD]];
+			vertex.texCoords = glm::vec2(texCoord.x, 1.0f - texCoord.y);
+		}
+		else
+			vertex.texCoords = glm::vec2(0);
+		return vertex;
+	}
+}
+
+bool objParser::parse(const char* path, OBJLoadMode mode, OBJData& data) {
+	std::cout << "Reading file from " << path << std::endl;
+
+	auto startTime = std::chrono::steady_clock::now();
+	bool success = false;
+	switch (mode) {
+	case OBJLoadMode::STDIO:
+		success = parseStdio(path, data);
+		break;
+	case OBJLoadMode::MAPPED:
+		success = parseMapped(path, data);
+		break;
+	case OBJLoadMode::PARALLEL:
+		success = parseParallel(path, data);
+		break;
+	default:
+		std::cout << "OBJ load mode is unrecognized!\n";
+		break;
+	}
+	if (!success)
+		return false;
+
+	std::chrono::duration<double> elapsed =
+		std::chrono::steady_clock::now() - startTime;
+	std::error_code ec;
+	double fileMB = (double)std::filesystem::file_size(path, ec) / BYTES_PER_MB;
+
+	std::cout << "Number of vertices: " << data.vertices.size() << std::endl;
+	std::cout << "Number of vertex normals: " << data.normals.size();
+	std::cout << std::endl;
+	std::cout << "Number of texture coordinates: " << data.texCoords.size();
+	std::cout << std::endl;
+	std::cout << "Number of triangles: ";
+	std::cout << data.corners.size() / VEC_3_NUM_COMPONENTS << std::endl;
+	std::cout << "Number of material switches: " << data.materialUses.size();
+	std::cout << std::endl;
+	std::cout << "Parsed " << fileMB << " MB in " << elapsed.count() << " s (";
+	std::cout << fileMB / elapsed.count() << " MB/s)" << std::endl;
+
+	return true;
+}
+
+bool objParser::parseStdio(const char* path, OBJData& data) {
+	FILE* fp;
+	glm::vec3 vertex, normal;
+	glm::vec2 texCoord;
+	glm::ivec3 index, normalIndex;
+	int c1, c2, result;
+
+	// Read file
+	fopen_s(&fp, path, "rb");
+	if (fp == nullptr) {
+		std::cout << "Failed to read file!\n";
+		return false;
+	}
+
+	// Read from file
+	result = 0;
+	while ((c1 = fgetc(fp)) != EOF) {
+		// Comment lines
+		if (c1 == '#') {
+			// Read all lines except newline, then read newline, don't put it to
+			// any variable
+			fscanf_s(fp, "%*[^\n]%*c");
+			continue;
+		}
+
+		c2 = fgetc(fp);
+		// Vertex position
+		if (c1 == 'v' && c2 == ' ') {
+			// Read vertex information (ignores color info)
+			result = fscanf_s(fp, "%f %f %f %*f %*f %*f\r\n",
+				&vertex.x, &vertex.y, &vertex.z);
+
+			if (result != VEC_3_NUM_COMPONENTS) {
+				std::cout << "Parsing OBJ failure on v\n";
+				fclose(fp);
+				return false;
+			}
+
+			data.vertices.push_back(glm::vec3(vertex));
+		}
+		// Vertex normal
+		else if (c1 == 'v' && c2 == 'n') {
+			result = fscanf_s(fp, "%f %f %f\r\n",
+				&normal.x, &normal.y, &normal.z);
+
+			if (result != VEC_3_NUM_COMPONENTS) {
+				std::cout << "Parsing OBJ failure on vn\n";
+				fclose(fp);
+				return false;
+			}
+			data.normals.push_back(normalize(normal));
+		}
+		// Vertex textures
+		else if (c1 == 'v' && c2 == 't') {
+			result = fscanf_s(fp, "%f %f %*f\r\n", &texCoord.x, &texCoord.y);
+
+			if (result != 2) {
+				std::cout << "Parsing OBJ failure on vt\n";
+				fclose(fp);
+				return false;
+			}
+			data.texCoords.push_back(texCoord);
+		}
+
+		// Face indices. Only triangles in the v//vn form
+		else if (c1 == 'f' && c2 == ' ') {
+			result = fscanf_s(fp, "%d//%d %d//%d %d//%d\r\n",
+				&index.x, &normalIndex.x, &index.y, &normalIndex.y,
+				&index.z, &normalIndex.z);
+
+			// Failed to parse face index data
+			if (result != 6) {
+				std::cout << "Failed to parse face index data\r\n";
+				fclose(fp);
+				return false;
+			}
+			for (int i = 0; i < VEC_3_NUM_COMPONENTS; ++i)
+				data.corners.push_back(glm::ivec3(index[i] - 1, -1, normalIndex[i] - 1));
+		}
+	}
+
+	fclose(fp);
+
+	return true;
+}
+
+bool objParser::parseMapped(const char* path, OBJData& data) {
+	MappedFile file(path);
+	if (!file.isOpen()) {
+		std::cout << "Failed to read file!\n";
+		return false;
+	}
+	return parseBuffer(file.begin(), file.end(), data);
+}
+
+bool objParser::parseParallel(const char* path, OBJData& data,
+	unsigned int numThreads) {
+	MappedFile file(path);
+	if (!file.isOpen()) {
+		std::cout << "Failed to read file!\n";
+		return false;
+	}
+	return parseBufferParallel(file.begin(), file.end(), data, numThreads);
+}
+
+bool objParser::parseBuffer(const char* begin, const char* end, OBJData& data) {
+	return parseRange(begin, begin, end, data, nullptr);
+}
+
+bool objParser::parseBufferParallel(const char* begin, const char* end,
+	OBJData& data, unsigned int numThreads) {
+	if (numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	// Small files are not worth the thread start up
+	size_t size = end - begin;
+	size_t numChunks = std::min<size_t>(numThreads, size / MIN_CHUNK_BYTES);
+	if (numChunks <= 1)
+		return parseBuffer(begin, end, data);
+
+	// Split at newline boundaries so no line straddles two chunks
+	std::vector<const char*> bounds(numChunks + 1);
+	bounds[0] = begin;
+	bounds[numChunks] = end;
+	for (size_t i = 1; i < numChunks; ++i) {
+		const char* split = std::max(begin + size * i / numChunks, bounds[i - 1]);
+		skipLine(split, end);
+		bounds[i] = split;
+	}
+
+	// Parse every chunk on its own worker
+	std::vector<ParsedChunk> chunks(numChunks);
+	std::vector<std::thread> workers;
+	workers.reserve(numChunks);
+	for (size_t i = 0; i < numChunks; ++i) {
+		workers.emplace_back([&, i]() {
+			ParsedChunk& chunk = chunks[i];
+			chunk.success = parseRange(begin, bounds[i], bounds[i + 1],
+				chunk.data, &chunk.relativeSlots);
+		});
+	}
+	for (auto& worker : workers)
+		worker.join();
+
+	// Work out where every chunk lands in the final arrays
+	glm::ivec3 numAttribs(
+		(int)data.vertices.size(),
+		(int)data.texCoords.size(),
+		(int)data.normals.size()
+	);
+	size_t numCorners = data.corners.size();
+	for (auto& chunk : chunks) {
+		if (!chunk.success)
+			return false;
+		chunk.attribOffset = numAttribs;
+		chunk.cornerOffset = numCorners;
+		numAttribs += glm::ivec3(
+			(int)chunk.data.vertices.size(),
+			(int)chunk.data.texCoords.size(),
+			(int)chunk.data.normals.size()
+		);
+		numCorners += chunk.data.corners.size();
+
+		// Material statements are few, so they are stitched right here
+		data.materialLibraries.insert(data.materialLibraries.end(),
+			chunk.data.materialLibraries.begin(),
+			chunk.data.materialLibraries.end());
+		for (auto& use : chunk.data.materialUses) {
+			use.firstCorner += chunk.cornerOffset;
+			data.materialUses.push_back(std::move(use));
+		}
+	}
+	data.vertices.resize(numAttribs[POSITION]);
+	data.texCoords.resize(numAttribs[TEX_COORD]);
+	data.normals.resize(numAttribs[NORMAL]);
+	data.corners.resize(numCorners);
+
+	// Stitch the chunks together in file order, again one worker per chunk.
+	// Relative (negative) indices were resolved against the chunk's own
+	// attributes, so they still need the chunk's global offsets
+	workers.clear();
+	for (size_t i = 0; i < numChunks; ++i) {
+		workers.emplace_back([&, i]() {
+			ParsedChunk& chunk = chunks[i];
+			std::copy(chunk.data.vertices.begin(), chunk.data.vertices.end(),
+				data.vertices.begin() + chunk.attribOffset[POSITION]);
+			std::copy(chunk.data.texCoords.begin(), chunk.data.texCoords.end(),
+				data.texCoords.begin() + chunk.attribOffset[TEX_COORD]);
+			std::copy(chunk.data.normals.begin(), chunk.data.normals.end(),
+				data.normals.begin() + chunk.attribOffset[NORMAL]);
+
+			glm::ivec3* corners = &data.corners[chunk.cornerOffset];
+			std::copy(chunk.data.corners.begin(), chunk.data.corners.end(),
+				corners);
+			for (size_t slot : chunk.relativeSlots) {
+				int component = (int)(slot % VEC_3_NUM_COMPONENTS);
+				int& index = corners[slot / VEC_3_NUM_COMPONENTS][component];
+				index += chunk.attribOffset[component];
+				// Counted back past the first attribute of the file
+				if (index < 0)
+					chunk.success = false;
+			}
+
+			// Release chunk memory as soon as it has been copied out
+			chunk.data = OBJData();
+		});
+	}
+	for (auto& worker : workers)
+		worker.join();
+
+	for (const auto& chunk : chunks) {
+		if (!chunk.success) {
+			std::cout << "Relative face index out of range\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+void objParser::groupByMaterial(const OBJData& data,
+	std::vector<OBJMaterialGroup>& groups, size_t firstCorner,
+	size_t lastCorner) {
+	groups.clear();
+	lastCorner = std::min(lastCorner, data.corners.size());
+	std::vector<std::pair<std::string, size_t>> groupIndices;
+	auto addRange = [&](const std::string& name, size_t first, size_t last) {
+		first = std::max(first, firstCorner);
+		last = std::min(last, lastCorner);
+		if (first >= last)
+			return;
+		// Files rarely use more than a handful of materials
+		size_t index = 0;
+		while (index < groupIndices.size() && groupIndices[index].first != name)
+			++index;
+		if (index == groupIndices.size()) {
+			groupIndices.emplace_back(name, groups.size());
+			groups.emplace_back();
+			groups.back().name = name;
+		}
+		OBJMaterialGroup& group = groups[groupIndices[index].second];
+		group.cornerRanges.emplace_back(first, last);
+		group.numCorners += last - first;
+	};
+
+	size_t first = 0;
+	std::string name;
+	for (const auto& use : data.materialUses) {
+		addRange(name, first, use.firstCorner);
+		first = use.firstCorner;
+		name = use.name;
+	}
+	addRange(name, first, lastCorner);
+}
+
+void objParser::accumulateNormals(const OBJData& data, size_t firstCorner,
+	size_t lastCorner, std::vector<glm::vec3>& sums) {
+	const unsigned int numVertices = (unsigned int)data.vertices.size();
+	sums.resize(numVertices, glm::vec3(0.0f));
+	lastCorner = std::min(lastCorner, data.corners.size());
+	for (size_t i = firstCorner; i + 2 < lastCorner; i += 3) {
+		int a = data.corners[i][POSITION];
+		int b = data.corners[i + 1][POSITION];
+		int c = data.corners[i + 2][POSITION];
+		// Faces across every material count, but only the group being
+		// welded has been validated
+		if ((unsigned int)a >= numVertices || (unsigned int)b >= numVertices ||
+			(unsigned int)c >= numVertices)
+			continue;
+		glm::vec3 faceNormal = glm::cross(
+			data.vertices[b] - data.vertices[a],
+			data.vertices[c] - data.vertices[a]);
+		sums[a] += faceNormal;
+		sums[b] += faceNormal;
+		sums[c] += faceNormal;
+	}
+}
+
+bool objParser::weldIndices(const OBJData& data, unsigned int* indices,
+	OBJWeld& weld) {
+	OBJMaterialGroup everything;
+	everything.cornerRanges.emplace_back(0, data.corners.size());
+	everything.numCorners = data.corners.size();
+	weld.smoothNormals.clear();
+	return weldIndices(data, everything, indices, weld);
+}
+
+bool objParser::weldIndices(const OBJData& data, const OBJMaterialGroup& group,
+	unsigned int* indices, OBJWeld& weld) {
+	const glm::ivec3 numAttribs(
+		(int)data.vertices.size(),
+		(int)data.texCoords.size(),
+		(int)data.normals.size()
+	);
+
+	// Validate every index before touching the attribute arrays
+	bool missingNormals = false;
+	for (const auto& range : group.cornerRanges) {
+		for (size_t c = range.first; c < range.second; ++c) {
+			const glm::ivec3& corner = data.corners[c];
+			for (int i = 0; i < VEC_3_NUM_COMPONENTS; ++i) {
+				bool optional = (i != POSITION);
+				if (corner[i] >= numAttribs[i] ||
+					corner[i] < (optional ? -1 : 0)) {
+					std::cout << "Face index out of range\n";
+					return false;
+				}
+			}
+			missingNormals |= (corner[NORMAL] == -1);
+		}
+	}
+
+	if (missingNormals && weld.smoothNormals.size() != data.vertices.size()) {
+		weld.smoothNormals.clear();
+		accumulateNormals(data, 0, data.corners.size(), weld.smoothNormals);
+	}
+
+	// Every distinct triplet becomes one vertex
+	size_t expectedVertices = std::min(group.numCorners, std::max({
+		data.vertices.size(), data.texCoords.size(), data.normals.size() }));
+	VertexWeldMap weldMap(expectedVertices);
+	weld.firstCorners.clear();
+	weld.firstCorners.reserve(expectedVertices);
+
+	size_t numWritten = 0;
+	for (const auto& range : group.cornerRanges) {
+		for (size_t i = range.first; i < range.second; ++i) {
+			bool inserted;
+			indices[numWritten++] = weldMap.findOrInsert(data.corners[i],
+				(unsigned int)weld.firstCorners.size(), inserted);
+			if (inserted)
+				weld.firstCorners.push_back((unsigned int)i);
+		}
+	}
+
+	std::cout << "Welded " << group.numCorners << " corners into ";
+	std::cout << weld.firstCorners.size() << " vertices" << std::endl;
+	return true;
+}
+
+void objParser::writeVertices(const OBJData& data, const OBJWeld& weld,
+	Vertex* vertices, glm::vec3& minCorner, glm::vec3& maxCorner) {
+	glm::vec3 min(std::numeric_limits<float>::max());
+	glm::vec3 max(std::numeric_limits<float>::lowest());
+
+	// Build each vertex locally and store it whole. Mapped memory is often
+	// write-combined, so it should be written once, front to back
+	for (size_t i = 0; i < weld.firstCorners.size(); ++i) {
+		Vertex vertex = buildVertex(data, weld, data.corners[weld.firstCorners[i]]);
+		vertices[i] = vertex;
+
+		min = glm::min(min, vertex.position);
+		max = glm::max(max, vertex.position);
+	}
+
+	minCorner = min;
+	maxCorner = max;
+}
+
+void objParser::writeVertices(const OBJData& data, const OBJWeld& weld,
+	size_t first, size_t count, Vertex* vertices) {
+	for (size_t i = 0; i < count; ++i)
+		vertices[i] = buildVertex(data, weld, data.corners[weld.firstCorners[first + i]]);
+}
+
+void objParser::writePositions(const OBJData& data, const OBJWeld& weld,
+	glm::vec3* positions) {
+	for (size_t i = 0; i < weld.firstCorners.size(); ++i)
+		positions[i] = data.vertices[data.corners[weld.firstCorners[i]][POSITION]];
+}
+
+bool objParser::weld(const OBJData& data, std::vector<Vertex>& vertices,
+	std::vector<unsigned int>& indices) {
+	OBJWeld weld;
+	indices.resize(data.corners.size());
+	if (!weldIndices(data, indices.data(), weld))
+		return false;
+
+	glm::vec3 minCorner, maxCorner;
+	vertices.resize(weld.firstCorners.size());
+	writeVertices(data, weld, vertices.data(), minCorner, maxCorner);
+	return true;
+}
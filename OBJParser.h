@@ -0,0 +1,242 @@
+/*  Wavefront OBJ parsing kept separate from any OpenGL state, so the same code
+    can feed OBJObject or run headless
+    - RAB
+ */
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// <summary>
+/// Selects how an OBJ file is read from disk
+/// </summary>
+enum class OBJLoadMode
+{
+	// Original fgetc/fscanf_s reader. Kept as a reference for the others
+	STDIO,
+	// Maps the whole file and tokenizes it in place
+	MAPPED,
+	// Same tokenizer as MAPPED, split over worker threads at line boundaries
+	PARALLEL
+};
+
+// Defined in Mesh.h
+struct Vertex;
+
+/// <summary>
+/// A usemtl statement. The material applies from firstCorner up to the next
+/// statement
+/// </summary>
+struct OBJMaterialUse {
+	size_t firstCorner;
+	std::string name;
+};
+
+/// <summary>
+/// Geometry read out of an OBJ file
+/// </summary>
+struct OBJData {
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> texCoords;
+	std::vector<glm::vec3> normals;
+	// Zero-based position/uv/normal indices of every triangle corner, three
+	// corners per triangle. Missing uv or normal indices are -1
+	std::vector<glm::ivec3> corners;
+	// Files named by mtllib statements, relative to the OBJ file
+	std::vector<std::string> materialLibraries;
+	// usemtl statements in file order
+	std::vector<OBJMaterialUse> materialUses;
+};
+
+/// <summary>
+/// Every corner of an OBJ file that uses the same material
+/// </summary>
+struct OBJMaterialGroup {
+	// Material name. Empty for corners that come before any usemtl
+	std::string name;
+	// Half-open [first, last) ranges of corners, in file order
+	std::vector<std::pair<size_t, size_t>> cornerRanges;
+	size_t numCorners = 0;
+};
+
+/// <summary>
+/// Result of welding the corners of an OBJ file. Records where each welded
+/// vertex comes from so the vertices can be written out in a second pass,
+/// once their number is known
+/// </summary>
+struct OBJWeld {
+	// Index of the corner that introduced each welded vertex
+	std::vector<unsigned int> firstCorners;
+	// Unnormalized smooth normal of every position. Filled once a corner
+	// without a normal is welded, then kept for the other groups of the same
+	// file. Recomputed if it does not cover every position
+	std::vector<glm::vec3> smoothNormals;
+};
+
+namespace objParser {
+	/// <summary>
+	/// Parses an OBJ file with the given reader and prints its throughput
+	/// </summary>
+	/// <param name="path"> file path name of the OBJ file </param>
+	/// <param name="mode"> reader to parse the file with </param>
+	/// <param name="data"> Stores the parsed geometry </param>
+	/// <returns> True if successful, False if otherwise </returns>
+	bool parse(const char* path, OBJLoadMode mode, OBJData& data);
+
+	/// <summary>
+	/// Parses an OBJ file one fgetc/fscanf_s call at a time. Reads geometry
+	/// only, no material statements
+	/// </summary>
+	/// <param name="path"> file path name of the OBJ file </param>
+	/// <param name="data"> Stores the parsed geometry </param>
+	/// <returns> True if successful, False if otherwise </returns>
+	bool parseStdio(const char* path, OBJData& data);
+
+	/// <summary>
+	/// Maps an OBJ file into memory and tokenizes it in place. Produces the
+	/// same output as parseStdio
+	/// </summary>
+	/// <param name="path"> file path name of the OBJ file </param>
+	/// <param name="data"> Stores the parsed geometry </param>
+	/// <returns> True if successful, False if otherwise </returns>
+	bool parseMapped(const char* path, OBJData& data);
+
+	/// <summary>
+	/// Maps an OBJ file into memory and tokenizes it in chunks on several
+	/// threads. Produces the same output as parseMapped
+	/// </summary>
+	/// <param name="path"> file path name of the OBJ file </param>
+	/// <param name="data"> Stores the parsed geometry </param>
+	/// <param name="numThreads"> number of workers. 0 uses every core </param>
+	/// <returns> True if successful, False if otherwise </returns>
+	bool parseParallel(const char* path, OBJData& data,
+		unsigned int numThreads = 0);
+
+	/// <summary>
+	/// Tokenizes an OBJ file that is already in memory
+	/// </summary>
+	/// <param name="begin"> first byte of the file </param>
+	/// <param name="end"> one past the last byte of the file </param>
+	/// <param name="data"> Stores the parsed geometry </param>
+	/// <returns> True if successful, False if otherwise </returns>
+	bool parseBuffer(const char* begin, const char* end, OBJData& data);
+
+	/// <summary>
+	/// Tokenizes an OBJ file that is already in memory on several threads.
+	/// The file is split at newline boundaries, each chunk is parsed on its
+	/// own worker and the results are stitched back together in file order
+	/// </summary>
+	/// <param name="begin"> first byte of the file </param>
+	/// <param name="end"> one past the last byte of the file </param>
+	/// <param name="data"> Stores the parsed geometry. Anything already in it
+	/// is kept and the file is appended </param>
+	/// <param name="numThreads"> number of workers. 0 uses every core </param>
+	/// <returns> True if successful, False if otherwise </returns>
+	bool parseBufferParallel(const char* begin, const char* end, OBJData& data,
+		unsigned int numThreads = 0);
+
+	/// <summary>
+	/// Splits the corners of a file by the material they use
+	/// </summary>
+	/// <param name="data"> Parsed geometry </param>
+	/// <param name="groups"> Stores one group per material with corners, in
+	/// order of first use </param>
+	/// <param name="firstCorner"> first corner to group </param>
+	/// <param name="lastCorner"> one past the last corner to group. Clamped
+	/// to the number of corners </param>
+	void groupByMaterial(const OBJData& data,
+		std::vector<OBJMaterialGroup>& groups, size_t firstCorner = 0,
+		size_t lastCorner = SIZE_MAX);
+
+	/// <summary>
+	/// Adds the area weighted normals of a range of triangles to the sums of
+	/// their positions. Lets a file that is still being read keep its smooth
+	/// normals up to date without going over every face again
+	/// </summary>
+	/// <param name="data"> Parsed geometry </param>
+	/// <param name="firstCorner"> first corner of the first triangle </param>
+	/// <param name="lastCorner"> one past the last corner </param>
+	/// <param name="sums"> Normal sum of every position. Grown to the number
+	/// of positions </param>
+	void accumulateNormals(const OBJData& data, size_t firstCorner,
+		size_t lastCorner, std::vector<glm::vec3>& sums);
+
+	/// <summary>
+	/// First weld pass. Validates every corner and writes the welded vertex
+	/// index of each one, in order, to a caller provided array
+	/// </summary>
+	/// <param name="data"> Parsed geometry </param>
+	/// <param name="indices"> Room for data.corners.size() indices. Only
+	/// written to, so it may point into write-only mapped memory </param>
+	/// <param name="weld"> Stores the vertices the pass found </param>
+	/// <returns> True if successful, False if an index is out of range </returns>
+	bool weldIndices(const OBJData& data, unsigned int* indices, OBJWeld& weld);
+
+	/// <summary>
+	/// First weld pass over the corners of one material group. Welded
+	/// vertices are numbered from 0 within the group
+	/// </summary>
+	/// <param name="data"> Parsed geometry </param>
+	/// <param name="group"> corners to weld </param>
+	/// <param name="indices"> Room for group.numCorners indices. Only written
+	/// to, so it may point into write-only mapped memory </param>
+	/// <param name="weld"> Stores the vertices the pass found. Reuse it for
+	/// every group of a file so smooth normals are only computed once </param>
+	/// <returns> True if successful, False if an index is out of range </returns>
+	bool weldIndices(const OBJData& data, const OBJMaterialGroup& group,
+		unsigned int* indices, OBJWeld& weld);
+
+	/// <summary>
+	/// Second weld pass. Writes the interleaved vertices found by
+	/// weldIndices, in order, to a caller provided array
+	/// </summary>
+	/// <param name="data"> Parsed geometry </param>
+	/// <param name="weld"> Result of weldIndices on the same data </param>
+	/// <param name="vertices"> Room for weld.firstCorners.size() vertices.
+	/// Only written to, so it may point into write-only mapped memory </param>
+	/// <param name="minCorner"> Stores the min corner of the positions </param>
+	/// <param name="maxCorner"> Stores the max corner of the positions </param>
+	void writeVertices(const OBJData& data, const OBJWeld& weld,
+		Vertex* vertices, glm::vec3& minCorner, glm::vec3& maxCorner);
+
+	/// <summary>
+	/// Second weld pass over a range of the vertices found by weldIndices.
+	/// Lets the vertices be written in pieces, such as through a small
+	/// buffer they are packed from
+	/// </summary>
+	/// <param name="data"> Parsed geometry </param>
+	/// <param name="weld"> Result of weldIndices on the same data </param>
+	/// <param name="first"> first vertex to write </param>
+	/// <param name="count"> number of vertices to write </param>
+	/// <param name="vertices"> Room for count vertices. Only written to, so
+	/// it may point into write-only mapped memory </param>
+	void writeVertices(const OBJData& data, const OBJWeld& weld, size_t first,
+		size_t count, Vertex* vertices);
+
+	/// <summary>
+	/// Writes only the positions of the vertices found by weldIndices, for
+	/// work that needs nothing else, in under half the space of the vertices
+	/// </summary>
+	/// <param name="data"> Parsed geometry </param>
+	/// <param name="weld"> Result of weldIndices on the same data </param>
+	/// <param name="positions"> Room for weld.firstCorners.size() positions
+	/// </param>
+	void writePositions(const OBJData& data, const OBJWeld& weld,
+		glm::vec3* positions);
+
+	/// <summary>
+	/// Welds the position/uv/normal triplets of every corner into one
+	/// interleaved vertex per distinct triplet, using an open-addressing hash
+	/// map. Corners without a normal get the smoothed normal of their position
+	/// </summary>
+	/// <param name="data"> Parsed geometry </param>
+	/// <param name="vertices"> Stores the welded vertices </param>
+	/// <param name="indices"> Stores three vertex indices per triangle </param>
+	/// <returns> True if successful, False if an index is out of range </returns>
+	bool weld(const OBJData& data, std::vector<Vertex>& vertices,
+		std::vector<unsigned int>& indices);
+}
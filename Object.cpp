@@ -39,6 +39,45 @@ void Object::reset() {
 	model = glm::mat4(1.0f);
 }
 
+glm::mat4 Object::getWorldMat() const {
+	glm::mat4 world = model;
+	world[3] = model * glm::vec4(-pivot, 1.0f);
+	return world;
+}
+
+size_t Object::cull(const glm::mat4& view, const glm::mat4& projection) {
+	return 0;
+}
+
+void Object::drawVisible(const Shader& program, glm::mat4 view,
+	glm::mat4 projection) {
+	draw(program, view, projection);
+}
+
+size_t Object::cullShadowCasters(const glm::mat4& lightTransform) {
+	return 0;
+}
+
+void Object::drawShadowCasters(const Shader& program, glm::mat4 view,
+	glm::mat4 projection) {
+	draw(program, view, projection);
+}
+
+bool Object::getBounds(glm::vec3& minCorner, glm::vec3& maxCorner) {
+	return false;
+}
+
+size_t Object::getNumMeshes() const {
+	return 0;
+}
+
+bool Object::raycast(const glm::vec3& origin, const glm::vec3& direction,
+	float maxDistance, RayHit& hit) {
+	return false;
+}
+
+void Object::update() {}
+
 void Object::setShaderToRenderType(const Shader& program) const {
 	switch (renderMode) {
 	case renderType::NORMAL:
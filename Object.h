@@ -18,10 +18,33 @@ enum class renderType
 	PHONG
 };
 
+class Object;
+
+/// <summary>
+/// Where a ray first hits an object
+/// </summary>
+struct RayHit {
+	// Distance along the ray, in units of its direction's length
+	float distance;
+	Object* object;
+	// Mesh of the object that was hit, and the copy of it for instanced
+	// objects
+	size_t mesh;
+	size_t instance;
+	// Triangle of the mesh's full detail level, and the weights of its
+	// second and third corners. The first corner weighs 1 - x - y
+	unsigned int triangle;
+	glm::vec2 barycentrics;
+};
+
 class Object {
 protected:
 	// Places object in world space
 	glm::mat4 model = glm::mat4(1.0f);
+
+	// Point of the object's own geometry that model places. Lets an object
+	// be centered without touching its vertices
+	glm::vec3 pivot = glm::vec3(0.0f);
 	
 	// Mode for object to be rendered in 
 	renderType renderMode = renderType::NORMAL;
@@ -55,6 +78,76 @@ public:
 	virtual void draw(const Shader& program, 
 		              glm::mat4 view, glm::mat4 projection) = 0;
 
+	/// <summary>
+	/// Works out which parts of the object the camera can see. Called once
+	/// a frame before drawVisible. Objects that cannot be culled in parts
+	/// do nothing
+	/// </summary>
+	/// <param name="view"> inverse camera transformation matrix </param>
+	/// <param name="projection"> projection transformation matrix </param>
+	/// <returns> Number of meshes skipped as a whole </returns>
+	virtual size_t cull(const glm::mat4& view, const glm::mat4& projection);
+
+	/// <summary>
+	/// Draws the parts of the object the last cull kept. Passes that do not
+	/// look through the camera, such as shadow maps, use draw instead
+	/// </summary>
+	/// <param name="program"> ID of shader program to use </param>
+	/// <param name="view"> inverse camera transformation matrix </param>
+	/// <param name="projection"> projection transformation matrix </param>
+	virtual void drawVisible(const Shader& program,
+		glm::mat4 view, glm::mat4 projection);
+
+	/// <summary>
+	/// Works out which meshes can cast a shadow into a light's depth map,
+	/// which are those inside the volume it renders. Called once a frame
+	/// before drawShadowCasters. Objects that cannot be culled in parts do
+	/// nothing
+	/// </summary>
+	/// <param name="lightTransform"> light's projection * view matrix
+	/// </param>
+	/// <returns> Number of meshes skipped </returns>
+	virtual size_t cullShadowCasters(const glm::mat4& lightTransform);
+
+	/// <summary>
+	/// Draws the meshes the last cullShadowCasters kept, whole
+	/// </summary>
+	/// <param name="program"> ID of shader program to use </param>
+	/// <param name="view"> inverse camera transformation matrix </param>
+	/// <param name="projection"> projection transformation matrix </param>
+	virtual void drawShadowCasters(const Shader& program,
+		glm::mat4 view, glm::mat4 projection);
+
+	/// <summary>
+	/// Gets the bounds of the object in world space, every instanced copy
+	/// included. Scenes keep their hierarchy over these
+	/// </summary>
+	/// <param name="minCorner"> Stores min corner </param>
+	/// <param name="maxCorner"> Stores max corner </param>
+	/// <returns> False if the object has no bounds yet. Scenes then cull
+	/// and draw it every frame </returns>
+	virtual bool getBounds(glm::vec3& minCorner, glm::vec3& maxCorner);
+
+	/// <summary>
+	/// Gets the number of meshes the object is drawn as
+	/// </summary>
+	/// <returns> 0 for objects that are not made of meshes </returns>
+	virtual size_t getNumMeshes() const;
+
+	/// <summary>
+	/// Finds the closest triangle a ray hits. Objects without triangle
+	/// hierarchies are never hit
+	/// </summary>
+	/// <param name="origin"> start of the ray, in world space </param>
+	/// <param name="direction"> direction of the ray. Need not be of unit
+	/// length </param>
+	/// <param name="maxDistance"> furthest distance along the ray, in units
+	/// of direction </param>
+	/// <param name="hit"> Stores the closest hit </param>
+	/// <returns> True if the ray hits the object before maxDistance </returns>
+	virtual bool raycast(const glm::vec3& origin, const glm::vec3& direction,
+		float maxDistance, RayHit& hit);
+
 	/// <summary>
 	/// Translates the object
 	/// </summary>
@@ -93,6 +186,19 @@ public:
 	/// </summary>
 	virtual void reset();
 
+	/// <summary>
+	/// Gets the matrix that takes the object's geometry to world space,
+	/// which is the model matrix applied after moving the pivot to the origin
+	/// </summary>
+	/// <returns> world matrix of the geometry </returns>
+	glm::mat4 getWorldMat() const;
+
+	/// <summary>
+	/// Called once a frame before the object is drawn. Lets objects that are
+	/// still loading pick up the geometry that has arrived
+	/// </summary>
+	virtual void update();
+
 	/// <summary>
 	/// Gets the rendering mode for the given 3D object
 	/// </summary>
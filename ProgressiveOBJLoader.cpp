@@ -0,0 +1,166 @@
+#include "ProgressiveOBJLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include "MappedFile.h"
+#include "MeshletBuilder.h"
+#include "MeshSimplifier.h"
+
+namespace {
+	// The first slice is small so something shows up right away. Later ones
+	// grow so a huge file does not end up as thousands of meshes
+	const size_t FIRST_SLICE_BYTES = 1 << 20;
+	const size_t MAX_SLICE_BYTES = 32 << 20;
+	const int NORMAL = 2;
+	const double BYTES_PER_MB = 1024.0 * 1024.0;
+}
+
+ProgressiveOBJLoader::ProgressiveOBJLoader(const char* path)
+	: path(path), cancelled(false), finished(false), succeeded(false),
+	  numLibrariesSeen(0), numCornersPublished(0) {
+	std::cout << "Reading file progressively from " << path << std::endl;
+	worker = std::thread(&ProgressiveOBJLoader::run, this);
+}
+
+ProgressiveOBJLoader::~ProgressiveOBJLoader() {
+	cancelled = true;
+	if (worker.joinable())
+		worker.join();
+}
+
+void ProgressiveOBJLoader::run() {
+	auto startTime = std::chrono::steady_clock::now();
+	MappedFile file(path.c_str());
+	if (!file.isOpen()) {
+		std::cout << "Failed to read file!\n";
+		finish(false);
+		return;
+	}
+	std::string directory =
+		std::filesystem::path(path).parent_path().generic_string();
+
+	size_t sliceBytes = FIRST_SLICE_BYTES;
+	const char* p = file.begin();
+	while (p < file.end() && !cancelled) {
+		// End every slice on a line boundary
+		const char* sliceEnd = p + std::min(sliceBytes, (size_t)(file.end() - p));
+		if (sliceEnd < file.end()) {
+			const char* newline =
+				(const char*)memchr(sliceEnd, '\n', file.end() - sliceEnd);
+			sliceEnd = newline ? newline + 1 : file.end();
+		}
+
+		// Appends to what earlier slices read. Slices big enough to be worth
+		// it are split over every core
+		if (!objParser::parseBufferParallel(p, sliceEnd, data)) {
+			finish(false);
+			return;
+		}
+		loadNewLibraries(directory);
+		if (!publish()) {
+			finish(false);
+			return;
+		}
+
+		p = sliceEnd;
+		sliceBytes = std::min(2 * sliceBytes, MAX_SLICE_BYTES);
+	}
+
+	if (!cancelled) {
+		std::chrono::duration<double> elapsed =
+			std::chrono::steady_clock::now() - startTime;
+		double fileMB = file.size() / BYTES_PER_MB;
+		std::cout << "Number of vertices: " << data.vertices.size() << std::endl;
+		std::cout << "Number of triangles: " << data.corners.size() / 3;
+		std::cout << std::endl;
+		std::cout << "Parsed " << fileMB << " MB in " << elapsed.count();
+		std::cout << " s (" << fileMB / elapsed.count() << " MB/s)" << std::endl;
+	}
+
+	// The batches hold everything the owner still needs
+	data = OBJData();
+	weld = OBJWeld();
+	finish(!cancelled);
+}
+
+bool ProgressiveOBJLoader::publish() {
+	const size_t numCorners = data.corners.size();
+	if (numCorners == numCornersPublished)
+		return true;
+
+	// Smooth normals are kept up to date with the faces read so far. Earlier
+	// batches keep the normals they were published with
+	bool missingNormals = false;
+	for (size_t i = numCornersPublished; i < numCorners && !missingNormals; ++i)
+		missingNormals = (data.corners[i][NORMAL] == -1);
+	if (missingNormals || !weld.smoothNormals.empty()) {
+		size_t first = weld.smoothNormals.empty() ? 0 : numCornersPublished;
+		objParser::accumulateNormals(data, first, numCorners, weld.smoothNormals);
+	}
+
+	std::vector<OBJMaterialGroup> groups;
+	objParser::groupByMaterial(data, groups, numCornersPublished, numCorners);
+	for (const auto& group : groups) {
+		ProgressiveBatch batch;
+		batch.material = materialCache::findInLibraries(libraries, group.name);
+		batch.indices.resize(group.numCorners);
+		if (!objParser::weldIndices(data, group, batch.indices.data(), weld))
+			return false;
+
+		batch.vertices.resize(weld.firstCorners.size());
+		objParser::writeVertices(data, weld, batch.vertices.data(),
+			batch.aabbMin, batch.aabbMax);
+		// Clustering and simplifying here keeps the work off the thread
+		// that uploads
+		meshletBuilder::build(batch.vertices.data(), batch.vertices.size(),
+			batch.indices.data(), batch.indices.size(), batch.meshlets);
+		meshSimplifier::buildLODChain(batch.vertices.data(), batch.vertices.size(),
+			batch.indices, batch.lods);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		batches.push_back(std::move(batch));
+	}
+	numCornersPublished = numCorners;
+	return true;
+}
+
+void ProgressiveOBJLoader::loadNewLibraries(const std::string& directory) {
+	for (; numLibrariesSeen < data.materialLibraries.size(); ++numLibrariesSeen) {
+		std::string library = (std::filesystem::path(directory) /
+			data.materialLibraries[numLibrariesSeen]).generic_string();
+		if (materialCache::loadLibrary(library))
+			libraries.push_back(library);
+	}
+}
+
+void ProgressiveOBJLoader::finish(bool success) {
+	std::lock_guard<std::mutex> lock(mutex);
+	finished = true;
+	succeeded = success;
+}
+
+size_t ProgressiveOBJLoader::takeBatches(std::vector<ProgressiveBatch>& out,
+	size_t maxBytes) {
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t numTaken = 0;
+	size_t bytes = 0;
+	while (!batches.empty() && (numTaken == 0 || bytes < maxBytes)) {
+		ProgressiveBatch& batch = batches.front();
+		bytes += batch.vertices.size() * sizeof(Vertex) +
+			batch.indices.size() * sizeof(unsigned int);
+		out.push_back(std::move(batch));
+		batches.pop_front();
+		++numTaken;
+	}
+	return numTaken;
+}
+
+bool ProgressiveOBJLoader::isDone(bool& success) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	success = succeeded;
+	return finished && batches.empty();
+}
@@ -0,0 +1,102 @@
+/*  Reads an OBJ file on a worker thread and hands out the geometry in
+    batches while the rest of the file is still being parsed, so a huge model
+    starts showing up after the first slice instead of after the whole file
+    - RAB
+ */
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Mesh.h"
+#include "OBJParser.h"
+
+/// <summary>
+/// Welded geometry of the faces of one material in one slice of the file
+/// </summary>
+struct ProgressiveBatch {
+	std::vector<Vertex> vertices;
+	std::vector<unsigned int> indices;
+	const MaterialRecord* material;
+	glm::vec3 aabbMin, aabbMax;
+	// Index ranges of the levels of detail within indices
+	std::vector<LODLevel> lods;
+	// Clusters of the full detail level
+	std::vector<Meshlet> meshlets;
+};
+
+class ProgressiveOBJLoader
+{
+	std::string path;
+	std::thread worker;
+	// Set by the owner to stop the worker early
+	std::atomic<bool> cancelled;
+
+	// Guards everything below
+	mutable std::mutex mutex;
+	std::deque<ProgressiveBatch> batches;
+	bool finished;
+	bool succeeded;
+
+	// Worker side state. Only touched by the worker thread
+	OBJData data;
+	OBJWeld weld;
+	std::vector<std::string> libraries;
+	size_t numLibrariesSeen;
+	size_t numCornersPublished;
+
+	/// <summary>
+	/// Parses the file slice by slice. Runs on the worker thread
+	/// </summary>
+	void run();
+
+	/// <summary>
+	/// Welds the faces parsed since the last call into batches and queues
+	/// them
+	/// </summary>
+	/// <returns> True if successful, False if an index is out of range </returns>
+	bool publish();
+
+	/// <summary>
+	/// Loads the material libraries named since the last call
+	/// </summary>
+	/// <param name="directory"> directory of the OBJ file </param>
+	void loadNewLibraries(const std::string& directory);
+
+	void finish(bool success);
+
+public:
+	/// <summary>
+	/// Starts reading an OBJ file in the background
+	/// </summary>
+	/// <param name="path"> file path name of the OBJ file </param>
+	/// <returns> N/A </returns>
+	ProgressiveOBJLoader(const char* path);
+
+	// Stops the worker and waits for it
+	~ProgressiveOBJLoader();
+
+	ProgressiveOBJLoader(const ProgressiveOBJLoader&) = delete;
+	ProgressiveOBJLoader& operator=(const ProgressiveOBJLoader&) = delete;
+
+	/// <summary>
+	/// Takes the batches that are ready, oldest first
+	/// </summary>
+	/// <param name="out"> Batches are appended here </param>
+	/// <param name="maxBytes"> Stop once this much vertex and index data was
+	/// taken. At least one batch is taken if any is ready </param>
+	/// <returns> Number of batches taken </returns>
+	size_t takeBatches(std::vector<ProgressiveBatch>& out, size_t maxBytes);
+
+	/// <summary>
+	/// Checks whether the whole file was read and every batch taken
+	/// </summary>
+	/// <param name="success"> Set to whether the file was read without error
+	/// </param>
+	/// <returns> True if nothing more will arrive </returns>
+	bool isDone(bool& success) const;
+};
@@ -2,8 +2,19 @@
 
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <limits>
+
+#include "Frustum.h"
+
+namespace {
+	// Most drawables a leaf of the hierarchy holds
+	const unsigned int OBJECTS_PER_LEAF = 2;
+}
+
 void Scene::load(const char* path) {}
 
+Scene::Scene() {}
+
 Scene::Scene(const char* path) {
 	load(path);
 }
@@ -18,4 +29,130 @@ Scene::~Scene() {
 	lights.clear();
 }
 
+void Scene::update() {
+	for (auto drawable : drawables)
+		drawable->update();
+
+	// The bounds are gathered every frame, as any drawable may have moved.
+	// Refitting keeps the tree, so only a change in which drawables it holds
+	// builds it over
+	bool changed = false;
+	size_t numBounded = 0;
+	unbounded.clear();
+	for (auto drawable : drawables) {
+		glm::vec3 min, max;
+		if (!drawable->getBounds(min, max)) {
+			unbounded.push_back(drawable);
+			continue;
+		}
+		if (numBounded == bounded.size()) {
+			bounded.push_back(drawable);
+			objectMins.push_back(min);
+			objectMaxs.push_back(max);
+			changed = true;
+		}
+		else {
+			if (bounded[numBounded] != drawable) {
+				bounded[numBounded] = drawable;
+				changed = true;
+			}
+			objectMins[numBounded] = min;
+			objectMaxs[numBounded] = max;
+		}
+		++numBounded;
+	}
+	if (numBounded != bounded.size()) {
+		bounded.resize(numBounded);
+		objectMins.resize(numBounded);
+		objectMaxs.resize(numBounded);
+		changed = true;
+	}
+
+	if (changed)
+		objectBVH.build(objectMins.data(), objectMaxs.data(), numBounded,
+			OBJECTS_PER_LEAF);
+	else
+		objectBVH.update(objectMins.data(), objectMaxs.data(), numBounded,
+			OBJECTS_PER_LEAF);
+}
+
+void Scene::draw(const Shader& program, glm::mat4 view, glm::mat4 projection) {
+	for (auto drawable : drawables)
+		drawable->draw(program, view, projection);
+}
+
+size_t Scene::findVisible(const glm::vec4 planes[6],
+	std::vector<Object*>& objects) {
+	objectBVH.queryFrustum(planes, found);
+	inside.assign(bounded.size(), 0);
+	for (unsigned int i : found)
+		inside[i] = 1;
 
+	size_t numSkipped = 0;
+	objects.clear();
+	for (size_t i = 0; i < bounded.size(); ++i) {
+		if (inside[i])
+			objects.push_back(bounded[i]);
+		else
+			numSkipped += bounded[i]->getNumMeshes();
+	}
+	objects.insert(objects.end(), unbounded.begin(), unbounded.end());
+	return numSkipped;
+}
+
+size_t Scene::cull(const glm::mat4& view, const glm::mat4& projection) {
+	glm::vec4 planes[6];
+	frustum::extractPlanes(projection * view, planes);
+	size_t numSkipped = findVisible(planes, visible);
+	for (auto drawable : visible)
+		numSkipped += drawable->cull(view, projection);
+	return numSkipped;
+}
+
+void Scene::drawVisible(const Shader& program, glm::mat4 view,
+	glm::mat4 projection) {
+	for (auto drawable : visible)
+		drawable->drawVisible(program, view, projection);
+}
+
+size_t Scene::cullShadowCasters(const glm::mat4& lightTransform) {
+	glm::vec4 planes[6];
+	frustum::extractPlanes(lightTransform, planes);
+	size_t numSkipped = findVisible(planes, casters);
+	for (auto drawable : casters)
+		numSkipped += drawable->cullShadowCasters(lightTransform);
+	return numSkipped;
+}
+
+void Scene::drawShadowCasters(const Shader& program, glm::mat4 view,
+	glm::mat4 projection) {
+	for (auto drawable : casters)
+		drawable->drawShadowCasters(program, view, projection);
+}
+
+bool Scene::raycast(const glm::vec3& origin, const glm::vec3& direction,
+	RayHit& hit) {
+	auto hitObject = [&](Object* drawable, float& closest) {
+		if (!drawable->raycast(origin, direction, closest, hit))
+			return false;
+		closest = hit.distance;
+		return true;
+	};
+
+	float maxDistance = std::numeric_limits<float>::max();
+	const std::vector<unsigned int>& order = objectBVH.getOrder();
+	bool hitAny = objectBVH.raycast(origin, direction, maxDistance,
+		[&](unsigned int first, unsigned int count, float& closest) {
+		bool any = false;
+		for (unsigned int i = first; i < first + count; ++i) {
+			if (hitObject(bounded[order[i]], closest))
+				any = true;
+		}
+		return any;
+	});
+	for (auto drawable : unbounded) {
+		if (hitObject(drawable, maxDistance))
+			hitAny = true;
+	}
+	return hitAny;
+}
@@ -1,4 +1,4 @@
-/* 
+/*
    In charge of describing, loading, and rendering scenes
    - RAB
  */
@@ -7,6 +7,7 @@
 #include <vector>
 #include <glm/glm.hpp>
 
+#include "BVH.h"
 #include "Object.h"
 #include "Light.h"
 #include "Camera.h"
@@ -14,17 +15,47 @@
 
 class Scene
 {
+	// Drawables that have bounds, the bounds and the hierarchy over them.
+	// Kept up to date by update
+	std::vector<Object*> bounded;
+	std::vector<glm::vec3> objectMins, objectMaxs;
+	BVH objectBVH;
+	// Drawables without bounds yet, such as models still loading. Culled
+	// and drawn every frame
+	std::vector<Object*> unbounded;
+	// Drawables the last cull and cullShadowCasters kept
+	std::vector<Object*> visible, casters;
+	// Scratch space of the frustum queries
+	std::vector<unsigned int> found;
+	std::vector<unsigned char> inside;
+
 	/// <summary>
 	/// Loads a scene file into memory
 	/// </summary>
 	/// <param name="path"> Path of scene file </param>
 	void load(const char* path);
+
+	/// <summary>
+	/// Finds the drawables inside a frustum through the hierarchy
+	/// </summary>
+	/// <param name="planes"> planes from frustum::extractPlanes </param>
+	/// <param name="objects"> Stores the drawables found in the order of
+	/// drawables, followed by every unbounded one </param>
+	/// <returns> Number of meshes of the drawables left out </returns>
+	size_t findVisible(const glm::vec4 planes[6], std::vector<Object*>& objects);
+
 public:
 	// These are public for now until we design and write some .scene files
 	std::vector<Object*> drawables;
 	std::vector<Light*> lights;
 	std::vector<Camera> cameras;
 
+	/// <summary>
+	/// Scene ctor for a scene filled in by hand
+	/// </summary>
+	/// <returns></returns>
+	Scene();
+
 	/// <summary>
 	/// Scene ctor that loads a scene file to memory
 	/// </summary>
@@ -33,6 +64,13 @@ public:
 	Scene(const char* path);
 	~Scene();
 
+	/// <summary>
+	/// Updates every drawable, then refits the hierarchy over their bounds,
+	/// or builds it over once drawables came, went or gained bounds. Call
+	/// once a frame before culling or casting rays
+	/// </summary>
+	void update();
+
 	/// <summary>
 	/// Draws every drawable object
 	/// </summary>
@@ -40,5 +78,52 @@ public:
 	/// <param name="view"></param>
 	/// <param name="projection"></param>
 	void draw(const Shader& program, glm::mat4 view, glm::mat4 projection);
+
+	/// <summary>
+	/// Skips the drawables outside the camera's frustum by the hierarchy and
+	/// lets the rest cull their own meshes
+	/// </summary>
+	/// <param name="view"> view matrix </param>
+	/// <param name="projection"> projection matrix </param>
+	/// <returns> Number of meshes skipped </returns>
+	size_t cull(const glm::mat4& view, const glm::mat4& projection);
+
+	/// <summary>
+	/// Draws what the last cull kept
+	/// </summary>
+	/// <param name="program"> Shader program </param>
+	/// <param name="view"> view matrix </param>
+	/// <param name="projection"> projection matrix </param>
+	void drawVisible(const Shader& program, glm::mat4 view, glm::mat4 projection);
+
+	/// <summary>
+	/// Skips the drawables outside the light's volume by the hierarchy and
+	/// lets the rest pick their own shadow casters
+	/// </summary>
+	/// <param name="lightTransform"> light's projection * view matrix
+	/// </param>
+	/// <returns> Number of meshes skipped </returns>
+	size_t cullShadowCasters(const glm::mat4& lightTransform);
+
+	/// <summary>
+	/// Draws the shadow casters the last cullShadowCasters kept
+	/// </summary>
+	/// <param name="program"> Shader program </param>
+	/// <param name="view"> view matrix </param>
+	/// <param name="projection"> projection matrix </param>
+	void drawShadowCasters(const Shader& program, glm::mat4 view,
+		glm::mat4 projection);
+
+	/// <summary>
+	/// Finds the closest triangle of any drawable a ray hits. Only the
+	/// drawables whose bounds the ray passes are tested
+	/// </summary>
+	/// <param name="origin"> start of the ray, in world space </param>
+	/// <param name="direction"> direction of the ray. Need not be of unit
+	/// length </param>
+	/// <param name="hit"> Stores the closest hit </param>
+	/// <returns> True if the ray hits anything </returns>
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction,
+		RayHit& hit);
 };
 
@@ -5,6 +5,8 @@
 #include <sstream>
 #include <iostream>
 
+#include "MaterialCache.h"
+
 Shader::Shader() {
 	// TODO
 	ID = 0;
@@ -96,6 +98,13 @@ Shader::Shader(const char* vertPath, const char* fragPath) {
 	}
 	glValidateProgram(ID);
 
+	// Programs that shade with a material read it from the shared block
+	unsigned int materialBlock = glGetUniformBlockIndex(ID,
+		materialCache::MATERIAL_BLOCK_NAME);
+	if (materialBlock != GL_INVALID_INDEX)
+		glUniformBlockBinding(ID, materialBlock,
+			materialCache::MATERIAL_BLOCK_BINDING);
+
 
 	std::cout << "Shader ID: " << ID << std::endl;
 
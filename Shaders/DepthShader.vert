@@ -10,6 +10,34 @@ uniform mat4 model;
 //uniform mat4 projection;
 uniform mat4 lightTransform;
 
+// Layout of the vertex attributes
+#define VERTEX_FORMAT_FLOAT 0
+#define VERTEX_FORMAT_PACKED 1
+uniform int vertexFormat;
+// Box packed positions are fractions of
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+// Copies drawn by one instanced call. Each copy's transform goes in front
+// of model, one column a texel
+uniform int instanced;
+uniform samplerBuffer instanceTransforms;
+
+vec3 decodePosition() {
+   if (vertexFormat == VERTEX_FORMAT_PACKED)
+       return positionOffset + positionScale * vertPos;
+   return vertPos;
+}
+
+mat4 instanceTransform() {
+   int column = 4 * gl_InstanceID;
+   return mat4(texelFetch(instanceTransforms, column),
+               texelFetch(instanceTransforms, column + 1),
+               texelFetch(instanceTransforms, column + 2),
+               texelFetch(instanceTransforms, column + 3));
+}
+
 void main() {
-   gl_Position = lightTransform * model * vec4(vertPos, 1.0f);
+   mat4 world = instanced != 0 ? instanceTransform() * model : model;
+   gl_Position = lightTransform * world * vec4(decodePosition(), 1.0f);
 }
@@ -15,17 +15,21 @@ struct SPointLight {
     float cutoff;
 };
 
-struct Material {
+// Shared with every mesh using the same material. See MaterialCache
+layout (std140) uniform MaterialBlock {
     vec3 ambient, diffuse, specular;
     float shininess;
-};
-uniform Material material;
+} material;
 
 uniform mat4 view; // view matrix
 
 uniform int colorMode;    // Color mode (really this is rendering mode)
 uniform sampler2D depthMap; // Depth map
 uniform sampler2D texImg; // 2D texture sampler
+uniform sampler2D diffuseMap;  // Material diffuse texture
+uniform sampler2D specularMap; // Material specular texture
+uniform bool hasDiffuseMap;    // Whether diffuseMap holds a texture
+uniform bool hasSpecularMap;   // Whether specularMap holds a texture
 
 uniform int numDirLights;    // number of directional lights
 uniform DirLight dLight;     // test directional light
@@ -124,12 +128,20 @@ void main() {
         //workingCol = (1.0f - shadow) * texture(texImg, tcoord).xyz;
         break;
     case COLOR_MODE_PHONG:
+        // Maps scale the material's colors, as in MTL files
+        vec3 diffuseCol = material.diffuse;
+        if (hasDiffuseMap)
+            diffuseCol *= texture(diffuseMap, tcoord).rgb;
+        vec3 specularCol = material.specular;
+        if (hasSpecularMap)
+            specularCol *= texture(specularMap, tcoord).rgb;
+
         // Directional lights
         for (int i = 0; i < numDirLights; ++i) {
             vec3 lightDir = -normalize(vec3(view * vec4(dLight.direction, 0)));
-            workingCol += lambert(normalView, material.diffuse, lightDir, 
+            workingCol += lambert(normalView, diffuseCol, lightDir, 
                                   dLight.color);
-            workingCol += specular(normalView, material.specular, 
+            workingCol += specular(normalView, specularCol, 
                                    material.shininess, lightDir,
                                    dLight.color);
         }
@@ -137,9 +149,9 @@ void main() {
         for (int i = 0; i < numSPointLights; ++i) {
             vec3 lightPosView = vec3(view * vec4(sPLight.position, 1.0f));
             vec3 lightDir = normalize(lightPosView - fragPos);
-            workingCol += lambert(normalView, material.diffuse, lightDir,
+            workingCol += lambert(normalView, diffuseCol, lightDir,
                                   sPLight.color);
-            workingCol += specular(normalView, material.specular,
+            workingCol += specular(normalView, specularCol,
                                    material.shininess, lightDir,
                                    sPLight.color);
         }
@@ -15,6 +15,19 @@ uniform mat4 projection;
 uniform mat4 invTransModelview;
 uniform mat4 lightTransform;
 
+// Layout of the vertex attributes
+#define VERTEX_FORMAT_FLOAT 0
+#define VERTEX_FORMAT_PACKED 1
+uniform int vertexFormat;
+// Box packed positions are fractions of
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+// Copies drawn by one instanced call. Each copy's transform goes in front
+// of model, one column a texel
+uniform int instanced;
+uniform samplerBuffer instanceTransforms;
+
 // Render mode
 uniform int colorMode;
 
@@ -32,20 +45,55 @@ out vec3 fragPos;
 // Position of fragment in light space NDCs
 out vec4 fragPosLightSpace;
 
+vec3 decodePosition() {
+   if (vertexFormat == VERTEX_FORMAT_PACKED)
+       return positionOffset + positionScale * vertPos;
+   return vertPos;
+}
+
+// Unfolds an octahedral normal. Float normals are used as they are
+vec3 decodeNormal() {
+   if (vertexFormat != VERTEX_FORMAT_PACKED)
+       return normal;
+   vec3 n = vec3(normal.xy, 1.0f - abs(normal.x) - abs(normal.y));
+   float fold = max(-n.z, 0.0f);
+   n.x += n.x >= 0.0f ? -fold : fold;
+   n.y += n.y >= 0.0f ? -fold : fold;
+   return normalize(n);
+}
+
+mat4 instanceTransform() {
+   int column = 4 * gl_InstanceID;
+   return mat4(texelFetch(instanceTransforms, column),
+               texelFetch(instanceTransforms, column + 1),
+               texelFetch(instanceTransforms, column + 2),
+               texelFetch(instanceTransforms, column + 3));
+}
+
 void main() {
-   gl_Position = projection * view * model * vec4(vertPos, 1.0f);
+   vec3 position = decodePosition();
+   vec3 vertNormal = decodeNormal();
+   mat4 world = model;
+   // invTransModelview is set per draw, so copies work out their own
+   mat3 normalMatrix = mat3(invTransModelview);
+   if (instanced != 0) {
+       world = instanceTransform() * model;
+       normalMatrix = transpose(inverse(mat3(view * world)));
+   }
+   gl_Position = projection * view * world * vec4(position, 1.0f);
 
    if (colorMode == COLOR_MODE_NORMAL)
-       color = vec4(0.5f * normal + 0.5f, 1.0f);
+       color = vec4(0.5f * vertNormal + 0.5f, 1.0f);
    else if (colorMode == COLOR_MODE_TEXTURE_WRAP) {
        tcoord = texCoord;
        tcoord *= numTiles;
        normalView = normalize(vec3(invTransModelview * vec4(0, 1.0f, 0, 0)));
    }
    else if (colorMode == COLOR_MODE_PHONG) {
-       normalView = normalize(vec3(invTransModelview * vec4(normal, 0)));
+       tcoord = texCoord;
+       normalView = normalize(normalMatrix * vertNormal);
    }
-   fragPos = vec3(view * model * vec4(vertPos, 1.0f));
-   fragPosLightSpace = lightTransform * model * vec4(vertPos, 1.0f);
+   fragPos = vec3(view * world * vec4(position, 1.0f));
+   fragPosLightSpace = lightTransform * world * vec4(position, 1.0f);
 }
 
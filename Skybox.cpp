@@ -3,7 +3,7 @@
 #include <filesystem>
 #include <glad/glad.h>
 
-#include "stb_image.h"
+#include "CompressedTexture.h"
 #include "PrintDebug.h"
 
 const glm::vec3 Skybox::vertices[8] = {
@@ -38,17 +38,18 @@ const glm::ivec3 Skybox::indices[12] = {
 	glm::ivec3(0, 1, 3)
 };
 
-Skybox::Skybox() {
+Skybox::Skybox() : loadToken(std::make_shared<LoadToken>()) {
 	load("Skybox/Default");
 	init();
 }
 
-Skybox::Skybox(const char* path) {
+Skybox::Skybox(const char* path) : loadToken(std::make_shared<LoadToken>()) {
 	load(path);
 	init();
 }
 
 Skybox::~Skybox() {
+	loadToken->cancelled = true;
 	glDeleteBuffers(1, &VBO);
 	glDeleteBuffers(1, &EBO);
 	glDeleteVertexArrays(1, &VAO);
@@ -137,28 +138,23 @@ bool Skybox::load(const char* path) {
 		}
 	}
 
-	// Create textures
+	// Create textures. The faces are loaded on the worker pool and show up
+	// once the render thread uploads them. Their mip chains are built on the
+	// CPU and cached, block compressed where the driver takes it, in one file
+	// for the directory
 	glGenTextures(1, &texId);
 	glBindTexture(GL_TEXTURE_CUBE_MAP, texId);
-
-	int width, height, nrChannels;
-	unsigned char* data;
-	for (unsigned int i = 0; i < NUM_FACES; ++i) {
-		// TODO
-		data = stbi_load(fileNames[i].c_str(), &width, &height, &nrChannels, 0);
-		if (data) {
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-				0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		}
-		else
-			std::cout << "Failed to load data!\n";
-
-		// Free image memory
-		stbi_image_free(data);
-	}
+	GLuint cubemap = texId;
+	std::vector<std::string> sources(fileNames, fileNames + NUM_FACES);
+	compressedTexture::loadAsync(sources,
+		dirName + compressedTexture::CACHE_EXTENSION, loadToken,
+		[cubemap](const CompressedImage& image) {
+		compressedTexture::upload(image, cubemap);
+	});
 
 	// Texture sampler settings
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+		GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -6,6 +6,9 @@
 
 #include <glad/glad.h>
 
+#include <memory>
+
+#include "AsyncLoader.h"
 #include "Object.h"
 #include "Shader.h"
 
@@ -18,9 +21,12 @@ class Skybox : public Object
 
 	// Buffer/VAO objects
 	GLuint VAO, VBO, EBO, texId;
+	// Cancelled on deletion so face uploads still queued are dropped
+	std::shared_ptr<LoadToken> loadToken;
 
 	/// <summary>
-	/// Loads texture from a given directory path.
+	/// Loads texture from a given directory path. The faces are decoded
+	/// in the background and uploaded by asyncLoader::drainUploads.
 	/// Below is the expected structure for each skybox
 	///   * Each texture file will have the last 3 letters of its name
 	///     represent which face the texture represents (_lf = left)
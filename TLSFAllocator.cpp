@@ -0,0 +1,260 @@
+#include "TLSFAllocator.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+	// Index of the highest set bit. x must not be 0
+	inline int highestBit(uint64_t x) {
+#if defined(_MSC_VER) && defined(_WIN64)
+		unsigned long index;
+		_BitScanReverse64(&index, x);
+		return (int)index;
+#elif defined(_MSC_VER)
+		unsigned long index;
+		if (_BitScanReverse(&index, (unsigned long)(x >> 32)))
+			return (int)index + 32;
+		_BitScanReverse(&index, (unsigned long)x);
+		return (int)index;
+#else
+		return 63 - __builtin_clzll(x);
+#endif
+	}
+
+	// Index of the lowest set bit. x must not be 0
+	inline int lowestBit(uint64_t x) {
+#if defined(_MSC_VER) && defined(_WIN64)
+		unsigned long index;
+		_BitScanForward64(&index, x);
+		return (int)index;
+#elif defined(_MSC_VER)
+		unsigned long index;
+		if (_BitScanForward(&index, (unsigned long)x))
+			return (int)index;
+		_BitScanForward(&index, (unsigned long)(x >> 32));
+		return (int)index + 32;
+#else
+		return __builtin_ctzll(x);
+#endif
+	}
+
+	// Size class of a size. Sizes below 2^slBits get one class each, larger
+	// ones are split into 2^slBits classes per power of two
+	inline void sizeClass(size_t size, int slBits, int& fl, int& sl) {
+		if (size < ((size_t)1 << slBits)) {
+			fl = 0;
+			sl = (int)size;
+		}
+		else {
+			int top = highestBit(size);
+			fl = top - slBits + 1;
+			sl = (int)(size >> (top - slBits)) - (1 << slBits);
+		}
+	}
+}
+
+TLSFAllocator::TLSFAllocator(size_t capacity) {
+	reset(capacity);
+}
+
+void TLSFAllocator::reset(size_t newCapacity) {
+	blocks.clear();
+	unusedBlocks.clear();
+	for (int fl = 0; fl < FL_COUNT; ++fl) {
+		for (int sl = 0; sl < SL_COUNT; ++sl)
+			freeLists[fl][sl] = INVALID_BLOCK;
+		slBitmaps[fl] = 0;
+	}
+	flBitmap = 0;
+	capacity = 0;
+	freeSize = 0;
+	lastBlock = INVALID_BLOCK;
+	if (newCapacity > 0)
+		grow(newCapacity);
+}
+
+uint32_t TLSFAllocator::newBlock(size_t offset, size_t size) {
+	uint32_t block;
+	if (!unusedBlocks.empty()) {
+		block = unusedBlocks.back();
+		unusedBlocks.pop_back();
+	}
+	else {
+		block = (uint32_t)blocks.size();
+		blocks.push_back(Block());
+	}
+	Block& b = blocks[block];
+	b.offset = offset;
+	b.size = size;
+	b.prevPhysical = b.nextPhysical = INVALID_BLOCK;
+	b.prevFree = b.nextFree = INVALID_BLOCK;
+	b.free = false;
+	return block;
+}
+
+void TLSFAllocator::insertFree(uint32_t block) {
+	Block& b = blocks[block];
+	int fl, sl;
+	sizeClass(b.size, SL_BITS, fl, sl);
+	b.free = true;
+	b.prevFree = INVALID_BLOCK;
+	b.nextFree = freeLists[fl][sl];
+	if (b.nextFree != INVALID_BLOCK)
+		blocks[b.nextFree].prevFree = block;
+	freeLists[fl][sl] = block;
+	flBitmap |= (uint64_t)1 << fl;
+	slBitmaps[fl] |= 1u << sl;
+	freeSize += b.size;
+}
+
+void TLSFAllocator::removeFree(uint32_t block) {
+	Block& b = blocks[block];
+	int fl, sl;
+	sizeClass(b.size, SL_BITS, fl, sl);
+	if (b.prevFree != INVALID_BLOCK)
+		blocks[b.prevFree].nextFree = b.nextFree;
+	else
+		freeLists[fl][sl] = b.nextFree;
+	if (b.nextFree != INVALID_BLOCK)
+		blocks[b.nextFree].prevFree = b.prevFree;
+	if (freeLists[fl][sl] == INVALID_BLOCK) {
+		slBitmaps[fl] &= ~(1u << sl);
+		if (slBitmaps[fl] == 0)
+			flBitmap &= ~((uint64_t)1 << fl);
+	}
+	b.free = false;
+	b.prevFree = b.nextFree = INVALID_BLOCK;
+	freeSize -= b.size;
+}
+
+uint32_t TLSFAllocator::findFree(size_t size) {
+	// Round up to the next size class, so any block found there fits
+	size_t rounded = size;
+	if (size >= ((size_t)1 << SL_BITS)) {
+		size_t step = ((size_t)1 << (highestBit(size) - SL_BITS)) - 1;
+		if (size <= SIZE_MAX - step)
+			rounded = size + step;
+	}
+	int fl, sl;
+	sizeClass(rounded, SL_BITS, fl, sl);
+
+	uint32_t block = INVALID_BLOCK;
+	if (fl < FL_COUNT) {
+		uint32_t slMap = slBitmaps[fl] & (~0u << sl);
+		if (slMap != 0) {
+			block = freeLists[fl][lowestBit(slMap)];
+		}
+		else {
+			uint64_t flMap = (fl + 1 < FL_COUNT) ? flBitmap & (~(uint64_t)0 << (fl + 1)) : 0;
+			if (flMap != 0) {
+				int nextFl = lowestBit(flMap);
+				block = freeLists[nextFl][lowestBit(slBitmaps[nextFl])];
+			}
+		}
+	}
+
+	// Blocks in the class of size itself may still fit. Matters once the
+	// buffer is nearly full
+	if (block == INVALID_BLOCK) {
+		sizeClass(size, SL_BITS, fl, sl);
+		for (uint32_t b = freeLists[fl][sl]; b != INVALID_BLOCK; b = blocks[b].nextFree) {
+			if (blocks[b].size >= size) {
+				block = b;
+				break;
+			}
+		}
+	}
+
+	if (block != INVALID_BLOCK)
+		removeFree(block);
+	return block;
+}
+
+bool TLSFAllocator::allocate(size_t size, Allocation& allocation) {
+	if (size == 0 || size > freeSize)
+		return false;
+	uint32_t block = findFree(size);
+	if (block == INVALID_BLOCK)
+		return false;
+
+	// Give the rest back
+	if (blocks[block].size > size) {
+		uint32_t rest = newBlock(blocks[block].offset + size, blocks[block].size - size);
+		Block& b = blocks[block];
+		b.size = size;
+		blocks[rest].prevPhysical = block;
+		blocks[rest].nextPhysical = b.nextPhysical;
+		if (b.nextPhysical != INVALID_BLOCK)
+			blocks[b.nextPhysical].prevPhysical = rest;
+		else
+			lastBlock = rest;
+		b.nextPhysical = rest;
+		insertFree(rest);
+	}
+
+	allocation.offset = blocks[block].offset;
+	allocation.size = size;
+	allocation.block = block;
+	return true;
+}
+
+void TLSFAllocator::free(const Allocation& allocation) {
+	uint32_t block = allocation.block;
+	if (block == INVALID_BLOCK || block >= blocks.size() || blocks[block].free)
+		return;
+
+	// Merge with the free neighbours
+	uint32_t prev = blocks[block].prevPhysical;
+	if (prev != INVALID_BLOCK && blocks[prev].free) {
+		removeFree(prev);
+		blocks[prev].size += blocks[block].size;
+		blocks[prev].nextPhysical = blocks[block].nextPhysical;
+		if (blocks[block].nextPhysical != INVALID_BLOCK)
+			blocks[blocks[block].nextPhysical].prevPhysical = prev;
+		else
+			lastBlock = prev;
+		unusedBlocks.push_back(block);
+		block = prev;
+	}
+	uint32_t next = blocks[block].nextPhysical;
+	if (next != INVALID_BLOCK && blocks[next].free) {
+		removeFree(next);
+		blocks[block].size += blocks[next].size;
+		blocks[block].nextPhysical = blocks[next].nextPhysical;
+		if (blocks[next].nextPhysical != INVALID_BLOCK)
+			blocks[blocks[next].nextPhysical].prevPhysical = block;
+		else
+			lastBlock = block;
+		unusedBlocks.push_back(next);
+	}
+	insertFree(block);
+}
+
+void TLSFAllocator::grow(size_t newCapacity) {
+	if (newCapacity <= capacity)
+		return;
+	size_t added = newCapacity - capacity;
+	if (lastBlock != INVALID_BLOCK && blocks[lastBlock].free) {
+		removeFree(lastBlock);
+		blocks[lastBlock].size += added;
+		insertFree(lastBlock);
+	}
+	else {
+		uint32_t block = newBlock(capacity, added);
+		blocks[block].prevPhysical = lastBlock;
+		if (lastBlock != INVALID_BLOCK)
+			blocks[lastBlock].nextPhysical = block;
+		lastBlock = block;
+		insertFree(block);
+	}
+	capacity = newCapacity;
+}
+
+size_t TLSFAllocator::getCapacity() const {
+	return capacity;
+}
+
+size_t TLSFAllocator::getFreeSize() const {
+	return freeSize;
+}
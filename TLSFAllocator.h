@@ -0,0 +1,106 @@
+/*  Two-level segregated fit allocator for ranges of a buffer that lives
+    somewhere else, such as a GL buffer. Hands out offsets, never touches the
+    memory, and allocates and frees in constant time
+    - RAB
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class TLSFAllocator {
+public:
+	/// <summary>
+	/// A range handed out by allocate. Pass it back to free
+	/// </summary>
+	struct Allocation {
+		size_t offset;
+		size_t size;
+		// Block that holds the range. INVALID_BLOCK if nothing is allocated
+		uint32_t block;
+	};
+
+	static const uint32_t INVALID_BLOCK = UINT32_MAX;
+
+private:
+	// Each power of two size class is split into 2^SL_BITS linear classes
+	static const int SL_BITS = 4;
+	static const int SL_COUNT = 1 << SL_BITS;
+	static const int FL_COUNT = 64 - SL_BITS + 1;
+
+	struct Block {
+		size_t offset;
+		size_t size;
+		// Neighbours in the buffer
+		uint32_t prevPhysical, nextPhysical;
+		// Neighbours in the free list of the block's size class
+		uint32_t prevFree, nextFree;
+		bool free;
+	};
+
+	std::vector<Block> blocks;
+	// Entries of blocks that are not in use, so blocks never reallocates in
+	// steady state
+	std::vector<uint32_t> unusedBlocks;
+	// Heads of the free lists, and bitmaps of which lists are non-empty
+	uint32_t freeLists[FL_COUNT][SL_COUNT];
+	uint64_t flBitmap;
+	uint32_t slBitmaps[FL_COUNT];
+	// Block at the end of the buffer
+	uint32_t lastBlock;
+	size_t capacity;
+	size_t freeSize;
+
+	uint32_t newBlock(size_t offset, size_t size);
+	void insertFree(uint32_t block);
+	void removeFree(uint32_t block);
+	// Finds a free block of at least size, removed from its free list
+	uint32_t findFree(size_t size);
+
+public:
+	/// <summary>
+	/// Creates an allocator for a buffer of the given size
+	/// </summary>
+	/// <param name="capacity"> size of the buffer, in whatever unit the
+	/// caller allocates in </param>
+	/// <returns> N/A </returns>
+	TLSFAllocator(size_t capacity = 0);
+
+	/// <summary>
+	/// Allocates a range
+	/// </summary>
+	/// <param name="size"> size of the range. Must not be 0 </param>
+	/// <param name="allocation"> Set to the range if successful </param>
+	/// <returns> True if successful, False if no free range is big enough
+	/// </returns>
+	bool allocate(size_t size, Allocation& allocation);
+
+	/// <summary>
+	/// Frees a range and merges it with free neighbours
+	/// </summary>
+	/// <param name="allocation"> range from allocate </param>
+	void free(const Allocation& allocation);
+
+	/// <summary>
+	/// Makes the buffer bigger. The new space is free and joins a free range
+	/// at the end
+	/// </summary>
+	/// <param name="newCapacity"> new size of the buffer. Must not be smaller
+	/// than the current one </param>
+	void grow(size_t newCapacity);
+
+	/// <summary>
+	/// Frees everything and sets a new buffer size
+	/// </summary>
+	/// <param name="newCapacity"> new size of the buffer </param>
+	void reset(size_t newCapacity);
+
+	size_t getCapacity() const;
+
+	/// <summary>
+	/// Gets the total size of every free range. A request this big can still
+	/// fail if the free space is fragmented
+	/// </summary>
+	size_t getFreeSize() const;
+};
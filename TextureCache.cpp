@@ -0,0 +1,146 @@
+#include "TextureCache.h"
+
+#include <glad/glad.h>
+
+#include <filesystem>
+#include <iostream>
+#include <map>
+
+#include "Mesh.h"
+
+namespace {
+	/// <summary>
+	/// State behind the textureCache functions. Only the render thread
+	/// touches it, so it needs no lock
+	/// </summary>
+	struct Cache {
+		// std::map never moves its elements, so records can be handed out
+		std::map<std::string, TextureRecord> records;
+	};
+
+	Cache& cache() {
+		static Cache instance;
+		return instance;
+	}
+
+	/// <summary>
+	/// Gets the key of a path, so different spellings of the same path find
+	/// the same record
+	/// </summary>
+	std::string textureKey(const std::string& path) {
+		return std::filesystem::path(path).lexically_normal().generic_string();
+	}
+
+	/// <summary>
+	/// Gets the GL format of pixels with a number of channels
+	/// </summary>
+	GLenum pixelFormat(int numChannels) {
+		switch (numChannels) {
+		case 1:
+			return GL_RED;
+		case 2:
+			return GL_RG;
+		case 4:
+			return GL_RGBA;
+		default:
+			return GL_RGB;
+		}
+	}
+
+	/// <summary>
+	/// Fills a record's texture with decoded pixels
+	/// </summary>
+	void upload(TextureRecord& record, const DecodedImage& image) {
+		GLenum format = pixelFormat(image.numChannels);
+		glBindTexture(GL_TEXTURE_2D, record.id);
+		// Rows of 1 and 3 channel images are not padded to 4 bytes
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0,
+			format, GL_UNSIGNED_BYTE, image.pixels.get());
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		// Grayscale maps read the same from every channel
+		if (image.numChannels == 1) {
+			GLint swizzle[] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+			glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+		}
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		record.ready = true;
+		std::cout << "Loaded texture " << record.path << " (" << image.width;
+		std::cout << "x" << image.height << ")\n";
+	}
+}
+
+const TextureRecord* textureCache::acquire(const std::string& path) {
+	Cache& state = cache();
+	std::string key = textureKey(path);
+	auto result = state.records.try_emplace(key);
+	TextureRecord& record = result.first->second;
+	if (!result.second) {
+		++record.refCount;
+		return &record;
+	}
+
+	record.path = key;
+	record.refCount = 1;
+	record.ready = false;
+	record.token = std::make_shared<LoadToken>();
+	glGenTextures(1, &record.id);
+	glBindTexture(GL_TEXTURE_2D, record.id);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// The record outlives the upload unless it is released first, which
+	// cancels the token
+	TextureRecord* target = &record;
+	asyncLoader::decodeImage(key, record.token, [target](const DecodedImage& image) {
+		upload(*target, image);
+	});
+	return &record;
+}
+
+void textureCache::release(const TextureRecord* record) {
+	if (record == nullptr)
+		return;
+	Cache& state = cache();
+	auto it = state.records.find(record->path);
+	if (it == state.records.end() || &it->second != record)
+		return;
+	TextureRecord& entry = it->second;
+	if (--entry.refCount > 0)
+		return;
+	entry.token->cancelled = true;
+	glDeleteTextures(1, &entry.id);
+	state.records.erase(it);
+}
+
+std::vector<Texture> textureCache::materialTextures(const MTLMaterial& material) {
+	std::vector<Texture> textures;
+	const std::pair<const std::string*, const char*> maps[] = {
+		{ &material.diffuseMap, DIFFUSE_TYPE },
+		{ &material.specularMap, SPECULAR_TYPE }
+	};
+	for (const auto& map : maps) {
+		if (map.first->empty())
+			continue;
+		Texture texture;
+		texture.id = 0;
+		texture.type = map.second;
+		texture.path = *map.first;
+		texture.record = nullptr;
+		textures.push_back(texture);
+	}
+	return textures;
+}
+
+void textureCache::clear() {
+	Cache& state = cache();
+	for (auto& entry : state.records) {
+		entry.second.token->cancelled = true;
+		glDeleteTextures(1, &entry.second.id);
+	}
+	state.records.clear();
+}
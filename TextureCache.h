@@ -0,0 +1,74 @@
+/*  Process-wide store of the textures materials use, keyed by file path.
+    Every file is decoded and uploaded once, however many meshes use it, and
+    its texture is deleted when the last of them lets go. Decoding runs on
+    the worker pool, only the upload runs on the render thread
+    - RAB
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AsyncLoader.h"
+#include "MTLParser.h"
+
+/// <summary>
+/// A texture file shared by every mesh that uses it
+/// </summary>
+struct TextureRecord {
+	// Normalized file path. The key of the record
+	std::string path;
+	// GL texture. Exists from the start, but only holds the image once ready
+	unsigned int id;
+	// Number of acquires not yet released
+	unsigned int refCount;
+	// Whether the image has been uploaded. Until then the texture is not
+	// sampled
+	bool ready;
+	// Cancels the decode when the record goes away first
+	std::shared_ptr<LoadToken> token;
+};
+
+struct Texture;
+
+namespace textureCache {
+	// Names of the texture types meshes keep their maps under
+	const char* const DIFFUSE_TYPE = "texture_diffuse";
+	const char* const SPECULAR_TYPE = "texture_specular";
+	// Texture units the maps are bound to. 0 and 1 hold the shadow map and
+	// the ground's texture
+	const unsigned int DIFFUSE_MAP_UNIT = 2;
+	const unsigned int SPECULAR_MAP_UNIT = 3;
+
+	/// <summary>
+	/// Gets the record of a texture file, adding one and starting to decode
+	/// the file if there is none yet. Render thread only
+	/// </summary>
+	/// <param name="path"> file path name of the image </param>
+	/// <returns> The shared record. Stays valid until it is released as
+	/// often as it was acquired </returns>
+	const TextureRecord* acquire(const std::string& path);
+
+	/// <summary>
+	/// Gives up one use of a record. The last one deletes the texture and
+	/// the record. Render thread only
+	/// </summary>
+	/// <param name="record"> record returned by acquire </param>
+	void release(const TextureRecord* record);
+
+	/// <summary>
+	/// Lists the maps of a material that meshes draw with, as textures not
+	/// yet acquired
+	/// </summary>
+	/// <param name="material"> material properties </param>
+	/// <returns> Diffuse and specular map, where the material has them
+	/// </returns>
+	std::vector<Texture> materialTextures(const MTLMaterial& material);
+
+	/// <summary>
+	/// Deletes every texture and record. Records handed out before are
+	/// invalid afterwards, so only call this once nothing draws any more
+	/// </summary>
+	void clear();
+}
@@ -0,0 +1,104 @@
+#include "TriangleBVH.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "AsyncLoader.h"
+
+namespace {
+	// Most triangles a leaf holds. SAH mostly picks fewer
+	const unsigned int TRIANGLES_PER_LEAF = 4;
+	// Triangles one task of the worker pool bounds
+	const size_t TRIANGLES_PER_TASK = 1 << 16;
+
+	/// <summary>
+	/// Intersects a ray with a triangle from either side (Moller-Trumbore)
+	/// </summary>
+	/// <returns> False if it misses or only hits past maxDistance </returns>
+	inline bool intersectTriangle(const glm::vec3& origin,
+		const glm::vec3& direction, const glm::vec3& a, const glm::vec3& b,
+		const glm::vec3& c, float maxDistance, float& distance,
+		glm::vec2& barycentrics) {
+		glm::vec3 edge1 = b - a;
+		glm::vec3 edge2 = c - a;
+		glm::vec3 p = glm::cross(direction, edge2);
+		float determinant = glm::dot(edge1, p);
+		if (determinant == 0.0f)
+			return false;
+		float inverse = 1.0f / determinant;
+		glm::vec3 toOrigin = origin - a;
+		float u = glm::dot(toOrigin, p) * inverse;
+		if (u < 0.0f || u > 1.0f)
+			return false;
+		glm::vec3 q = glm::cross(toOrigin, edge1);
+		float v = glm::dot(direction, q) * inverse;
+		if (v < 0.0f || u + v > 1.0f)
+			return false;
+		float t = glm::dot(edge2, q) * inverse;
+		if (t < 0.0f || t >= maxDistance)
+			return false;
+		distance = t;
+		barycentrics = glm::vec2(u, v);
+		return true;
+	}
+}
+
+TriangleBVH::TriangleBVH() : ready(false) {
+}
+
+void TriangleBVH::build(std::vector<glm::vec3> positions,
+	std::vector<unsigned int> indices) {
+	this->positions = std::move(positions);
+	size_t numTriangles = indices.size() / 3;
+	std::vector<glm::vec3> mins(numTriangles), maxs(numTriangles);
+	asyncLoader::parallelFor((numTriangles + TRIANGLES_PER_TASK - 1) /
+		TRIANGLES_PER_TASK, [&](size_t task) {
+		size_t last = std::min((task + 1) * TRIANGLES_PER_TASK, numTriangles);
+		for (size_t i = task * TRIANGLES_PER_TASK; i < last; ++i) {
+			const glm::vec3& a = this->positions[indices[3 * i]];
+			const glm::vec3& b = this->positions[indices[3 * i + 1]];
+			const glm::vec3& c = this->positions[indices[3 * i + 2]];
+			mins[i] = glm::min(a, glm::min(b, c));
+			maxs[i] = glm::max(a, glm::max(b, c));
+		}
+	});
+	bvh.build(mins.data(), maxs.data(), numTriangles, TRIANGLES_PER_LEAF);
+
+	const std::vector<unsigned int>& order = bvh.getOrder();
+	this->indices.resize(3 * numTriangles);
+	for (size_t i = 0; i < numTriangles; ++i) {
+		for (int corner = 0; corner < 3; ++corner)
+			this->indices[3 * i + corner] = indices[3 * (size_t)order[i] + corner];
+	}
+	ready = true;
+}
+
+bool TriangleBVH::isReady() const {
+	return ready;
+}
+
+bool TriangleBVH::raycast(const glm::vec3& origin, const glm::vec3& direction,
+	float maxDistance, TriangleHit& hit) const {
+	if (!ready)
+		return false;
+	const std::vector<unsigned int>& order = bvh.getOrder();
+	return bvh.raycast(origin, direction, maxDistance,
+		[&](unsigned int first, unsigned int count, float& closest) {
+		bool found = false;
+		for (unsigned int i = first; i < first + count; ++i) {
+			const unsigned int* corners = &indices[3 * (size_t)i];
+			float distance;
+			glm::vec2 barycentrics;
+			if (!intersectTriangle(origin, direction, positions[corners[0]],
+				positions[corners[1]], positions[corners[2]], closest, distance,
+				barycentrics))
+				continue;
+			closest = distance;
+			hit.distance = distance;
+			hit.triangle = order[i];
+			hit.barycentrics = barycentrics;
+			found = true;
+		}
+		return found;
+	});
+}
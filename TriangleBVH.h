@@ -0,0 +1,70 @@
+/*  Hierarchy over the triangles of a mesh for casting rays at it on the CPU,
+    so picking needs no readback from the GPU. Meshes build theirs on the
+    worker pool once they are uploaded, from a copy of only the positions
+    and indices
+    - RAB
+ */
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "BVH.h"
+
+/// <summary>
+/// Where a ray first hits a mesh
+/// </summary>
+struct TriangleHit {
+	// Distance along the ray, in units of its direction's length
+	float distance;
+	// Triangle of the mesh's indices, counted in triangles
+	unsigned int triangle;
+	// Weights of the triangle's second and third corners. The first corner
+	// weighs 1 - x - y
+	glm::vec2 barycentrics;
+};
+
+class TriangleBVH {
+	BVH bvh;
+	std::vector<glm::vec3> positions;
+	// Corners of every triangle, in the BVH's leaf order, so the triangles
+	// of a leaf are next to each other
+	std::vector<unsigned int> indices;
+	// Set once build is done. Rays miss until then
+	std::atomic<bool> ready;
+
+public:
+	/// <summary>
+	/// Creates a hierarchy that is not built yet
+	/// </summary>
+	/// <returns> N/A </returns>
+	TriangleBVH();
+
+	/// <summary>
+	/// Builds the hierarchy. Takes over the positions and indices, which are
+	/// all it keeps of the mesh. Meant to run on the worker pool
+	/// </summary>
+	/// <param name="positions"> vertex positions </param>
+	/// <param name="indices"> three indices a triangle </param>
+	void build(std::vector<glm::vec3> positions,
+		std::vector<unsigned int> indices);
+
+	/// <summary>
+	/// Checks whether the hierarchy is built. Any thread
+	/// </summary>
+	bool isReady() const;
+
+	/// <summary>
+	/// Finds the closest triangle a ray hits, from either side
+	/// </summary>
+	/// <param name="origin"> start of the ray, in the mesh's own space </param>
+	/// <param name="direction"> direction of the ray. Need not be of unit
+	/// length </param>
+	/// <param name="maxDistance"> furthest distance along the ray, in units
+	/// of direction </param>
+	/// <param name="hit"> Stores the closest hit </param>
+	/// <returns> True if the ray hits a triangle before maxDistance. False
+	/// too if the hierarchy is not built yet </returns>
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction,
+		float maxDistance, TriangleHit& hit) const;
+};
@@ -0,0 +1,107 @@
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+	// Largest value of the normalized integer formats
+	const float UNORM16_MAX = 65535.0f;
+	const float SNORM16_MAX = 32767.0f;
+
+	unsigned short toUnorm16(float value) {
+		return (unsigned short)std::lround(std::min(std::max(value, 0.0f), 1.0f) *
+			UNORM16_MAX);
+	}
+
+	short toSnorm16(float value) {
+		return (short)std::lround(std::min(std::max(value, -1.0f), 1.0f) *
+			SNORM16_MAX);
+	}
+}
+
+unsigned short vertexPacking::toHalf(float value) {
+	unsigned int bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	unsigned int sign = (bits >> 16) & 0x8000;
+	unsigned int floatExponent = (bits >> 23) & 0xff;
+	unsigned int mantissa = bits & 0x7fffff;
+	int exponent = (int)floatExponent - 127 + 15;
+
+	// Infinity stays infinity and NaN stays NaN
+	if (floatExponent == 0xff)
+		return (unsigned short)(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+	if (exponent >= 31)
+		return (unsigned short)(sign | 0x7c00);
+
+	// Too small for a normal half. The implicit bit is shifted into the
+	// mantissa of a denormal
+	if (exponent <= 0) {
+		if (exponent < -10)
+			return (unsigned short)sign;
+		mantissa |= 0x800000;
+		unsigned int shift = (unsigned int)(14 - exponent);
+		unsigned int half = mantissa >> shift;
+		unsigned int rest = mantissa & ((1u << shift) - 1);
+		unsigned int halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			++half;
+		return (unsigned short)(sign | half);
+	}
+
+	// A carry out of the mantissa rounds up into the exponent, as it should
+	unsigned int half = ((unsigned int)exponent << 10) | (mantissa >> 13);
+	unsigned int rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+		++half;
+	return (unsigned short)(sign | half);
+}
+
+void vertexPacking::encodeNormal(const glm::vec3& normal, short encoded[2]) {
+	float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	if (length <= 0.0f) {
+		encoded[0] = encoded[1] = 0;
+		return;
+	}
+	float x = normal.x / length;
+	float y = normal.y / length;
+	// The lower half folds out over the corners of the square
+	if (normal.z < 0.0f) {
+		float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+	encoded[0] = toSnorm16(x);
+	encoded[1] = toSnorm16(y);
+}
+
+void vertexPacking::pack(const Vertex* vertices, size_t numVertices,
+	const glm::vec3& boxMin, const glm::vec3& boxMax, PackedVertex* packed) {
+	glm::vec3 extent = boxMax - boxMin;
+	glm::vec3 invExtent;
+	for (int axis = 0; axis < 3; ++axis)
+		invExtent[axis] = extent[axis] > 0.0f ? 1.0f / extent[axis] : 0.0f;
+
+	// Each vertex is built locally and stored whole, as packed is often
+	// write-combined mapped memory
+	PackedVertex out;
+	for (size_t i = 0; i < numVertices; ++i) {
+		const Vertex& vertex = vertices[i];
+		glm::vec3 fraction = (vertex.position - boxMin) * invExtent;
+		out.position[0] = toUnorm16(fraction.x);
+		out.position[1] = toUnorm16(fraction.y);
+		out.position[2] = toUnorm16(fraction.z);
+		out.position[3] = 0;
+		encodeNormal(vertex.normal, out.normal);
+		out.texCoords[0] = toHalf(vertex.texCoords.x);
+		out.texCoords[1] = toHalf(vertex.texCoords.y);
+		packed[i] = out;
+	}
+}
+
+void vertexPacking::narrowIndices(const unsigned int* indices, size_t numIndices,
+	unsigned short* narrowed) {
+	for (size_t i = 0; i < numIndices; ++i)
+		narrowed[i] = (unsigned short)indices[i];
+}
@@ -0,0 +1,49 @@
+/*  Packs vertices into the 16 byte PackedVertex layout: positions quantized
+    to 16 bits within the mesh's bounds, octahedral normals and half float
+    texture coordinates. The shaders decode it again
+    - RAB
+ */
+#pragma once
+
+#include "Mesh.h"
+
+namespace vertexPacking {
+	/// <summary>
+	/// Converts a float to a half float, rounding to nearest even
+	/// </summary>
+	/// <param name="value"> float to convert </param>
+	/// <returns> Bits of the half float </returns>
+	unsigned short toHalf(float value);
+
+	/// <summary>
+	/// Maps a unit vector onto the octahedron and unfolds it into a square,
+	/// stored as two signed normalized shorts
+	/// </summary>
+	/// <param name="normal"> direction to encode. Need not be unit length
+	/// </param>
+	/// <param name="encoded"> Stores the two components </param>
+	void encodeNormal(const glm::vec3& normal, short encoded[2]);
+
+	/// <summary>
+	/// Packs vertices. Positions are stored as fractions of the box, which
+	/// the shader scales back with positionScale and positionOffset
+	/// </summary>
+	/// <param name="vertices"> vertices to pack </param>
+	/// <param name="numVertices"> number of vertices </param>
+	/// <param name="boxMin"> min corner of the box the positions lie in </param>
+	/// <param name="boxMax"> max corner of the box the positions lie in </param>
+	/// <param name="packed"> Stores numVertices packed vertices. Only written
+	/// to, so it may point into write-only mapped memory </param>
+	void pack(const Vertex* vertices, size_t numVertices, const glm::vec3& boxMin,
+		const glm::vec3& boxMax, PackedVertex* packed);
+
+	/// <summary>
+	/// Copies indices into 16 bits. Every index must be below 65536
+	/// </summary>
+	/// <param name="indices"> indices to copy </param>
+	/// <param name="numIndices"> number of indices </param>
+	/// <param name="narrowed"> Stores numIndices short indices. Only written
+	/// to, so it may point into write-only mapped memory </param>
+	void narrowIndices(const unsigned int* indices, size_t numIndices,
+		unsigned short* narrowed);
+}
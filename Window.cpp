@@ -1,24 +1,36 @@
 #include "Window.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
 
 #include "PrintDebug.h"
 
+#include "AsyncLoader.h"
 #include "Object.h"
 #include "Model.h"
+#include "Scene.h"
 #include "Camera.h"
 #include "Skybox.h"
 #include "Shader.h"
 #include "OBJObject.h"
 #include "Ground.h"
+#include "MaterialCache.h"
+#include "TextureCache.h"
 #include "DirLight.h"
 #include "SPointLight.h"
 
 namespace {
 	// TODO: CLEAN UP BY ADDING SIMPLE FILE LOADING SYSTEM
 	std::string objPath = "Models/source/robot.obj";
+	// Drawables culled and drawn through the scene's hierarchy. The ground
+	// is drawn on its own, as it has no bounds to cull by
+	Scene* scene;
+	// Object the trackball, arrow keys, scale keys and scroll wheel move.
+	// Picked by clicking on it
+	Object* selected;
 	// test objects
-	Object* testObj;
 	Object* testQuad;
 	Skybox* skybox;
 	Ground* ground;
@@ -38,6 +50,30 @@ namespace {
 	glm::mat4 projection;
 	glm::mat4 lightSpaceTransfMat;
 
+	// Time the render thread spends on queued uploads per frame at most
+	const double UPLOAD_SECONDS_PER_FRAME = 0.004;
+
+	// Copies of the object to view, drawn instanced on a grid
+	int numInstances = 1;
+	// Distance between neighbouring copies
+	const float INSTANCE_SPACING = 3.0f;
+
+	/// <summary>
+	/// Lays copies out on a square grid on the xz plane, centered on the
+	/// origin
+	/// </summary>
+	std::vector<glm::mat4> instanceGrid(int count) {
+		int side = (int)std::ceil(std::sqrt((float)count));
+		float start = -0.5f * (side - 1) * INSTANCE_SPACING;
+		std::vector<glm::mat4> transforms(count);
+		for (int i = 0; i < count; ++i) {
+			glm::vec3 offset(start + (i % side) * INSTANCE_SPACING, 0.0f,
+				start + (i / side) * INSTANCE_SPACING);
+			transforms[i] = glm::translate(glm::mat4(1.0f), offset);
+		}
+		return transforms;
+	}
+
 	// Trackball mode variables
 	bool lmbPressed = false;
 	double oldPos[2];
@@ -53,6 +89,10 @@ namespace {
 
 	// Frames per second tracking
 	double deltaTime = 0.0f;
+	// Meshes the last frame skipped in the camera pass and in the shadow
+	// pass
+	size_t numCulledMeshes = 0;
+	size_t numCulledCasters = 0;
 
 	// Framebuffer
 }
@@ -91,6 +131,31 @@ inline glm::vec3 projectCursorOntoSphere(double xpos, double ypos) {
 	return glm::vec3(xpos, ypos, sqrt(1 - d));
 }
 
+/// <summary>
+/// Casts a ray from the cursor into the scene and selects the closest object
+/// it hits. Done on the CPU through the scene's hierarchies, so nothing is
+/// read back from the GPU. Missing keeps the selection
+/// </summary>
+/// <param name="xpos"> x position of cursor </param>
+/// <param name="ypos"> y position of cursor </param>
+inline void pickObject(double xpos, double ypos) {
+	glm::vec3 origin, direction;
+	mainCam.getRay(xpos, ypos, wWidth, wHeight, origin, direction);
+	auto start = std::chrono::steady_clock::now();
+	RayHit hit;
+	bool found = scene->raycast(origin, direction, hit);
+	std::chrono::duration<double, std::micro> micros =
+		std::chrono::steady_clock::now() - start;
+	if (!found)
+		return;
+
+	selected = hit.object;
+	std::cout << "Picked mesh " << hit.mesh << " (copy " << hit.instance <<
+		"), triangle " << hit.triangle << " at barycentrics " <<
+		hit.barycentrics.x << ", " << hit.barycentrics.y << " in " <<
+		micros.count() << " us\n";
+}
+
 Window::Window() {
 	wWidth = 800;
 	wHeight = 600;
@@ -163,12 +228,23 @@ void Window::setObjToView(const std::string& path) {
 	objPath = path;
 }
 
+void Window::setNumInstances(int count) {
+	numInstances = std::max(count, 1);
+}
+
 void Window::initializeScene() {
 	// Initialize objects
-	testObj = new Model(objPath.c_str());
+	// Everything below only queues its files on the worker pool, so they are
+	// read at the same time and show up as render drains the uploads
+	Model* viewed = new Model(objPath.c_str(), true);
+	if (numInstances > 1)
+		viewed->setInstances(instanceGrid(numInstances));
+	selected = viewed;
+	scene = new Scene();
+	scene->drawables.push_back(viewed);
 	skybox = new Skybox();
 	ground = new Ground();
-	testQuad = new Model("Models/quad.obj");
+	testQuad = new Model("Models/quad.obj", true);
 
     testDLight = new DirLight();
 	testPLight = new SPointLight();
@@ -180,6 +256,12 @@ void Window::initializeScene() {
 		                     "Shaders/DepthShader.frag");
 	screenShader = new Shader("Shaders/ScreenQuad.vert",
 		                      "Shaders/ScreenQuad.frag");
+	// The ground draws with these too, and must not leave the instance
+	// transforms on the shadow map's unit
+	testShader->use();
+	testShader->setInt("instanceTransforms", Model::INSTANCE_TRANSFORM_UNIT);
+	depthShader->use();
+	depthShader->setInt("instanceTransforms", Model::INSTANCE_TRANSFORM_UNIT);
 	
 	// Basic light space tester
 	glm::mat4 lightProjMat = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, 
@@ -192,13 +274,20 @@ void Window::initializeScene() {
 
 void Window::cleanUpScene() {
 	std::cout << "Deleting scene objects\n";
-	// Clean up models
-	delete testObj;
+	// Clean up models. The scene deletes its drawables
+	delete scene;
 	delete skybox;
 	delete ground;
 	delete testQuad;
 	delete testDLight;
 	delete testPLight;
+	// Wait for the loads still running. They may be adding materials
+	asyncLoader::shutdown();
+	// Every mesh that pointed at a material or texture is gone
+	materialCache::clear();
+	textureCache::clear();
+	// Nor does anything draw from the geometry pools
+	Mesh::destroyPools();
 
 	// Clean up shaders
 	testShader->deleteShader();
@@ -231,19 +320,19 @@ void Window::key_callback(GLFWwindow* window, int key, int scancode,
 			glfwSetWindowShouldClose(window, true);
 			return;
 		case GLFW_KEY_R:
-			testObj->reset();
+			selected->reset();
 			break;
 		case GLFW_KEY_UP:
-			testObj->translate(0, 1.0f, 0);
+			selected->translate(0, 1.0f, 0);
 			break;
 		case GLFW_KEY_DOWN:
-			testObj->translate(0, -1.0f, 0);
+			selected->translate(0, -1.0f, 0);
 			break;
 		case GLFW_KEY_LEFT:
-			testObj->translate(-1.0f, 0, 0);
+			selected->translate(-1.0f, 0, 0);
 			break;
 		case GLFW_KEY_RIGHT:
-			testObj->translate(1.0f, 0, 0);
+			selected->translate(1.0f, 0, 0);
 			break;
 		case GLFW_KEY_C:
 			CURR_CAM_MODE = ++CURR_CAM_MODE % NUM_CAM_MODES;
@@ -257,6 +346,8 @@ void Window::key_callback(GLFWwindow* window, int key, int scancode,
 		case GLFW_KEY_P:
 			// just some debug info
 			std::cout << "FPS: " << 1.0f / deltaTime << std::endl;
+			std::cout << "Meshes culled: " << numCulledMeshes <<
+				" (shadow pass " << numCulledCasters << ")" << std::endl;
 			errorHandler::printGlError();
 			std::cout << std::endl;
 			break;
@@ -277,7 +368,7 @@ void Window::key_callback(GLFWwindow* window, int key, int scancode,
 			switch (key) {
 			case GLFW_KEY_S:
 				if (CURR_CAM_MODE != FPS_MODE)
-				    testObj->scale(glm::vec3(0.9f));
+				    selected->scale(glm::vec3(0.9f));
 				break;
 			default:
 				break;
@@ -288,7 +379,7 @@ void Window::key_callback(GLFWwindow* window, int key, int scancode,
 			switch (key) {
 			case GLFW_KEY_S:
 				if (CURR_CAM_MODE != FPS_MODE)
-				    testObj->scale(glm::vec3(1.1f));
+				    selected->scale(glm::vec3(1.1f));
 				break;
 			default:
 				break;
@@ -313,7 +404,7 @@ void Window::cursor_position_callback(GLFWwindow* window, double xpos,
 				(glm::length(oldPosVec) * glm::length(newPosVec));
 			float angle = acosf(dot) / 15.0f;
 
-			testObj->rotate(angle, axis);
+			selected->rotate(angle, axis);
 		}
 	}
 
@@ -339,6 +430,8 @@ void Window::mouse_button_callback(GLFWwindow* window, int button, int action,
 				lmbPressed = true;
 				glfwGetCursorPos(window, oldPos, &oldPos[1]);
 				oldPosVec = projectCursorOntoSphere(oldPos[0], oldPos[1]);
+				// Clicking an object makes it the one the trackball rotates
+				pickObject(oldPos[0], oldPos[1]);
 
 			}
 			else if (action == GLFW_RELEASE) {
@@ -352,7 +445,7 @@ void Window::mouse_button_callback(GLFWwindow* window, int button, int action,
 
 void Window::scroll_callback(GLFWwindow* window, double xoffset,
 	double yoffset) {
-	testObj->translate(glm::vec3(0, 0, -yoffset));
+	selected->translate(glm::vec3(0, 0, -yoffset));
 }
 
 void Window::processKeyInput() const {
@@ -394,6 +487,11 @@ void Window::initGLFWcallbacks() {
 void Window::render() {
 	double currTime = glfwGetTime();
 
+	// Pick up whatever has finished loading
+	asyncLoader::drainUploads(UPLOAD_SECONDS_PER_FRAME);
+	scene->update();
+	testQuad->update();
+
 	// Clear color and depth buffer
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -402,7 +500,8 @@ void Window::render() {
 	depthShader->use();
 	depthShader->setMat4("lightTransform", lightSpaceTransfMat);
 	glCullFace(GL_FRONT);
-	testObj->draw(*depthShader, view, projection);
+	numCulledCasters = scene->cullShadowCasters(lightSpaceTransfMat);
+	scene->drawShadowCasters(*depthShader, view, projection);
 	glCullFace(GL_BACK);
 	ground->draw(*depthShader, view, projection);
 	testDLight->endRenderToDepthMap(wWidth, wHeight);
@@ -428,7 +527,10 @@ void Window::render() {
 	glBindTexture(GL_TEXTURE_2D, 0);
 	*/
 
-	testObj->draw(*testShader, view, projection);
+	// The shadow pass above skipped what the light cannot see, this one
+	// skips what the camera cannot see
+	numCulledMeshes = scene->cull(view, projection);
+	scene->drawVisible(*testShader, view, projection);
 	ground->draw(*testShader, view, projection);
 
 	// Skybox gets used last
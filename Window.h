@@ -52,6 +52,13 @@ public:
 	/// <param name="path"></param>
 	static void setObjToView(const std::string& path);
 
+	/// <summary>
+	/// Sets how many copies of the object to view are drawn, instanced on a
+	/// grid. Call before initializeScene
+	/// </summary>
+	/// <param name="count"> number of copies </param>
+	static void setNumInstances(int count);
+
 	/// <summary>
 	/// Initializes scene (Rendering objects, shader programs, etc)
 	/// </summary>
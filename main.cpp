@@ -10,7 +10,7 @@
 
 inline std::string printUsageStatement() {
 	std::string usage = "===========\nUSAGE\n===========\n";
-	usage += "\t [-h] [-w width height] obj\n";
+	usage += "\t [-h] [-p] [-b] [-w width height] [-i count] obj\n";
 	return usage;
 
 }
@@ -33,6 +33,8 @@ void initOpenGLSettings() {
 	glEnable(GL_DEPTH_TEST);
 	// Enable face culling
 	glEnable(GL_CULL_FACE);
+	// Filter across cubemap faces, so the skybox's smaller mips show no seams
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 	glViewport(0, 0, 800, 600);
 	glClearColor(0, 0, 0, 0);
 }
@@ -46,10 +48,11 @@ int main(int argc, char* argv[]) {
 	std::string objToLoad = TEST_OBJ;
 	int width = STND_WIDTH;
 	int height = STND_HEIGHT;
+	int numInstances = 1;
 
 	if (argc > MAX_NUM_USAGE) {
 		std::cout << "Error: Number of given arguments not supported!\n";
-		std::cout << printUsageStatement << std::endl;
+		std::cout << printUsageStatement() << std::endl;
 		exit(EXIT_FAILURE);
 	}
 
@@ -61,7 +64,28 @@ int main(int argc, char* argv[]) {
 			case 'h':
 				settings |= PRINT_HELP_BIT;
 				break;
+			case 'p':
+				settings |= PACKED_VERTICES_BIT;
+				break;
+			case 'b':
+				settings |= BC7_TEXTURES_BIT;
+				break;
+			case 'i':
+				if (i + 1 >= argc) {
+					std::cout << "Error: -i needs a count!\n";
+					std::cout << printUsageStatement() << std::endl;
+					exit(EXIT_FAILURE);
+				}
+				numInstances = atoi(argv[i + 1]);
+				// move to next option
+				++i;
+				break;
 			case 'w':
+				if (i + 2 >= argc) {
+					std::cout << "Error: -w needs a width and a height!\n";
+					std::cout << printUsageStatement() << std::endl;
+					exit(EXIT_FAILURE);
+				}
 				width = atoi(argv[i + 1]);
 				height = atoi(argv[i + 2]);
 				// move to next option
@@ -79,6 +103,12 @@ int main(int argc, char* argv[]) {
 	// Deal with settings
 	if (settings & PRINT_HELP_BIT)
 		std::cout << printUsageStatement();
+	// Meshes are uploaded quantized, at half the size
+	if (settings & PACKED_VERTICES_BIT)
+		Mesh::setVertexFormat(VertexFormat::PACKED);
+	// Ground and skybox are compressed to BC7 instead of BC1/BC3
+	if (settings & BC7_TEXTURES_BIT)
+		compressedTexture::setBC7Enabled(true);
 
 	std::cout << "Object to view: " << objToLoad << std::endl;
 
@@ -94,6 +124,7 @@ int main(int argc, char* argv[]) {
 
 	// Initialize object in scene
 	Window::setObjToView(objToLoad);
+	Window::setNumInstances(numInstances);
 	Window::initializeScene();
 
 	// Main render loop
@@ -2,6 +2,8 @@
 #include <iostream>
 
 #include "Window.h"
+#include "CompressedTexture.h"
+#include "Mesh.h"
 #include "PrintDebug.h"
 
 static constexpr unsigned int STND_WIDTH = 800;
@@ -12,9 +14,11 @@ static long settings = 0x0;
 static constexpr long PRINT_HELP_BIT = 0x1;
 static constexpr long OBJ_LOADED_BIT = 0x2;
 static constexpr long DEBUG_MODE_BIT = 0x4;
+static constexpr long PACKED_VERTICES_BIT = 0x8;
+static constexpr long BC7_TEXTURES_BIT = 0x10;
 
 // Other constants
-static constexpr int MAX_NUM_USAGE = 6;
+static constexpr int MAX_NUM_USAGE = 10;
 static const std::string TEST_OBJ = "./Models/bear.obj";
 //"Models/happy-buddha.fbx";
 //"Models/source/robot.obj";